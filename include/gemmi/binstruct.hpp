@@ -0,0 +1,132 @@
+// Copyright Global Phasing Ltd.
+//
+// Binary cache format for Structure, with columnar, read-only access
+// to atoms in a memory-mapped file.
+//
+// The file (extension .gbs) consists of a 256-byte header and sections.
+// All numbers are stored in the byte order of the machine that wrote
+// the file; a file with a different byte order is rejected when read.
+//   Header:
+//     char[8]   magic "GEMMIBS\0"
+//     uint32    format version (binary_structure_version)
+//     uint32    byte-order mark 0x01020304
+//     uint64[4] number of models, chains, residues and atoms
+//     uint64[BinSec::Count+1] section offsets (the last one is file size)
+//     zero padding up to 256 bytes
+//   Sections (each starts at an 8-byte aligned offset), in this order:
+//     ModelNum        int32[n_models]      Model::num
+//     ModelChains     uint32[n_models+1]   index of the first chain
+//     ChainResidues   uint32[n_chains+1]   index of the first residue
+//     ChainNameIdx    uint32[n_chains+1]   offsets of names in ChainNames
+//     ChainNames      char[]               null-terminated names
+//     ResidueAtoms    uint32[n_residues+1] index of the first atom
+//     ResidueSeqNum   int32[n_residues]    SeqId::num (INT_MIN if not set)
+//     ResidueIcode    char[n_residues]     SeqId::icode
+//     ResidueNameIdx  uint32[n_residues+1] offsets of names in ResidueNames
+//     ResidueNames    char[]
+//     AtomPos         float64[3*n_atoms]   x, y, z
+//     AtomOcc         float32[n_atoms]
+//     AtomBiso        float32[n_atoms]
+//     AtomElement     uint8[n_atoms]       El
+//     AtomAltloc      char[n_atoms]
+//     AtomNameIdx     uint32[n_atoms+1]    offsets of names in AtomNames
+//     AtomNames       char[]
+//     StructureData   complete Structure serialized with serialize.hpp
+// Chains, residues and atoms are stored in the same order as in Structure,
+// so e.g. atoms of residue i are [ResidueAtoms[i], ResidueAtoms[i+1]).
+
+#ifndef GEMMI_BINSTRUCT_HPP_
+#define GEMMI_BINSTRUCT_HPP_
+
+#include <cstdint>
+#include <algorithm>  // for min
+#include <string>
+#include "input.hpp"   // for CharArray
+#include "model.hpp"   // for Structure
+
+namespace gemmi {
+
+/// Version of the binary format, changed when the format changes
+/// (including changes of serialize_layout_version in serialize.hpp).
+constexpr std::uint32_t binary_structure_version = 1;
+
+enum class BinSec : int {
+  ModelNum, ModelChains, ChainResidues, ChainNameIdx, ChainNames,
+  ResidueAtoms, ResidueSeqNum, ResidueIcode, ResidueNameIdx, ResidueNames,
+  AtomPos, AtomOcc, AtomBiso, AtomElement, AtomAltloc, AtomNameIdx, AtomNames,
+  StructureData, Count
+};
+
+GEMMI_DLL void write_binary_structure(const Structure& st, const std::string& path);
+
+/// Memory-mapped binary structure file. Only the header is checked
+/// when the file is opened, atoms are accessed directly from the file.
+class GEMMI_DLL BinaryStructure {
+public:
+  explicit BinaryStructure(const std::string& path);
+  BinaryStructure(BinaryStructure&& o) noexcept;
+  BinaryStructure(const BinaryStructure&) = delete;
+  BinaryStructure& operator=(const BinaryStructure&) = delete;
+  ~BinaryStructure();
+
+  size_t model_count() const { return (size_t) counts_[0]; }
+  size_t chain_count() const { return (size_t) counts_[1]; }
+  size_t residue_count() const { return (size_t) counts_[2]; }
+  size_t atom_count() const { return (size_t) counts_[3]; }
+
+  const std::int32_t* model_nums() const { return sec<std::int32_t>(BinSec::ModelNum); }
+  const std::uint32_t* model_chains() const { return sec<std::uint32_t>(BinSec::ModelChains); }
+  const std::uint32_t* chain_residues() const {
+    return sec<std::uint32_t>(BinSec::ChainResidues);
+  }
+  const std::uint32_t* residue_atoms() const {
+    return sec<std::uint32_t>(BinSec::ResidueAtoms);
+  }
+  const std::int32_t* residue_seqnums() const {
+    return sec<std::int32_t>(BinSec::ResidueSeqNum);
+  }
+  const char* residue_icodes() const { return sec<char>(BinSec::ResidueIcode); }
+  const Position* positions() const { return sec<Position>(BinSec::AtomPos); }
+  const float* occupancies() const { return sec<float>(BinSec::AtomOcc); }
+  const float* b_isos() const { return sec<float>(BinSec::AtomBiso); }
+  const Element* elements() const { return sec<Element>(BinSec::AtomElement); }
+  const char* altlocs() const { return sec<char>(BinSec::AtomAltloc); }
+
+  const char* chain_name(size_t n) const {
+    return name(BinSec::ChainNameIdx, BinSec::ChainNames, n);
+  }
+  const char* residue_name(size_t n) const {
+    return name(BinSec::ResidueNameIdx, BinSec::ResidueNames, n);
+  }
+  const char* atom_name(size_t n) const {
+    return name(BinSec::AtomNameIdx, BinSec::AtomNames, n);
+  }
+
+  /// Deserializes complete Structure.
+  Structure structure() const;
+
+private:
+  const char* data_ = nullptr;
+  size_t size_ = 0;
+  bool mapped_ = false;
+  CharArray buffer_;  // used if the file is not memory-mapped
+  const std::uint64_t* counts_ = nullptr;
+  const std::uint64_t* offsets_ = nullptr;
+
+  template<typename T> const T* sec(BinSec s) const {
+    return reinterpret_cast<const T*>(data_ + offsets_[(int)s]);
+  }
+  const char* name(BinSec idx, BinSec names, size_t n) const {
+    const char* start = sec<char>(names);
+    size_t size = offsets_[(int)names + 1] - offsets_[(int)names];
+    return start + std::min((size_t) sec<std::uint32_t>(idx)[n], size - 1);
+  }
+  void check_header() const;
+};
+
+inline Structure read_binary_structure(const std::string& path) {
+  return BinaryStructure(path).structure();
+}
+
+} // namespace gemmi
+#endif
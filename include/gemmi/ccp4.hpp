@@ -224,18 +224,21 @@ struct Ccp4Base {
     hstats.dmax = header_float(21);
     hstats.dmean = header_float(22);
     hstats.rms = header_float(55);
-    if (grid) {
-      grid->unit_cell.set(header_rfloat(11), header_rfloat(12), header_rfloat(13),
-                          header_rfloat(14), header_rfloat(15), header_rfloat(16));
-      grid->nu = header_i32(1);
-      grid->nv = header_i32(2);
-      grid->nw = header_i32(3);
-      grid->spacegroup = find_spacegroup_by_number(header_i32(23));
-      auto pos = axis_positions();
-      grid->axis_order = AxisOrder::Unknown;
-      if (pos[0] == 0 && pos[1] == 1 && pos[2] == 2 && full_cell_(*grid))
-        grid->axis_order = AxisOrder::XYZ;
-    }
+    if (grid)
+      header_to_grid_meta_(*grid);
+  }
+
+  void header_to_grid_meta_(GridMeta& grid) const {
+    grid.unit_cell.set(header_rfloat(11), header_rfloat(12), header_rfloat(13),
+                       header_rfloat(14), header_rfloat(15), header_rfloat(16));
+    grid.nu = header_i32(1);
+    grid.nv = header_i32(2);
+    grid.nw = header_i32(3);
+    grid.spacegroup = find_spacegroup_by_number(header_i32(23));
+    auto pos = axis_positions();
+    grid.axis_order = AxisOrder::Unknown;
+    if (pos[0] == 0 && pos[1] == 1 && pos[2] == 2 && full_cell_(grid))
+      grid.axis_order = AxisOrder::XYZ;
   }
 };
 
@@ -489,6 +492,177 @@ void Ccp4<T>::write_ccp4_map(const std::string& path) const {
     impl::write_data<std::uint16_t>(grid.data, f.get());
 }
 
+/// Reads parts of an (uncompressed) map file on demand, without reading
+/// the whole data. Boxes are given in the file's (column, row, section)
+/// indices, counting from the first point stored in the file.
+/// Data is read with pread() (fseek+fread on Windows).
+class GEMMI_DLL Ccp4Reader : public Ccp4Base {
+public:
+  explicit Ccp4Reader(const std::string& path);
+
+  const std::string& path() const { return path_; }
+  int mode() const { return header_i32(4); }
+  /// numbers of columns, rows and sections (NC, NR, NS)
+  std::array<int, 3> file_dims() const { return header_3i32(1); }
+
+  /// Reads box [start, start+size) into out (size[0]*size[1]*size[2] values,
+  /// columns change fastest).
+  template<typename T>
+  void read_box(const std::array<int, 3>& start, const std::array<int, 3>& size,
+                T* out) const {
+    check_box(start, size);
+    switch (mode()) {
+      case 0: read_box_<std::int8_t>(start, size, out); break;
+      case 1: read_box_<std::int16_t>(start, size, out); break;
+      case 2: read_box_<float>(start, size, out); break;
+      case 6: read_box_<std::uint16_t>(start, size, out); break;
+    }
+  }
+
+  /// Returns Ccp4<T> with only the given box. The header is adjusted
+  /// (NC, NR, NS, NCSTART, ...) as in a map cut out of this one;
+  /// axes are not reordered (call setup() with MapSetup::ReorderOnly).
+  template<typename T>
+  Ccp4<T> read_subbox(const std::array<int, 3>& start,
+                      const std::array<int, 3>& size) const {
+    Ccp4<T> map;
+    map.ccp4_header = ccp4_header;
+    map.same_byte_order = same_byte_order;
+    map.hstats = hstats;
+    map.set_header_3i32(1, size[0], size[1], size[2]);
+    std::array<int, 3> file_start = header_3i32(5);
+    map.set_header_3i32(5, file_start[0] + start[0], file_start[1] + start[1],
+                        file_start[2] + start[2]);
+    map.header_to_grid_meta_(map.grid);
+    if (map.grid.axis_order != AxisOrder::Unknown)
+      map.grid.calculate_spacing();
+    map.grid.data.resize(map.grid.point_count());
+    read_box(start, size, map.grid.data.data());
+    return map;
+  }
+
+  /// Box in file indices that corresponds to the fractional box,
+  /// clipped to the extent of the file (no wrapping).
+  std::pair<std::array<int, 3>, std::array<int, 3>>
+  box_for_extent(const Box<Fractional>& box) const;
+
+  /// Calls func(first_section, n_sections, data) for consecutive slabs
+  /// of at most max_sections sections. The buffer is reused between calls.
+  template<typename T, typename Func>
+  void for_each_slab(int max_sections, Func func) const {
+    std::array<int, 3> dims = file_dims();
+    max_sections = std::max(1, std::min(max_sections, dims[2]));
+    std::vector<T> buf((size_t)dims[0] * dims[1] * max_sections);
+    for (int s = 0; s < dims[2]; s += max_sections) {
+      int n = std::min(max_sections, dims[2] - s);
+      read_box({{0, 0, s}}, {{dims[0], dims[1], n}}, buf.data());
+      func(s, n, buf);
+    }
+  }
+
+private:
+  std::string path_;
+  fileptr_t file_;
+  size_t data_offset_ = 0;
+
+  void check_box(const std::array<int, 3>& start, const std::array<int, 3>& size) const;
+  void read_bytes(size_t offset, size_t n, void* buf) const;
+
+  template<typename TFile, typename T>
+  void read_box_(const std::array<int, 3>& start, const std::array<int, 3>& size,
+                 T* out) const {
+    std::array<int, 3> dims = file_dims();
+    // whole rows are read at once, whole sections if possible
+    bool full_rows = start[0] == 0 && size[0] == dims[0];
+    size_t run = full_rows ? (size_t) size[0] * size[1] : (size_t) size[0];
+    std::vector<TFile> work(run);
+    for (int s = start[2]; s < start[2] + size[2]; ++s)
+      for (int r = start[1]; r < start[1] + size[1]; r += full_rows ? size[1] : 1) {
+        size_t idx = ((size_t) s * dims[1] + r) * dims[0] + start[0];
+        read_bytes(data_offset_ + idx * sizeof(TFile), run * sizeof(TFile), work.data());
+        for (TFile& value : work) {
+          if (!same_byte_order) {
+            if (sizeof(TFile) == 2)
+              swap_two_bytes(&value);
+            else if (sizeof(TFile) == 4)
+              swap_four_bytes(&value);
+          }
+          *out++ = impl::translate_map_point<TFile,T>(value);
+        }
+      }
+  }
+};
+
+/// Writes a map file incrementally, e.g. section by section.
+/// The header is taken from a Ccp4 or Ccp4Reader object (with NC, NR, NS,
+/// MODE, etc. already set); DMIN, DMAX, DMEAN and RMS are calculated
+/// from the written data and updated in finish().
+class GEMMI_DLL Ccp4Writer : public Ccp4Base {
+public:
+  Ccp4Writer(const std::string& path, const Ccp4Base& header);
+
+  /// Appends n values, converting them to the file mode.
+  template<typename T>
+  void write(const T* data, size_t n) {
+    switch (header_i32(4)) {
+      case 0: write_<std::int8_t>(data, n); break;
+      case 1: write_<std::int16_t>(data, n); break;
+      case 2: write_<float>(data, n); break;
+      case 6: write_<std::uint16_t>(data, n); break;
+    }
+  }
+  template<typename T>
+  void write(const std::vector<T>& data) { write(data.data(), data.size()); }
+
+  /// Checks that all points were written, writes updated header
+  /// and closes the file.
+  void finish();
+
+private:
+  fileptr_t f_;
+  std::string path_;
+  size_t point_count_ = 0;
+  size_t written_ = 0;
+  double sum_ = 0;
+  double sq_sum_ = 0;
+
+  void write_bytes(const void* buf, size_t n);
+
+  template<typename TFile, typename T>
+  void write_(const T* data, size_t n) {
+    if (written_ + n > point_count_)
+      fail("Ccp4Writer: more data than NC*NR*NS: " + path_);
+    constexpr size_t chunk_size = 64 * 1024;
+    std::vector<TFile> work(std::min(n, chunk_size));
+    for (size_t i = 0; i < n; i += chunk_size) {
+      size_t len = std::min(chunk_size, n - i);
+      for (size_t j = 0; j < len; ++j) {
+        double d = (double) data[i+j];
+        if (std::isnan(d)) {
+          hstats.nan_count++;
+        } else {
+          sum_ += d;
+          sq_sum_ += d * d;
+          if (!(d >= hstats.dmin))
+            hstats.dmin = d;
+          if (!(d <= hstats.dmax))
+            hstats.dmax = d;
+        }
+        TFile value = static_cast<TFile>(data[i+j]);
+        if (!same_byte_order) {
+          if (sizeof(TFile) == 2)
+            swap_two_bytes(&value);
+          else if (sizeof(TFile) == 4)
+            swap_four_bytes(&value);
+        }
+        work[j] = value;
+      }
+      write_bytes(work.data(), len * sizeof(TFile));
+    }
+    written_ += n;
+  }
+};
+
 GEMMI_DLL Ccp4<float> read_ccp4_map(const std::string& path, bool setup);
 GEMMI_DLL Ccp4<int8_t> read_ccp4_mask(const std::string& path, bool setup);
 GEMMI_DLL Ccp4Base read_ccp4_header(const std::string& path);
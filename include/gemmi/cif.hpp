@@ -8,14 +8,17 @@
 #define GEMMI_CIF_HPP_
 #include <cassert>
 #include <cstdio>     // for FILE
+#include <cstring>    // for memchr
 #include <iosfwd>     // for size_t, istream
 #include <string>
+#include <type_traits> // for is_same
 
 #include "third_party/tao/pegtl.hpp"
 //#include "third_party/tao/pegtl/contrib/tracer.hpp"  // for debugging
 
 #include "cifdoc.hpp" // for Document, etc
 #include "input.hpp"  // for CharArray
+#include "parallel.hpp" // for parallel_for_chunks
 #if defined(_WIN32)
 #include "fileutil.hpp" // for file_open
 #endif
@@ -118,10 +121,13 @@ namespace rules {
   struct loop_tag : tag {};
   struct loop_value : value {};
   struct loop_end : pegtl::opt<str_stop, ws_or_eof> {};
+  // used only when reading with num_threads > 1, defined after the actions
+  struct parallel_loop_values;
   struct loop : pegtl::if_must<str_loop,
                   whitespace,
                   pegtl::plus<pegtl::seq<loop_tag, whitespace, pegtl::discard>>,
-                  pegtl::sor<pegtl::plus<pegtl::seq<loop_value, ws_or_eof,
+                  pegtl::sor<parallel_loop_values,
+                             pegtl::plus<pegtl::seq<loop_value, ws_or_eof,
                                                     pegtl::discard>>,
                              // handle incorrect CIF with empty loop
                              pegtl::at<pegtl::sor<keyword, pegtl::eof>>>,
@@ -178,6 +184,72 @@ template<typename Rule> struct Errors : public pegtl::normal<Rule> {
 
 // **** parsing actions that fill the storage ****
 
+// The whole input is in memory (mmap or buffer) only for memory_input
+// and its derivatives; otherwise (cstream_input, etc) returns nullptr.
+template<typename Input>
+auto input_end(const Input& in, int) -> decltype(in.end()) { return in.end(); }
+template<typename Input>
+const char* input_end(const Input&, long) { return nullptr; }
+
+// Case-insensitive check if a reserved word starts at p.
+inline bool starts_with_keyword(const char* p, const char* end) {
+  char first = *p | 0x20;
+  if (first != 'd' && first != 'l' && first != 's' && first != 'g')
+    return false;
+  for (const char* kw : {"data_", "loop_", "save_", "global_", "stop_"}) {
+    size_t len = std::strlen(kw);
+    if (size_t(end - p) >= len &&
+        std::equal(kw, kw + len, p,
+                   [](char a, char b) { return a == '_' ? b == '_' : a == (b | 0x20); }))
+      return true;
+  }
+  return false;
+}
+
+// Returns approximate number of values in a loop, where p points to the
+// first value. Without it, loop values (which can take many times more
+// memory than the file) would be reallocated when the vector grows,
+// and up to half of the final capacity would be unused.
+// The number of lines in the loop is counted quickly (with memchr)
+// and multiplied by the number of values in the first line.
+inline size_t estimate_loop_values(const char* p, const char* end, size_t width) {
+  if (end - p < 4096)  // not worth it
+    return 0;
+  const char* eol = (const char*) std::memchr(p, '\n', end - p);
+  if (!eol)
+    return 0;
+  size_t per_line = 0;
+  for (const char* c = p; c < eol; ++per_line) {
+    if (*c == '\'' || *c == '"') {
+      char q = *c;
+      for (++c; c < eol && !(*c == q && (c + 1 == eol || char_table(c[1]) == 2)); )
+        ++c;
+      ++c;
+    } else if (*c == ';') {  // text field, rare in large loops
+      return 0;
+    }
+    while (c < eol && char_table(*c) != 2)
+      ++c;
+    while (c < eol && char_table(*c) == 2)
+      ++c;
+  }
+  size_t lines = 1;
+  for (const char* line = eol + 1; line < end; ++lines) {
+    while (line < end && (*line == ' ' || *line == '\t'))
+      ++line;
+    if (line == end || *line == '_' || *line == '#' || *line == ';' || starts_with_keyword(line, end))
+      break;
+    line = (const char*) std::memchr(line, '\n', end - line);
+    if (!line)
+      break;
+    ++line;
+  }
+  size_t n = lines * per_line;
+  n -= n % width;  // only complete rows
+  // each value takes at least 2 bytes
+  return std::min(n + width, size_t(end - p) / 2 + 1);
+}
+
 template<typename Rule> struct Action : pegtl::nothing<Rule> {};
 
 // We don't store comments here. We don't have a proper storage for comments.
@@ -251,29 +323,194 @@ template<> struct Action<rules::loop_value> {
   template<typename Input> static void apply(const Input& in, Document& out) {
     Item& last_item = out.items_->back();
     assert(last_item.type == ItemType::Loop);
-    last_item.loop.values.emplace_back(in.string());
+    std::vector<std::string>& values = last_item.loop.values;
+    if (values.empty())
+      if (const char* end = input_end(in.input(), 0)) {
+        values.reserve(estimate_loop_values(in.begin(), end,
+                                            last_item.loop.tags.size()));
+        out.loop_reserved_ = true;
+      }
+    values.emplace_back(in.begin(), in.end());
   }
 };
 template<> struct Action<rules::loop> {
   template<typename Input> static void apply(const Input& in, Document& out) {
     Item& last_item = out.items_->back();
     assert(last_item.type == ItemType::Loop);
-    const Loop& loop = last_item.loop;
+    Loop& loop = last_item.loop;
     if (loop.values.size() % loop.tags.size() != 0)
       throw pegtl::parse_error(
           "Wrong number of values in loop " + loop.common_prefix() + "*",
           in);
+    // estimate_loop_values() may overestimate (e.g. if rows span lines)
+    if (out.loop_reserved_) {
+      out.loop_reserved_ = false;
+      if (loop.values.capacity() > loop.values.size() + loop.values.size() / 8)
+        loop.values.shrink_to_fit();
+    }
   }
 };
 
+// **** multi-threaded parsing of large loops ****
+
+// Calls func(begin, end) for each value in [p, end), which contains
+// only complete lines from a loop, without text fields.
+// Returns false if it encounters anything other than plain values
+// and comments (a tag, a reserved word, a syntax error, ...),
+// which is then left for the normal parser.
+template<typename Func>
+bool for_each_loop_value(const char* p, const char* end, Func&& func) {
+  while (p != end) {
+    char c = *p;
+    if (char_table(c) == 2) {
+      ++p;
+    } else if (c == '#') {
+      p = (const char*) std::memchr(p, '\n', end - p);
+      if (!p)
+        p = end;
+    } else if (c == '\'' || c == '"') {
+      const char* q = p + 1;
+      for (;; ++q) {
+        if (q == end || *q == '\n')
+          return false;
+        if (*q == c && (q + 1 == end || char_table(q[1]) == 2 || q[1] == '#'))
+          break;
+      }
+      func(p, ++q);
+      p = q;
+    } else {
+      if (c == '_' || c == '$' || static_cast<unsigned char>(c - '!') > '~' - '!' ||
+          starts_with_keyword(p, end))
+        return false;
+      const char* q = p + 1;
+      while (q != end && static_cast<unsigned char>(*q - '!') <= '~' - '!')
+        ++q;
+      if (q != end && char_table(*q) != 2)
+        return false;
+      func(p, q);
+      p = q;
+    }
+  }
+  return true;
+}
+
+// Moves the input forward by n bytes with n_lines new-lines,
+// col is the resulting position in the last line.
+inline void bump_input(pegtl::internal::iterator& iter, size_t n, size_t n_lines,
+                       size_t col) {
+  iter.data += n;
+  iter.byte += n;
+  if (n_lines == 0) {
+    iter.byte_in_line += n;
+  } else {
+    iter.line += n_lines;
+    iter.byte_in_line = col;
+  }
+}
+inline void bump_input(const char*& iter, size_t n, size_t, size_t) { iter += n; }
+
+template<typename Input, typename... States>
+bool parse_loop_values_in_parallel(Input&, States&&...) { return false; }
+
+// Large loops (such as _atom_site in mmCIF files) can be split into chunks
+// at line boundaries and tokenized in parallel. It is done only when:
+// num_threads > 1, the whole input is in memory, the loop is large (1MB+),
+// and it has no text fields. Otherwise, it returns false without consuming
+// any input and the loop values are parsed normally.
+template<typename Input>
+auto parse_loop_values_in_parallel(Input& in, Document& doc) -> decltype(in.end(), bool()) {
+  const size_t min_size = 1024 * 1024;
+  if (doc.num_threads_ == 1)
+    return false;
+  const char* end = in.end();
+  const char* p = in.current();
+  if (size_t(end - p) < min_size || *p == ';')
+    return false;
+  // Find the end of the loop: a line that starts with a tag or reserved word.
+  const char* line = p;  // start of the current line (or p)
+  const char* body_end = end;
+  size_t n_lines = 0;
+  while (const char* eol = (const char*) std::memchr(line, '\n', end - line)) {
+    ++n_lines;
+    line = eol + 1;
+    if (line != end && *line == ';')  // text field
+      return false;
+    const char* c = line;
+    while (c != end && (*c == ' ' || *c == '\t'))
+      ++c;
+    if (c != end && (*c == '_' || starts_with_keyword(c, end))) {
+      body_end = c;
+      break;
+    }
+  }
+  if (size_t(body_end - p) < min_size)
+    return false;
+  int n_threads = get_num_threads(doc.num_threads_);
+  n_threads = std::min(n_threads, int((body_end - p) / (min_size / 4)));
+  // chunks start at line boundaries (quoted strings don't span lines)
+  std::vector<const char*> bounds(n_threads + 1, body_end);
+  bounds[0] = p;
+  for (int i = 1; i < n_threads; ++i) {
+    const char* b = std::max(p + (body_end - p) / n_threads * i, bounds[i-1]);
+    if (const char* eol = (const char*) std::memchr(b, '\n', body_end - b))
+      bounds[i] = eol + 1;
+  }
+  // the first pass counts values, the second one stores them
+  std::vector<size_t> offsets(n_threads + 1, 0);
+  std::vector<char> ok(n_threads, 0);
+  parallel_for_chunks(n_threads, n_threads, [&](size_t i, size_t, int) {
+    size_t count = 0;
+    ok[i] = for_each_loop_value(bounds[i], bounds[i+1],
+                                [&](const char*, const char*) { ++count; });
+    offsets[i+1] = count;
+  });
+  for (int i = 0; i < n_threads; ++i) {
+    if (!ok[i])
+      return false;
+    offsets[i+1] += offsets[i];
+  }
+  if (offsets.back() == 0)
+    return false;
+  Item& last_item = doc.items_->back();
+  assert(last_item.type == ItemType::Loop);
+  std::vector<std::string>& values = last_item.loop.values;
+  size_t start = values.size();
+  values.resize(start + offsets.back());
+  parallel_for_chunks(n_threads, n_threads, [&](size_t i, size_t, int) {
+    std::string* out = &values[start + offsets[i]];
+    for_each_loop_value(bounds[i], bounds[i+1], [&](const char* b, const char* e) {
+      (out++)->assign(b, e);
+    });
+  });
+  bump_input(in.iterator(), body_end - p, n_lines, body_end - line);
+  return true;
+}
+
+namespace rules {
+  struct parallel_loop_values {
+    using analyze_t = pegtl::analysis::generic<pegtl::analysis::rule_type::ANY>;
+    template<pegtl::apply_mode A, pegtl::rewind_mode M,
+             template<typename...> class Act, template<typename...> class Control,
+             typename Input, typename... States>
+    static bool match(Input& in, States&&... st) {
+      return A == pegtl::apply_mode::ACTION &&
+             std::is_same<Act<loop_value>, cif::Action<loop_value>>::value &&
+             parse_loop_values_in_parallel(in, st...);
+    }
+  };
+} // namespace rules
+
 
 template<typename Input> void parse_input(Document& d, Input&& in) {
   pegtl::parse<rules::file, Action, Errors>(in, d);
 }
 
-template<typename Input> Document read_input(Input&& in) {
+// num_threads > 1 (0 = all cores) is used only for large loops
+// and only if the input is in memory (read_file() and read_memory()).
+template<typename Input> Document read_input(Input&& in, int num_threads=1) {
   Document doc;
   doc.source = in.source();
+  doc.num_threads_ = num_threads;
   parse_input(doc, in);
   check_for_missing_values(doc);
   check_for_duplicates(doc);
@@ -296,17 +533,18 @@ size_t parse_one_block(Document& d, Input&& in) {
   tao::pegtl::file_input<> in(path)
 #endif
 
-inline Document read_file(const std::string& filename) {
+inline Document read_file(const std::string& filename, int num_threads=1) {
   GEMMI_CIF_FILE_INPUT(in, filename);
-  return read_input(in);
+  return read_input(in, num_threads);
 }
 
 // declared here for backward compatibility, now it's in read_cif.hpp
 Document read_string(const std::string& data);
 
-inline Document read_memory(const char* data, size_t size, const char* name) {
+inline Document read_memory(const char* data, size_t size, const char* name,
+                            int num_threads=1) {
   pegtl::memory_input<> in(data, size, name);
-  return read_input(in);
+  return read_input(in, num_threads);
 }
 
 inline Document read_cstream(std::FILE *f, size_t bufsize, const char* name) {
@@ -341,12 +579,12 @@ template<typename Input> bool try_parse(Input&& in, std::string* msg) {
 // A function for transparent reading of normal and compressed files.
 // T should have the same traits as BasicInput and MaybeGzipped.
 template<typename T>
-Document read(T&& input) {
+Document read(T&& input, int num_threads=1) {
   if (CharArray mem = input.uncompress_into_buffer())
-    return read_memory(mem.data(), mem.size(), input.path().c_str());
+    return read_memory(mem.data(), mem.size(), input.path().c_str(), num_threads);
   if (input.is_stdin())
     return read_cstream(stdin, 16*1024, "stdin");
-  return read_file(input.path());
+  return read_file(input.path(), num_threads);
 }
 
 template<typename T>
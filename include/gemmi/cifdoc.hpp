@@ -1059,6 +1059,11 @@ struct Document {
 
   // implementation detail: items of the currently parsed block or frame
   std::vector<Item>* items_ = nullptr;
+  // implementation detail: number of threads for parsing large loops
+  int num_threads_ = 1;
+  // implementation detail: values of the current loop were reserved
+  // using estimate_loop_values()
+  bool loop_reserved_ = false;
 
   Block& add_new_block(const std::string& name, int pos=-1) {
     if (find_block(name))
@@ -1072,6 +1077,7 @@ struct Document {
     source.clear();
     blocks.clear();
     items_ = nullptr;
+    loop_reserved_ = false;
   }
 
   // returns blocks[0] if the document has exactly one block (like mmCIF)
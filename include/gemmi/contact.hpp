@@ -45,90 +45,144 @@ struct ContactSearch {
     int image_idx;
     double dist_sq;
   };
-  std::vector<Result> find_contacts(NeighborSearch& ns) {
-    std::vector<Result> out;
-    for_each_contact(ns, [&out](const CRA& cra1, const CRA& cra2,
-                                int image_idx, double dist_sq) {
-        out.push_back({cra1, cra2, image_idx, dist_sq});
-    });
-    return out;
+  // With num_threads != 1 (0 = all cores) atoms are split between threads;
+  // contacts are returned in the same order as from a single thread.
+  std::vector<Result> find_contacts(NeighborSearch& ns, int num_threads=1);
+
+private:
+  void check_search(const NeighborSearch& ns) const {
+    if (!ns.model)
+      fail(ns.small_structure ? "ContactSearch does not work with SmallStructure"
+                              : "NeighborSearch not initialized");
+  }
+  PolymerType chain_polymer_type(const Chain& chain) const {
+    if (ignore == Ignore::AdjacentResidues)
+      return check_polymer_type(chain.get_polymer());
+    return PolymerType::Unknown;
   }
+  // finds contacts of one atom (chain n_ch, residue n_res, atom n_atom)
+  template<typename Func>
+  void for_each_atom_contact(NeighborSearch& ns, PolymerType pt,
+                             int n_ch, int n_res, int n_atom, const Func& func);
 };
 
 template<typename Func>
 void ContactSearch::for_each_contact(NeighborSearch& ns, const Func& func) {
-  if (!ns.model)
-    fail(ns.small_structure ? "ContactSearch does not work with SmallStructure"
-                            : "NeighborSearch not initialized");
+  check_search(ns);
   for (int n_ch = 0; n_ch != (int) ns.model->chains.size(); ++n_ch) {
     Chain& chain = ns.model->chains[n_ch];
-    PolymerType pt = PolymerType::Unknown;
-    if (ignore == Ignore::AdjacentResidues)
-      pt = check_polymer_type(chain.get_polymer());
+    PolymerType pt = chain_polymer_type(chain);
     for (int n_res = 0; n_res != (int) chain.residues.size(); ++n_res) {
       Residue& res = chain.residues[n_res];
-      for (int n_atom = 0; n_atom != (int) res.atoms.size(); ++n_atom) {
-        Atom& atom = res.atoms[n_atom];
-        if (!ns.include_h && is_hydrogen(atom.element))
-          continue;
-        if (atom.occ < min_occupancy)
-          continue;
-        ns.for_each(atom.pos, atom.altloc, search_radius,
-                    [&](NeighborSearch::Mark& m, double dist_sq) {
-            // do not consider connections inside a residue
-            if (ignore != Ignore::Nothing && m.image_idx == 0 &&
-                m.chain_idx == n_ch && m.residue_idx == n_res)
-              return;
-            switch (ignore) {
-              case Ignore::Nothing:
-                break;
-              case Ignore::SameResidue:
-                if (m.image_idx == 0 && m.chain_idx == n_ch)
-                  if (m.residue_idx == n_res)
-                    return;
-                break;
-              case Ignore::AdjacentResidues:
-                if (m.image_idx == 0 && m.chain_idx == n_ch)
-                  if (m.residue_idx == n_res ||
-                      are_connected(res, chain.residues[m.residue_idx], pt) ||
-                      are_connected(chain.residues[m.residue_idx], res, pt))
-                    return;
-                break;
-              case Ignore::SameChain:
-                if (m.image_idx == 0 && m.chain_idx == n_ch)
-                  return;
-                break;
-              case Ignore::SameAsu:
-                if (m.image_idx == 0)
-                  return;
-                break;
-            }
-            // additionally, we may have per-element distances
-            if (!radii.empty()) {
-              double d = radii[atom.element.ordinal()] + radii[m.element.ordinal()];
-              if (d < 0 || dist_sq > d * d)
+      for (int n_atom = 0; n_atom != (int) res.atoms.size(); ++n_atom)
+        for_each_atom_contact(ns, pt, n_ch, n_res, n_atom, func);
+    }
+  }
+}
+
+inline std::vector<ContactSearch::Result>
+ContactSearch::find_contacts(NeighborSearch& ns, int num_threads) {
+  check_search(ns);
+  num_threads = get_num_threads(num_threads);
+  std::vector<Result> out;
+  auto add_result = [](std::vector<Result>& results) {
+    return [&results](const CRA& cra1, const CRA& cra2, int image_idx, double dist_sq) {
+      results.push_back({cra1, cra2, image_idx, dist_sq});
+    };
+  };
+  if (num_threads == 1) {
+    for_each_contact(ns, add_result(out));
+    return out;
+  }
+  struct AtomRef { PolymerType pt; int n_ch, n_res, n_atom; };
+  std::vector<AtomRef> refs;
+  for (int n_ch = 0; n_ch != (int) ns.model->chains.size(); ++n_ch) {
+    const Chain& chain = ns.model->chains[n_ch];
+    PolymerType pt = chain_polymer_type(chain);
+    for (int n_res = 0; n_res != (int) chain.residues.size(); ++n_res)
+      for (int n_atom = 0; n_atom != (int) chain.residues[n_res].atoms.size(); ++n_atom)
+        refs.push_back({pt, n_ch, n_res, n_atom});
+  }
+  std::vector<std::vector<Result>> parts(num_threads);
+  parallel_for_chunks(refs.size(), num_threads, [&](size_t begin, size_t end, int i) {
+    for (size_t n = begin; n != end; ++n) {
+      const AtomRef& r = refs[n];
+      for_each_atom_contact(ns, r.pt, r.n_ch, r.n_res, r.n_atom, add_result(parts[i]));
+    }
+  });
+  size_t total = 0;
+  for (const std::vector<Result>& part : parts)
+    total += part.size();
+  out.reserve(total);
+  for (const std::vector<Result>& part : parts)
+    out.insert(out.end(), part.begin(), part.end());
+  return out;
+}
+
+template<typename Func>
+void ContactSearch::for_each_atom_contact(NeighborSearch& ns, PolymerType pt,
+                                          int n_ch, int n_res, int n_atom,
+                                          const Func& func) {
+  Chain& chain = ns.model->chains[n_ch];
+  Residue& res = chain.residues[n_res];
+  Atom& atom = res.atoms[n_atom];
+  if (!ns.include_h && is_hydrogen(atom.element))
+    return;
+  if (atom.occ < min_occupancy)
+    return;
+  ns.for_each(atom.pos, atom.altloc, search_radius,
+              [&](NeighborSearch::Mark& m, double dist_sq) {
+        // do not consider connections inside a residue
+        if (ignore != Ignore::Nothing && m.image_idx == 0 &&
+            m.chain_idx == n_ch && m.residue_idx == n_res)
+          return;
+        switch (ignore) {
+          case Ignore::Nothing:
+            break;
+          case Ignore::SameResidue:
+            if (m.image_idx == 0 && m.chain_idx == n_ch)
+              if (m.residue_idx == n_res)
                 return;
-            }
-            // avoid reporting connections twice (A-B and B-A)
-            if (!twice)
-              if (m.chain_idx < n_ch || (m.chain_idx == n_ch &&
-                    (m.residue_idx < n_res || (m.residue_idx == n_res &&
-                                               m.atom_idx < n_atom))))
+            break;
+          case Ignore::AdjacentResidues:
+            if (m.image_idx == 0 && m.chain_idx == n_ch)
+              if (m.residue_idx == n_res ||
+                  are_connected(res, chain.residues[m.residue_idx], pt) ||
+                  are_connected(chain.residues[m.residue_idx], res, pt))
                 return;
-            // atom can be linked with its image, but if the image
-            // is too close the atom is likely on special position.
-            if (m.chain_idx == n_ch && m.residue_idx == n_res &&
-                m.atom_idx == n_atom && dist_sq < special_pos_cutoff_sq)
+            break;
+          case Ignore::SameChain:
+            if (m.image_idx == 0 && m.chain_idx == n_ch)
               return;
-            CRA cra2 = m.to_cra(*ns.model);
-            // ignore atoms with occupancy below the specified value
-            if (cra2.atom->occ < min_occupancy)
+            break;
+          case Ignore::SameAsu:
+            if (m.image_idx == 0)
               return;
-            func(CRA{&chain, &res, &atom}, cra2, m.image_idx, dist_sq);
-        });
-      }
-    }
-  }
+            break;
+        }
+        // additionally, we may have per-element distances
+        if (!radii.empty()) {
+          double d = radii[atom.element.ordinal()] + radii[m.element.ordinal()];
+          if (d < 0 || dist_sq > d * d)
+            return;
+        }
+        // avoid reporting connections twice (A-B and B-A)
+        if (!twice)
+          if (m.chain_idx < n_ch || (m.chain_idx == n_ch &&
+                (m.residue_idx < n_res || (m.residue_idx == n_res &&
+                                           m.atom_idx < n_atom))))
+            return;
+        // atom can be linked with its image, but if the image
+        // is too close the atom is likely on special position.
+        if (m.chain_idx == n_ch && m.residue_idx == n_res &&
+            m.atom_idx == n_atom && dist_sq < special_pos_cutoff_sq)
+          return;
+        CRA cra2 = m.to_cra(*ns.model);
+        // ignore atoms with occupancy below the specified value
+        if (cra2.atom->occ < min_occupancy)
+          return;
+        func(CRA{&chain, &res, &atom}, cra2, m.image_idx, dist_sq);
+  });
 }
 
 } // namespace gemmi
@@ -11,6 +11,7 @@
 #include "grid.hpp"     // for Grid
 #include "model.hpp"    // for Structure, ...
 #include "calculate.hpp" // for calculate_b_aniso_range
+#include "parallel.hpp"  // for parallel_for_chunks
 
 namespace gemmi {
 
@@ -84,6 +85,9 @@ struct DensityCalculator {
   double rate = 1.5;
   double blur = 0.;
   float cutoff = 1e-5f;
+  /// number of threads used in add_model_density_to_grid() and symmetrize_sum();
+  /// 0 = all cores
+  int num_threads = 1;
 #if GEMMI_COUNT_DC
   size_t atoms_added = 0;
   size_t density_computations = 0;
@@ -103,9 +107,10 @@ struct DensityCalculator {
   }
 
   // pre: check if Table::has(atom.element)
-  void add_atom_density_to_grid(const Atom& atom) {
+  void add_atom_density_to_grid(const Atom& atom, int w_begin=0, int w_end=INT_MAX) {
     Element el = atom.element;
-    do_add_atom_density_to_grid(atom, Table::get(el, atom.charge), addends.get(el));
+    do_add_atom_density_to_grid(atom, Table::get(el, atom.charge), addends.get(el),
+                                w_begin, w_end);
   }
 
   // Parameter c is a constant factor and has the same meaning as either addend
@@ -122,35 +127,57 @@ struct DensityCalculator {
     return determine_cutoff_radius(x1, precal, (CReal)cutoff);
   }
 
+  /// radius of the sphere within which the atom's density is added
   template<typename Coef>
-  void do_add_atom_density_to_grid(const Atom& atom, const Coef& coef, float addend) {
+  CReal atom_radius(const Atom& atom, const Coef& coef, float addend) const {
+    if (!atom.aniso.nonzero()) {
+      CReal b = static_cast<CReal>(atom.b_iso + blur);
+      return estimate_radius(coef.precalculate_density_iso(b, addend), b);
+    }
+    auto aniso_b = atom.aniso.scaled(CReal(u_to_b())).added_kI(CReal(blur));
+    // rough estimate, so we don't calculate eigenvalues
+    CReal b_max = std::max(std::max(aniso_b.u11, aniso_b.u22), aniso_b.u33);
+    return estimate_radius(coef.precalculate_density_iso(b_max, addend), b_max);
+  }
+
+  /// Only grid points with w index in [w_begin, w_end) are modified.
+  template<typename Coef>
+  void do_add_atom_density_to_grid(const Atom& atom, const Coef& coef, float addend,
+                                   int w_begin=0, int w_end=INT_MAX) {
 #if GEMMI_COUNT_DC
     ++atoms_added;
 #endif
     Fractional fpos = grid.unit_cell.fractionalize(atom.pos);
+    double radius = atom_radius(atom, coef, addend);
+    int du = (int) std::ceil(radius / grid.spacing[0]);
+    int dv = (int) std::ceil(radius / grid.spacing[1]);
+    int dw = (int) std::ceil(radius / grid.spacing[2]);
+    grid.template check_size_for_points_in_box<true>(du, dv, dw,
+                                                     /*fail_on_too_large_radius=*/false);
     if (!atom.aniso.nonzero()) {
       // isotropic
       CReal b = static_cast<CReal>(atom.b_iso + blur);
       auto precal = coef.precalculate_density_iso(b, addend);
-      CReal radius = estimate_radius(precal, b);
-      grid.template use_points_around<true>(fpos, radius, [&](GReal& point, double r2) {
-          point += GReal(atom.occ * precal.calculate((CReal)r2));
+      grid.template do_use_rows_in_box<true>(
+          fpos, du, dv, dw,
+          [&](GReal* points, const double* dist_sq, int n) {
+            CReal r2[Grid<GReal>::row_chunk];
+            CReal density[Grid<GReal>::row_chunk];
+            for (int i = 0; i < n; ++i)
+              r2[i] = (CReal) dist_sq[i];
+            precal.calculate_array(r2, density, n);
+            for (int i = 0; i < n; ++i)
+              points[i] += GReal(atom.occ * density[i]);
 #if GEMMI_COUNT_DC
-          ++density_computations;
+            density_computations += n;
 #endif
-      }, /*fail_on_too_large_radius=*/false);
+          },
+          radius, w_begin, w_end);
     } else {
       // anisotropic
       auto aniso_b = atom.aniso.scaled(CReal(u_to_b())).added_kI(CReal(blur));
-      // rough estimate, so we don't calculate eigenvalues
-      CReal b_max = std::max(std::max(aniso_b.u11, aniso_b.u22), aniso_b.u33);
-      auto precal_iso = coef.precalculate_density_iso(b_max, addend);
-      double radius = estimate_radius(precal_iso, b_max);
       auto precal = coef.precalculate_density_aniso_b(aniso_b, addend);
-      int du = (int) std::ceil(radius / grid.spacing[0]);
-      int dv = (int) std::ceil(radius / grid.spacing[1]);
-      int dw = (int) std::ceil(radius / grid.spacing[2]);
-      grid.template use_points_in_box<true>(
+      grid.template do_use_points_in_box<true>(
           fpos, du, dv, dw,
           [&](GReal& point, double, const Position& delta, int, int, int) {
             point += GReal(atom.occ * precal.calculate(delta));
@@ -158,10 +185,19 @@ struct DensityCalculator {
             ++density_computations;
 #endif
           },
-          false, radius);
+          radius, w_begin, w_end);
     }
   }
 
+  /// Returns (first wrapped w index, number of w layers) of the atom's box.
+  std::pair<int, int> atom_w_span(const Atom& atom) const {
+    Element el = atom.element;
+    double radius = atom_radius(atom, Table::get(el, atom.charge), addends.get(el));
+    int dw = std::min((int) std::ceil(radius / grid.spacing[2]), grid.nw - 1);
+    int w0 = iround(grid.unit_cell.fractionalize(atom.pos).z * grid.nw);
+    return {modulo(w0 - dw, grid.nw), 2 * dw + 1};
+  }
+
   void initialize_grid() {
     grid.data.clear();
     double spacing = requested_grid_spacing();
@@ -176,16 +212,47 @@ struct DensityCalculator {
 
   void add_model_density_to_grid(const Model& model) {
     grid.check_not_empty();
+    int n_threads = get_num_threads(num_threads);
+#if GEMMI_COUNT_DC
+    n_threads = 1;  // counters are not thread-safe
+#endif
+    if (n_threads == 1) {
+      for (const Chain& chain : model.chains)
+        for (const Residue& res : chain.residues)
+          for (const Atom& atom : res.atoms)
+            add_atom_density_to_grid(atom);
+      return;
+    }
+    // The grid is split into slabs along w. Each thread adds density from
+    // all atoms that overlap its slab, in the same order as above,
+    // so the result is identical to the single-threaded one.
+    std::vector<const Atom*> atoms;
     for (const Chain& chain : model.chains)
       for (const Residue& res : chain.residues)
         for (const Atom& atom : res.atoms)
-          add_atom_density_to_grid(atom);
+          atoms.push_back(&atom);
+    std::vector<std::pair<int, int>> w_spans(atoms.size());
+    parallel_for_chunks(atoms.size(), n_threads, [&](size_t begin, size_t end, int) {
+      for (size_t i = begin; i != end; ++i)
+        w_spans[i] = atom_w_span(*atoms[i]);
+    });
+    const int nw = grid.nw;
+    parallel_for_chunks(nw, n_threads, [&](size_t begin, size_t end, int) {
+      int w_begin = (int) begin;
+      int w_end = (int) end;
+      for (size_t i = 0; i != atoms.size(); ++i) {
+        int first = w_spans[i].first;
+        int last = first + w_spans[i].second;  // exclusive, can be > nw
+        if (last - first >= nw || (first < w_end && last > w_begin) || last > nw + w_begin)
+          add_atom_density_to_grid(*atoms[i], w_begin, w_end);
+      }
+    });
   }
 
   void put_model_density_on_grid(const Model& model) {
     initialize_grid();
     add_model_density_to_grid(model);
-    grid.symmetrize_sum();
+    grid.symmetrize_sum(num_threads);
   }
 
   // deprecated, use directly grid.setup_from(st)
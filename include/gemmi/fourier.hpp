@@ -7,16 +7,25 @@
 
 #include <array>
 #include <complex>       // for std::conj
+#include <utility>       // for pair
 #include "recgrid.hpp"   // for ReciprocalGrid
 #include "math.hpp"      // for rad
 #include "symmetry.hpp"  // for GroupOps, Op
 #include "fail.hpp"      // for fail
+#include "parallel.hpp"  // for parallel_for_chunks
 
 #ifdef __MINGW32__  // MinGW may have problem with std::mutex etc
 # define POCKETFFT_CACHE_SIZE 0
+# define POCKETFFT_NO_MULTITHREADING
+#endif
+#if defined(__GNUC__) && __GNUC__-0 > 4
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wshadow"
 #endif
-#define POCKETFFT_NO_MULTITHREADING
 #include "third_party/pocketfft_hdronly.h"
+#if defined(__GNUC__) && __GNUC__-0 > 4
+#pragma GCC diagnostic pop
+#endif
 
 namespace gemmi {
 
@@ -84,48 +93,35 @@ bool data_fits_into(const DataProxy& data, std::array<int, 3> size) {
   return true;
 }
 
+// Only zeros are replaced, and only with values from non-zero mates,
+// so rows can be processed in any order (and in parallel).
 template<typename T>
-void add_friedel_mates(ReciprocalGrid<T>& grid) {
+void add_friedel_mates(ReciprocalGrid<T>& grid, int num_threads=1) {
   const T default_val = T(); // initialized to 0 or 0+0i
-  if (grid.axis_order == AxisOrder::XYZ) {
-    for (int w = 0; w != (grid.half_l ? 1 : grid.nw); ++w) {
-      int w_ = w == 0 ? 0 : grid.nw - w;
-      for (int v = 0; v != grid.nv; ++v) {
-        int v_ = v == 0 ? 0 : grid.nv - v;
-        for (int u = 0; u != grid.nu; ++u) {
-          size_t idx = grid.index_q(u, v, w);
-          if (grid.data[idx] == default_val) {
-            int u_ = u == 0 ? 0 : grid.nu - u;
-            size_t inv_idx = grid.index_q(u_, v_, w_);
-            grid.data[idx] = friedel_mate_value(grid.data[inv_idx]);
-          }
-        }
-      }
-    }
-  } else { // grid.axis_order == AxisOrder::ZYX
-    for (int w = 0; w != grid.nw; ++w) {
+  // rows along u: (v, w) for w in [0, n_w)
+  bool xyz = grid.axis_order == AxisOrder::XYZ;
+  int n_w = xyz && grid.half_l ? 1 : grid.nw;
+  // with ZYX and half_l only u=0 (l=0) needs to be filled
+  int n_u = !xyz && grid.half_l ? 1 : grid.nu;
+  size_t n_rows = (size_t) n_w * grid.nv;
+  parallel_for_chunks(n_rows, get_num_threads(num_threads),
+                      [&](size_t begin, size_t end, int) {
+    for (size_t row = begin; row != end; ++row) {
+      int w = int(row / grid.nv);
+      int v = int(row % grid.nv);
       int w_ = w == 0 ? 0 : grid.nw - w;
-      for (int v = 0; v != grid.nv; ++v) {
-        int v_ = v == 0 ? 0 : grid.nv - v;
-        if (grid.half_l) {
-          size_t idx = grid.index_q(0, v, w);
-          if (grid.data[idx] == default_val) {
-            size_t inv_idx = grid.index_q(0, v_, w_);
-            grid.data[idx] = friedel_mate_value(grid.data[inv_idx]);
-          }
-        } else {
-          for (int u = 0; u != grid.nu; ++u) {
-            size_t idx = grid.index_q(u, v, w);
-            if (grid.data[idx] == default_val) {
-              int u_ = u == 0 ? 0 : grid.nu - u;
-              size_t inv_idx = grid.index_q(u_, v_, w_);
-              grid.data[idx] = friedel_mate_value(grid.data[inv_idx]);
-            }
-          }
+      int v_ = v == 0 ? 0 : grid.nv - v;
+      for (int u = 0; u != n_u; ++u) {
+        size_t idx = grid.index_q(u, v, w);
+        if (grid.data[idx] == default_val) {
+          int u_ = u == 0 ? 0 : grid.nu - u;
+          const T& mate = grid.data[grid.index_q(u_, v_, w_)];
+          if (mate != default_val)
+            grid.data[idx] = friedel_mate_value(mate);
         }
       }
     }
-  }
+  });
 }
 
 template<typename T, typename DataProxy>
@@ -164,37 +160,73 @@ private:
 
 // If half_l is true, grid has only data with l>=0.
 // Parameter size can be obtained from get_size_for_hkl().
+// With num_threads != 1, reflections are expanded by symmetry in parallel
+// and the values are then written to the grid in parallel, in slabs.
+// When a grid point gets multiple values, the first one (in the order
+// of reflections and symops) is used, as in the single-threaded version.
 template<typename T, typename FPhi>
 FPhiGrid<T> get_f_phi_on_grid(const FPhi& fphi,
                               std::array<int, 3> size, bool half_l,
-                              AxisOrder axis_order=AxisOrder::XYZ) {
+                              AxisOrder axis_order=AxisOrder::XYZ,
+                              int num_threads=1) {
   FPhiGrid<T> grid;
   initialize_hkl_grid(grid, fphi, size, half_l, axis_order);
   const std::complex<T> default_val; // initialized to 0+0i
   GroupOps ops = grid.spacegroup->operations();
-  for (size_t i = 0; i < fphi.size(); i += fphi.stride()) {
-    Miller hkl = fphi.get_hkl(i);
-    T f = (T) fphi.get_f(i);
-    if (f == 0.f)  // is there enough of F=0 to justify this 'if'?
-      continue;
-    double phi = fphi.get_phi(i);
-    for (const Op& op : ops.sym_ops) {
-      auto hklp = op.apply_to_hkl(hkl);
-      int lp = hklp[2];
-      if (axis_order == AxisOrder::ZYX)
-        std::swap(hklp[0], hklp[2]);
-      if (!grid.has_index(hklp[0], hklp[1], hklp[2]))
+  // calls func(idx, value) for reflections with offsets [begin, end)
+  auto expand = [&](size_t begin, size_t end, auto&& func) {
+    for (size_t i = begin; i < end; i += fphi.stride()) {
+      Miller hkl = fphi.get_hkl(i);
+      T f = (T) fphi.get_f(i);
+      if (f == 0.f)  // is there enough of F=0 to justify this 'if'?
         continue;
-      int sign = (!half_l || lp >= 0 ? 1 : -1);
-      size_t idx = grid.index_n(sign * hklp[0], sign * hklp[1], sign * hklp[2]);
-      if (grid.data[idx] == default_val) {
-        T theta = sign * T(phi + op.phase_shift(hkl));
-        grid.data[idx] = std::complex<T>(f * std::cos(theta), f * std::sin(theta));
+      for (const Op& op : ops.sym_ops) {
+        auto hklp = op.apply_to_hkl(hkl);
+        int lp = hklp[2];
+        if (axis_order == AxisOrder::ZYX)
+          std::swap(hklp[0], hklp[2]);
+        if (!grid.has_index(hklp[0], hklp[1], hklp[2]))
+          continue;
+        int sign = (!half_l || lp >= 0 ? 1 : -1);
+        size_t idx = grid.index_n(sign * hklp[0], sign * hklp[1], sign * hklp[2]);
+        func(idx, [&] {
+          T theta = sign * T(fphi.get_phi(i) + op.phase_shift(hkl));
+          return std::complex<T>(f * std::cos(theta), f * std::sin(theta));
+        });
       }
     }
+  };
+  size_t n_rows = fphi.stride() != 0 ? fphi.size() / fphi.stride() : 0;
+  int n = get_num_threads(num_threads);
+  if ((size_t) n > n_rows)
+    n = std::max((int) n_rows, 1);
+  if (n == 1) {
+    expand(0, fphi.size(), [&](size_t idx, auto&& value) {
+      if (grid.data[idx] == default_val)
+        grid.data[idx] = value();
+    });
+  } else {
+    // buckets[t][s]: values from reflection chunk t for grid slab s
+    using Item = std::pair<size_t, std::complex<T>>;
+    std::vector<std::vector<std::vector<Item>>> buckets(n);
+    size_t grid_size = grid.data.size();
+    parallel_for_chunks(n_rows, n, [&](size_t begin, size_t end, int t) {
+      std::vector<std::vector<Item>>& slabs = buckets[t];
+      slabs.resize(n);
+      expand(begin * fphi.stride(), end * fphi.stride(), [&](size_t idx, auto&& value) {
+        slabs[idx * n / grid_size].emplace_back(idx, value());
+      });
+    });
+    parallel_for_chunks(n, n, [&](size_t begin, size_t end, int) {
+      for (size_t s = begin; s != end; ++s)
+        for (const std::vector<std::vector<Item>>& slabs : buckets)
+          for (const Item& item : slabs[s])
+            if (grid.data[item.first] == default_val)
+              grid.data[item.first] = item.second;
+    });
   }
   if (!ops.is_centrosymmetric())
-    add_friedel_mates(grid);
+    add_friedel_mates(grid, num_threads);
   return grid;
 }
 
@@ -232,15 +264,21 @@ ReciprocalGrid<T> get_value_on_grid(const DataProxy& data, size_t column,
 }
 
 
+// num_threads is passed to pocketfft (0 = all cores).
 template<typename T>
-void transform_f_phi_grid_to_map_(FPhiGrid<T>&& hkl, Grid<T>& map) {
+void transform_f_phi_grid_to_map_(FPhiGrid<T>&& hkl, Grid<T>& map, int num_threads=1) {
+  num_threads = get_num_threads(num_threads);
   // NaNs are not good for FFT, so we change them to 0.
   // x -> conj(x) is equivalent to changing axis direction before FFT.
-  for (std::complex<T>& x : hkl.data)
-    if (std::isnan(x.imag()))
-      x = 0;
-    else
-      x.imag(-x.imag());
+  parallel_for_chunks(hkl.data.size(), num_threads, [&](size_t begin, size_t end, int) {
+    for (size_t i = begin; i != end; ++i) {
+      std::complex<T>& x = hkl.data[i];
+      if (std::isnan(x.imag()))
+        x = 0;
+      else
+        x.imag(-x.imag());
+    }
+  });
   map.spacegroup = hkl.spacegroup;
   map.unit_cell = hkl.unit_cell;
   map.axis_order = hkl.axis_order;
@@ -265,15 +303,15 @@ void transform_f_phi_grid_to_map_(FPhiGrid<T>&& hkl, Grid<T>& map) {
     size_t last_axis = axes.back();
     axes.pop_back();
     pocketfft::c2c<T>(shape, stride, stride, axes, pocketfft::BACKWARD,
-                      &hkl.data[0], &hkl.data[0], norm);
+                      &hkl.data[0], &hkl.data[0], norm, (size_t) num_threads);
     pocketfft::stride_t stride_out{s * map.nu * map.nv, s * map.nu, s};
     shape[0] = (size_t) map.nw;
     shape[2] = (size_t) map.nu;
     pocketfft::c2r<T>(shape, stride, stride_out, last_axis, pocketfft::BACKWARD,
-                      &hkl.data[0], &map.data[0], 1.0f);
+                      &hkl.data[0], &map.data[0], 1.0f, (size_t) num_threads);
   } else {
     pocketfft::c2c<T>(shape, stride, stride, axes, pocketfft::BACKWARD,
-                      &hkl.data[0], &hkl.data[0], norm);
+                      &hkl.data[0], &hkl.data[0], norm, (size_t) num_threads);
     assert(map.data.size() == hkl.data.size());
     for (size_t i = 0; i != map.data.size(); ++i)
       map.data[i] = hkl.data[i].real();
@@ -281,9 +319,9 @@ void transform_f_phi_grid_to_map_(FPhiGrid<T>&& hkl, Grid<T>& map) {
 }
 
 template<typename T>
-Grid<T> transform_f_phi_grid_to_map(FPhiGrid<T>&& hkl) {
+Grid<T> transform_f_phi_grid_to_map(FPhiGrid<T>&& hkl, int num_threads=1) {
   Grid<T> map;
-  transform_f_phi_grid_to_map_(std::forward<FPhiGrid<T>>(hkl), map);
+  transform_f_phi_grid_to_map_(std::forward<FPhiGrid<T>>(hkl), map, num_threads);
   return map;
 }
 
@@ -292,13 +330,15 @@ Grid<T> transform_f_phi_to_map(const FPhi& fphi,
                                std::array<int, 3> size,
                                double sample_rate,
                                bool exact_size=false,
-                               AxisOrder order=AxisOrder::XYZ) {
+                               AxisOrder order=AxisOrder::XYZ,
+                               int num_threads=1) {
   if (exact_size) {
     gemmi::check_grid_factors(fphi.spacegroup(), size);
   } else {
     size = get_size_for_hkl(fphi, size, sample_rate);
   }
-  return transform_f_phi_grid_to_map(get_f_phi_on_grid<T>(fphi, size, true, order));
+  return transform_f_phi_grid_to_map(
+      get_f_phi_on_grid<T>(fphi, size, true, order, num_threads), num_threads);
 }
 
 template<typename T, typename FPhi>
@@ -306,14 +346,17 @@ Grid<T> transform_f_phi_to_map2(const FPhi& fphi,
                                 std::array<int, 3> min_size,
                                 double sample_rate,
                                 std::array<int, 3> exact_size,
-                                AxisOrder order=AxisOrder::XYZ) {
+                                AxisOrder order=AxisOrder::XYZ,
+                                int num_threads=1) {
   bool exact = (exact_size[0] != 0 || exact_size[1] != 0 || exact_size[2] != 0);
   return transform_f_phi_to_map<float>(fphi, exact ? exact_size : min_size,
-                                       sample_rate, exact, order);
+                                       sample_rate, exact, order, num_threads);
 }
 
 template<typename T>
-FPhiGrid<T> transform_map_to_f_phi(const Grid<T>& map, bool half_l, bool use_scale=true) {
+FPhiGrid<T> transform_map_to_f_phi(const Grid<T>& map, bool half_l, bool use_scale=true,
+                                   int num_threads=1) {
+  num_threads = get_num_threads(num_threads);
   if (half_l && map.axis_order == AxisOrder::ZYX)
     fail("transform_map_to_f_phi(): half_l + ZYX order are not supported yet");
   FPhiGrid<T> hkl;
@@ -329,25 +372,30 @@ FPhiGrid<T> transform_map_to_f_phi(const Grid<T>& map, bool half_l, bool use_sca
   pocketfft::stride_t stride_in{s * hkl.nv * hkl.nu, s * hkl.nu, s};
   pocketfft::stride_t stride{2*s * hkl.nv * hkl.nu, 2*s * hkl.nu, 2*s};
   pocketfft::r2c<T>(shape, stride_in, stride, /*axis=*/0, pocketfft::FORWARD,
-                    &map.data[0], &hkl.data[0], norm);
+                    &map.data[0], &hkl.data[0], norm, (size_t) num_threads);
   shape[0] = half_nw;
   pocketfft::c2c<T>(shape, stride, stride, {1, 2}, pocketfft::FORWARD,
-                    &hkl.data[0], &hkl.data[0], 1.0f);
+                    &hkl.data[0], &hkl.data[0], 1.0f, (size_t) num_threads);
   if (!half_l)  // add Friedel pairs
-    for (int w = half_nw; w != hkl.nw; ++w) {
-      int w_ = hkl.nw - w;
-      for (int v = 0; v != hkl.nv; ++v) {
-        int v_ = v == 0 ? 0 : hkl.nv - v;
-        for (int u = 0; u != hkl.nu; ++u) {
-          int u_ = u == 0 ? 0 : hkl.nu - u;
-          size_t idx = hkl.index_q(u, v, w);
-          size_t inv_idx = hkl.index_q(u_, v_, w_);
-          hkl.data[idx] = hkl.data[inv_idx];  // conj() is called later
+    parallel_for_chunks(hkl.nw - half_nw, num_threads, [&](size_t begin, size_t end, int) {
+      for (int w = half_nw + (int)begin; w != half_nw + (int)end; ++w) {
+        int w_ = hkl.nw - w;
+        for (int v = 0; v != hkl.nv; ++v) {
+          int v_ = v == 0 ? 0 : hkl.nv - v;
+          for (int u = 0; u != hkl.nu; ++u) {
+            int u_ = u == 0 ? 0 : hkl.nu - u;
+            size_t idx = hkl.index_q(u, v, w);
+            size_t inv_idx = hkl.index_q(u_, v_, w_);
+            hkl.data[idx] = hkl.data[inv_idx];  // conj() is called later
+          }
         }
       }
-    }
-  for (int i = 0; i != hkl.nu * hkl.nv * half_nw; ++i)
-    hkl.data[i].imag(-hkl.data[i].imag());
+    });
+  size_t half_size = (size_t) hkl.nu * hkl.nv * half_nw;
+  parallel_for_chunks(half_size, num_threads, [&](size_t begin, size_t end, int) {
+    for (size_t i = begin; i != end; ++i)
+      hkl.data[i].imag(-hkl.data[i].imag());
+  });
   return hkl;
 }
 
@@ -6,7 +6,9 @@
 #define GEMMI_GRID_HPP_
 
 #include <cassert>
+#include <climits>    // for INT_MAX
 #include <cstddef>    // for ptrdiff_t
+#include <cstdint>    // for uint64_t
 #include <complex>
 #include <algorithm>  // for fill
 #include <numeric>    // for accumulate
@@ -16,6 +18,7 @@
 #include "symmetry.hpp"
 #include "stats.hpp"  // for DataStats
 #include "fail.hpp"   // for fail
+#include "parallel.hpp"  // for parallel_for_chunks
 
 namespace gemmi {
 
@@ -206,6 +209,54 @@ struct GridMeta {
     return grid_ops;
   }
 
+  /// Checks that the operations, together with identity, are closed
+  /// under composition modulo the grid size. Otherwise, the grid size
+  /// is not compatible with the space group.
+  void check_ops_form_group(const std::vector<GridOp>& ops) const {
+    const int dims[3] = {nu, nv, nw};
+    // rotation matrices in a group have elements -1, 0 and 1,
+    // so rotation and translation can be encoded in a single number
+    auto encode = [&](const Op::Rot& rot, Op::Tran tran) -> std::uint64_t {
+      std::uint64_t key = 0;
+      for (int i = 0; i != 3; ++i)
+        for (int j = 0; j != 3; ++j) {
+          if (rot[i][j] < -1 || rot[i][j] > 1)
+            return UINT64_MAX;
+          key = key * 3 + (rot[i][j] + 1);
+        }
+      for (int i = 0; i != 3; ++i) {
+        tran[i] %= dims[i];
+        key = key * dims[i] + (tran[i] < 0 ? tran[i] + dims[i] : tran[i]);
+      }
+      return key;
+    };
+    std::vector<std::uint64_t> group;
+    group.reserve(ops.size() + 1);
+    group.push_back(encode({{{1, 0, 0}, {0, 1, 0}, {0, 0, 1}}}, {0, 0, 0}));
+    for (const GridOp& op : ops) {
+      for (int i = 0; i != 3; ++i)
+        for (int j = 0; j != 3; ++j)
+          if (i != j && op.scaled_op.rot[i][j] != 0 && dims[i] != dims[j])
+            fail("grid size is not compatible with space group");
+      group.push_back(encode(op.scaled_op.rot, op.scaled_op.tran));
+    }
+    std::sort(group.begin(), group.end());
+    for (const GridOp& a : ops)
+      for (const GridOp& b : ops) {
+        const Op::Rot& ra = a.scaled_op.rot;
+        Op::Rot rot;
+        Op::Tran tran = a.scaled_op.tran;
+        for (int i = 0; i != 3; ++i)
+          for (int j = 0; j != 3; ++j) {
+            rot[i][j] = ra[i][0] * b.scaled_op.rot[0][j] + ra[i][1] * b.scaled_op.rot[1][j]
+                      + ra[i][2] * b.scaled_op.rot[2][j];
+            tran[i] += ra[i][j] * b.scaled_op.tran[j];
+          }
+        if (!std::binary_search(group.begin(), group.end(), encode(rot, tran)))
+          fail("grid size is not compatible with space group");
+      }
+  }
+
   /// Quick(est) index function, but works only if `0 <= u < nu`, etc.
   size_t index_q(int u, int v, int w) const {
     return size_t(w * nv + v) * nu + u;
@@ -622,9 +673,11 @@ struct Grid : GridBase<T> {
     }
   }
 
+  /// Points with the wrapped w index outside of [w_begin, w_end) are skipped;
+  /// it's used to split the grid into slabs processed by separate threads.
   template <bool UsePbc, typename Func>
   void do_use_points_in_box(const Fractional& fctr, int du, int dv, int dw, Func&& func,
-                            double radius=INFINITY) {
+                            double radius=INFINITY, int w_begin=0, int w_end=INT_MAX) {
     double max_dist_sq = radius * radius;
     const Fractional nctr(fctr.x * nu, fctr.y * nv, fctr.z * nw);
     int u0 = iround(nctr.x);
@@ -650,6 +703,8 @@ struct Grid : GridBase<T> {
     auto wrap = [](int& q, int nq) { if (UsePbc && q == nq) q = 0; };
     Fractional fdelta(nctr.x - u_lo, 0, 0);
     for (int w = w_lo, w_ = w_0; w <= w_hi; ++w, wrap(++w_, nw)) {
+      if (w_ < w_begin || w_ >= w_end)
+        continue;
       fdelta.z = nctr.z - w;
       for (int v = v_lo, v_ = v_0; v <= v_hi; ++v, wrap(++v_, nv)) {
         fdelta.y = nctr.y - v;
@@ -677,6 +732,79 @@ struct Grid : GridBase<T> {
     }
   }
 
+  /// max. number of points passed at once by do_use_rows_in_box()
+  static constexpr int row_chunk = 64;
+
+  /// Visits the same points as do_use_points_in_box(), but calls
+  /// func(T* ptr, const double* dist_sq, int n) for runs of up to row_chunk
+  /// points that are consecutive in memory (along u), so that func can
+  /// process a run of points in a vectorizable loop.
+  template <bool UsePbc, typename Func>
+  void do_use_rows_in_box(const Fractional& fctr, int du, int dv, int dw, Func&& func,
+                          double radius=INFINITY, int w_begin=0, int w_end=INT_MAX) {
+    double max_dist_sq = radius * radius;
+    const Fractional nctr(fctr.x * nu, fctr.y * nv, fctr.z * nw);
+    int u0 = iround(nctr.x);
+    int v0 = iround(nctr.y);
+    int w0 = iround(nctr.z);
+    int u_lo = u0 - du;
+    int u_hi = u0 + du;
+    int v_lo = v0 - dv;
+    int v_hi = v0 + dv;
+    int w_lo = w0 - dw;
+    int w_hi = w0 + dw;
+    if (!UsePbc) {
+      u_lo = std::max(u_lo, 0);
+      u_hi = std::min(u_hi, nu - 1);
+      v_lo = std::max(v_lo, 0);
+      v_hi = std::min(v_hi, nv - 1);
+      w_lo = std::max(w_lo, 0);
+      w_hi = std::min(w_hi, nw - 1);
+    }
+    int u_0 = UsePbc ? modulo(u_lo, nu) : u_lo;
+    int v_0 = UsePbc ? modulo(v_lo, nv) : v_lo;
+    int w_0 = UsePbc ? modulo(w_lo, nw) : w_lo;
+    auto wrap = [](int& q, int nq) { if (UsePbc && q == nq) q = 0; };
+    double dist_sq[row_chunk];
+    Fractional fdelta(nctr.x - u_lo, 0, 0);
+    for (int w = w_lo, w_ = w_0; w <= w_hi; ++w, wrap(++w_, nw)) {
+      if (w_ < w_begin || w_ >= w_end)
+        continue;
+      fdelta.z = nctr.z - w;
+      for (int v = v_lo, v_ = v_0; v <= v_hi; ++v, wrap(++v_, nv)) {
+        fdelta.y = nctr.y - v;
+        Position delta(orth_n.multiply(fdelta));
+        T* t = &data[this->index_q(u_0, v_, w_)];
+        double dist_sq0 = sq(delta.y) + sq(delta.z);
+        if (dist_sq0 > max_dist_sq)
+          continue;
+        // points within the radius form a contiguous range k_lo..k_hi
+        // (k = u - u_lo); distances are calculated for whole runs of points
+        double half = std::sqrt(max_dist_sq - dist_sq0);
+        double x0 = delta.x;
+        int k_lo = (int) std::max(0., std::ceil((x0 - half) / orth_n.a11));
+        int k_hi = (int) std::min(double(u_hi - u_lo), std::floor((x0 + half) / orth_n.a11));
+        int u_ = UsePbc ? modulo(u_lo + k_lo, nu) : u_lo + k_lo;
+        t += u_ - u_0;
+        for (int k = k_lo; k <= k_hi;) {
+          int n = std::min(k_hi - k + 1, row_chunk);
+          if (UsePbc)
+            n = std::min(n, nu - u_);
+          for (int i = 0; i < n; ++i)
+            dist_sq[i] = dist_sq0 + sq(x0 - (k + i) * orth_n.a11);
+          func(t, dist_sq, n);
+          k += n;
+          u_ += n;
+          t += n;
+          if (UsePbc && u_ == nu) {
+            u_ = 0;
+            t -= nu;
+          }
+        }
+      }
+    }
+  }
+
   template <bool UsePbc, typename Func>
   void use_points_in_box(const Fractional& fctr, int du, int dv, int dw,
                          Func&& func, bool fail_on_too_large_radius=true,
@@ -716,62 +844,139 @@ struct Grid : GridBase<T> {
   /// grid point, then assign the result to all the points.
   /// \par func takes two values and returns a value.
   template<typename Func>
-  void symmetrize(Func func) {
-    symmetrize_using_ops(this->get_scaled_ops_except_id(), func);
+  void symmetrize(Func func, int num_threads=1) {
+    symmetrize_using_ops(this->get_scaled_ops_except_id(), func, num_threads);
   }
 
+  /// Each orbit of symmetry-related points is processed once, starting
+  /// from the point with the lowest index (as in a serial scan), so the result
+  /// doesn't depend on the number of threads. Rows (along u) are processed
+  /// in blocks of 16x16 rows, and most rows are skipped after checking
+  /// only the operations that don't depend on u.
   template<typename Func>
-  void symmetrize_using_ops(const std::vector<GridOp>& ops, Func func) {
+  void symmetrize_using_ops(const std::vector<GridOp>& ops, Func func,
+                            int num_threads=1) {
     if (ops.empty())
       return;
-    std::vector<size_t> mates(ops.size(), 0);
-    std::vector<signed char> visited(data.size(), 0);  // faster than vector<bool>
-    size_t idx = 0;
-    for (int w = 0; w != nw; ++w)
-      for (int v = 0; v != nv; ++v)
-        for (int u = 0; u != nu; ++u, ++idx) {
-          assert(idx == this->index_q(u, v, w));
-          if (visited[idx])
-            continue;
-          for (size_t k = 0; k < ops.size(); ++k) {
-            std::array<int,3> t = ops[k].apply(u, v, w);
-            mates[k] = this->index_n(t[0], t[1], t[2]);
-          }
-          T value = data[idx];
-          for (size_t k : mates) {
-            if (visited[k])
-              fail("grid size is not compatible with space group");
-            value = func(value, data[k]);
-          }
-          data[idx] = value;
-          visited[idx] = 1;
-          for (size_t k : mates) {
-            data[k] = value;
-            visited[k] = 1;
-          }
+    this->check_ops_form_group(ops);
+    const int dims[3] = {nu, nv, nw};
+    const size_t strides[3] = {1, (size_t)nu, (size_t)nu * nv};
+    // tables that replace modulo: wrapped[i][x - lo[i]] = (x mod n_i) * stride_i
+    int lo[3], hi[3];
+    for (int i = 0; i != 3; ++i) {
+      lo[i] = hi[i] = ops[0].scaled_op.tran[i];
+      for (const GridOp& op : ops) {
+        int a = op.scaled_op.tran[i], b = a;
+        for (int j = 0; j != 3; ++j) {
+          int r = op.scaled_op.rot[i][j] * (dims[j] - 1);
+          (r < 0 ? a : b) += r;
         }
-    assert(idx == data.size());
+        lo[i] = std::min(lo[i], a);
+        hi[i] = std::max(hi[i], b);
+      }
+    }
+    std::vector<size_t> wrapped[3];
+    for (int i = 0; i != 3; ++i) {
+      wrapped[i].resize(hi[i] - lo[i] + 1);
+      for (int x = lo[i]; x <= hi[i]; ++x) {
+        int m = x % dims[i];
+        wrapped[i][x - lo[i]] = size_t(m < 0 ? m + dims[i] : m) * strides[i];
+      }
+    }
+    // t: the mate of (0,v,w) before wrapping and shifted by -lo
+    auto mate_index = [&](const Op::Rot& rot, const std::array<int,3>& t, int u) {
+      return wrapped[0][t[0] + rot[0][0] * u] +
+             wrapped[1][t[1] + rot[1][0] * u] +
+             wrapped[2][t[2] + rot[2][0] * u];
+    };
+    constexpr int block = 16;
+    const int nbv = (nv + block - 1) / block;
+    const int nbw = (nw + block - 1) / block;
+    const size_t n_ops = ops.size();
+    parallel_for_chunks((size_t) nbv * nbw, get_num_threads(num_threads),
+                        [&](size_t begin, size_t end, int) {
+      std::vector<std::array<int,3>> row_start(n_ops);
+      std::vector<size_t> active;  // ops that need to be checked for each u
+      active.reserve(n_ops);
+      std::vector<size_t> mates(n_ops);
+      for (size_t b = begin; b != end; ++b) {
+        int v0 = int(b % nbv) * block;
+        int w0 = int(b / nbv) * block;
+        for (int w = w0; w != std::min(w0 + block, nw); ++w)
+          for (int v = v0; v != std::min(v0 + block, nv); ++v) {
+            const size_t row_idx = this->index_q(0, v, w);
+            active.clear();
+            bool skip_row = false;
+            for (size_t k = 0; k != n_ops; ++k) {
+              const Op& op = ops[k].scaled_op;
+              std::array<int,3>& t = row_start[k];
+              for (int i = 0; i != 3; ++i)
+                t[i] = op.rot[i][1] * v + op.rot[i][2] * w + op.tran[i] - lo[i];
+              // if the mate's w (or w and v) doesn't depend on u,
+              // this op either excludes the whole row or can be ignored
+              if (op.rot[2][0] == 0) {
+                size_t m = wrapped[2][t[2]];
+                size_t m0 = w * strides[2];
+                if (op.rot[1][0] == 0) {
+                  m += wrapped[1][t[1]];
+                  m0 = row_idx;
+                }
+                if (m < m0) {
+                  skip_row = true;
+                  break;
+                }
+                if (m > m0)
+                  continue;
+              }
+              active.push_back(k);
+            }
+            if (skip_row)
+              continue;
+            size_t idx = row_idx;
+            for (int u = 0; u != nu; ++u, ++idx) {
+              bool is_first = true;
+              for (size_t k : active)
+                if (mate_index(ops[k].scaled_op.rot, row_start[k], u) < idx) {
+                  is_first = false;
+                  break;
+                }
+              if (!is_first)
+                continue;
+              for (size_t k = 0; k != n_ops; ++k)
+                mates[k] = mate_index(ops[k].scaled_op.rot, row_start[k], u);
+              T value = data[idx];
+              for (size_t m : mates)
+                value = func(value, data[m]);
+              data[idx] = value;
+              for (size_t m : mates)
+                data[m] = value;
+            }
+          }
+      }
+    });
   }
 
   // most common symmetrize functions
-  void symmetrize_min() {
-    symmetrize([](T a, T b) { return (a < b || !(b == b)) ? a : b; });
+  void symmetrize_min(int num_threads=1) {
+    symmetrize([](T a, T b) { return (a < b || !(b == b)) ? a : b; }, num_threads);
   }
-  void symmetrize_max() {
-    symmetrize([](T a, T b) { return (a > b || !(b == b)) ? a : b; });
+  void symmetrize_max(int num_threads=1) {
+    symmetrize([](T a, T b) { return (a > b || !(b == b)) ? a : b; }, num_threads);
   }
-  void symmetrize_abs_max() {
-    symmetrize([](T a, T b) { return (std::abs(a) > std::abs(b) || !(b == b)) ? a : b; });
+  void symmetrize_abs_max(int num_threads=1) {
+    symmetrize([](T a, T b) { return (std::abs(a) > std::abs(b) || !(b == b)) ? a : b; },
+               num_threads);
   }
   /// multiplies grid points on special position
-  void symmetrize_sum() {
-    symmetrize([](T a, T b) { return a + b; });
+  void symmetrize_sum(int num_threads=1) {
+    symmetrize([](T a, T b) { return a + b; }, num_threads);
   }
-  void symmetrize_nondefault(T default_) {
-    symmetrize([default_](T a, T b) { return impl::is_same(a, default_) ? b : a; });
+  void symmetrize_nondefault(T default_, int num_threads=1) {
+    symmetrize([default_](T a, T b) { return impl::is_same(a, default_) ? b : a; },
+               num_threads);
   }
-  void symmetrize_avg() {
-    symmetrize_sum();
+  void symmetrize_avg(int num_threads=1) {
+    symmetrize_sum(num_threads);
     if (spacegroup && spacegroup->number != 1) {
       int n_ops = spacegroup->operations().order();
       for (T& x : data)
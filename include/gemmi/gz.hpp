@@ -25,9 +25,12 @@ private:
   void* f;  // implementation detail
 };
 
+// In uncompress_into_buffer(), BGZF files (series of small gzip members
+// with sizes in headers) are decompressed on num_threads threads (0 = all).
+// create_stream() decompresses large files on a background thread.
 class GEMMI_DLL MaybeGzipped : public BasicInput {
 public:
-  explicit MaybeGzipped(const std::string& path);
+  explicit MaybeGzipped(const std::string& path, int num_threads=1);
   ~MaybeGzipped();
   size_t gzread_checked(void* buf, size_t len);
   bool is_compressed() const { return iends_with(path(), ".gz"); }
@@ -41,6 +44,7 @@ public:
 
 private:
   void* file_ = nullptr;
+  int num_threads_;
 };
 
 } // namespace gemmi
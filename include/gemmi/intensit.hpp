@@ -13,6 +13,7 @@
 #include "util.hpp"     // for vector_remove_if
 #include "mtz.hpp"      // for Mtz
 #include "stats.hpp"    // for Correlation
+#include "binner.hpp"   // for Binner
 #include "xds_ascii.hpp" // for XdsAscii
 
 namespace gemmi {
@@ -29,6 +30,17 @@ enum class DataType { Unknown, Unmerged, Mean, Anomalous, MergedMA, MergedAM };
 /// Returns STARANISO version or empty string.
 GEMMI_DLL std::string read_staraniso_b_from_mtz(const Mtz& mtz, SMat33<double>& output);
 
+/// Statistics from Intensities::merge_in_place(), for one resolution bin.
+struct MergingStats {
+  int all_refl = 0;     // observations, including rejected outliers
+  int unique_refl = 0;  // merged reflections (<I>, I(+) and I(-) separately)
+  int rejected = 0;     // observations rejected as outliers
+  // Correlation between means of two halves of observations, for reflections
+  // with at least two observations. Observations are assigned to halves
+  // alternately (in the original order), so the result is reproducible.
+  Correlation cc_half;
+};
+
 struct GEMMI_DLL Intensities {
   struct Refl {
     Miller hkl;
@@ -109,9 +121,20 @@ struct GEMMI_DLL Intensities {
 
   void sort() { std::sort(data.begin(), data.end()); }
 
-  void merge_in_place(DataType data_type);
-
-  void switch_to_asu_indices();
+  /// Merges observations of the same reflection using inverse-variance
+  /// weighting. Observations are grouped by sorting packed (h,k,l,sign) keys
+  /// (radix sort); equal keys keep the original order, so the result
+  /// doesn't depend on num_threads.
+  /// If outlier_sigma > 0, the observation most deviating from the weighted
+  /// mean of the others is rejected if the deviation exceeds outlier_sigma
+  /// combined sigmas, and this is repeated while more than 2 remain.
+  /// Returns statistics per bin of binner, or a single element if no binner.
+  /// Returns empty vector if the data doesn't need to be merged.
+  std::vector<MergingStats> merge_in_place(DataType data_type, int num_threads=1,
+                                           double outlier_sigma=0.,
+                                           const Binner* binner=nullptr);
+
+  void switch_to_asu_indices(int num_threads=1);
 
   void read_unmerged_intensities_from_mtz(const Mtz& mtz);
   void read_mean_intensities_from_mtz(const Mtz& mtz);
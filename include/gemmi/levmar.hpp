@@ -81,6 +81,9 @@ inline void print_parameters(const std::string& name, std::vector<double> &a) {
   fprintf(stderr, "\n");
 }
 
+// Generic implementations of compute_wssr() and compute_lm_matrices().
+// Target can provide faster overloads that take non-const Target&
+// (as in scaling.hpp); they are picked by LevMar::fit().
 template<typename Target>
 double compute_wssr(const Target& target) {
   long double wssr = 0; // long double here notably increases the accuracy
@@ -15,6 +15,16 @@ namespace gemmi {
 /// structure from a coordinate mmCIF block
 GEMMI_DLL Structure make_structure_from_block(const cif::Block& block);
 
+/// Reads coordinate mmCIF directly into Structure. Unlike
+/// make_structure(cif::read_memory(...)), values of _atom_site are not
+/// kept in a Document -- they are converted to atoms in chunks during
+/// parsing. If possible_chemcomp is true, CCD and monomer library files
+/// are also accepted (as in read_structure_from_memory()).
+GEMMI_DLL Structure read_mmcif_streaming(const char* data, size_t size,
+                                         const std::string& name,
+                                         bool possible_chemcomp=false);
+GEMMI_DLL Structure read_mmcif_file_streaming(const std::string& path);
+
 /// structure from a coordinate mmCIF document
 inline Structure make_structure(cif::Document&& doc, cif::Document* save_doc=nullptr) {
   // mmCIF files for deposition may have more than one block:
@@ -67,9 +67,12 @@ inline Structure read_structure_from_memory(char* data, size_t size,
     format = coor_format_from_content(data, data + size);
   if (format == CoorFormat::Pdb)
     return read_pdb_from_memory(data, size, path);
-  if (format == CoorFormat::Mmcif)
+  if (format == CoorFormat::Mmcif) {
+    if (!save_doc)
+      return read_mmcif_streaming(data, size, path, true);
     return make_structure_from_doc(cif::read_memory(data, size, path.c_str()),
                                    true, save_doc);
+  }
   if (format == CoorFormat::Mmjson)
     return make_structure(cif::read_mmjson_insitu(data, size, path), save_doc);
   fail("wrong format of coordinate file " + path);
@@ -97,6 +100,12 @@ Structure read_structure(T&& input, CoorFormat format=CoorFormat::Unknown,
     case CoorFormat::Pdb:
       return read_pdb(input);
     case CoorFormat::Mmcif:
+      // without save_doc, _atom_site doesn't need to be stored in Document
+      if (!save_doc && !input.is_stdin()) {
+        if (CharArray mem = input.uncompress_into_buffer())
+          return read_mmcif_streaming(mem.data(), mem.size(), input.path());
+        return read_mmcif_file_streaming(input.path());
+      }
       return make_structure(cif::read(input), save_doc);
     case CoorFormat::Mmjson: {
       Structure st = make_structure(cif::read_mmjson(input), save_doc);
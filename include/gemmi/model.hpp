@@ -102,6 +102,7 @@ struct PdbReadOptions {
   int max_line_length = 0;
   bool split_chain_on_ter = false;
   bool skip_remarks = false;
+  int num_threads = 1;  // for reading atom fields; 0 = all cores
 };
 // end of PdbReadOptions for mol.rst
 
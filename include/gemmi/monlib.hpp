@@ -69,7 +69,7 @@ struct GEMMI_DLL ChemMod {
     int func;
     std::string old_id;
     std::string new_id;
-    Element el;
+    Element el = El::X;
     float charge;
     std::string chem_type;
   };
@@ -88,7 +88,7 @@ struct GEMMI_DLL ChemMod {
 struct EnerLib {
   enum class RadiusType {Vdw, Vdwh, Ion};
   struct Atom {
-    Element element;
+    Element element = El::X;
     char hb_type;
     double vdw_radius;
     double vdwh_radius;
@@ -229,10 +229,16 @@ struct GEMMI_DLL MonLib {
   }
 
   /// Read mon_lib_list.cif, ener_lib.cif and required monomers.
+  /// Files are parsed in num_threads threads (0 = all cores).
+  /// If cache_dir (an existing directory) is given, the content of each
+  /// file is also stored there in a binary form and re-used in next calls,
+  /// until the file's modification time or size changes.
   /// Returns true if all requested monomers were added.
   bool read_monomer_lib(const std::string& monomer_dir_,
                         const std::vector<std::string>& resnames,
-                        const Logger& logger);
+                        const Logger& logger,
+                        int num_threads=1,
+                        const std::string& cache_dir="");
 
   double find_ideal_distance(const const_CRA& cra1, const const_CRA& cra2) const;
   void update_old_atom_names(Structure& st, const Logger& logger) const;
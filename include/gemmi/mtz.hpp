@@ -8,6 +8,7 @@
 #include <cassert>
 #include <cmath>         // for isnan
 #include <cstdint>       // for int32_t
+#include <cstring>       // for memcpy
 #include <algorithm>     // for copy
 #include <array>
 #include <initializer_list>
@@ -430,6 +431,12 @@ struct GEMMI_DLL Mtz {
 
   void read_raw_data(AnyStream& stream);
 
+  /// Reads data only from the first three columns (H, K, L) and columns
+  /// with the given labels. Other columns are removed (before reading),
+  /// so the memory is used only for the selected columns.
+  void read_raw_data_of_columns(AnyStream& stream,
+                                const std::vector<std::string>& labels);
+
   void read_all_headers(AnyStream& stream);
 
   void read_stream(AnyStream&& stream, bool with_data) {
@@ -461,6 +468,10 @@ struct GEMMI_DLL Mtz {
   /// the same as read_input(MaybeGzipped(path), with_data)
   void read_file_gz(const std::string& path, bool with_data=true);
 
+  /// the same as read_file_gz(path), but uses read_raw_data_of_columns()
+  void read_file_columns(const std::string& path,
+                         const std::vector<std::string>& labels);
+
   std::vector<int> sorted_row_indices(int use_first=3) const;
   bool sort(int use_first=3);
 
@@ -605,6 +616,74 @@ struct MtzExternalDataProxy : MtzDataProxy {
 
 inline MtzDataProxy data_proxy(const Mtz& mtz) { return {mtz}; }
 
+/// MTZ file mapped into memory (mmap). The headers are read into mtz
+/// (mtz.data stays empty) and the data is accessed directly in the file,
+/// byte-swapped on the fly if needed.
+class GEMMI_DLL MappedMtz {
+public:
+  Mtz mtz;
+
+  /// strided, read-only view of one column
+  struct ColumnView {
+    const MappedMtz* parent;
+    size_t idx;
+    size_t size() const { return (size_t) parent->mtz.nreflections; }
+    float operator[](size_t n) const { return parent->get_num(idx + n * parent->stride()); }
+    float at(size_t n) const {
+      if (n >= size())
+        fail("MappedMtz::ColumnView: index out of range");
+      return (*this)[n];
+    }
+  };
+
+  explicit MappedMtz(const std::string& path);
+  MappedMtz(MappedMtz&& o) noexcept;
+  MappedMtz(const MappedMtz&) = delete;
+  MappedMtz& operator=(const MappedMtz&) = delete;
+  ~MappedMtz();
+
+  size_t stride() const { return mtz.columns.size(); }
+  size_t size() const { return stride() * mtz.nreflections; }
+
+  float get_num(size_t n) const {
+    float f;
+    std::memcpy(&f, data_ + 4 * n, 4);
+    if (!mtz.same_byte_order)
+      swap_four_bytes(&f);
+    return f;
+  }
+  Miller get_hkl(size_t offset) const {
+    return {{(int)get_num(offset), (int)get_num(offset+1), (int)get_num(offset+2)}};
+  }
+
+  ColumnView column(const Mtz::Column& col) const { return {this, col.idx}; }
+  ColumnView column(const std::string& label) const {
+    return column(mtz.get_column_with_label(label));
+  }
+
+  /// Returns Mtz with data of H, K, L and columns with the given labels,
+  /// cf. Mtz::read_raw_data_of_columns().
+  Mtz read_columns(const std::vector<std::string>& labels) const;
+
+private:
+  const char* file_ = nullptr;  // start of the file
+  const char* data_ = nullptr;  // start of the reflection data
+  size_t file_size_ = 0;
+  bool mapped_ = false;
+  CharArray buffer_;  // used if the file is not memory-mapped
+};
+
+// Data proxy for MappedMtz, used in the same way as MtzDataProxy.
+struct MtzMappedDataProxy : MtzDataProxy {
+  const MappedMtz& map_;
+  explicit MtzMappedDataProxy(const MappedMtz& m) : MtzDataProxy{m.mtz}, map_(m) {}
+  size_t size() const { return map_.size(); }
+  float get_num(size_t n) const { return map_.get_num(n); }
+  Miller get_hkl(size_t offset) const { return map_.get_hkl(offset); }
+};
+
+inline MtzMappedDataProxy data_proxy(const MappedMtz& m) { return MtzMappedDataProxy(m); }
+
 } // namespace gemmi
 
 #endif
@@ -2,17 +2,24 @@
 //
 // Cell-linked lists method for atom searching (a.k.a. grid search, binning,
 // bucketing, cell technique for neighbor search, etc).
+//
+// Marks are kept in per-cell vectors (grid.data) while the search is being
+// populated. compact() moves them into one cell-sorted array, with
+// coordinates also stored separately (SoA), which is faster to search.
 
 #ifndef GEMMI_NEIGHBOR_HPP_
 #define GEMMI_NEIGHBOR_HPP_
 
 #include <vector>
 #include <cmath>  // for INFINITY, sqrt
+#include <type_traits>  // for is_invocable
 
 #include "fail.hpp"      // for fail
 #include "grid.hpp"
 #include "model.hpp"
+#include "parallel.hpp"  // for parallel_for_chunks
 #include "small.hpp"
+#include "span.hpp"      // for Span
 
 namespace gemmi {
 
@@ -51,7 +58,13 @@ struct NeighborSearch {
     }
   };
 
+  // marks in per-cell vectors; after compact() all the cells are empty
   Grid<std::vector<Mark>> grid;
+  // compact storage, used after compact():
+  // marks from cell i are flat_marks[cell_offsets[i]:cell_offsets[i+1]]
+  std::vector<Mark> flat_marks;
+  std::vector<size_t> cell_offsets;
+  std::vector<double> flat_x, flat_y, flat_z;  // copy of flat_marks[i].pos
   double radius_specified = 0.;
   Model* model = nullptr;
   SmallStructure* small_structure = nullptr;
@@ -73,36 +86,113 @@ struct NeighborSearch {
     set_grid_size();
   }
 
-  NeighborSearch& populate(bool include_h_=true);
+  // With num_threads != 1 (0 = all cores) atoms of the model are binned
+  // on multiple threads; the result is the same as with a single thread.
+  NeighborSearch& populate(bool include_h_=true, int num_threads=1);
   void add_chain(const Chain& chain, bool include_h_=true);
   void add_chain_n(const Chain& chain, int n_ch);
   void add_atom(const Atom& atom, int n_ch, int n_res, int n_atom);
   void add_site(const SmallStructure::Site& site, int n);
 
+  // Switches to the compact storage. Marks can't be added afterwards.
+  NeighborSearch& compact();
+  bool is_compact() const { return !cell_offsets.empty(); }
+
+  // calls func(cell_index, Mark&&) for the atom and each of its images
+  template<typename Func>
+  void for_each_atom_image(const Atom& atom, int n_ch, int n_res, int n_atom,
+                           const Func& func) const;
+
   // assumes data in [0, 1), but uses index_n to account for numerical errors
-  std::vector<Mark>& get_subcell(const Fractional& fr) {
+  size_t get_subcell_index(const Fractional& fr) const {
     size_t idx = grid.index_n(int(fr.x * grid.nu),
                               int(fr.y * grid.nv),
                               int(fr.z * grid.nw));
     if (idx >= grid.data.size())
       fail("NeighborSearch error, probably due to NaN in coordinates");
-    return grid.data[idx];
+    // all functions adding marks use this function
+    if (is_compact())
+      fail("NeighborSearch: cannot add atoms after compact()");
+    return idx;
+  }
+  std::vector<Mark>& get_subcell(const Fractional& fr) {
+    if (is_compact())
+      fail("NeighborSearch: get_subcell() can't be used after compact()");
+    return grid.data[get_subcell_index(fr)];
   }
 
+  Span<Mark> cell_marks(size_t idx) {
+    if (is_compact())
+      return Span<Mark>(flat_marks.data() + cell_offsets[idx],
+                        cell_offsets[idx+1] - cell_offsets[idx]);
+    return Span<Mark>(grid.data[idx].data(), grid.data[idx].size());
+  }
+
+  // calls func(Span<Mark>& marks, const Fractional& fr) for each cell
+  // within k cells from pos.
+  // func taking std::vector<Mark>& (as in gemmi <= 0.7.0) is still accepted,
+  // but only before compact().
   template<typename Func>
-  void for_each_cell(const Position& pos, const Func& func, int k=1);
+  void for_each_cell(const Position& pos, const Func& func, int k=1) {
+    constexpr bool takes_vector =
+      !std::is_invocable<const Func&, Span<Mark>&, const Fractional&>::value;
+    if (takes_vector && is_compact())
+      fail("NeighborSearch: for_each_cell() with std::vector<Mark>& argument"
+           " can't be used after compact()");
+    for_each_cell_range(pos, [&](size_t begin, size_t end, const Fractional& fr) {
+        for (size_t idx = begin; idx != end; ++idx) {
+          if constexpr (takes_vector) {
+            func(grid.data[idx], fr);
+          } else {
+            Span<Mark> marks = cell_marks(idx);
+            func(marks, fr);
+          }
+        }
+    }, k);
+  }
+  // The same, but calls func(begin, end, fr) for ranges of consecutive
+  // cell indices; in the compact storage their marks are contiguous.
+  template<typename Func>
+  void for_each_cell_range(const Position& pos, const Func& func, int k=1) const;
+
+  // Calls func(mark, dist_sq) for marks from cells [begin, end) that have
+  // dist_sq < max_dist_sq; max_dist_sq can be changed by func.
+  template<typename Func>
+  void for_each_mark_within(size_t begin, size_t end, const Position& p,
+                            const double& max_dist_sq, const Func& func) {
+    if (is_compact()) {
+      const double* xs = flat_x.data();
+      const double* ys = flat_y.data();
+      const double* zs = flat_z.data();
+      for (size_t i = cell_offsets[begin]; i != cell_offsets[end]; ++i) {
+        double dx = xs[i] - p.x;
+        double dy = ys[i] - p.y;
+        double dz = zs[i] - p.z;
+        double dist_sq = dx * dx + dy * dy + dz * dz;
+        if (dist_sq < max_dist_sq)
+          func(flat_marks[i], dist_sq);
+      }
+    } else {
+      for (size_t idx = begin; idx != end; ++idx)
+        for (Mark& m : grid.data[idx]) {
+          double dist_sq = m.pos.dist_sq(p);
+          if (dist_sq < max_dist_sq)
+            func(m, dist_sq);
+        }
+    }
+  }
 
   template<typename Func>
   void for_each(const Position& pos, char alt, double radius, const Func& func, int k=1) {
     if (radius <= 0)
       return;
-    for_each_cell(pos, [&](std::vector<Mark>& marks, const Fractional& fr) {
+    const double radius_sq = sq(radius);
+    for_each_cell_range(pos, [&](size_t begin, size_t end, const Fractional& fr) {
         Position p = use_pbc ? grid.unit_cell.orthogonalize(fr) : pos;
-        for (Mark& m : marks) {
-          double dist_sq = m.pos.dist_sq(p);
-          if (dist_sq < sq(radius) && is_same_conformer(alt, m.altloc))
+        for_each_mark_within(begin, end, p, radius_sq, [&](Mark& m, double dist_sq) {
+          if (is_same_conformer(alt, m.altloc))
             func(m, dist_sq);
-        }
+        });
     }, k);
   }
 
@@ -134,19 +224,31 @@ struct NeighborSearch {
     return find_atoms(pos, '\0', min_dist, max_dist);
   }
 
+  // Results of find_atoms_batch() in a compressed (CSR-like) layout:
+  // atoms found for the i-th position are marks[offsets[i]:offsets[i+1]].
+  struct BatchResult {
+    std::vector<size_t> offsets;
+    std::vector<Mark*> marks;
+    std::vector<double> dist_sq;
+
+    size_t size() const { return offsets.empty() ? 0 : offsets.size() - 1; }
+    size_t count(size_t i) const { return offsets.at(i+1) - offsets[i]; }
+  };
+
+  // find_atoms() for many positions, run on num_threads threads (0 = all).
+  BatchResult find_atoms_batch(const std::vector<Position>& positions, char alt,
+                               double min_dist, double radius, int num_threads=1);
+
   std::pair<Mark*, double>
   find_nearest_atom_within_k(const Position& pos, int k, double radius) {
     Mark* mark = nullptr;
     double nearest_dist_sq = radius * radius;
-    for_each_cell(pos, [&](std::vector<Mark>& marks, const Fractional& fr) {
+    for_each_cell_range(pos, [&](size_t begin, size_t end, const Fractional& fr) {
         Position p = use_pbc ? grid.unit_cell.orthogonalize(fr) : pos;
-        for (Mark& m : marks) {
-          double dist_sq = m.pos.dist_sq(p);
-          if (dist_sq < nearest_dist_sq) {
-            mark = &m;
-            nearest_dist_sq = dist_sq;
-          }
-        }
+        for_each_mark_within(begin, end, p, nearest_dist_sq, [&](Mark& m, double dist_sq) {
+          mark = &m;
+          nearest_dist_sq = dist_sq;
+        });
     }, k);
     return {mark, nearest_dist_sq};
   }
@@ -237,9 +339,49 @@ private:
   }
 };
 
-inline NeighborSearch& NeighborSearch::populate(bool include_h_) {
+inline NeighborSearch& NeighborSearch::populate(bool include_h_, int num_threads) {
   include_h = include_h_;
-  if (model) {
+  num_threads = get_num_threads(num_threads);
+  if (model && num_threads > 1) {
+    struct AtomRef { const Atom* atom; int n_ch, n_res, n_atom; };
+    std::vector<AtomRef> refs;
+    for (int n_ch = 0; n_ch != (int) model->chains.size(); ++n_ch) {
+      const Chain& chain = model->chains[n_ch];
+      for (int n_res = 0; n_res != (int) chain.residues.size(); ++n_res) {
+        const Residue& res = chain.residues[n_res];
+        for (int n_atom = 0; n_atom != (int) res.atoms.size(); ++n_atom)
+          if (include_h || !res.atoms[n_atom].is_hydrogen())
+            refs.push_back({&res.atoms[n_atom], n_ch, n_res, n_atom});
+      }
+    }
+    // Marks are computed in parallel into per-thread bins that are then
+    // appended to cells in thread order, preserving the serial order.
+    using Bin = std::vector<std::pair<size_t, Mark>>;
+    std::vector<Bin> bins(num_threads);
+    parallel_for_chunks(refs.size(), num_threads,
+                        [&](size_t begin, size_t end, int i) {
+      Bin& bin = bins[i];
+      bin.reserve((end - begin) * (grid.unit_cell.images.size() + 1));
+      for (size_t n = begin; n != end; ++n) {
+        const AtomRef& r = refs[n];
+        for_each_atom_image(*r.atom, r.n_ch, r.n_res, r.n_atom,
+                            [&](size_t idx, Mark&& mark) {
+          bin.emplace_back(idx, std::move(mark));
+        });
+      }
+    });
+    std::vector<size_t> counts(grid.data.size(), 0);
+    for (const Bin& bin : bins)
+      for (const auto& item : bin)
+        ++counts[item.first];
+    for (size_t idx = 0; idx != counts.size(); ++idx)
+      grid.data[idx].reserve(grid.data[idx].size() + counts[idx]);
+    for (Bin& bin : bins) {
+      for (const auto& item : bin)
+        grid.data[item.first].push_back(item.second);
+      Bin().swap(bin);
+    }
+  } else if (model) {
     for (int n_ch = 0; n_ch != (int) model->chains.size(); ++n_ch)
       add_chain_n(model->chains[n_ch], n_ch);
   } else if (small_structure) {
@@ -278,25 +420,33 @@ inline void NeighborSearch::add_chain_n(const Chain& chain, int n_ch) {
   }
 }
 
-inline void NeighborSearch::add_atom(const Atom& atom,
-                                     int n_ch, int n_res, int n_atom) {
+template<typename Func>
+void NeighborSearch::for_each_atom_image(const Atom& atom, int n_ch, int n_res,
+                                         int n_atom, const Func& func) const {
   const UnitCell& gcell = grid.unit_cell;
   Fractional frac0 = gcell.fractionalize(atom.pos);
   {
     Fractional frac = frac0.wrap_to_unit();
     // for non-crystals, frac==frac0 => pos = atom.pos
     Position pos = use_pbc ? gcell.orthogonalize(frac) : atom.pos;
-    get_subcell(frac).emplace_back(pos, atom.altloc, atom.element.elem,
-                                   0, n_ch, n_res, n_atom);
+    func(get_subcell_index(frac),
+         Mark(pos, atom.altloc, atom.element.elem, 0, n_ch, n_res, n_atom));
   }
   for (int n_im = 0; n_im != (int) gcell.images.size(); ++n_im) {
     Fractional frac = gcell.images[n_im].apply(frac0).wrap_to_unit();
     Position pos = gcell.orthogonalize(frac);
-    get_subcell(frac).emplace_back(pos, atom.altloc, atom.element.elem,
-                                   short(n_im + 1), n_ch, n_res, n_atom);
+    func(get_subcell_index(frac),
+         Mark(pos, atom.altloc, atom.element.elem, short(n_im + 1), n_ch, n_res, n_atom));
   }
 }
 
+inline void NeighborSearch::add_atom(const Atom& atom,
+                                     int n_ch, int n_res, int n_atom) {
+  for_each_atom_image(atom, n_ch, n_res, n_atom, [&](size_t idx, Mark&& mark) {
+    grid.data[idx].push_back(mark);
+  });
+}
+
 // We exclude special position images of atoms here, but not in add_atom.
 // This choice is somewhat arbitrary, but it also reflects the fact that
 // in MX files occupances of atoms on special positions are (almost always)
@@ -325,8 +475,76 @@ inline void NeighborSearch::add_site(const SmallStructure::Site& site, int n) {
   }
 }
 
+inline NeighborSearch::BatchResult
+NeighborSearch::find_atoms_batch(const std::vector<Position>& positions, char alt,
+                                 double min_dist, double radius, int num_threads) {
+  int k = sufficient_k(radius);
+  if (radius == 0)
+    radius = radius_specified;
+  num_threads = get_num_threads(num_threads);
+  if ((size_t) num_threads > positions.size())
+    num_threads = std::max((int) positions.size(), 1);
+  std::vector<BatchResult> parts(num_threads);
+  parallel_for_chunks(positions.size(), num_threads,
+                      [&](size_t begin, size_t end, int i) {
+    BatchResult& part = parts[i];
+    part.offsets.reserve(end - begin + 1);
+    for (size_t n = begin; n != end; ++n) {
+      part.offsets.push_back(part.marks.size());
+      for_each(positions[n], alt, radius, [&](Mark& a, double dist_sq) {
+          if (dist_sq >= sq(min_dist)) {
+            part.marks.push_back(&a);
+            part.dist_sq.push_back(dist_sq);
+          }
+      }, k);
+    }
+  });
+  BatchResult result;
+  size_t total = 0;
+  for (const BatchResult& part : parts)
+    total += part.marks.size();
+  result.offsets.reserve(positions.size() + 1);
+  result.marks.reserve(total);
+  result.dist_sq.reserve(total);
+  for (const BatchResult& part : parts) {
+    size_t shift = result.marks.size();
+    for (size_t offset : part.offsets)
+      result.offsets.push_back(offset + shift);
+    result.marks.insert(result.marks.end(), part.marks.begin(), part.marks.end());
+    result.dist_sq.insert(result.dist_sq.end(), part.dist_sq.begin(), part.dist_sq.end());
+  }
+  result.offsets.push_back(result.marks.size());
+  return result;
+}
+
+inline NeighborSearch& NeighborSearch::compact() {
+  if (is_compact())
+    return *this;
+  size_t total = 0;
+  for (const std::vector<Mark>& marks : grid.data)
+    total += marks.size();
+  flat_marks.reserve(total);
+  cell_offsets.reserve(grid.data.size() + 1);
+  for (std::vector<Mark>& marks : grid.data) {
+    cell_offsets.push_back(flat_marks.size());
+    flat_marks.insert(flat_marks.end(), marks.begin(), marks.end());
+    std::vector<Mark>().swap(marks);
+  }
+  cell_offsets.push_back(flat_marks.size());
+  flat_x.resize(total);
+  flat_y.resize(total);
+  flat_z.resize(total);
+  for (size_t i = 0; i != total; ++i) {
+    flat_x[i] = flat_marks[i].pos.x;
+    flat_y[i] = flat_marks[i].pos.y;
+    flat_z[i] = flat_marks[i].pos.z;
+  }
+  return *this;
+}
+
 template<typename Func>
-void NeighborSearch::for_each_cell(const Position& pos, const Func& func, int k) {
+void NeighborSearch::for_each_cell_range(const Position& pos, const Func& func,
+                                         int k) const {
   Fractional fr = grid.unit_cell.fractionalize(pos);
   if (use_pbc)
     fr = fr.wrap_to_unit();
@@ -349,10 +567,13 @@ void NeighborSearch::for_each_cell(const Position& pos, const Func& func, int k)
       for (int v = v0; v < vend; ++v) {
         int dv = shift(v, grid.nv);
         size_t idx0 = grid.index_q(0, v - dv * grid.nv, w - dw * grid.nw);
-        for (int u = u0; u < uend; ++u) {
+        // split the row into ranges that have the same shift du
+        for (int u = u0; u < uend; ) {
           int du = shift(u, grid.nu);
+          int u_next = std::min(uend, (du + 1) * grid.nu);
           size_t idx = idx0 + (u - du * grid.nu);
-          func(grid.data[idx], Fractional(fr.x - du, fr.y - dv, fr.z - dw));
+          func(idx, idx + (u_next - u), Fractional(fr.x - du, fr.y - dv, fr.z - dw));
+          u = u_next;
         }
       }
     }
@@ -363,12 +584,13 @@ void NeighborSearch::for_each_cell(const Position& pos, const Func& func, int k)
     uend = std::min(uend, grid.nu);
     vend = std::min(vend, grid.nv);
     wend = std::min(wend, grid.nw);
+    if (u0 >= uend)
+      return;
     for (int w = w0; w < wend; ++w)
-      for (int v = v0; v < vend; ++v)
-        for (int u = u0; u < uend; ++u) {
-          size_t idx = grid.index_q(u, v, w);
-          func(grid.data[idx], fr);
-        }
+      for (int v = v0; v < vend; ++v) {
+        size_t idx = grid.index_q(u0, v, w);
+        func(idx, idx + (uend - u0), fr);
+      }
   }
 }
 
@@ -0,0 +1,59 @@
+// Copyright Global Phasing Ltd.
+//
+// Minimal helpers for running loops on multiple threads (std::thread).
+
+#ifndef GEMMI_PARALLEL_HPP_
+#define GEMMI_PARALLEL_HPP_
+
+#include <cstddef>    // for size_t
+#include <exception>  // for exception_ptr
+#include <thread>
+#include <vector>
+
+namespace gemmi {
+
+/// Returns n if it's positive, otherwise the number of hardware threads.
+inline int get_num_threads(int n) {
+  if (n > 0)
+    return n;
+  unsigned hc = std::thread::hardware_concurrency();
+  return hc != 0 ? (int) hc : 1;
+}
+
+/// Splits [0, size) into n_threads contiguous, nearly equal chunks
+/// and calls func(begin, end, thread_index) for each chunk.
+/// The calling thread processes the first chunk.
+/// If any call throws, the first exception (in chunk order) is re-thrown
+/// after all the threads have finished.
+template<typename Func>
+void parallel_for_chunks(size_t size, int n_threads, Func&& func) {
+  if ((size_t) n_threads > size)
+    n_threads = (int) size;
+  if (n_threads <= 1) {
+    func(size_t(0), size, 0);
+    return;
+  }
+  std::vector<std::exception_ptr> errors(n_threads);
+  auto run = [&](int i) {
+    size_t begin = size * i / n_threads;
+    size_t end = size * (i + 1) / n_threads;
+    try {
+      func(begin, end, i);
+    } catch (...) {
+      errors[i] = std::current_exception();
+    }
+  };
+  std::vector<std::thread> threads;
+  threads.reserve(n_threads - 1);
+  for (int i = 1; i < n_threads; ++i)
+    threads.emplace_back(run, i);
+  run(0);
+  for (std::thread& t : threads)
+    t.join();
+  for (std::exception_ptr& e : errors)
+    if (e)
+      std::rethrow_exception(e);
+}
+
+} // namespace gemmi
+#endif
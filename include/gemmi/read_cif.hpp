@@ -10,11 +10,12 @@
 
 namespace gemmi {
 
-GEMMI_DLL cif::Document read_cif_gz(const std::string& path);
+GEMMI_DLL cif::Document read_cif_gz(const std::string& path, int num_threads=1);
 GEMMI_DLL bool check_cif_syntax_gz(const std::string& path, std::string* msg);
 GEMMI_DLL cif::Document read_mmjson_gz(const std::string& path);
 GEMMI_DLL CharArray read_into_buffer_gz(const std::string& path);
-GEMMI_DLL cif::Document read_cif_from_memory(const char* data, size_t size, const char* name);
+GEMMI_DLL cif::Document read_cif_from_memory(const char* data, size_t size, const char* name,
+                                             int num_threads=1);
 GEMMI_DLL cif::Document read_first_block_gz(const std::string& path, size_t limit);
 
 namespace cif {
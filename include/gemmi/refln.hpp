@@ -10,11 +10,38 @@
 #include "fail.hpp"       // for fail
 #include "mmcif_impl.hpp" // for set_cell_from_mmcif, read_spacegroup_from_block
 #include "numb.hpp"       // for as_number
+#include "parallel.hpp"   // for parallel_for_chunks
 #include "symmetry.hpp"   // for SpaceGroup
 #include "unitcell.hpp"   // for UnitCell
 
 namespace gemmi {
 
+/// Miller indices and selected columns of ReflnBlock converted to numbers,
+/// stored row-wise like Mtz::data: index_h, index_k, index_l and then
+/// the selected columns. Null values ('?' and '.') are stored as NaN.
+struct ReflnNumericData {
+  UnitCell cell;
+  const SpaceGroup* spacegroup = nullptr;
+  std::vector<std::string> labels;  // tags without the category part
+  std::vector<double> data;
+
+  size_t stride() const { return labels.size(); }
+  size_t length() const { return labels.empty() ? 0 : data.size() / labels.size(); }
+
+  int find_column_index(const std::string& label) const {
+    for (int i = 0; i != (int) labels.size(); ++i)
+      if (labels[i] == label)
+        return i;
+    return -1;
+  }
+  size_t get_column_index(const std::string& label) const {
+    int idx = find_column_index(label);
+    if (idx == -1)
+      fail("Column not found: " + label);
+    return idx;
+  }
+};
+
 struct ReflnBlock {
   cif::Block block;
   std::string entry_id;
@@ -137,6 +164,45 @@ struct ReflnBlock {
     return r;
   }
 
+  /// Converts Miller indices and the selected columns (all if labels is empty)
+  /// to numbers, for algorithms that read the data more than once --
+  /// ReflnDataProxy parses the strings on each access.
+  ReflnNumericData make_numeric_data(const std::vector<std::string>& labels={},
+                                     int num_threads=1) const {
+    check_ok();
+    auto hkl_idx = get_hkl_column_indices();
+    ReflnNumericData r;
+    r.cell = cell;
+    r.spacegroup = spacegroup;
+    r.labels = {"index_h", "index_k", "index_l"};
+    std::vector<size_t> cols;
+    if (labels.empty()) {
+      for (const std::string& label : column_labels())
+        if (label != "index_h" && label != "index_k" && label != "index_l")
+          r.labels.push_back(label);
+    } else {
+      r.labels.insert(r.labels.end(), labels.begin(), labels.end());
+    }
+    for (size_t i = 3; i < r.labels.size(); ++i)
+      cols.push_back(get_column_index(r.labels[i]));
+    const size_t stride = r.labels.size();
+    const size_t width = default_loop->width();
+    const std::vector<std::string>& values = default_loop->values;
+    r.data.resize(default_loop->length() * stride);
+    parallel_for_chunks(default_loop->length(), get_num_threads(num_threads),
+                        [&](size_t begin, size_t end, int) {
+      for (size_t j = begin; j < end; ++j) {
+        const std::string* row = &values[j * width];
+        double* out = &r.data[j * stride];
+        for (int i = 0; i != 3; ++i)
+          out[i] = cif::as_int(row[hkl_idx[i]]);
+        for (size_t i = 0; i != cols.size(); ++i)
+          out[3 + i] = cif::as_number(row[cols[i]]);
+      }
+    });
+    return r;
+  }
+
   std::vector<double> make_d_vector() const {
     std::vector<double> vec = make_1_d2_vector();
     for (double& d : vec)
@@ -242,5 +308,24 @@ private:
 
 inline ReflnDataProxy data_proxy(const ReflnBlock& rb) { return ReflnDataProxy(rb); }
 
+// Reads ReflnNumericData, cf. MtzExternalDataProxy.
+struct ReflnNumericDataProxy {
+  const ReflnNumericData& d_;
+  size_t stride() const { return d_.stride(); }
+  size_t size() const { return d_.data.size(); }
+  using num_type = double;
+  double get_num(size_t n) const { return d_.data[n]; }
+  const UnitCell& unit_cell() const { return d_.cell; }
+  const SpaceGroup* spacegroup() const { return d_.spacegroup; }
+  Miller get_hkl(size_t offset) const {
+    return {{(int) d_.data[offset + 0],
+             (int) d_.data[offset + 1],
+             (int) d_.data[offset + 2]}};
+  }
+  size_t column_index(const std::string& label) const { return d_.get_column_index(label); }
+};
+
+inline ReflnNumericDataProxy data_proxy(const ReflnNumericData& d) { return {d}; }
+
 } // namespace gemmi
 #endif
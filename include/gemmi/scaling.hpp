@@ -7,6 +7,7 @@
 
 #include "asudata.hpp"
 #include "levmar.hpp"
+#include "parallel.hpp"  // for parallel_for_chunks
 #if WITH_NLOPT
 # include <nlopt.h>
 #endif
@@ -94,6 +95,23 @@ struct Scaling {
   double k_sol = 0.35;
   double b_sol = 46.0;
   std::vector<Point> points;
+  // used in fit_parameters(); results can differ in the last digits
+  // depending on the number of threads
+  int num_threads = 1;
+
+  // Copy of points as separate arrays (for vectorization), with cached
+  // exponential factors that depend only on b_star and b_sol.
+  // Updated in compute_wssr() and compute_lm_matrices().
+  struct PointArrays {
+    std::vector<double> hh, kk, ll, hk, hl, kl;  // products of h, k, l
+    std::vector<double> stol2, fc_re, fc_im, fm_re, fm_im, fobs, weight;
+    // for each row of constraint_matrix: -d(ln kaniso)/d(parameter)
+    std::vector<std::vector<double>> aniso_der;
+    std::vector<double> kaniso;  // exp(-0.25 * b_star.r_u_r(hkl))
+    std::vector<double> solv_b;  // exp(-b_sol * stol2)
+    SMat33<double> kaniso_b_star{NAN, NAN, NAN, NAN, NAN, NAN};
+    double solv_b_sol = NAN;
+  } arrays;
 
   Scaling(const UnitCell& cell_, const SpaceGroup* sg)
       : cell(cell_), constraint_matrix(adp_symmetry_constraints(sg)) {}
@@ -298,10 +316,143 @@ struct Scaling {
   }
 
   double fit_parameters() {
+    copy_points_to_arrays();
     LevMar levmar;
     return levmar.fit(*this);
   }
 
+  void copy_points_to_arrays() {
+    PointArrays& a = arrays;
+    size_t n = points.size();
+    for (auto v : {&a.hh, &a.kk, &a.ll, &a.hk, &a.hl, &a.kl, &a.stol2,
+                   &a.fc_re, &a.fc_im, &a.fm_re, &a.fm_im, &a.fobs, &a.weight,
+                   &a.kaniso, &a.solv_b})
+      v->resize(n);
+    a.aniso_der.resize(constraint_matrix.size());
+    for (std::vector<double>& v : a.aniso_der)
+      v.resize(n);
+    for (size_t i = 0; i != n; ++i) {
+      const Point& p = points[i];
+      Vec3 h(p.hkl);
+      a.hh[i] = h.x * h.x;
+      a.kk[i] = h.y * h.y;
+      a.ll[i] = h.z * h.z;
+      a.hk[i] = h.x * h.y;
+      a.hl[i] = h.x * h.z;
+      a.kl[i] = h.y * h.z;
+      a.stol2[i] = p.stol2;
+      a.fc_re[i] = p.fcmol.real();
+      a.fc_im[i] = p.fcmol.imag();
+      a.fm_re[i] = p.fmask.real();
+      a.fm_im[i] = p.fmask.imag();
+      a.fobs[i] = p.get_y();
+      a.weight[i] = p.get_weight();
+      for (size_t j = 0; j != constraint_matrix.size(); ++j) {
+        const Vec6& c = constraint_matrix[j];
+        a.aniso_der[j][i] = 0.25 * (c[0] * a.hh[i] + c[1] * a.kk[i] + c[2] * a.ll[i])
+                          + 0.5 * (c[3] * a.hk[i] + c[4] * a.hl[i] + c[5] * a.kl[i]);
+      }
+    }
+    a.kaniso_b_star = {NAN, NAN, NAN, NAN, NAN, NAN};
+    a.solv_b_sol = NAN;
+  }
+
+  /// Recalculates exponential factors if b_star or b_sol changed.
+  void update_cached_factors() {
+    PointArrays& a = arrays;
+    if (a.fobs.size() != points.size())
+      copy_points_to_arrays();
+    const SMat33<double>& b = b_star;
+    const SMat33<double>& cb = a.kaniso_b_star;
+    bool kaniso_ok = b.u11 == cb.u11 && b.u22 == cb.u22 && b.u33 == cb.u33 &&
+                     b.u12 == cb.u12 && b.u13 == cb.u13 && b.u23 == cb.u23;
+    bool solv_ok = !use_solvent || b_sol == a.solv_b_sol;
+    if (kaniso_ok && solv_ok)
+      return;
+    parallel_for_chunks(points.size(), get_num_threads(num_threads),
+                        [&](size_t begin, size_t end, int) {
+      if (!kaniso_ok)
+        for (size_t i = begin; i != end; ++i)
+          a.kaniso[i] = std::exp(-0.25 * (a.hh[i] * b.u11 + a.kk[i] * b.u22 + a.ll[i] * b.u33 +
+                                          2 * (a.hk[i] * b.u12 + a.hl[i] * b.u13 + a.kl[i] * b.u23)));
+      if (!solv_ok)
+        for (size_t i = begin; i != end; ++i)
+          a.solv_b[i] = std::exp(-b_sol * a.stol2[i]);
+    });
+    a.kaniso_b_star = b;
+    if (use_solvent)
+      a.solv_b_sol = b_sol;
+  }
+
+  /// Fast equivalent of gemmi::compute_wssr(*this) from levmar.hpp.
+  double compute_wssr() {
+    update_cached_factors();
+    int n_threads = get_num_threads(num_threads);
+    std::vector<long double> sums(n_threads, 0.);
+    parallel_for_chunks(points.size(), n_threads, [&](size_t begin, size_t end, int n) {
+      double dy[block_size];
+      for (size_t start = begin; start < end; start += block_size) {
+        size_t m = std::min(block_size, end - start);
+        calculate_residuals(start, m, dy, nullptr);
+        for (size_t i = 0; i != m; ++i)
+          sums[n] += sq(dy[i]);
+      }
+    });
+    long double wssr = 0;
+    for (long double sum : sums)
+      wssr += sum;
+    return (double) wssr;
+  }
+
+  /// Fast equivalent of gemmi::compute_lm_matrices(*this, alpha, beta).
+  double compute_lm_matrices(std::vector<double>& alpha, std::vector<double>& beta) {
+    update_cached_factors();
+    size_t na = beta.size();
+    assert(alpha.size() == na * na);
+    struct Sums {
+      std::vector<double> alpha, beta;
+      long double wssr = 0;
+    };
+    int n_threads = get_num_threads(num_threads);
+    std::vector<Sums> sums(n_threads);
+    parallel_for_chunks(points.size(), n_threads, [&](size_t begin, size_t end, int n) {
+      Sums& sum = sums[n];
+      sum.alpha.resize(na * na, 0.);
+      sum.beta.resize(na, 0.);
+      double dy[block_size];
+      std::vector<double> dy_da(na * block_size);
+      for (size_t start = begin; start < end; start += block_size) {
+        size_t m = std::min(block_size, end - start);
+        calculate_residuals(start, m, dy, dy_da.data());
+        for (size_t j = 0; j != na; ++j) {
+          const double* dj = &dy_da[j * block_size];
+          for (size_t k = 0; k <= j; ++k)
+            sum.alpha[na * j + k] += dot_product(dj, &dy_da[k * block_size], m);
+          sum.beta[j] += dot_product(dy, dj, m);
+        }
+        for (size_t i = 0; i != m; ++i)
+          sum.wssr += sq(dy[i]);
+      }
+    });
+    std::fill(alpha.begin(), alpha.end(), 0.0);
+    std::fill(beta.begin(), beta.end(), 0.0);
+    long double wssr = 0;
+    for (const Sums& sum : sums) {
+      if (sum.beta.empty())
+        continue;
+      for (size_t i = 0; i != alpha.size(); ++i)
+        alpha[i] += sum.alpha[i];
+      for (size_t i = 0; i != na; ++i)
+        beta[i] += sum.beta[i];
+      wssr += sum.wssr;
+    }
+    // Only half of the alpha matrix was filled above. Fill the rest.
+    for (size_t j = 1; j < na; j++)
+      for (size_t k = 0; k < j; k++)
+        alpha[na * k + j] = alpha[na * j + k];
+    return (double) wssr;
+  }
+
   double calculate_r_factor() const {
     double abs_diff_sum = 0;
     double denom = 0;
@@ -317,6 +468,72 @@ struct Scaling {
     return std::abs(get_fcalc(p)) * (Real) get_overall_scale_factor(p.hkl);
   }
 
+  // points are processed in blocks in compute_wssr() and compute_lm_matrices()
+  static constexpr size_t block_size = 256;
+
+  static double dot_product(const double* a, const double* b, size_t n) {
+    // independent partial sums can be computed in parallel
+    double s[4] = {0., 0., 0., 0.};
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4)
+      for (int j = 0; j < 4; ++j)
+        s[j] += a[i+j] * b[i+j];
+    for (; i != n; ++i)
+      s[0] += a[i] * b[i];
+    return (s[0] + s[1]) + (s[2] + s[3]);
+  }
+
+  // Calculates weighted residuals dy (weight * (y_obs - y_calc)) for m points
+  // starting from start and, if dy_da is not null, weighted derivatives of
+  // y_calc in dy_da[j * block_size + i] for parameter j and i-th point.
+  // The same formulas as in compute_value_and_derivatives().
+  void calculate_residuals(size_t start, size_t m, double* dy, double* dy_da) const {
+    const PointArrays& a = arrays;
+    double fe[block_size];  // |Fcalc| * kaniso
+    double dy_dsol[block_size];
+    if (use_solvent) {
+      for (size_t i = 0; i != m; ++i) {
+        size_t n = start + i;
+        double solv_scale = k_sol * a.solv_b[n];
+        double re = a.fc_re[n] + solv_scale * a.fm_re[n];
+        double im = a.fc_im[n] + solv_scale * a.fm_im[n];
+        double fcalc_abs = std::sqrt(re * re + im * im);
+        fe[i] = fcalc_abs * a.kaniso[n];
+        dy_dsol[i] = (re * a.fm_re[n] + im * a.fm_im[n]) / fcalc_abs
+                     * k_overall * a.kaniso[n] * a.weight[n];
+      }
+    } else {
+      for (size_t i = 0; i != m; ++i) {
+        size_t n = start + i;
+        fe[i] = std::sqrt(sq(a.fc_re[n]) + sq(a.fc_im[n])) * a.kaniso[n];
+      }
+    }
+    for (size_t i = 0; i != m; ++i)
+      dy[i] = a.weight[start + i] * (a.fobs[start + i] - k_overall * fe[i]);
+    if (!dy_da)
+      return;
+    double* d = dy_da;
+    for (size_t i = 0; i != m; ++i)
+      d[i] = a.weight[start + i] * fe[i];
+    if (use_solvent) {
+      if (!fix_k_sol) {
+        d += block_size;
+        for (size_t i = 0; i != m; ++i)
+          d[i] = a.solv_b[start + i] * dy_dsol[i];
+      }
+      if (!fix_b_sol) {
+        d += block_size;
+        for (size_t i = 0; i != m; ++i)
+          d[i] = -a.stol2[start + i] * k_sol * a.solv_b[start + i] * dy_dsol[i];
+      }
+    }
+    for (const std::vector<double>& der : a.aniso_der) {
+      d += block_size;
+      for (size_t i = 0; i != m; ++i)
+        d[i] = -k_overall * a.weight[start + i] * fe[i] * der[start + i];
+    }
+  }
+
   double compute_value_and_derivatives(const Point& p, std::vector<double>& dy_da) const {
     Vec3 h(p.hkl);
     double kaniso = std::exp(-0.25 * b_star.r_u_r(h));
@@ -353,6 +570,17 @@ struct Scaling {
   }
 };
 
+// Overloads of functions from levmar.hpp, found by ADL in LevMar::fit().
+template<typename Real>
+double compute_wssr(Scaling<Real>& scaling) {
+  return scaling.compute_wssr();
+}
+template<typename Real>
+double compute_lm_matrices(Scaling<Real>& scaling,
+                           std::vector<double>& alpha, std::vector<double>& beta) {
+  return scaling.compute_lm_matrices(alpha, beta);
+}
+
 // only for testing and evaluation - scaling with NLOpt
 #if WITH_NLOPT
 namespace impl {
@@ -389,6 +617,7 @@ inline const char* nlresult_to_string(nlopt_result r) {
 
 template<typename Real>
 double fit_parameters_with_nlopt(Scaling<Real>& scaling, const char* optimizer) {
+  scaling.copy_points_to_arrays();
   std::vector<double> params = scaling.get_parameters();
   nlopt_opt opt = nlopt_create(nlopt_algorithm_from_string(optimizer), params.size());
   {  // prepare bounds
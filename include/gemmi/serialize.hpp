@@ -1,6 +1,7 @@
 // Copyright Global Phasing Ltd.
 //
-// Binary serialization for Structure (as well as Model, UnitCell, etc).
+// Binary serialization for Structure (as well as Model, UnitCell, etc)
+// and for the content of MonLib (ChemComp, ChemLink, ChemMod, EnerLib).
 //
 // Based on zpp::serializer, include third_party/serializer.h first.
 
@@ -9,6 +10,7 @@
 
 #include "model.hpp"
 #include "cifdoc.hpp"
+#include "monlib.hpp"
 
 #define SERIALIZE(Struct, ...) \
 template <typename Archive> \
@@ -32,6 +34,14 @@ void serialize(Archive& archive, const Struct<T>& o) { archive(__VA_ARGS__); }
 
 namespace gemmi {
 
+/// Version of the layout defined below. It must be incremented
+/// when serialized fields of any type here are added, removed or
+/// reordered (or when such a type changes). Files that store this
+/// layout check it with static_assert and bump their own versions:
+/// binary_structure_version (binstruct.cpp) and monlib_cache_version
+/// (monlib.cpp).
+constexpr int serialize_layout_version = 1;
+
 SERIALIZE_T1(OptionalInt, int, o.value)
 
 //SERIALIZE(Element, o.elem) is ambiguous because of El->Element conversion
@@ -143,6 +153,8 @@ SERIALIZE(Chain, o.name, o.residues)
 
 SERIALIZE(Model, o.num, o.chains)
 
+// Structure is stored in the StructureData section of the binary format,
+// see serialize_layout_version above.
 SERIALIZE(Structure, o.name, o.cell, o.spacegroup_hm, o.models,
           o.ncs, o.entities, o.connections, o.cispeps, o.mod_residues,
           o.helices, o.sheets, o.assemblies, o.conect_map, o.meta,
@@ -150,6 +162,45 @@ SERIALIZE(Structure, o.name, o.cell, o.spacegroup_hm, o.models,
           o.has_origx, o.origx, o.info, o.shortened_ccd_codes,
           o.raw_remarks, o.resolution)
 
+// Types below are stored in the monomer library cache,
+// see serialize_layout_version above.
+SERIALIZE(Restraints::AtomId, o.comp, o.atom)
+
+SERIALIZE(Restraints::Bond, o.id1, o.id2, o.type, o.aromatic,
+          o.value, o.esd, o.value_nucleus, o.esd_nucleus)
+
+SERIALIZE(Restraints::Angle, o.id1, o.id2, o.id3, o.value, o.esd)
+
+SERIALIZE(Restraints::Torsion, o.label, o.id1, o.id2, o.id3, o.id4,
+          o.value, o.esd, o.period)
+
+SERIALIZE(Restraints::Chirality, o.id_ctr, o.id1, o.id2, o.id3, o.sign)
+
+SERIALIZE(Restraints::Plane, o.label, o.ids, o.esd)
+
+SERIALIZE(Restraints, o.bonds, o.angles, o.torsions, o.chirs, o.planes)
+
+SERIALIZE(ChemComp::Atom, o.id, o.old_id, o.el, o.charge, o.chem_type, o.xyz)
+
+SERIALIZE(ChemComp::Aliasing, o.group, o.related)
+
+SERIALIZE(ChemComp, o.name, o.type_or_group, o.group, o.has_coordinates,
+          o.atoms, o.aliases, o.rt)
+
+SERIALIZE(ChemLink::Side, o.comp, o.mod, o.group)
+
+SERIALIZE(ChemLink, o.id, o.name, o.side1, o.side2, o.rt, o.block)
+
+SERIALIZE(ChemMod::AtomMod, o.func, o.old_id, o.new_id, o.el, o.charge, o.chem_type)
+
+SERIALIZE(ChemMod, o.id, o.name, o.comp_id, o.group_id, o.atom_mods, o.rt, o.block)
+
+SERIALIZE(EnerLib::Atom, o.element, o.hb_type, o.vdw_radius, o.vdwh_radius,
+          o.ion_radius, o.valency, o.sp)
+
+SERIALIZE(EnerLib::Bond, o.atom_type_2, o.type, o.length, o.value_esd)
+
+SERIALIZE(EnerLib, o.atoms, o.bonds)
 
 namespace cif {
 
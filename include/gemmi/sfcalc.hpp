@@ -2,18 +2,22 @@
 //
 // Direct calculation of structure factors.
 //
-// It does not use optimizations described in the literature,
+// It does not use most of the optimizations described in the literature,
 // cf. Bourhis et al (2014) https://doi.org/10.1107/S2053273314022207,
 // because direct calculations are not used in MX if performance is important.
+// Only the variant that takes a list of reflections has a vectorizable
+// inner loop and can use multiple threads.
 // For FFT-based calculations see dencalc.hpp + fourier.hpp.
 
 #ifndef GEMMI_SFCALC_HPP_
 #define GEMMI_SFCALC_HPP_
 
 #include <complex>
-#include "addends.hpp" // for Addends
-#include "model.hpp"   // for Structure, ...
-#include "small.hpp"   // for SmallStructure
+#include <cstdint>      // for int32_t
+#include "addends.hpp"  // for Addends
+#include "model.hpp"    // for Structure, ...
+#include "parallel.hpp" // for parallel_for_chunks
+#include "small.hpp"    // for SmallStructure
 
 namespace gemmi {
 
@@ -24,6 +28,27 @@ inline std::complex<double> calculate_sf_part(const Fractional& fpos,
   return std::complex<double>{std::cos(arg), std::sin(arg)};
 }
 
+// sin(2 pi t) and cos(2 pi t) without branches and library calls,
+// so that the compiler can vectorize loops that use it.
+// The absolute error is below 1e-15. |t| must be below 2^31.
+inline void sincos_2pi(double t, double& s, double& c) {
+  t -= (double)(std::int32_t) t;        // t is in (-1, 1)
+  t -= (double)(std::int32_t) (2 * t);  // t is in [-0.5, 0.5]
+  // sin(2 pi t) = sign(t) cos(x) and cos(2 pi t) = sin(x), x in [-pi/2, pi/2]
+  double x = 2 * pi() * (0.25 - std::abs(t));
+  double x2 = x * x;
+  double sin_x = x * (1 + x2 * (-1./6 + x2 * (1./120 + x2 * (-1./5040
+                 + x2 * (1./362880 + x2 * (-1./39916800 + x2 * (1./6227020800
+                 + x2 * (-1./1307674368000 + x2 * (1./355687428096000
+                 + x2 * (-1./121645100408832000))))))))));
+  double cos_x = 1 + x2 * (-1./2 + x2 * (1./24 + x2 * (-1./720 + x2 * (1./40320
+                 + x2 * (-1./3628800 + x2 * (1./479001600 + x2 * (-1./87178291200
+                 + x2 * (1./20922789888000 + x2 * (-1./6402373705728000
+                 + x2 * (1./2432902008176640000))))))))));
+  s = std::copysign(cos_x, t);
+  c = sin_x;
+}
+
 template <typename Table>
 class StructureFactorCalculator {
 public:
@@ -122,6 +147,9 @@ public:
   double mott_bethe_factor() const {
     return -mott_bethe_const() / 4 / stol2_;
   }
+  double mott_bethe_factor(const Miller& hkl) const {
+    return -mott_bethe_const() / 4 / (coef_type) cell_.calculate_stol_sq(hkl);
+  }
 
   // The occupancy is assumed to take into account symmetry,
   // i.e. to be fractional if the atom is on special position.
@@ -134,10 +162,125 @@ public:
     return sf;
   }
 
+  /// Calculates structure factors for many reflections.
+  /// Isotropic atoms are stored in arrays (SoA) and summed in a loop that
+  /// the compiler can vectorize. Reflections are split between threads.
+  std::vector<std::complex<double>>
+  calculate_sf_from_model(const Model& model, const std::vector<Miller>& hkls,
+                          int num_threads=1) {
+    std::vector<std::pair<Fractional, const Atom*>> sites;
+    for (const Chain& chain : model.chains)
+      for (const Residue& res : chain.residues)
+        for (const Atom& site : res.atoms)
+          sites.emplace_back(cell_.fractionalize(site.pos), &site);
+    return calculate_sf_from_sites(sites, hkls, num_threads);
+  }
+
+  std::vector<std::complex<double>>
+  calculate_sf_from_small_structure(const SmallStructure& small_st,
+                                    const std::vector<Miller>& hkls,
+                                    int num_threads=1) {
+    std::vector<std::pair<Fractional, const SmallStructure::Site*>> sites;
+    for (const SmallStructure::Site& site : small_st.sites)
+      sites.emplace_back(site.fract, &site);
+    return calculate_sf_from_sites(sites, hkls, num_threads);
+  }
+
 private:
   const UnitCell& cell_;
   coef_type stol2_;
   std::vector<double> scattering_factors_;
+
+  // isotropic sites in the layout used by calculate_sf_from_sites()
+  struct IsoSites {
+    std::vector<double> x, y, z, occ, b;
+    std::vector<int> type;  // index in types
+    std::vector<std::pair<Element, signed char>> types;
+  };
+
+  static double iso_b(const Atom& atom) { return atom.b_iso; }
+  static double iso_b(const SmallStructure::Site& site) { return u_to_b() * site.u_iso; }
+
+  // sum of w_j exp(2 pi i (h x_j + shift)) over isotropic sites
+  static std::complex<double> sum_iso_sites(const IsoSites& iso, const double* w,
+                                            const Vec3& h, double shift) {
+    constexpr size_t chunk = 64;
+    double re[chunk], im[chunk];
+    std::complex<double> sum = 0.;
+    for (size_t start = 0; start < iso.x.size(); start += chunk) {
+      size_t len = std::min(chunk, iso.x.size() - start);
+      const double* x = &iso.x[start];
+      const double* y = &iso.y[start];
+      const double* z = &iso.z[start];
+      const double* wj = w + start;
+      for (size_t k = 0; k < len; ++k) {
+        double s, c;
+        sincos_2pi(h.x * x[k] + h.y * y[k] + h.z * z[k] + shift, s, c);
+        re[k] = wj[k] * c;
+        im[k] = wj[k] * s;
+      }
+      // separate loop, because the compiler won't vectorize a reduction
+      for (size_t k = 0; k < len; ++k)
+        sum += std::complex<double>(re[k], im[k]);
+    }
+    return sum;
+  }
+
+  template<typename Site>
+  std::vector<std::complex<double>>
+  calculate_sf_from_sites(const std::vector<std::pair<Fractional, const Site*>>& sites,
+                          const std::vector<Miller>& hkls, int num_threads) {
+    IsoSites iso;
+    std::vector<std::pair<Fractional, const Site*>> aniso_sites;
+    // like in get_scattering_factor(), the charge of the first atom is used
+    std::vector<int> type_of_element(addends.size(), -1);
+    for (const auto& fs : sites) {
+      const Site& site = *fs.second;
+      if (site.aniso.nonzero()) {
+        aniso_sites.push_back(fs);
+        continue;
+      }
+      int& type = type_of_element[site.element.ordinal()];
+      if (type == -1) {
+        if (!Table::has(site.element.elem))
+          fail("Missing scattering factor for ", site.element.name());
+        type = (int) iso.types.size();
+        iso.types.emplace_back(site.element, site.charge);
+      }
+      iso.x.push_back(fs.first.x);
+      iso.y.push_back(fs.first.y);
+      iso.z.push_back(fs.first.z);
+      iso.occ.push_back(site.occ);
+      iso.b.push_back(iso_b(site));
+      iso.type.push_back(type);
+    }
+    std::vector<std::complex<double>> result(hkls.size());
+    parallel_for_chunks(hkls.size(), get_num_threads(num_threads),
+                        [&](size_t begin, size_t end, int) {
+      StructureFactorCalculator calc(*this);  // not thread-safe, hence a copy
+      std::vector<double> type_sf(iso.types.size());
+      std::vector<double> weights(iso.x.size());
+      for (size_t n = begin; n != end; ++n) {
+        const Miller& hkl = hkls[n];
+        calc.set_stol2_and_scattering_factors(hkl);
+        std::complex<double> sf = 0.;
+        for (const auto& fs : aniso_sites)
+          sf += calc.calculate_sf_from_atom(fs.first, *fs.second, hkl);
+        for (size_t i = 0; i != iso.types.size(); ++i)
+          type_sf[i] = calc.get_scattering_factor(iso.types[i].first, iso.types[i].second);
+        for (size_t j = 0; j != iso.x.size(); ++j)
+          weights[j] = iso.occ[j] * type_sf[iso.type[j]] * std::exp(-calc.stol2_ * iso.b[j]);
+        Vec3 vhkl(hkl[0], hkl[1], hkl[2]);
+        sf += sum_iso_sites(iso, weights.data(), vhkl, 0.);
+        for (const FTransform& image : cell_.images)
+          sf += sum_iso_sites(iso, weights.data(), image.mat.left_multiply(vhkl),
+                              vhkl.dot(image.vec));
+        result[n] = sf;
+      }
+    });
+    return result;
+  }
+
 public:
   Addends addends;  // usually f' for X-rays
 };
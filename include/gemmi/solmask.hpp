@@ -102,20 +102,101 @@ inline float refmac_radius_for_bulk_solvent(El el) {
 #endif
 }
 
-// mask utilities
-template<typename T>
-void mask_points_in_constant_radius(Grid<T>& mask, const Model& model,
-                                    double radius, T value,
-                                    bool ignore_hydrogen,
-                                    bool ignore_zero_occupancy_atoms) {
+inline double atomic_radius_for_mask(AtomicRadiiSet atomic_radii_set, El elem) {
+  switch (atomic_radii_set) {
+    case AtomicRadiiSet::VanDerWaals: return vdw_radius(elem);
+    case AtomicRadiiSet::Cctbx: return cctbx_vdw_radius(elem);
+    case AtomicRadiiSet::Refmac: return refmac_radius_for_bulk_solvent(elem);
+    case AtomicRadiiSet::Constant: assert(0); break;
+  }
+  return 0.;
+}
+
+/// Calls func(T&) for each grid point within radius from each of spheres
+/// (pairs of position and radius). A point covered by n spheres is passed
+/// n times. With num_threads != 1 the grid is split into slabs along w
+/// and each thread visits points from all spheres that overlap its slab.
+template<typename T, typename Func>
+void use_points_in_spheres(Grid<T>& grid,
+                           const std::vector<std::pair<Position, double>>& spheres,
+                           Func&& func, int num_threads=1) {
+  struct Box { Fractional fctr; int du, dv, dw; };
+  std::vector<Box> boxes(spheres.size());
+  // cf. use_points_around()
+  auto make_box = [&](size_t i) {
+    Box& box = boxes[i];
+    double radius = spheres[i].second;
+    box.fctr = grid.unit_cell.fractionalize(spheres[i].first);
+    box.du = (int) std::ceil(radius / grid.spacing[0]);
+    box.dv = (int) std::ceil(radius / grid.spacing[1]);
+    box.dw = (int) std::ceil(radius / grid.spacing[2]);
+    grid.template check_size_for_points_in_box<true>(box.du, box.dv, box.dw, false);
+  };
+  auto visit = [&](size_t i, int w_begin, int w_end) {
+    const Box& box = boxes[i];
+    grid.template do_use_points_in_box<true>(
+        box.fctr, box.du, box.dv, box.dw,
+        [&](T& ref, double, const Position&, int, int, int) { func(ref); },
+        spheres[i].second, w_begin, w_end);
+  };
+  int n_threads = get_num_threads(num_threads);
+  if (n_threads == 1) {
+    for (size_t i = 0; i != spheres.size(); ++i) {
+      make_box(i);
+      visit(i, 0, INT_MAX);
+    }
+    return;
+  }
+  parallel_for_chunks(spheres.size(), n_threads, [&](size_t begin, size_t end, int) {
+    for (size_t i = begin; i != end; ++i)
+      make_box(i);
+  });
+  const int nw = grid.nw;
+  parallel_for_chunks(nw, n_threads, [&](size_t begin, size_t end, int) {
+    int w_begin = (int) begin;
+    int w_end = (int) end;
+    for (size_t i = 0; i != boxes.size(); ++i) {
+      // cf. DensityCalculator::add_model_density_to_grid()
+      int first = modulo(iround(boxes[i].fctr.z * nw) - boxes[i].dw, nw);
+      int last = first + 2 * boxes[i].dw + 1;  // exclusive, can be > nw
+      if (last - first >= nw || (first < w_end && last > w_begin) || last > nw + w_begin)
+        visit(i, w_begin, w_end);
+    }
+  });
+}
+
+/// Returns (position, radius) of atoms that are to be masked.
+/// Radius is r_probe + constant_r or r_probe + radius from atomic_radii_set.
+inline std::vector<std::pair<Position, double>>
+spheres_for_mask(const Model& model, AtomicRadiiSet atomic_radii_set,
+                 double constant_r, double r_probe,
+                 bool ignore_hydrogen, bool ignore_zero_occupancy_atoms) {
+  std::vector<std::pair<Position, double>> spheres;
   for (const Chain& chain : model.chains)
     for (const Residue& res : chain.residues)
       for (const Atom& atom : res.atoms) {
         if ((ignore_hydrogen && atom.is_hydrogen()) ||
             (ignore_zero_occupancy_atoms && atom.occ <= 0))
           continue;
-        mask.set_points_around(atom.pos, radius, value);
+        double r = atomic_radii_set == AtomicRadiiSet::Constant
+                   ? constant_r
+                   : atomic_radius_for_mask(atomic_radii_set, atom.element.elem);
+        spheres.emplace_back(atom.pos, r + r_probe);
       }
+  return spheres;
+}
+
+// mask utilities
+template<typename T>
+void mask_points_in_constant_radius(Grid<T>& mask, const Model& model,
+                                    double radius, T value,
+                                    bool ignore_hydrogen,
+                                    bool ignore_zero_occupancy_atoms,
+                                    int num_threads=1) {
+  use_points_in_spheres(mask, spheres_for_mask(model, AtomicRadiiSet::Constant,
+                                               radius, 0., ignore_hydrogen,
+                                               ignore_zero_occupancy_atoms),
+                        [&](T& ref) { ref = value; }, num_threads);
 }
 
 template<typename T>
@@ -123,28 +204,238 @@ void mask_points_in_varied_radius(Grid<T>& mask, const Model& model,
                                   AtomicRadiiSet atomic_radii_set,
                                   double r_probe, T value,
                                   bool ignore_hydrogen,
-                                  bool ignore_zero_occupancy_atoms) {
-  for (const Chain& chain : model.chains)
-    for (const Residue& res : chain.residues)
-      for (const Atom& atom : res.atoms) {
-        if ((ignore_hydrogen && atom.is_hydrogen()) ||
-            (ignore_zero_occupancy_atoms && atom.occ <= 0))
-          continue;
-        El elem = atom.element.elem;
-        double r = 0;
-        switch (atomic_radii_set) {
-          case AtomicRadiiSet::VanDerWaals: r = vdw_radius(elem); break;
-          case AtomicRadiiSet::Cctbx: r = cctbx_vdw_radius(elem); break;
-          case AtomicRadiiSet::Refmac: r = refmac_radius_for_bulk_solvent(elem); break;
-          case AtomicRadiiSet::Constant: assert(0); break;
+                                  bool ignore_zero_occupancy_atoms,
+                                  int num_threads=1) {
+  assert(atomic_radii_set != AtomicRadiiSet::Constant);
+  use_points_in_spheres(mask, spheres_for_mask(model, atomic_radii_set,
+                                               0., r_probe, ignore_hydrogen,
+                                               ignore_zero_occupancy_atoms),
+                        [&](T& ref) { ref = value; }, num_threads);
+}
+
+namespace impl {
+// 1D squared distance transform of a sampled function
+// (Felzenszwalb & Huttenlocher, Theory of Computing 8, 415, 2012),
+// with periodic boundary conditions. For each q in [0, n) finds p
+// that minimizes (q-p)^2 + f[p mod n]. Only the nearest periodic images
+// of sites can be the minima, so p in [-n/2-1, n+n/2+1) is checked.
+// f[i] is INFINITY where there is no site.
+struct PeriodicDistanceTransform {
+  static constexpr int none = INT_MIN;
+  std::vector<int> v;      // sites forming the lower envelope
+  std::vector<double> fv;  // f of these sites
+  // boundaries between parabolas, z = z_num / z_den (z_den > 0)
+  std::vector<double> z_num, z_den;
+
+  // Sets offset[q] = q - p, or none if there are no sites.
+  void run(const double* f, int n, int* offset) {
+    const int p_begin = -n / 2 - 1;
+    const int p_end = n + n / 2 + 1;
+    v.resize(p_end - p_begin);
+    fv.resize(p_end - p_begin);
+    z_num.resize(p_end - p_begin + 1);
+    z_den.resize(p_end - p_begin + 1);
+    int k = -1;
+    auto add_site = [&](int p, double fp) {
+      double num = -1., den = 0.;  // -infinity
+      while (k >= 0) {
+        int q = v[k];
+        num = fp - fv[k] + double(p * p - q * q);
+        den = 2 * (p - q);
+        if (num * z_den[k] > z_num[k] * den)
+          break;
+        --k;
+      }
+      ++k;
+      v[k] = p;
+      fv[k] = fp;
+      z_num[k] = num;
+      z_den[k] = den;
+    };
+    for (int p = p_begin; p < 0; ++p)
+      if (f[p + n] != INFINITY)
+        add_site(p, f[p + n]);
+    for (int p = 0; p < n; ++p)
+      if (f[p] != INFINITY)
+        add_site(p, f[p]);
+    for (int p = n; p < p_end; ++p)
+      if (f[p - n] != INFINITY)
+        add_site(p, f[p - n]);
+    if (k < 0) {
+      std::fill(offset, offset + n, none);
+      return;
+    }
+    z_num[k + 1] = 1.;  // +infinity
+    z_den[k + 1] = 0.;
+    for (int q = 0, j = 0; q < n; ++q) {
+      while (z_num[j + 1] < q * z_den[j + 1])
+        ++j;
+      offset[q] = q - v[j];
+    }
+  }
+
+  // The same for f that is 0 for sites: finds the nearest site.
+  static void run_binary(const std::vector<char>& is_site, int* offset) {
+    const int n = (int) is_site.size();
+    int last = none;
+    for (int i = -n; i < n; ++i) {
+      if (is_site[i < 0 ? i + n : i])
+        last = i;
+      if (i >= 0)
+        offset[i] = last == none ? none : i - last;
+    }
+    if (last == none)
+      return;
+    int next = none;
+    for (int i = 2 * n - 1; i >= 0; --i) {
+      if (is_site[i < n ? i : i - n])
+        next = i;
+      if (i < n && next - i < std::abs(offset[i]))
+        offset[i] = i - next;
+    }
+  }
+};
+} // namespace impl
+
+/// Returns true if euclidean_distance_transform() can be used for the grid:
+/// the unit cell must be orthogonal and each grid dimension below 16384
+/// (offsets are stored as 16-bit integers).
+template<typename T>
+bool can_use_distance_transform(const Grid<T>& grid) {
+  return grid.unit_cell.is_orthogonal() &&
+         std::max(std::max(grid.nu, grid.nv), grid.nw) < 16384;
+}
+
+/// Exact Euclidean distance transform with periodic boundary conditions.
+/// Calls func(size_t idx, double dist_sq) for each grid point, where dist_sq
+/// is the squared distance (in A^2) to the nearest point for which
+/// is_site(value) returns true (or INFINITY if there is no such point).
+/// The transform is separable, which requires an orthogonal unit cell.
+/// It takes linear time; the three passes along u, v and w are split
+/// between threads, and in the last pass func is called from many threads.
+/// The distance is calculated from the grid offsets to the nearest site
+/// in the same way as in set_margin_around().
+template<typename T, typename Pred, typename Func>
+void euclidean_distance_transform(const Grid<T>& grid, Pred&& is_site, Func&& func,
+                                  int num_threads=1) {
+  if (!grid.unit_cell.is_orthogonal())
+    fail("distance transform requires orthogonal unit cell");
+  const Mat33& orth = grid.unit_cell.orth.mat;
+  const int nu = grid.nu, nv = grid.nv, nw = grid.nw;
+  if (std::max(std::max(nu, nv), nw) >= 16384)
+    fail("grid too big for distance transform");
+  const int none = impl::PeriodicDistanceTransform::none;
+  const std::int16_t none16 = INT16_MIN;
+  // cost[axis][d + n] - squared distance for offset d along the axis;
+  // offsets to the nearest periodic image of a site are in [-n/2, n/2]
+  std::vector<double> cost[3];
+  const int dims[3] = {nu, nv, nw};
+  for (int axis = 0; axis < 3; ++axis) {
+    int n = dims[axis];
+    cost[axis].resize(2 * n + 1);
+    for (int d = -n; d <= n; ++d)
+      cost[axis][d + n] = sq(orth[axis][axis] * (d * (1.0 / n)));
+  }
+  auto cost_u = [&](int d) { return cost[0][d + nu]; };
+  auto cost_v = [&](int d) { return cost[1][d + nv]; };
+  auto cost_w = [&](int d) { return cost[2][d + nw]; };
+  // site index p = q - offset, in [-n/2-1, 3n/2+1), wrapped to [0, n)
+  auto wrap = [](int p, int n) { return p < 0 ? p + n : p < n ? p : p - n; };
+  // 1D transforms along v and w use distances in units of spacing
+  const double inv_s2[3] = {0., 1. / cost_v(1), 1. / cost_w(1)};
+  // offsets (along u and v) to the nearest site found so far
+  std::vector<std::int16_t> off_u(grid.data.size());
+  std::vector<std::int16_t> off_v(grid.data.size());
+  int n_threads = get_num_threads(num_threads);
+
+  // pass 1: rows along u
+  parallel_for_chunks((size_t) nv * nw, n_threads, [&](size_t begin, size_t end, int) {
+    std::vector<char> sites(nu);
+    std::vector<int> offset(nu);
+    for (size_t row = begin; row != end; ++row) {
+      size_t idx0 = row * nu;
+      for (int u = 0; u < nu; ++u)
+        sites[u] = is_site(grid.data[idx0 + u]);
+      impl::PeriodicDistanceTransform::run_binary(sites, offset.data());
+      for (int u = 0; u < nu; ++u)
+        off_u[idx0 + u] = offset[u] == none ? none16 : (std::int16_t) offset[u];
+    }
+  });
+
+  // Passes 2 and 3 transform columns (along v or w) in blocks of adjacent
+  // columns, to access memory in rows.
+  constexpr int block = 16;
+  const int n_blocks = (nu + block - 1) / block;
+
+  // pass 2: columns along v
+  parallel_for_chunks((size_t) nw * n_blocks, n_threads, [&](size_t begin, size_t end, int) {
+    impl::PeriodicDistanceTransform dt;
+    std::vector<double> f(nv);
+    std::vector<int> offset(block * nv);
+    std::vector<std::int16_t> col(block * nv);
+    for (size_t b = begin; b != end; ++b) {
+      int u0 = int(b % n_blocks) * block;
+      int bsize = std::min(block, nu - u0);
+      size_t idx0 = grid.index_q(u0, 0, int(b / n_blocks));
+      for (int v = 0; v < nv; ++v)
+        for (int i = 0; i < bsize; ++i)
+          col[i * nv + v] = off_u[idx0 + (size_t) v * nu + i];
+      for (int i = 0; i < bsize; ++i) {
+        const std::int16_t* c = &col[i * nv];
+        for (int v = 0; v < nv; ++v)
+          f[v] = c[v] == none16 ? INFINITY : cost_u(c[v]) * inv_s2[1];
+        dt.run(f.data(), nv, &offset[i * nv]);
+      }
+      for (int v = 0; v < nv; ++v)
+        for (int i = 0; i < bsize; ++i) {
+          size_t idx = idx0 + (size_t) v * nu + i;
+          int d = offset[i * nv + v];
+          if (d == none) {
+            off_u[idx] = off_v[idx] = none16;
+          } else {
+            off_u[idx] = col[i * nv + wrap(v - d, nv)];
+            off_v[idx] = (std::int16_t) d;
+          }
         }
-        mask.set_points_around(atom.pos, r + r_probe, value);
+    }
+  });
+
+  // pass 3: columns along w
+  parallel_for_chunks((size_t) nv * n_blocks, n_threads, [&](size_t begin, size_t end, int) {
+    impl::PeriodicDistanceTransform dt;
+    std::vector<double> f(nw);
+    std::vector<int> offset(block * nw);
+    std::vector<double> d2_uv(block * nw);
+    const size_t stride = (size_t) nu * nv;
+    for (size_t b = begin; b != end; ++b) {
+      int u0 = int(b % n_blocks) * block;
+      int bsize = std::min(block, nu - u0);
+      size_t idx0 = grid.index_q(u0, int(b / n_blocks), 0);
+      for (int w = 0; w < nw; ++w)
+        for (int i = 0; i < bsize; ++i) {
+          size_t idx = idx0 + w * stride + i;
+          d2_uv[i * nw + w] = off_u[idx] == none16
+                              ? INFINITY : cost_u(off_u[idx]) + cost_v(off_v[idx]);
+        }
+      for (int i = 0; i < bsize; ++i) {
+        for (int w = 0; w < nw; ++w)
+          f[w] = d2_uv[i * nw + w] * inv_s2[2];
+        dt.run(f.data(), nw, &offset[i * nw]);
       }
+      for (int w = 0; w < nw; ++w)
+        for (int i = 0; i < bsize; ++i) {
+          int d = offset[i * nw + w];
+          double d2 = d == none ? INFINITY : d2_uv[i * nw + wrap(w - d, nw)] + cost_w(d);
+          func(idx0 + w * stride + i, d2);
+        }
+    }
+  });
 }
 
 // All points != value in a distance < r from value are set to margin_value
 template<typename T>
-void set_margin_around(Grid<T>& mask, double r, T value, T margin_value) {
+void set_margin_around(Grid<T>& mask, double r, T value, T margin_value,
+                       int num_threads=1) {
   int du = (int) std::floor(r / mask.spacing[0]);
   int dv = (int) std::floor(r / mask.spacing[1]);
   int dw = (int) std::floor(r / mask.spacing[2]);
@@ -170,39 +461,93 @@ void set_margin_around(Grid<T>& mask, double r, T value, T margin_value) {
             stencil2.push_back(wvu);
         }
       }
-  if (stencil2.empty()) {
-    for (typename Grid<T>::Point p : mask)
-      if (*p.value != value) {
-        for (const auto& wvu : stencil1) {
-          size_t idx = mask.index_near_zero(p.u + wvu[2], p.v + wvu[1], p.w + wvu[0]);
-          if (mask.data[idx] == value) {
-            *p.value = margin_value;
-            break;
-          }
-        }
-      }
-  } else {
-    for (typename Grid<T>::Point p : mask) {
-      if (*p.value == value) {
-        bool found = false;
-        for (const auto& wvu : stencil1) {
-          size_t idx = mask.index_near_zero(p.u + wvu[2], p.v + wvu[1], p.w + wvu[0]);
-          if (mask.data[idx] != value) {
-            mask.data[idx] = margin_value;
-            found = true;
+  int n_threads = get_num_threads(num_threads);
+  // The cost of using stencils grows as r^3, while the distance transform
+  // takes constant time per point. In orthogonal cells both give the same
+  // result: the nearest point == value to a point != value always has
+  // a neighbour != value in stencil1 (one step towards that point).
+  if (stencil1.size() + stencil2.size() > 400 && can_use_distance_transform(mask)) {
+    euclidean_distance_transform(mask, [&](T x) { return x == value; },
+                                 [&](size_t idx, double d2) {
+      if (d2 <= r * r && mask.data[idx] != value)
+        mask.data[idx] = margin_value;
+    }, n_threads);
+    return;
+  }
+  if (n_threads == 1) {
+    if (stencil2.empty()) {
+      for (typename Grid<T>::Point p : mask)
+        if (*p.value != value) {
+          for (const auto& wvu : stencil1) {
+            size_t idx = mask.index_near_zero(p.u + wvu[2], p.v + wvu[1], p.w + wvu[0]);
+            if (mask.data[idx] == value) {
+              *p.value = margin_value;
+              break;
+            }
           }
         }
-        if (found)
-          for (const auto& wvu : stencil2) {
+    } else {
+      for (typename Grid<T>::Point p : mask) {
+        if (*p.value == value) {
+          bool found = false;
+          for (const auto& wvu : stencil1) {
             size_t idx = mask.index_near_zero(p.u + wvu[2], p.v + wvu[1], p.w + wvu[0]);
-            if (mask.data[idx] != value)
+            if (mask.data[idx] != value) {
               mask.data[idx] = margin_value;
+              found = true;
+            }
           }
+          if (found)
+            for (const auto& wvu : stencil2) {
+              size_t idx = mask.index_near_zero(p.u + wvu[2], p.v + wvu[1], p.w + wvu[0]);
+              if (mask.data[idx] != value)
+                mask.data[idx] = margin_value;
+            }
+        }
       }
     }
+    return;
   }
-  //printf("stencil sizes: %zu\n", stencil1.size(), stencil2.size());
-  //printf("margin: %zu\n", std::count(mask.data.begin(), mask.data.end(), margin_value));
+  auto any_neighbour = [&](const std::vector<std::array<int,3>>& stencil,
+                           int u, int v, int w, auto&& pred) {
+    for (const auto& wvu : stencil)
+      if (pred(mask.index_near_zero(u + wvu[2], v + wvu[1], w + wvu[0])))
+        return true;
+    return false;
+  };
+  auto for_slabs = [&](auto&& func) {
+    parallel_for_chunks(mask.nw, n_threads,
+                        [&](size_t begin, size_t end, int) {
+      for (int w = (int) begin; w < (int) end; ++w)
+        for (int v = 0; v < mask.nv; ++v)
+          for (int u = 0; u < mask.nu; ++u)
+            func(u, v, w, mask.index_q(u, v, w));
+    });
+  };
+  // Multi-threaded version. The stencils are symmetric, so instead of
+  // spreading the margin from points == value, each point != value checks
+  // its neighbours, and slabs along w can be processed independently.
+  // Points are first classified:
+  // 0 - point != value, 1 - point == value,
+  // 2 - point == value, with a neighbour != value in stencil1;
+  // only points 2 spread the margin to the distance of stencil2.
+  std::vector<std::uint8_t> kind(mask.data.size());
+  for_slabs([&](int u, int v, int w, size_t idx) {
+    if (mask.data[idx] != value)
+      kind[idx] = 0;
+    else if (stencil2.empty() ||
+             any_neighbour(stencil1, u, v, w,
+                           [&](size_t n) { return mask.data[n] != value; }))
+      kind[idx] = 2;
+    else
+      kind[idx] = 1;
+  });
+  for_slabs([&](int u, int v, int w, size_t idx) {
+    if (kind[idx] == 0 &&
+        (any_neighbour(stencil1, u, v, w, [&](size_t n) { return kind[n] != 0; }) ||
+         any_neighbour(stencil2, u, v, w, [&](size_t n) { return kind[n] == 2; })))
+      mask.data[idx] = margin_value;
+  });
 }
 
 struct SolventMasker {
@@ -214,6 +559,7 @@ struct SolventMasker {
   double island_min_volume;
   double constant_r;
   double requested_spacing = 0.;
+  int num_threads = 1;
 
   SolventMasker(AtomicRadiiSet choice, double constant_r_=0.) {
     set_radii(choice, constant_r_);
@@ -254,19 +600,22 @@ struct SolventMasker {
   template<typename T> void mask_points(Grid<T>& grid, const Model& model) const {
     if (atomic_radii_set == AtomicRadiiSet::Constant)
       mask_points_in_constant_radius(grid, model, constant_r + rprobe, (T)0,
-                                     ignore_hydrogen, ignore_zero_occupancy_atoms);
+                                     ignore_hydrogen, ignore_zero_occupancy_atoms,
+                                     num_threads);
     else
       mask_points_in_varied_radius(grid, model, atomic_radii_set, rprobe, (T)0,
-                                   ignore_hydrogen, ignore_zero_occupancy_atoms);
+                                   ignore_hydrogen, ignore_zero_occupancy_atoms,
+                                   num_threads);
   }
 
   template<typename T> void symmetrize(Grid<T>& grid) const {
-    grid.symmetrize([&](T a, T b) { return a == (T)0 || b == (T)0 ? (T)0 : (T)1; });
+    grid.symmetrize([&](T a, T b) { return a == (T)0 || b == (T)0 ? (T)0 : (T)1; },
+                    num_threads);
   }
 
   template<typename T> void shrink(Grid<T>& grid) const {
     if (rshrink > 0) {
-      set_margin_around(grid, rshrink, (T)1, (T)-1);
+      set_margin_around(grid, rshrink, (T)1, (T)-1, num_threads);
       grid.change_values((T)-1, (T)1);
     }
   }
@@ -308,7 +657,7 @@ struct SolventMasker {
 
   void set_to_zero(Grid<float>& grid, const Model& model) const {
     mask_points(grid, model);
-    grid.symmetrize([&](float a, float b) { return b == 0.f ? 0.f : a; });
+    grid.symmetrize([&](float a, float b) { return b == 0.f ? 0.f : a; }, num_threads);
   }
 
 #if 0
@@ -332,6 +681,95 @@ struct SolventMasker {
 #endif
 };
 
+/// Solvent mask that is updated incrementally when the model changes
+/// (e.g. in consecutive refinement cycles). The number of atoms covering
+/// each grid point is stored between calls, and only regions around atoms
+/// that moved by more than tolerance since they were last marked are updated.
+/// Symmetrization, removal of islands and shrinking are done as usual.
+struct IncrementalSolventMasker {
+  SolventMasker masker;
+  double tolerance = 0.;
+  size_t updated_atoms = 0;  // number of atoms updated in the last call
+
+  IncrementalSolventMasker(AtomicRadiiSet choice, double constant_r_=0.)
+    : masker(choice, constant_r_) {}
+
+  /// Forces recalculation of the whole mask in the next call.
+  void reset() {
+    coverage_.data.clear();
+    spheres_.clear();
+  }
+
+  template<typename T> void put_mask_on_grid(Grid<T>& grid, const Model& model) {
+    assert(!grid.data.empty());
+    std::vector<std::pair<Position, double>> spheres = atom_spheres(model);
+    auto marked = [](const std::pair<Position, double>& s) { return s.second >= 0; };
+    if (coverage_.data.size() != grid.data.size() ||
+        coverage_.nu != grid.nu || coverage_.nv != grid.nv || coverage_.nw != grid.nw ||
+        coverage_.unit_cell != grid.unit_cell ||
+        spheres_.size() != spheres.size()) {
+      coverage_.copy_metadata_from(grid);
+      coverage_.data.assign(grid.data.size(), 0);
+      spheres_ = spheres;
+      spheres.erase(std::remove_if(spheres.begin(), spheres.end(),
+                                   [&](const std::pair<Position, double>& s) {
+                                     return !marked(s);
+                                   }),
+                    spheres.end());
+      updated_atoms = spheres_.size();
+      use_points_in_spheres(coverage_, spheres, [](std::uint16_t& n) { ++n; },
+                            masker.num_threads);
+    } else {
+      std::vector<std::pair<Position, double>> removed, added;
+      updated_atoms = 0;
+      for (size_t i = 0; i != spheres.size(); ++i) {
+        std::pair<Position, double>& old = spheres_[i];
+        const std::pair<Position, double>& cur = spheres[i];
+        if (cur.second != old.second ||
+            cur.first.dist_sq(old.first) > tolerance * tolerance) {
+          if (marked(old))
+            removed.push_back(old);
+          if (marked(cur))
+            added.push_back(cur);
+          old = cur;
+          ++updated_atoms;
+        }
+      }
+      use_points_in_spheres(coverage_, removed, [](std::uint16_t& n) { --n; },
+                            masker.num_threads);
+      use_points_in_spheres(coverage_, added, [](std::uint16_t& n) { ++n; },
+                            masker.num_threads);
+    }
+    for (size_t i = 0; i != grid.data.size(); ++i)
+      grid.data[i] = coverage_.data[i] == 0 ? (T)1 : (T)0;
+    masker.symmetrize(grid);
+    masker.remove_islands(grid);
+    masker.shrink(grid);
+  }
+
+private:
+  Grid<std::uint16_t> coverage_;
+  // position and radius of each atom when it was marked, radius -1 if ignored
+  std::vector<std::pair<Position, double>> spheres_;
+
+  std::vector<std::pair<Position, double>> atom_spheres(const Model& model) const {
+    const SolventMasker& m = masker;
+    std::vector<std::pair<Position, double>> spheres;
+    for (const Chain& chain : model.chains)
+      for (const Residue& res : chain.residues)
+        for (const Atom& atom : res.atoms) {
+          double r = -1;
+          if (!(m.ignore_hydrogen && atom.is_hydrogen()) &&
+              !(m.ignore_zero_occupancy_atoms && atom.occ <= 0))
+            r = m.rprobe + (m.atomic_radii_set == AtomicRadiiSet::Constant
+                            ? m.constant_r
+                            : atomic_radius_for_mask(m.atomic_radii_set, atom.element.elem));
+          spheres.emplace_back(atom.pos, r);
+        }
+    return spheres;
+  }
+};
+
 struct NodeInfo {
   double dist_sq;  // distance from the nearest atom
   bool found = false;  // the mask flag
@@ -416,8 +854,19 @@ void interpolate_grid_of_aligned_model2(Grid<T>& dest, const Grid<T>& src,
 
 // add soft edge to 1/0 mask using raised cosine function
 template<typename T>
-void add_soft_edge_to_mask(Grid<T>& grid, double width) {
+void add_soft_edge_to_mask(Grid<T>& grid, double width, int num_threads=1) {
   const double width2 = width * width;
+  auto soft_edge = [&](double d2) {
+    return T(0.5 + 0.5 * std::cos(pi() * std::sqrt(d2) / width));
+  };
+  if (can_use_distance_transform(grid)) {
+    euclidean_distance_transform(grid, [](T x) { return x > 0.999; },
+                                 [&](size_t idx, double d2) {
+      if (grid.data[idx] < 1e-3 && d2 < width2)
+        grid.data[idx] = soft_edge(d2);
+    }, num_threads);
+    return;
+  }
   const int du = (int) std::ceil(width / grid.spacing[0]);
   const int dv = (int) std::ceil(width / grid.spacing[1]);
   const int dw = (int) std::ceil(width / grid.spacing[2]);
@@ -438,7 +887,7 @@ void add_soft_edge_to_mask(Grid<T>& grid, double width) {
               }
             });
         if (min_d2 < width2)
-          grid.data[idx] = T(0.5 + 0.5 * std::cos(pi() * std::sqrt(min_d2) / width));
+          grid.data[idx] = soft_edge(min_d2);
       }
 }
 
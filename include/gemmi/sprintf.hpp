@@ -1,10 +1,13 @@
 // Copyright 2017 Global Phasing Ltd.
 //
 // interface to stb_sprintf: snprintf_z, to_str(float|double)
+// and faster to_chars_g(float|double) that gives the same output.
 
 #ifndef GEMMI_SPRINTF_HPP_
 #define GEMMI_SPRINTF_HPP_
 
+#include <cmath>    // for fabs, floor
+#include <cstdint>  // for uint64_t
 #include <string>
 #ifdef __has_include
 # if __has_include(<charconv>) && !(defined(_MSVC_LANG) && _MSVC_LANG < 201703L)
@@ -45,6 +48,85 @@ inline std::string to_str(float d) {
   return std::string(buf, len > 0 ? len : 0);
 }
 
+namespace impl {
+// Formats v as printf's %.{P}g would, but only if v is written in
+// fixed-point notation (1e-3 <= |v| < 10^P) and the result does not depend
+// on how the rounding is done. Returns nullptr otherwise.
+// For floats (P=6) v*10^d is exact and ties are rounded away from zero,
+// as in stb_sprintf. For doubles (P=9) v*10^d can be off by ~1e-7
+// and values within tie_margin from a tie are left to stb_sprintf.
+template<int P>
+char* to_chars_g_fixed(char* buf, double v, double tie_margin) {
+  static_assert(P <= 9, "unsupported precision");
+  static const double p10[] = {1e-3, 1e-2, 1e-1, 1e0, 1e1, 1e2, 1e3, 1e4,
+                               1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11};
+  double a = std::fabs(v);
+  if (!(a >= 1e-3 && a < p10[P+3]))
+    return nullptr;
+  int e = -3;  // decimal exponent
+  while (e < P-1 && a >= p10[e+4])
+    ++e;
+  int d = P - 1 - e;  // number of decimal places
+  double y = a * p10[d+3];
+  double fl = std::floor(y);
+  double frac = y - fl;
+  if (tie_margin != 0 && std::fabs(frac - 0.5) <= tie_margin)
+    return nullptr;
+  std::uint64_t r = (std::uint64_t) fl + (frac >= 0.5);
+  std::uint64_t div = 1;  // 10^d
+  for (int i = 0; i < d; ++i)
+    div *= 10;
+  if (r == std::uint64_t(p10[P+3])) {  // rounded up to 10^P
+    if (d == 0)
+      return nullptr;
+    r /= 10;
+    div /= 10;
+    --d;
+  }
+  char* p = buf;
+  if (v < 0)
+    *p++ = '-';
+  std::uint64_t ip = r / div;
+  std::uint64_t fr = r % div;
+  char tmp[16];
+  int n = 0;
+  do {
+    tmp[n++] = char('0' + ip % 10);
+    ip /= 10;
+  } while (ip != 0);
+  while (n != 0)
+    *p++ = tmp[--n];
+  if (fr != 0) {
+    for (; fr % 10 == 0; fr /= 10)
+      --d;
+    *p++ = '.';
+    for (int i = d; i-- != 0; fr /= 10)
+      p[i] = char('0' + fr % 10);
+    p += d;
+  }
+  *p = '\0';
+  return p;
+}
+} // namespace impl
+
+/// Writes the same string as to_str(d) into buf (of size >= 24),
+/// returns pointer to the terminating null.
+inline char* to_chars_g(char* buf, double d) {
+  if (char* end = impl::to_chars_g_fixed<9>(buf, d, 1e-6))
+    return end;
+  int len = sprintf_z(buf, "%.9g", d);
+  return buf + (len > 0 ? len : 0);
+}
+
+/// Writes the same string as to_str(d) into buf (of size >= 16),
+/// returns pointer to the terminating null.
+inline char* to_chars_g(char* buf, float d) {
+  if (char* end = impl::to_chars_g_fixed<6>(buf, d, 0))
+    return end;
+  int len = sprintf_z(buf, "%.6g", d);
+  return buf + (len > 0 ? len : 0);
+}
+
 template<int Prec>
 std::string to_str_prec(double d) {
   static_assert(Prec >= 0 && Prec < 7, "unsupported precision");
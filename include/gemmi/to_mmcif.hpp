@@ -1,12 +1,14 @@
 // Copyright 2017 Global Phasing Ltd.
 //
-// Create cif::Document (for PDBx/mmCIF file) from Structure.
+// Create cif::Document (for PDBx/mmCIF file) from Structure,
+// or write Structure directly as mmCIF.
 
 #ifndef GEMMI_TO_MMCIF_HPP_
 #define GEMMI_TO_MMCIF_HPP_
 
 #include "model.hpp"
 #include "cifdoc.hpp"
+#include "to_cif.hpp"  // for WriteOptions
 
 namespace gemmi {
 
@@ -65,6 +67,16 @@ GEMMI_DLL cif::Block make_mmcif_block(const Structure& st,
 GEMMI_DLL cif::Block make_mmcif_headers(const Structure& st);
 GEMMI_DLL void add_minimal_mmcif_data(const Structure& st, cif::Block& block);
 
+/// Writes the same output as write_cif_to_stream() with
+/// make_mmcif_document(st, groups), but values of _atom_site and
+/// _atom_site_anisotrop are formatted directly from Structure,
+/// without storing them as strings in cif::Document. Atoms can be
+/// formatted on num_threads threads (0 = all cores).
+GEMMI_DLL void write_mmcif(const Structure& st, std::ostream& os,
+                           MmcifOutputGroups groups=MmcifOutputGroups(true),
+                           cif::WriteOptions options=cif::WriteOptions(),
+                           int num_threads=1);
+
 // temporarily we use it in crd.cpp
 GEMMI_DLL void write_ncs_oper(const Structure& st, cif::Block& block);
 GEMMI_DLL void write_struct_conn(const Structure& st, cif::Block& block);
@@ -48,7 +48,9 @@ struct PdbWriteOptions {
 /// record type ATOM/HETATM to use for writing given residue
 GEMMI_DLL bool use_hetatm(const Residue& res);
 
-GEMMI_DLL void write_pdb(const Structure& st, std::ostream& os, PdbWriteOptions opt={});
+/// With num_threads > 1 (0 = all cores), chains are formatted in parallel.
+GEMMI_DLL void write_pdb(const Structure& st, std::ostream& os, PdbWriteOptions opt={},
+                         int num_threads=1);
 GEMMI_DLL std::string make_pdb_string(const Structure& st, PdbWriteOptions opt={});
 
 // deprecated
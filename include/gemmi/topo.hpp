@@ -5,7 +5,6 @@
 #ifndef GEMMI_TOPO_HPP_
 #define GEMMI_TOPO_HPP_
 
-#include <map>           // for multimap
 #include <memory>        // for unique_ptr
 #include <unordered_map> // for unordered_map
 #include "chemcomp.hpp"  // for ChemComp
@@ -196,10 +195,43 @@ struct GEMMI_DLL Topo {
   std::vector<Chirality> chirs;
   std::vector<Plane> planes;
 
-  std::multimap<const Atom*, Bond*> bond_index;       // indexes both atoms
-  std::multimap<const Atom*, Angle*> angle_index;     // only middle atom
-  std::multimap<const Atom*, Torsion*> torsion_index; // two middle atoms
-  std::multimap<const Atom*, Plane*> plane_index;     // all atoms
+  // Adjacency in CSR format: restraints of the atom with dense index i
+  // are items[offsets[i]], ..., items[offsets[i+1]-1].
+  template<typename T>
+  struct RestraintIndex {
+    std::vector<int> offsets;
+    std::vector<T*> items;
+
+    Span<T* const> get(int idx) const {
+      if (idx < 0 || (size_t) idx + 1 >= offsets.size())
+        return {};
+      return {items.data() + offsets[idx], size_t(offsets[idx+1] - offsets[idx])};
+    }
+  };
+
+  // Indices set up in create_indices(), valid until atoms are added or removed.
+  std::unordered_map<const Atom*, int> atom_index;  // dense atom index
+  RestraintIndex<Bond> bond_index;       // indexes both atoms
+  RestraintIndex<Angle> angle_index;     // only middle atom
+  RestraintIndex<Torsion> torsion_index; // two middle atoms
+  RestraintIndex<Plane> plane_index;     // all atoms
+
+  int get_atom_index(const Atom* a) const {
+    auto it = atom_index.find(a);
+    return it != atom_index.end() ? it->second : -1;
+  }
+  Span<Bond* const> bonds_with(const Atom* a) const {
+    return bond_index.get(get_atom_index(a));
+  }
+  Span<Angle* const> angles_with(const Atom* middle) const {
+    return angle_index.get(get_atom_index(middle));
+  }
+  Span<Torsion* const> torsions_with(const Atom* middle) const {
+    return torsion_index.get(get_atom_index(middle));
+  }
+  Span<Plane* const> planes_with(const Atom* a) const {
+    return plane_index.get(get_atom_index(a));
+  }
 
   ResInfo* find_resinfo(const Residue* res) {
     for (ChainInfo& ci : chain_infos)
@@ -217,9 +249,7 @@ struct GEMMI_DLL Topo {
   }
 
   const Restraints::Bond* take_bond(const Atom* a, const Atom* b) const {
-    auto range = bond_index.equal_range(a);
-    for (auto i = range.first; i != range.second; ++i) {
-      const Bond* bond = i->second;
+    for (const Bond* bond : bonds_with(a)) {
       if ((bond->atoms[0] == b && bond->atoms[1] == a) ||
           (bond->atoms[1] == b && bond->atoms[0] == a))
         return bond->restr;
@@ -230,9 +260,7 @@ struct GEMMI_DLL Topo {
   const Restraints::Angle* take_angle(const Atom* a,
                                       const Atom* b,
                                       const Atom* c) const {
-    auto range = angle_index.equal_range(b);
-    for (auto i = range.first; i != range.second; ++i) {
-      const Angle* ang = i->second;
+    for (const Angle* ang : angles_with(b)) {
       if ((ang->atoms[0] == a && ang->atoms[2] == c) ||
           (ang->atoms[0] == c && ang->atoms[2] == a))
         return ang->restr;
@@ -266,7 +294,7 @@ struct GEMMI_DLL Topo {
   // monlib is needed only for links.
   void apply_all_restraints(const MonLib& monlib);
 
-  // prepare bond_index, angle_index, torsion_index, plane_index
+  // prepare atom_index, bond_index, angle_index, torsion_index, plane_index
   void create_indices();
 
   // Searches for matching Link in ResInfo::prev lists.
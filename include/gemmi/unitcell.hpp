@@ -186,6 +186,11 @@ struct UnitCell : UnitCellParameters {
   // that is why we check both.
   bool is_crystal() const { return a != 1.0 && frac.mat[0][0] != 1.0; }
 
+  // true if the orthogonalization matrix is diagonal (all angles are 90deg)
+  bool is_orthogonal() const {
+    return orth.mat[0][1] == 0 && orth.mat[0][2] == 0 && orth.mat[1][2] == 0;
+  }
+
   // compare lengths using relative tolerance rel, angles using tolerance deg
   bool is_similar(const UnitCell& o, double rel, double deg) const {
     auto siml = [&](double x, double y) { return std::fabs(x - y) < rel * std::max(x, y); };
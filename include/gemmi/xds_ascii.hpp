@@ -5,7 +5,7 @@
 #ifndef GEMMI_XDS_ASCII_HPP_
 #define GEMMI_XDS_ASCII_HPP_
 
-#include "input.hpp"     // for AnyStream, FileStream
+#include "input.hpp"     // for AnyStream, BasicInput, read_into_buffer
 #include "unitcell.hpp"  // for UnitCell
 #include "util.hpp"      // for starts_with
 
@@ -90,9 +90,20 @@ struct GEMMI_DLL XdsAscii : XdsAsciiMetadata {
   }
   void read_stream(AnyStream& reader, const std::string& source);
 
+  /// Faster than read_stream(), data lines are parsed on num_threads
+  /// threads (0 = all cores) directly from memory.
+  void read_memory(const char* data, size_t size, const std::string& source,
+                   int num_threads=1);
+
+  /// With num_threads != 1 the whole file is first read into memory.
   template<typename T>
-  void read_input(T&& input) {
-    read_stream(*input.create_stream(), input.path());
+  void read_input(T&& input, int num_threads=1) {
+    if (num_threads == 1) {
+      read_stream(*input.create_stream(), input.path());
+    } else {
+      CharArray mem = read_into_buffer(input);
+      read_memory(mem.data(), mem.size(), input.path(), num_threads);
+    }
   }
 
   bool is_merged() const { return read_columns < 8; }
@@ -167,17 +178,21 @@ struct GEMMI_DLL XdsAscii : XdsAsciiMetadata {
     double minz = batchmin - 1;
     vector_remove_if(data, [&](Refl& r) { return r.zd < minz; });
   }
+
+private:
+  // implementation of read_stream() and read_memory() (in xds_ascii.cpp)
+  template<typename Reader>
+  void read_lines(Reader& reader, const std::string& source, int num_threads);
 };
 
-inline XdsAscii read_xds_ascii_file(const std::string& path) {
+inline XdsAscii read_xds_ascii_file(const std::string& path, int num_threads=1) {
   XdsAscii ret;
-  FileStream stream(path.c_str(), "rb");
-  ret.read_stream(stream, path);
+  ret.read_input(BasicInput(path), num_threads);
   return ret;
 }
 
 /// read possibly gzipped file
-GEMMI_DLL XdsAscii read_xds_ascii(const std::string& path);
+GEMMI_DLL XdsAscii read_xds_ascii(const std::string& path, int num_threads=1);
 
 } // namespace gemmi
 #endif
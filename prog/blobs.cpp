@@ -68,6 +68,7 @@ const option::Descriptor Usage[] = {
   MapUsage[Sample],
   MapUsage[GridQuery],
   MapUsage[TimingFft],
+  MapUsage[FftThreads],
 
   { Dimple, 0, "", "dimple", Arg::None, nullptr }, // output for Dimple
   { 0, 0, 0, 0, 0, 0 }
@@ -104,7 +105,7 @@ int run(OptParser& p) {
 
   // read map (includes FFT)
   FILE* verbose_output = p.options[Verbose] ? stdout : nullptr;
-  gemmi::Grid<float> grid = read_sf_and_fft_to_map(sf_path.c_str(), p.options,
+  gemmi::Grid<float> grid = read_sf_and_fft_to_map(sf_path.c_str(), p,
                                                    verbose_output, true);
   if (p.options[Verbose])
     printf("Unit cell: %g A^3, grid points: %zu, volume/point: %g A^3.\n",
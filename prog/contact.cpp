@@ -10,6 +10,7 @@
 #include "gemmi/assembly.hpp"  // for transform_to_assembly
 #include <gemmi/mmread_gz.hpp> // for read_structure_gz
 #include <gemmi/sprintf.hpp>   // for snprintf_z
+#include <gemmi/parallel.hpp>  // for parallel_for_chunks
 #define GEMMI_PROG contact
 #include "options.h"
 
@@ -19,7 +20,7 @@ using namespace gemmi;
 using std::printf;
 
 enum OptionIndex { Cov=4, CovMult, MaxDist, Occ, Ignore, NoSym, AsAssembly,
-                   NoH, NoWater, NoLigand, Count, Twice, Sort };
+                   NoH, NoWater, NoLigand, Count, Twice, Sort, Threads };
 
 const option::Descriptor Usage[] = {
   { NoOp, 0, "", "", Arg::None,
@@ -55,6 +56,8 @@ const option::Descriptor Usage[] = {
     "  --twice  \tPrint each atom pair A-B twice (A-B and B-A)." },
   { Sort, 0, "", "sort", Arg::None,
     "  --sort  \tSort output by distance." },
+  { Threads, 0, "j", "threads", Arg::Int,
+    "  -j, --threads=N  \tNumber of threads (default: 1, 0 = all cores)." },
   { 0, 0, 0, 0, 0, 0 }
 };
 
@@ -70,13 +73,45 @@ struct ContactParameters {
   float cov_mult = 1.0f;
   float max_dist = 3.0f;
   float min_occ = 0.0f;
+  int num_threads = 1;
   int verbose;
 };
 
+std::string format_contact(Structure& st, const ContactParameters& params,
+                           const CRA& cra1, const CRA& cra2,
+                           int image_idx, double dist_sq) {
+  std::string sym1, sym2;
+  if (!params.no_symmetry) {
+    NearestImage im = st.cell.find_nearest_pbc_image(cra1.atom->pos,
+                                                     cra2.atom->pos, image_idx);
+    sym1 = "1555";
+    sym2 = im.symmetry_code(false);
+  }
+  std::string conn_info;
+  if (Connection* conn = st.find_connection_by_cra(cra1, cra2))
+    conn_info = conn->name.empty() ? "(link)" : conn->name;
+  char buf[256];
+  snprintf_z(buf, 255, "%-11s %-4s%c%3s%2s%4s%c         "
+                       "      %-4s%c%3s%2s%4s%c  %6s %6s %5.2f\n",
+         conn_info.c_str(),
+         cra1.atom->padded_name().c_str(),
+         cra1.atom->altloc ? std::toupper(cra1.atom->altloc) : ' ',
+         cra1.residue->name.c_str(),
+         cra1.chain->name.c_str(),
+         cra1.residue->seqid.num.str().c_str(), cra1.residue->seqid.icode,
+         cra2.atom->padded_name().c_str(),
+         cra2.atom->altloc ? std::toupper(cra2.atom->altloc) : ' ',
+         cra2.residue->name.c_str(),
+         cra2.chain->name.c_str(),
+         cra2.residue->seqid.num.str().c_str(), cra2.residue->seqid.icode,
+         sym1.c_str(), sym2.c_str(), std::sqrt(dist_sq));
+  return buf;
+}
+
 void print_contacts(Structure& st, const ContactParameters& params) {
   float max_r = params.use_cov_radius ? 4.f + params.cov_tol : params.max_dist;
   NeighborSearch ns(st.first_model(), st.cell, std::max(5.0f, max_r));
-  ns.populate(/*include_h=*/!params.no_hydrogens);
+  ns.populate(/*include_h=*/!params.no_hydrogens, params.num_threads);
 
   if (params.verbose > 0) {
     if (params.verbose > 1) {
@@ -106,6 +141,7 @@ void print_contacts(Structure& st, const ContactParameters& params) {
     printf(" Items per cell: from %zu to %zu, average: %.2g\n",
            min_count, max_count, double(total_count) / ns.grid.data.size());
   }
+  ns.compact();
 
   // the code here is similar to LinkHunt::find_possible_links()
   int counter = 0;
@@ -115,41 +151,40 @@ void print_contacts(Structure& st, const ContactParameters& params) {
   if (params.use_cov_radius)
     contacts.setup_atomic_radii(params.cov_mult, params.cov_tol);
   std::multimap<double, std::string> lines;
-  char buf[256];
-  contacts.for_each_contact(ns, [&](const CRA& cra1, const CRA& cra2,
-                                    int image_idx, double dist_sq) {
-      ++counter;
-      if (params.print_count)
-        return;
-      std::string sym1, sym2;
-      if (!params.no_symmetry) {
-        NearestImage im = st.cell.find_nearest_pbc_image(cra1.atom->pos,
-                                                         cra2.atom->pos, image_idx);
-        sym1 = "1555";
-        sym2 = im.symmetry_code(false);
-      }
-      std::string conn_info;
-      if (Connection* conn = st.find_connection_by_cra(cra1, cra2))
-        conn_info = conn->name.empty() ? "(link)" : conn->name;
-      snprintf_z(buf, 255, "%-11s %-4s%c%3s%2s%4s%c         "
-                           "      %-4s%c%3s%2s%4s%c  %6s %6s %5.2f\n",
-             conn_info.c_str(),
-             cra1.atom->padded_name().c_str(),
-             cra1.atom->altloc ? std::toupper(cra1.atom->altloc) : ' ',
-             cra1.residue->name.c_str(),
-             cra1.chain->name.c_str(),
-             cra1.residue->seqid.num.str().c_str(), cra1.residue->seqid.icode,
-             cra2.atom->padded_name().c_str(),
-             cra2.atom->altloc ? std::toupper(cra2.atom->altloc) : ' ',
-             cra2.residue->name.c_str(),
-             cra2.chain->name.c_str(),
-             cra2.residue->seqid.num.str().c_str(), cra2.residue->seqid.icode,
-             sym1.c_str(), sym2.c_str(), std::sqrt(dist_sq));
-      if (params.sort)
-        lines.emplace(dist_sq, buf);
-      else
-        printf("%s", buf);
-  });
+  if (params.num_threads != 1) {
+    // search and formatting are done on multiple threads, printing is not
+    std::vector<ContactSearch::Result> results =
+      contacts.find_contacts(ns, params.num_threads);
+    counter = (int) results.size();
+    if (!params.print_count) {
+      std::vector<std::string> formatted(results.size());
+      parallel_for_chunks(results.size(), get_num_threads(params.num_threads),
+                          [&](size_t begin, size_t end, int) {
+        for (size_t i = begin; i != end; ++i) {
+          const ContactSearch::Result& r = results[i];
+          formatted[i] = format_contact(st, params, r.partner1, r.partner2,
+                                        r.image_idx, r.dist_sq);
+        }
+      });
+      for (size_t i = 0; i != results.size(); ++i)
+        if (params.sort)
+          lines.emplace(results[i].dist_sq, std::move(formatted[i]));
+        else
+          printf("%s", formatted[i].c_str());
+    }
+  } else {
+    contacts.for_each_contact(ns, [&](const CRA& cra1, const CRA& cra2,
+                                      int image_idx, double dist_sq) {
+        ++counter;
+        if (params.print_count)
+          return;
+        std::string line = format_contact(st, params, cra1, cra2, image_idx, dist_sq);
+        if (params.sort)
+          lines.emplace(dist_sq, std::move(line));
+        else
+          printf("%s", line.c_str());
+    });
+  }
   if (params.sort)
     for (const auto& it : lines)
       printf("%s", it.second.c_str());
@@ -187,6 +222,7 @@ int GEMMI_MAIN(int argc, char **argv) {
   params.no_symmetry = p.options[NoSym];
   params.twice = p.options[Twice];
   params.sort = p.options[Sort];
+  params.num_threads = p.integer_or(Threads, 1);
   try {
     for (int i = 0; i < p.nonOptionsCount(); ++i) {
       std::string input = p.coordinate_input_file(i);
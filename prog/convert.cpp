@@ -7,13 +7,14 @@
 #include "gemmi/align.hpp"     // for assign_label_seq_id
 #include "gemmi/to_pdb.hpp"    // for write_pdb, ...
 #include "gemmi/fstream.hpp"   // for Ofstream, Ifstream
-#include "gemmi/to_mmcif.hpp"  // for update_mmcif_block
+#include "gemmi/to_mmcif.hpp"  // for update_mmcif_block, write_mmcif
 #include "gemmi/assembly.hpp"  // for ChainNameGenerator, transform_to_assembly
 #include "gemmi/pirfasta.hpp"  // for read_pir_or_fasta
 #include "gemmi/mmread_gz.hpp" // for read_structure_gz
 #include "gemmi/select.hpp"    // for Selection
 #include "gemmi/enumstr.hpp"   // for polymer_type_to_string
 #include "gemmi/calculate.hpp" // for parse_triplet_as_ftransform
+#include "gemmi/binstruct.hpp" // for write_binary_structure, read_binary_structure
 
 #include <cstring>
 #include <iostream>
@@ -166,7 +167,8 @@ const option::Descriptor Usage[] = {
   { NoOp, 0, "", "", Arg::None,
     "\nFORMAT can be specified as one of: mmcif, mmjson, pdb. chemcomp (read-only)."
     "\nchemcomp = coordinates of a component from CCD or monomer library (see docs)."
-    "\nWhen output file is -, write to standard output (default format: pdb)." },
+    "\nWhen output file is -, write to standard output (default format: pdb)."
+    "\nFiles with extension .gbs are in gemmi binary format (see docs)." },
   { 0, 0, 0, 0, 0, 0 }
 };
 
@@ -478,11 +480,24 @@ void convert(gemmi::Structure& st,
   if (options[ShortenTLC] || output_type == CoorFormat::Pdb)
     shorten_ccd_codes(st);
 
+  if (gemmi::iends_with(output, ".gbs")) {
+    gemmi::write_binary_structure(st, output);
+    return;
+  }
+
   gemmi::Ofstream os(output, &std::cout);
 
   if (output_type == CoorFormat::Mmcif || output_type == CoorFormat::Mmjson) {
     if (options[BlockName])
       st.name = options[BlockName].arg;
+    if (output_type == CoorFormat::Mmcif && !options[Minimal] &&
+        !options[SkipCat] && !options[SortCif]) {
+      // atoms are formatted directly, without making cif::Document
+      gemmi::MmcifOutputGroups groups(true);
+      groups.auth_all = options[AllAuth];
+      gemmi::write_mmcif(st, os.ref(), groups, cif_write_options(options[CifStyle]));
+      return;
+    }
     cif::Document doc;
     doc.blocks.resize(1);
     if (options[Minimal]) {
@@ -530,6 +545,9 @@ int GEMMI_MAIN(int argc, char **argv) {
   if (out_type == CoorFormat::Unknown) {
     if (output[0] == '-' && output[1] == '\0')
       out_type = CoorFormat::Pdb;
+    else if (gemmi::iends_with(output, ".gbs"))
+      // binary format stores the same data as mmCIF
+      out_type = CoorFormat::Mmcif;
     else
       out_type = gemmi::coor_format_from_ext_gz(output);
   }
@@ -559,6 +577,8 @@ int GEMMI_MAIN(int argc, char **argv) {
           // cf. ChemCompModel
           which = p.options[FormatIn].arg[9] == 'i' ? 4 : 2;
         st = gemmi::read_structure_from_chemcomp_gz(input, nullptr, which);
+      } else if (gemmi::iends_with(input, ".gbs")) {
+        st = gemmi::read_binary_structure(input);
       } else {
         st = gemmi::read_structure_gz(input, in_type);
       }
@@ -19,7 +19,7 @@ namespace {
 
 using gemmi::Mtz;
 
-enum OptionIndex { Base=4, Section, DMin, FType, PhiType, Spacegroup };
+enum OptionIndex { Base=4, Section, DMin, FType, PhiType, Spacegroup, Threads };
 
 const option::Descriptor Usage[] = {
   { NoOp, 0, "", "", Arg::None,
@@ -42,6 +42,8 @@ const option::Descriptor Usage[] = {
     "  --phitype=TYPE  \tMTZ phase column type (default: P)." },
   { Spacegroup, 0, "", "spacegroup", Arg::Required,
     "  --spacegroup=SG  \tOverwrite space group from map header." },
+  { Threads, 0, "j", "threads", Arg::Int,
+    "  -j, --threads=N  \tNumber of threads (default: 1, 0 = all cores)." },
   { 0, 0, 0, 0, 0, 0 }
 };
 
@@ -68,7 +70,9 @@ void transform_map_to_sf(OptParser& p) {
   if (verbose)
     fprintf(stderr, "Fourier transform of grid %d x %d x %d...\n",
             map.grid.nu, map.grid.nv, map.grid.nw);
-  gemmi::FPhiGrid<float> hkl = gemmi::transform_map_to_f_phi(map.grid, /*half_l=*/true);
+  gemmi::FPhiGrid<float> hkl = gemmi::transform_map_to_f_phi(map.grid, /*half_l=*/true,
+                                                             /*use_scale=*/true,
+                                                             p.integer_or(Threads, 1));
   if (gemmi::giends_with(output_path, ".mtz")) {
     gemmi::Mtz mtz;
     if (p.options[Base]) {
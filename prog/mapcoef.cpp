@@ -48,6 +48,8 @@ const option::Descriptor MapUsage[] = {
     "  -G  \tPrint size of the grid that would be used and exit." },
   { TimingFft, 0, "", "timing", Arg::None,
     "  --timing  \tPrint calculation times." },
+  { FftThreads, 0, "j", "threads", Arg::Int,
+    "  -j, --threads=N  \tNumber of threads (default: 1, 0 = all cores)." },
 };
 
 
@@ -123,9 +125,10 @@ void adjust_size(const DataProxy& data, std::array<int, 3>& size,
 
 gemmi::Grid<float>
 read_sf_and_fft_to_map(const char* input_path,
-                       const std::vector<option::Option>& options,
+                       const OptParser& p,
                        FILE* output,
                        bool oversample_by_default) {
+  const std::vector<option::Option>& options = p.options;
   if (options[PhLabel] && !options[FLabel])
     gemmi::fail("Option -p can be given only together with -f");
   if (options[FLabel] && options[Diff])
@@ -146,6 +149,7 @@ read_sf_and_fft_to_map(const char* input_path,
     sample_rate = std::strtod(options[Sample].arg, nullptr);
   else if (oversample_by_default && !options[GridDims])
     sample_rate = 3.;
+  int num_threads = p.integer_or(FftThreads, 1);
   const char* section = options[Section] ? options[Section].arg : nullptr;
   const char* f_label = options[FLabel] ? options[FLabel].arg : nullptr;
   const char* ph_label = options[PhLabel] ? options[PhLabel].arg : nullptr;
@@ -169,21 +173,22 @@ read_sf_and_fft_to_map(const char* input_path,
     gemmi::ReflnBlock rblock = gemmi::get_refln_block(
                                    gemmi::read_cif_gz(input_path).blocks,
                                    {f_label, ph_label}, section);
-    gemmi::ReflnDataProxy data(rblock);
-    adjust_size(data, size, sample_rate,
+    // the data is read more than once, so strings are converted only once
+    std::vector<std::string> labels = {f_label, ph_label};
+    if (weight_label)
+      labels.emplace_back(weight_label);
+    gemmi::ReflnNumericData numeric = rblock.make_numeric_data(labels, num_threads);
+    gemmi::ReflnNumericDataProxy data_proxy{numeric};
+    adjust_size(data_proxy, size, sample_rate,
                 options[ExactDims], options[GridQuery]);
     if (output)
       fprintf(output, "Putting data from block %s into matrix...\n",
               rblock.block.name.c_str());
-    gemmi::ReflnDataProxy data_proxy(rblock);
-    int f_col = rblock.find_column_index(f_label);
-    int phi_col = rblock.find_column_index(ph_label);
-    gemmi::FPhiProxy<gemmi::ReflnDataProxy> fphi(data_proxy, f_col, phi_col);
-    grid = gemmi::get_f_phi_on_grid<float>(fphi, size, half_l, axis_order);
+    gemmi::FPhiProxy<gemmi::ReflnNumericDataProxy> fphi(data_proxy, 3, 4);
+    grid = gemmi::get_f_phi_on_grid<float>(fphi, size, half_l, axis_order, num_threads);
     if (weight_label)
-      weight_grid = gemmi::get_value_on_grid<float>(
-          data_proxy, rblock.find_column_index(weight_label),
-          size, half_l, axis_order);
+      weight_grid = gemmi::get_value_on_grid<float>(data_proxy, 5,
+                                                    size, half_l, axis_order);
   } else {
     timer.start();
     Mtz mtz;
@@ -198,7 +203,7 @@ read_sf_and_fft_to_map(const char* input_path,
               cols[0]->label.c_str(), cols[1]->label.c_str());
     timer.start();
     gemmi::FPhiProxy<gemmi::MtzDataProxy> fphi(data_proxy, cols[0]->idx, cols[1]->idx);
-    grid = gemmi::get_f_phi_on_grid<float>(fphi, size, half_l, axis_order);
+    grid = gemmi::get_f_phi_on_grid<float>(fphi, size, half_l, axis_order, num_threads);
     timer.print("F/Phi grid prepared in");
     if (weight_label) {
       const Mtz::Column& col = get_mtz_column(mtz, section, weight_label);
@@ -212,7 +217,7 @@ read_sf_and_fft_to_map(const char* input_path,
   if (output)
     fprintf(output, "Fourier transform...\n");
   timer.start();
-  gemmi::Grid<float> map = gemmi::transform_f_phi_grid_to_map(std::move(grid));
+  gemmi::Grid<float> map = gemmi::transform_f_phi_grid_to_map(std::move(grid), num_threads);
   timer.print("FFT in");
   assert(map.axis_order == axis_order);
   if (output)
@@ -6,14 +6,16 @@
 
 // used by sf2map and blobs
 enum MapOptions { Diff=4, Section, FLabel, PhLabel, WeightLabel, GridDims,
-                  ExactDims, Sample, AxesZyx, GridQuery, TimingFft,
+                  ExactDims, Sample, AxesZyx, GridQuery, TimingFft, FftThreads,
                   AfterMapOptions };
 
 extern const option::Descriptor MapUsage[];
 
+struct OptParser;
+
 gemmi::Grid<float>
 read_sf_and_fft_to_map(const char* input_path,
-                       const std::vector<option::Option>& options,
+                       const OptParser& p,
                        FILE* output,
                        bool oversample_by_default=false);
 
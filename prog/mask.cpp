@@ -15,7 +15,8 @@ namespace {
 
 enum OptionIndex {
   Timing=4, GridSpac, GridDims, Radius, RProbe, RShrink,
-  IslandLimit, Hydrogens, AnyOccupancy, CctbxCompat, RefmacCompat, Invert
+  IslandLimit, Hydrogens, AnyOccupancy, CctbxCompat, RefmacCompat, Invert,
+  Threads
 };
 
 struct MaskArg {
@@ -56,6 +57,8 @@ const option::Descriptor Usage[] = {
     "  --refmac-compat  \tUse radii compatible with Refmac." },
   { Invert, 0, "I", "invert", Arg::None,
     "  -I, --invert  \t0 for solvent, 1 for molecule." },
+  { Threads, 0, "j", "threads", Arg::Int,
+    "  -j, --threads=N  \tNumber of threads (default: 1, 0 = all cores)." },
   { 0, 0, 0, 0, 0, 0 }
 };
 
@@ -132,6 +135,7 @@ int GEMMI_MAIN(int argc, char **argv) {
       masker.ignore_hydrogen = false;
     if (p.options[AnyOccupancy])
       masker.ignore_zero_occupancy_atoms = false;
+    masker.num_threads = p.integer_or(Threads, 1);
 
     timer.start();
     masker.clear(mask.grid);
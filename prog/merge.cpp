@@ -5,9 +5,11 @@
 
 #include <cmath>              // for sqrt
 #include <cstdio>             // for fprintf
+#include <cstdlib>            // for strtod
 #include <algorithm>          // for sort
 #include <iostream>           // for cout
 #include <gemmi/asudata.hpp>  // for calculate_hkl_value_correlation
+#include <gemmi/binner.hpp>   // for Binner
 #include <gemmi/gz.hpp>       // for MaybeGzipped
 #include <gemmi/mtz2cif.hpp>  // for MtzToCif
 #include <gemmi/fstream.hpp>  // for Ofstream
@@ -20,7 +22,8 @@
 namespace {
 
 enum OptionIndex {
-  WriteAnom=4, NoSysAbs, NumObs, BlockName, Compare, PrintAll
+  WriteAnom=4, NoSysAbs, NumObs, BlockName, Compare, PrintAll,
+  Reject, Stats, Threads
 };
 
 const option::Descriptor Usage[] = {
@@ -44,6 +47,13 @@ const option::Descriptor Usage[] = {
     "  --compare  \tcompare unmerged and merged data (no output file)." },
   { PrintAll, 0, "", "print-all", Arg::None,
     "  --print-all  \tprint all compared reflections." },
+  { Reject, 0, "", "reject", Arg::Float,
+    "  --reject=SIGMA  \treject outliers that differ from the other observations"
+    " by more than SIGMA combined sigmas." },
+  { Stats, 0, "", "stats", Arg::Int,
+    "  --stats=N  \tprint statistics (incl. CC1/2) in N resolution shells." },
+  { Threads, 0, "j", "threads", Arg::Int,
+    "  -j, --threads=N  \tNumber of threads (default: 1, 0 = all cores)." },
   { NoOp, 0, "", "", Arg::None,
     "\nThe input file can be SF-mmCIF with _diffrn_refln, MTZ or XDS_ASCII.HKL."
     "\nThe output file can be either SF-mmCIF or MTZ."
@@ -67,6 +77,29 @@ void output_intensity_statistics(const Intensities& intensities) {
                intensities.data.size(), plus_count, minus_count);
 }
 
+void print_merging_stats(const std::vector<gemmi::MergingStats>& stats,
+                         const gemmi::Binner& binner) {
+  std::fprintf(stderr, "  d_max   d_min      #obs   #rej   #unique    CC1/2\n");
+  gemmi::MergingStats total;
+  for (size_t i = 0; i < stats.size(); ++i) {
+    const gemmi::MergingStats& st = stats[i];
+    // the upper limit of the last bin is +inf
+    double d_min = i + 1 < stats.size() ? binner.dmin_of_bin((int)i)
+                                         : 1 / std::sqrt(binner.max_1_d2);
+    std::fprintf(stderr, "%7.2f %7.2f %9d %6d %9d %8.4f\n",
+                 binner.dmax_of_bin((int)i), d_min,
+                 st.all_refl, st.rejected, st.unique_refl, st.cc_half.coefficient());
+    total.all_refl += st.all_refl;
+    total.rejected += st.rejected;
+    total.unique_refl += st.unique_refl;
+    if (st.cc_half.n != 0)
+      total.cc_half = gemmi::combine_two_correlations(total.cc_half, st.cc_half);
+  }
+  std::fprintf(stderr, "    overall     %9d %6d %9d %8.4f\n",
+               total.all_refl, total.rejected, total.unique_refl,
+               total.cc_half.coefficient());
+}
+
 void read_intensities_from_rblocks(Intensities& intensities,
                                    DataType data_type,
                                    std::vector<gemmi::ReflnBlock>& rblocks,
@@ -266,6 +299,10 @@ int GEMMI_MAIN(int argc, char **argv) {
   const char* block_name = nullptr;
   if (p.options[BlockName])
     block_name = p.options[BlockName].arg;
+  int num_threads = p.integer_or(Threads, 1);
+  double outlier_sigma = 0.;
+  if (p.options[Reject])
+    outlier_sigma = std::strtod(p.options[Reject].arg, nullptr);
 
   Intensities ref;
   if (p.options[Compare] && output_path) {
@@ -299,11 +336,25 @@ int GEMMI_MAIN(int argc, char **argv) {
       output_intensity_statistics(intensities);
     if (p.options[Compare]) {
       if (intensities.type != ref.type)
-        intensities.merge_in_place(ref.type);
+        intensities.merge_in_place(ref.type, num_threads, outlier_sigma);
       compare_intensities(intensities, ref, p.options[PrintAll]);
     } else {
       assert(output_path);
-      intensities.merge_in_place(otype);
+      gemmi::Binner binner;
+      bool with_stats = p.options[Stats] && intensities.type == DataType::Unmerged;
+      if (with_stats) {
+        std::vector<double> inv_d2(intensities.data.size());
+        for (size_t i = 0; i != inv_d2.size(); ++i)
+          inv_d2[i] = intensities.unit_cell.calculate_1_d2(intensities.data[i].hkl);
+        binner.setup_from_1_d2(p.integer_or(Stats, 10), gemmi::Binner::Method::Dstar3,
+                               std::move(inv_d2), &intensities.unit_cell);
+      }
+      auto stats = intensities.merge_in_place(otype, num_threads, outlier_sigma,
+                                              with_stats ? &binner : nullptr);
+      if (with_stats)
+        print_merging_stats(stats, binner);
+      else if (verbose && outlier_sigma > 0 && !stats.empty())
+        std::fprintf(stderr, "Rejected %d outliers.\n", stats[0].rejected);
       if (p.options[NoSysAbs])
         intensities.remove_systematic_absences();
       if (verbose)
@@ -47,6 +47,7 @@ const option::Descriptor Usage[] = {
   MapUsage[AxesZyx],
   MapUsage[GridQuery],
   MapUsage[TimingFft],
+  MapUsage[FftThreads],
   { Normalize, 0, "", "normalize", Arg::None,
     "  --normalize  \tScale the map to standard deviation 1 and mean 0." },
   { MapMask, 0, "", "mapmask", Arg::Required,
@@ -66,7 +67,7 @@ void transform_sf_to_map(OptParser& p) {
   const char* input_path = p.nonOption(0);
   const char* map_path = p.options[GridQuery] ? nullptr : p.nonOption(1);
   gemmi::Ccp4<float> ccp4;
-  ccp4.grid = read_sf_and_fft_to_map(input_path, p.options,
+  ccp4.grid = read_sf_and_fft_to_map(input_path, p,
                                      p.options[Verbose] ? stderr : nullptr);
   if (p.options[Verbose])
     fprintf(stderr, "Writing %s ...\n", map_path);
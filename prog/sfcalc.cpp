@@ -34,7 +34,8 @@ enum OptionIndex {
   Hkl=4, Dmin, For, NormalizeIt92, UseCharge, Rate, Blur, RCut,
   Test, WriteMap, ToMtz, Compare, FLabel, PhiLabel,
   CifFp, Wavelength, Unknown, NoAniso, Margin, ScaleTo, SigmaCutoff,
-  MaskSpacing, RadiiSet, Rprobe, Rshrink, MaskFile, Ksolv, Bsolv, Kov, Baniso
+  MaskSpacing, RadiiSet, Rprobe, Rshrink, MaskFile, Ksolv, Bsolv, Kov, Baniso,
+  Threads
 };
 
 struct SfCalcArg: public Arg {
@@ -107,6 +108,8 @@ const option::Descriptor Usage[] = {
     "  --blur=NUM  \tB added for Gaussian blurring (default: auto)." },
   { RCut, 0, "", "rcut", Arg::Float,
     "  --rcut=Y  \tUse atomic radius r such that rho(r) < Y (default: 1e-5)." },
+  { Threads, 0, "j", "threads", Arg::Int,
+    "  -j, --threads=N  \tNumber of threads (default: 1, 0 = all cores)." },
   { Test, 0, "", "test", Arg::Optional,
     "  --test[=CACHE]  \tCalculate exact values and report differences (slow)." },
   { WriteMap, 0, "", "write-map", Arg::Required,
@@ -269,7 +272,9 @@ void process_with_fft(const gemmi::Structure& st,
     fflush(stderr);
     timer.start();
   }
-  gemmi::FPhiGrid<Real> sf = transform_map_to_f_phi(dencalc.grid, /*half_l=*/true);
+  gemmi::FPhiGrid<Real> sf = transform_map_to_f_phi(dencalc.grid, /*half_l=*/true,
+                                                    /*use_scale=*/true,
+                                                    dencalc.num_threads);
   if (verbose) {
     timer.print("...took");
     fprintf(stderr, "Preparing results...\n");
@@ -292,6 +297,7 @@ void process_with_fft(const gemmi::Structure& st,
 
   if (scale_to.size() != 0) {
     scaling.prepare_points(asu_data, scale_to, mask_data);
+    scaling.num_threads = dencalc.num_threads;
     printf("Calculating scale factors using %zu points...\n", scaling.points.size());
     if (scaling.b_star.all_zero()) {
       scaling.fit_isotropic_b_approximately();
@@ -328,7 +334,16 @@ void process_with_fft(const gemmi::Structure& st,
       print_sf(hv.value, hv.hkl);
   } else {
     Comparator comparator;
-    for (gemmi::HklValue<std::complex<Real>>& hv : asu_data.v) {
+    std::vector<std::complex<double>> exact_values;
+    if (!file.path) {
+      std::vector<gemmi::Miller> hkls;
+      hkls.reserve(asu_data.size());
+      for (const gemmi::HklValue<std::complex<Real>>& hv : asu_data.v)
+        hkls.push_back(hv.hkl);
+      exact_values = calc.calculate_sf_from_model(st.models[0], hkls, dencalc.num_threads);
+    }
+    for (size_t i = 0; i != asu_data.size(); ++i) {
+      const gemmi::HklValue<std::complex<Real>>& hv = asu_data.v[i];
       std::complex<double> exact;
       if (file.path) {
         if (file.mode == RefFile::Mode::Test) {
@@ -349,9 +364,9 @@ void process_with_fft(const gemmi::Structure& st,
           exact = it->value;
         }
       } else {
-        exact = calc.calculate_sf_from_model(st.models[0], hv.hkl);
+        exact = exact_values[i];
         if (mott_bethe)
-          exact *= calc.mott_bethe_factor();
+          exact *= calc.mott_bethe_factor(hv.hkl);
       }
       comparator.add_complex(hv.value, exact);
       printf(" (%d %d %d)\t%7.2f\t%8.3f \t%6.2f\t%7.3f\td=%5.2f\n",
@@ -370,11 +385,10 @@ void process_with_fft(const gemmi::Structure& st,
 template<typename Table>
 void print_structure_factors_sm(const gemmi::SmallStructure& small,
                                 gemmi::StructureFactorCalculator<Table>& calc,
-                                bool mott_bethe, double d_min, bool verbose,
-                                const RefFile& file) {
+                                bool mott_bethe, double d_min, int num_threads,
+                                bool verbose, const RefFile& file) {
   Timer timer(verbose);
   timer.start();
-  int counter = 0;
   // cf. prepare_asu_data()
   double max_1_d = 1. / d_min;
   int max_h = int(max_1_d / small.cell.ar);
@@ -384,8 +398,8 @@ void print_structure_factors_sm(const gemmi::SmallStructure& small,
   if (!sg)
     sg = &gemmi::get_spacegroup_p1();
   gemmi::ReciprocalAsu asu(sg);
-  gemmi::AsuData<std::complex<double>> asu_data;
   gemmi::GroupOps gops = sg->operations();
+  std::vector<gemmi::Miller> hkls;
   for (int h = -max_h; h <= max_h; ++h)
     for (int k = -max_k; k <= max_k; ++k)
       for (int l = 0; l <= max_l; ++l) {
@@ -395,20 +409,24 @@ void print_structure_factors_sm(const gemmi::SmallStructure& small,
         if (gops.is_systematically_absent(hkl))
           continue;
         double hkl_1_d2 = small.cell.calculate_1_d2(hkl);
-        if (hkl_1_d2 < max_1_d * max_1_d) {
-          auto value = calc.calculate_sf_from_small_structure(small, hkl);
-          if (mott_bethe)
-            value *= calc.mott_bethe_factor();
-          if (file.mode == RefFile::Mode::WriteMtz)
-            asu_data.v.push_back({hkl, value});
-          else
-            print_sf(value, hkl);
-          ++counter;
-        }
+        if (hkl_1_d2 < max_1_d * max_1_d)
+          hkls.push_back(hkl);
       }
+  std::vector<std::complex<double>> values =
+    calc.calculate_sf_from_small_structure(small, hkls, num_threads);
+  gemmi::AsuData<std::complex<double>> asu_data;
+  for (size_t i = 0; i != hkls.size(); ++i) {
+    std::complex<double> value = values[i];
+    if (mott_bethe)
+      value *= calc.mott_bethe_factor(hkls[i]);
+    if (file.mode == RefFile::Mode::WriteMtz)
+      asu_data.v.push_back({hkls[i], value});
+    else
+      print_sf(value, hkls[i]);
+  }
   if (verbose) {
     fflush(stdout);
-    fprintf(stderr, "Calculated %d SFs in %g s.\n", counter, timer.count());
+    fprintf(stderr, "Calculated %zu SFs in %g s.\n", hkls.size(), timer.count());
     fflush(stderr);
   }
   if (file.mode == RefFile::Mode::WriteMtz) {
@@ -646,6 +664,7 @@ void process_with_table(bool use_st, gemmi::Structure& st, const gemmi::SmallStr
         dencalc.rate = std::atof(p.options[Rate].arg);
       if (p.options[RCut])
         dencalc.cutoff = (float) std::atof(p.options[RCut].arg);
+      dencalc.num_threads = p.integer_or(Threads, 1);
       dencalc.addends = calc.addends;
       dencalc.grid.setup_from(st);
       if (p.options[Blur]) {
@@ -722,12 +741,14 @@ void process_with_table(bool use_st, gemmi::Structure& st, const gemmi::SmallStr
           if (spacing <= 0)
             spacing = dencalc.requested_grid_spacing();
           gr.set_size_from_spacing(spacing, gemmi::GridSizeRounding::Up);
+          masker.num_threads = dencalc.num_threads;
           masker.put_mask_on_grid(gr, st.models[0]);
         }
         if (p.options[Verbose])
           fprintf(stderr, "Solvent mask: %.1f%% of %d x %d x %d grid.\n",
                   100. * gr.sum() / gr.point_count(), gr.nu, gr.nv, gr.nw);
-        mask_data = transform_map_to_f_phi(gr, /*half_l=*/true)
+        mask_data = transform_map_to_f_phi(gr, /*half_l=*/true, /*use_scale=*/true,
+                                           dencalc.num_threads)
                     .prepare_asu_data(dencalc.d_min, 0);
       } else {
         mask_data_ptr = nullptr;
@@ -740,7 +761,8 @@ void process_with_table(bool use_st, gemmi::Structure& st, const gemmi::SmallStr
           p.options[Test])
         gemmi::fail("Small molecule SFs are calculated directly. Do not use any\n"
                     "of the FFT-related options: --rate, --blur, --rcut, --test.");
-      print_structure_factors_sm(small, calc, mott_bethe, d_min, p.options[Verbose], file);
+      print_structure_factors_sm(small, calc, mott_bethe, d_min, p.integer_or(Threads, 1),
+                                 p.options[Verbose], file);
     }
 
   // handle option --compare
@@ -15,7 +15,8 @@
 namespace {
 
 enum OptionIndex {
-  Title=4, History, Project, Crystal, Dataset, Batchmin, Polarization, Normal, Overload
+  Title=4, History, Project, Crystal, Dataset, Batchmin, Polarization, Normal, Overload,
+  Threads
 };
 
 const option::Descriptor Usage[] = {
@@ -38,6 +39,8 @@ const option::Descriptor Usage[] = {
     "  --dataset=DATASET  \tDataset in MTZ hierarchy (default: 'XDSdataset')" },
   { Batchmin, 0, "", "batchmin", Arg::Int,
     "  --batchmin=BATCHMIN  \tDelete reflections with BATCH<BATCHMIN (default: 1)" },
+  { Threads, 0, "j", "threads", Arg::Int,
+    "  -j, --threads=N  \tNumber of threads (default: 1, 0 = all cores)." },
   { NoOp, 0, "", "", Arg::None,
     "\nPolarization correction and overload elimination options for INTEGRATE.HKL files:" },
   { Polarization, 0, "", "polarization", Arg::Float,
@@ -70,7 +73,7 @@ int GEMMI_MAIN(int argc, char **argv) {
   if (verbose)
     std::fprintf(stderr, "Reading %s ...\n", input_path);
   try {
-    xds.read_input(gemmi::MaybeGzipped(input_path));
+    xds.read_input(gemmi::MaybeGzipped(input_path), p.integer_or(Threads, 1));
 
     // batchmin handling
     int batchmin = 1;
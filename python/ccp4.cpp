@@ -5,6 +5,7 @@
 #include "common.h"
 #include <nanobind/stl/string.h>
 #include <nanobind/stl/array.h>  // for Ccp4Base::axis_positions
+#include <nanobind/stl/pair.h>   // for Ccp4Reader::box_for_extent
 
 using namespace gemmi;
 
@@ -54,6 +55,22 @@ void add_ccp4(nb::module_& m) {
 
   add_ccp4_common<float>(m, "Ccp4Map");
   add_ccp4_common<int8_t>(m, "Ccp4Mask");
+  nb::class_<Ccp4Reader, Ccp4Base>(m, "Ccp4Reader")
+    .def(nb::init<const std::string&>(), nb::arg("path"))
+    .def("mode", &Ccp4Reader::mode)
+    .def("file_dims", &Ccp4Reader::file_dims)
+    .def("read_subbox", &Ccp4Reader::read_subbox<float>,
+         nb::arg("start"), nb::arg("size"), nb::rv_policy::move)
+    .def("box_for_extent", &Ccp4Reader::box_for_extent, nb::arg("box"))
+    ;
+  nb::class_<Ccp4Writer, Ccp4Base>(m, "Ccp4Writer")
+    .def(nb::init<const std::string&, const Ccp4Base&>(),
+         nb::arg("path"), nb::arg("header"))
+    .def("write", [](Ccp4Writer& self, const Ccp4<float>& map) {
+        self.write(map.grid.data);
+    }, nb::arg("map"))
+    .def("finish", &Ccp4Writer::finish)
+    ;
   m.def("read_ccp4_map", &read_ccp4_map,
         nb::arg("path"), nb::arg("setup")=false, nb::rv_policy::move,
         "Reads a CCP4 file, mode 2 (floating-point data).");
@@ -196,5 +196,5 @@ void add_xds(nb::module_& m) {
          nb::arg("p"), nb::arg("normal"))
     .def("to_mtz", &gemmi::xds_to_mtz)
     ;
-  m.def("read_xds_ascii", &read_xds_ascii);
+  m.def("read_xds_ascii", &read_xds_ascii, nb::arg("path"), nb::arg("num_threads")=1);
 }
@@ -120,14 +120,15 @@ nb::class_<Grid<T>, GridBase<T>> add_grid_common(nb::module_& m, const std::stri
     .def("set_unit_cell", (void (Gr::*)(const UnitCell&)) &Gr::set_unit_cell)
     .def("set_points_around", &Gr::set_points_around,
          nb::arg("position"), nb::arg("radius"), nb::arg("value"), nb::arg("use_pbc")=true)
-    .def("symmetrize_min", &Gr::symmetrize_min)
-    .def("symmetrize_max", &Gr::symmetrize_max)
-    .def("symmetrize_abs_max", &Gr::symmetrize_abs_max)
-    .def("symmetrize_sum", &Gr::symmetrize_sum)
+    .def("symmetrize_min", &Gr::symmetrize_min, nb::arg("num_threads")=1)
+    .def("symmetrize_max", &Gr::symmetrize_max, nb::arg("num_threads")=1)
+    .def("symmetrize_abs_max", &Gr::symmetrize_abs_max, nb::arg("num_threads")=1)
+    .def("symmetrize_sum", &Gr::symmetrize_sum, nb::arg("num_threads")=1)
     .def("masked_asu", &masked_asu<T>, nb::keep_alive<0, 1>())
     .def("mask_points_in_constant_radius", &mask_points_in_constant_radius<T>,
          nb::arg("model"), nb::arg("radius"), nb::arg("value"),
-         nb::arg("ignore_hydrogen")=false, nb::arg("ignore_zero_occupancy_atoms")=false)
+         nb::arg("ignore_hydrogen")=false, nb::arg("ignore_zero_occupancy_atoms")=false,
+         nb::arg("num_threads")=1)
     .def("get_subarray",
          [](const Gr& self, std::array<int,3> start, std::array<int,3> shape) {
         auto arr = make_numpy_array<T>(
@@ -249,9 +250,10 @@ void add_grid(nb::module_& m) {
     ;
   auto grid_float = add_grid_common<float>(m, "FloatGrid");
   add_grid_interpolation<float>(grid_float);
-  grid_float.def("symmetrize_avg", &Grid<float>::symmetrize_avg);
+  grid_float.def("symmetrize_avg", &Grid<float>::symmetrize_avg, nb::arg("num_threads")=1);
   grid_float.def("normalize", &Grid<float>::normalize);
-  grid_float.def("add_soft_edge_to_mask", &add_soft_edge_to_mask<float>);
+  grid_float.def("add_soft_edge_to_mask", &add_soft_edge_to_mask<float>,
+                 nb::arg("width"), nb::arg("num_threads")=1);
 
   add_grid_base<std::complex<float>>(m, "ComplexGridBase");
 
@@ -271,12 +273,23 @@ void add_grid(nb::module_& m) {
     .def_rw("constant_r", &SolventMasker::constant_r)
     .def_rw("ignore_hydrogen", &SolventMasker::ignore_hydrogen)
     .def_rw("ignore_zero_occupancy_atoms", &SolventMasker::ignore_zero_occupancy_atoms)
+    .def_rw("num_threads", &SolventMasker::num_threads)
     .def("set_radii", &SolventMasker::set_radii,
          nb::arg("choice"), nb::arg("constant_r")=0.)
     .def("put_mask_on_int8_grid", &SolventMasker::put_mask_on_grid<int8_t>)
     .def("put_mask_on_float_grid", &SolventMasker::put_mask_on_grid<float>)
     .def("set_to_zero", &SolventMasker::set_to_zero)
     ;
+  nb::class_<IncrementalSolventMasker>(m, "IncrementalSolventMasker")
+    .def(nb::init<AtomicRadiiSet, double>(),
+         nb::arg("choice"), nb::arg("constant_r")=0.)
+    .def_rw("masker", &IncrementalSolventMasker::masker)
+    .def_rw("tolerance", &IncrementalSolventMasker::tolerance)
+    .def_ro("updated_atoms", &IncrementalSolventMasker::updated_atoms)
+    .def("reset", &IncrementalSolventMasker::reset)
+    .def("put_mask_on_int8_grid", &IncrementalSolventMasker::put_mask_on_grid<int8_t>)
+    .def("put_mask_on_float_grid", &IncrementalSolventMasker::put_mask_on_grid<float>)
+    ;
   m.def("interpolate_grid", &interpolate_grid<float>,
         nb::arg("dest"), nb::arg("src"), nb::arg("tr"), nb::arg("order")=1);
   m.def("interpolate_grid_of_aligned_model2", &interpolate_grid_of_aligned_model2<float>,
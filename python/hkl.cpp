@@ -24,6 +24,27 @@ using namespace gemmi;
 NB_MAKE_OPAQUE(std::vector<ReflnBlock>)
 
 void add_hkl(nb::module_& m) {
+  nb::class_<ReflnNumericData>(m, "ReflnNumericData")
+    .def_ro("cell", &ReflnNumericData::cell)
+    .def_ro("spacegroup", &ReflnNumericData::spacegroup)
+    .def_ro("labels", &ReflnNumericData::labels)
+    .def_prop_ro("array", [](ReflnNumericData& self) {
+        return nb::ndarray<nb::numpy, double, nb::ndim<2>>(
+            self.data.data(), {self.length(), self.stride()}, nb::handle());
+    }, nb::rv_policy::reference_internal)
+    .def("get_size_for_hkl",
+         [](const ReflnNumericData& self,
+            std::array<int,3> min_size, double sample_rate) {
+          return get_size_for_hkl(data_proxy(self), min_size, sample_rate);
+    }, nb::arg("min_size")=std::array<int,3>{{0,0,0}},
+       nb::arg("sample_rate")=0.)
+    .def("get_f_phi", [](const ReflnNumericData& self, const std::string& f_col,
+                                                       const std::string& phi_col,
+                                                       bool as_is) {
+        return make_asu_data<std::complex<float>, 2>(self, {f_col, phi_col}, as_is);
+    }, nb::arg("f"), nb::arg("phi"), nb::arg("as_is")=false)
+    ;
+
   nb::class_<ReflnBlock> pyReflnBlock(m, "ReflnBlock");
   nb::bind_vector<std::vector<ReflnBlock>, rv_ri>(m, "ReflnBlocks");
   pyReflnBlock
@@ -42,6 +63,8 @@ void add_hkl(nb::module_& m) {
          [](ReflnBlock& self, const std::string& tag, double null) {
            return numpy_array_from_vector(self.make_vector(tag, null));
     }, nb::arg("tag"), nb::arg("null")=NAN)
+    .def("make_numeric_data", &ReflnBlock::make_numeric_data,
+         nb::arg("labels")=std::vector<std::string>(), nb::arg("num_threads")=1)
     .def("make_miller_array", [](ReflnBlock& self) {
         return py_array2d_from_vector(self.make_miller_vector());
     })
@@ -64,13 +87,13 @@ void add_hkl(nb::module_& m) {
                                  const std::string& f_col,
                                  const std::string& phi_col,
                                  std::array<int, 3> size,
-                                 bool half_l, AxisOrder order) {
+                                 bool half_l, AxisOrder order, int num_threads) {
         size_t f_idx = self.get_column_index(f_col);
         size_t phi_idx = self.get_column_index(phi_col);
         FPhiProxy<ReflnDataProxy> fphi(ReflnDataProxy{self}, f_idx, phi_idx);
-        return get_f_phi_on_grid<float>(fphi, size, half_l, order);
+        return get_f_phi_on_grid<float>(fphi, size, half_l, order, num_threads);
     }, nb::arg("f"), nb::arg("phi"), nb::arg("size"),
-       nb::arg("half_l")=false, nb::arg("order")=AxisOrder::XYZ)
+       nb::arg("half_l")=false, nb::arg("order")=AxisOrder::XYZ, nb::arg("num_threads")=1)
     .def("get_value_on_grid", [](const ReflnBlock& self,
                                  const std::string& column,
                                  std::array<int, 3> size,
@@ -86,17 +109,19 @@ void add_hkl(nb::module_& m) {
                                       std::array<int, 3> min_size,
                                       std::array<int, 3> exact_size,
                                       double sample_rate,
-                                      AxisOrder order) {
-        size_t f_idx = self.get_column_index(f_col);
-        size_t phi_idx = self.get_column_index(phi_col);
-        FPhiProxy<ReflnDataProxy> fphi(ReflnDataProxy{self}, f_idx, phi_idx);
+                                      AxisOrder order,
+                                      int num_threads) {
+        // hkl are read twice (to determine the size and to fill the grid)
+        ReflnNumericData numeric = self.make_numeric_data({f_col, phi_col}, num_threads);
+        FPhiProxy<ReflnNumericDataProxy> fphi(ReflnNumericDataProxy{numeric}, 3, 4);
         return transform_f_phi_to_map2<float>(fphi, min_size, sample_rate,
-                                              exact_size, order);
+                                              exact_size, order, num_threads);
     }, nb::arg("f"), nb::arg("phi"),
        nb::arg("min_size")=std::array<int,3>{{0,0,0}},
        nb::arg("exact_size")=std::array<int,3>{{0,0,0}},
        nb::arg("sample_rate")=0.,
-       nb::arg("order")=AxisOrder::XYZ)
+       nb::arg("order")=AxisOrder::XYZ,
+       nb::arg("num_threads")=1)
     .def("get_float", &make_asu_data<float, ReflnBlock>,
          nb::arg("col"), nb::arg("as_is")=false)
     .def("get_int", &make_asu_data<int, ReflnBlock>,
@@ -127,11 +152,12 @@ void add_hkl(nb::module_& m) {
   m.def("as_refln_blocks",
         [](cif::Document& d) { return as_refln_blocks(std::move(d.blocks)); });
   m.def("hkl_cif_as_refln_block", &hkl_cif_as_refln_block, nb::arg("block"));
-  m.def("transform_f_phi_grid_to_map", [](FPhiGrid<float> grid) {
-          return transform_f_phi_grid_to_map<float>(std::move(grid));
-        }, nb::arg("grid"));
+  m.def("transform_f_phi_grid_to_map", [](FPhiGrid<float> grid, int num_threads) {
+          return transform_f_phi_grid_to_map<float>(std::move(grid), num_threads);
+        }, nb::arg("grid"), nb::arg("num_threads")=1);
   m.def("transform_map_to_f_phi", &transform_map_to_f_phi<float>,
-        nb::arg("map"), nb::arg("half_l")=false, nb::arg("use_scale")=true);
+        nb::arg("map"), nb::arg("half_l")=false, nb::arg("use_scale")=true,
+        nb::arg("num_threads")=1);
   m.def("cromer_liberman", [](int z, double energy) {
       std::pair<double, double> r;
       r.first = cromer_liberman(z, energy, &r.second);
@@ -188,6 +214,13 @@ void add_hkl(nb::module_& m) {
       return check_data_type_under_symmetry(MtzDataProxy{data});
   });
 
+  nb::class_<MergingStats>(m, "MergingStats")
+    .def_ro("all_refl", &MergingStats::all_refl)
+    .def_ro("unique_refl", &MergingStats::unique_refl)
+    .def_ro("rejected", &MergingStats::rejected)
+    .def_ro("cc_half", &MergingStats::cc_half)
+    ;
+
   nb::class_<Intensities>(m, "Intensities")
     .def(nb::init<>())
     .def_rw("spacegroup", &Intensities::spacegroup)
@@ -195,7 +228,9 @@ void add_hkl(nb::module_& m) {
     .def_rw("type", &Intensities::type)
     .def("resolution_range", &Intensities::resolution_range)
     .def("remove_systematic_absences", &Intensities::remove_systematic_absences)
-    .def("merge_in_place", &Intensities::merge_in_place, nb::arg("itype"))
+    .def("merge_in_place", &Intensities::merge_in_place, nb::arg("itype"),
+         nb::arg("num_threads")=1, nb::arg("outlier_sigma")=0.,
+         nb::arg("binner")=nb::none())
     .def("read_mtz", &Intensities::read_mtz, nb::arg(), nb::arg("type"))
     .def("read_xds", &Intensities::read_xds, nb::arg())
     .def("read_mmcif", &Intensities::read_mmcif, nb::arg(), nb::arg("type"))
@@ -263,6 +298,10 @@ void add_hkl(nb::module_& m) {
                      const ReflnBlock& r, const UnitCell* cell) {
         self.setup(nbins, method, ReflnDataProxy(r), cell);
     }, nb::arg("nbins"), nb::arg("method"), nb::arg("r"), nb::arg("cell")=nb::none())
+    .def("setup", [](Binner& self, int nbins, Binner::Method method,
+                     const ReflnNumericData& r, const UnitCell* cell) {
+        self.setup(nbins, method, data_proxy(r), cell);
+    }, nb::arg("nbins"), nb::arg("method"), nb::arg("r"), nb::arg("cell")=nb::none())
     .def("setup", [](Binner& self, int nbins, Binner::Method method,
                      const cpu_miller_array& hkl, const UnitCell* cell) {
         auto h = hkl.view();
@@ -285,6 +324,9 @@ void add_hkl(nb::module_& m) {
     .def("get_bins", [](Binner& self, const ReflnBlock& r) {
         return numpy_array_from_vector(self.get_bins(ReflnDataProxy(r)));
     })
+    .def("get_bins", [](Binner& self, const ReflnNumericData& r) {
+        return numpy_array_from_vector(self.get_bins(data_proxy(r)));
+    })
     .def("get_bins", [](Binner& self, const cpu_miller_array& hkl) {
         if (hkl.stride(1) != 1 || hkl.stride(0) < 3)
           throw std::domain_error("hkl array must be contiguous");
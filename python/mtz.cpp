@@ -173,13 +173,14 @@ void add_mtz(nb::module_& m) {
                                  const std::string& phi_col,
                                  std::array<int, 3> size,
                                  bool half_l,
-                                 AxisOrder order) {
+                                 AxisOrder order,
+                                 int num_threads) {
         const Mtz::Column& f = self.get_column_with_label(f_col);
         const Mtz::Column& phi = self.get_column_with_label(phi_col);
         FPhiProxy<MtzDataProxy> fphi(MtzDataProxy{self}, f.idx, phi.idx);
-        return get_f_phi_on_grid<float>(fphi, size, half_l, order);
+        return get_f_phi_on_grid<float>(fphi, size, half_l, order, num_threads);
     }, nb::arg("f"), nb::arg("phi"), nb::arg("size"),
-       nb::arg("half_l")=false, nb::arg("order")=AxisOrder::XYZ)
+       nb::arg("half_l")=false, nb::arg("order")=AxisOrder::XYZ, nb::arg("num_threads")=1)
     .def("get_value_on_grid", [](const Mtz& self,
                                  const std::string& label,
                                  std::array<int, 3> size,
@@ -196,17 +197,19 @@ void add_mtz(nb::module_& m) {
                                       std::array<int, 3> min_size,
                                       std::array<int, 3> exact_size,
                                       double sample_rate,
-                                      AxisOrder order) {
+                                      AxisOrder order,
+                                      int num_threads) {
         const Mtz::Column& f = self.get_column_with_label(f_col);
         const Mtz::Column& phi = self.get_column_with_label(phi_col);
         FPhiProxy<MtzDataProxy> fphi(MtzDataProxy{self}, f.idx, phi.idx);
         return transform_f_phi_to_map2<float>(fphi, min_size, sample_rate,
-                                              exact_size, order);
+                                              exact_size, order, num_threads);
     }, nb::arg("f"), nb::arg("phi"),
        nb::arg("min_size")=std::array<int,3>{{0,0,0}},
        nb::arg("exact_size")=std::array<int,3>{{0,0,0}},
        nb::arg("sample_rate")=0.,
-       nb::arg("order")=AxisOrder::XYZ)
+       nb::arg("order")=AxisOrder::XYZ,
+       nb::arg("num_threads")=1)
     .def("get_float", &make_asu_data<float, Mtz>,
          nb::arg("col"), nb::arg("as_is")=false)
     .def("get_int", &make_asu_data<int, Mtz>,
@@ -346,10 +349,54 @@ void add_mtz(nb::module_& m) {
     .def("clone", [](const Mtz::Batch& self) { return new Mtz::Batch(self); })
     ;
 
-  m.def("read_mtz_file", [](const std::string& path, Logger&& logging) {
+  m.def("read_mtz_file", [](const std::string& path, Logger&& logging,
+                            const std::vector<std::string>& columns) {
     std::unique_ptr<Mtz> mtz(new Mtz);
     mtz->logger = std::move(logging);
-    mtz->read_file_gz(path, true);
+    if (columns.empty())
+      mtz->read_file_gz(path, true);
+    else
+      mtz->read_file_columns(path, columns);
     return mtz.release();
-  }, nb::arg("path"), nb::arg("logging")=nb::none());
+  }, nb::arg("path"), nb::arg("logging")=nb::none(),
+     nb::arg("columns")=std::vector<std::string>());
+
+  nb::class_<MappedMtz> mapped_mtz(m, "MappedMtz",
+      "MTZ file mapped into memory; mtz has headers, data is read from the file.");
+  using ColumnView = MappedMtz::ColumnView;
+  nb::class_<ColumnView>(mapped_mtz, "ColumnView")
+    .def_ro("idx", &ColumnView::idx)
+    .def("__len__", &ColumnView::size)
+    .def("__getitem__", [](const ColumnView& self, size_t n) {
+        if (n >= self.size())
+          throw nb::index_error();
+        return self[n];
+    }, nb::arg("n"))
+    .def_prop_ro("array", [](const ColumnView& self) {
+        auto arr = make_numpy_array<float>({self.size()});
+        float* ptr = arr.data();
+        for (size_t i = 0; i < self.size(); ++i)
+          ptr[i] = self[i];
+        return arr;
+    }, "Copy of the column data.")
+    ;
+  mapped_mtz
+    .def(nb::init<const std::string&>(), nb::arg("path"))
+    .def_ro("mtz", &MappedMtz::mtz)
+    .def("column", (ColumnView (MappedMtz::*)(const std::string&) const) &MappedMtz::column,
+         nb::arg("label"), nb::keep_alive<0, 1>())
+    .def("read_columns", &MappedMtz::read_columns, nb::arg("labels"))
+    .def("get_float", &make_asu_data<float, MappedMtz>,
+         nb::arg("col"), nb::arg("as_is")=false)
+    .def("get_f_phi", [](const MappedMtz& self, const std::string& f_col,
+                                                const std::string& phi_col,
+                                                bool as_is) {
+        return make_asu_data<std::complex<float>, 2>(self, {f_col, phi_col}, as_is);
+    }, nb::arg("f"), nb::arg("phi"), nb::arg("as_is")=false)
+    .def("get_value_sigma", [](const MappedMtz& self, const std::string& f_col,
+                                                      const std::string& sigma_col,
+                                                      bool as_is) {
+        return make_asu_data<ValueSigma<float>, 2>(self, {f_col, sigma_col}, as_is);
+    }, nb::arg("f"), nb::arg("sigma"), nb::arg("as_is")=false)
+    ;
 }
@@ -16,14 +16,31 @@
 #include "gemmi/read_cif.hpp"      // for read_cif_gz, read_mmjson_gz
 #include "gemmi/mmread_gz.hpp"     // for read_structure_gz
 #include "gemmi/json.hpp"          // for read_mmjson_insitu
+#include "gemmi/binstruct.hpp"     // for BinaryStructure, read_binary_structure
+#include <nanobind/ndarray.h>
 
 
 using namespace gemmi;
 
 NB_MAKE_OPAQUE(std::vector<SmallStructure::Site>)
 
+namespace {
+
+// read-only array that refers to a section of BinaryStructure
+template<typename T>
+nb::ndarray<nb::numpy, const T, nb::shape<-1>> column_array(const T* data, size_t size) {
+  return nb::ndarray<nb::numpy, const T, nb::shape<-1>>(data, {size}, nb::handle());
+}
+
+void check_index(size_t n, size_t size) {
+  if (n >= size)
+    throw nb::index_error();
+}
+
+} // anonymous namespace
+
 void add_cif_read(nb::module_& cif) {
-  cif.def("read_file", &read_cif_gz, nb::arg("filename"),
+  cif.def("read_file", &read_cif_gz, nb::arg("filename"), nb::arg("num_threads")=1,
           "Reads a CIF file copying data into Document.");
   cif.def("read", &read_cif_or_mmjson_gz,
           nb::arg("filename"), "Reads normal or gzipped CIF file.");
@@ -80,23 +97,92 @@ void add_read_structure(nb::module_& m) {
         "CIF block from CCD or monomer library -> single-residue Model(s).");
 
   m.def("read_pdb_string", [](const std::string& s, int max_line_length,
-                              bool split_chain_on_ter) {
-          PdbReadOptions options{max_line_length, split_chain_on_ter, false};
+                              bool split_chain_on_ter, int num_threads) {
+          PdbReadOptions options{max_line_length, split_chain_on_ter, false, num_threads};
           return new Structure(read_pdb_string(s, "string", options));
         }, nb::arg("s"), nb::arg("max_line_length")=0,
-           nb::arg("split_chain_on_ter")=false, "Reads a string as PDB file.");
+           nb::arg("split_chain_on_ter")=false, nb::arg("num_threads")=1,
+           "Reads a string as PDB file.");
   m.def("read_pdb_string", [](const nb::bytes& s, int max_line_length,
-                              bool split_chain_on_ter) {
-          PdbReadOptions options{max_line_length, split_chain_on_ter, false};
+                              bool split_chain_on_ter, int num_threads) {
+          PdbReadOptions options{max_line_length, split_chain_on_ter, false, num_threads};
           return new Structure(read_pdb_from_memory(s.c_str(), s.size(), "string", options));
         }, nb::arg("s"), nb::arg("max_line_length")=0,
-           nb::arg("split_chain_on_ter")=false, "Reads a string as PDB file.");
+           nb::arg("split_chain_on_ter")=false, nb::arg("num_threads")=1,
+           "Reads a string as PDB file.");
   m.def("read_pdb", [](const std::string& path, int max_line_length,
-                       bool split_chain_on_ter) {
-          PdbReadOptions options{max_line_length, split_chain_on_ter, false};
+                       bool split_chain_on_ter, int num_threads) {
+          PdbReadOptions options{max_line_length, split_chain_on_ter, false, num_threads};
           return new Structure(read_pdb_gz(path, options));
         }, nb::arg("filename"), nb::arg("max_line_length")=0,
-           nb::arg("split_chain_on_ter")=false);
+           nb::arg("split_chain_on_ter")=false, nb::arg("num_threads")=1);
+
+  // from binstruct.hpp
+  m.def("read_binary_structure", [](const std::string& path) {
+          return new Structure(read_binary_structure(path));
+        }, nb::arg("path"), "Reads file written by write_binary_structure().");
+  m.def("write_binary_structure", &write_binary_structure,
+        nb::arg("st"), nb::arg("path"),
+        "Writes Structure in gemmi binary format (.gbs).");
+  nb::class_<BinaryStructure>(m, "BinaryStructure",
+      "Read-only, memory-mapped file written by write_binary_structure().")
+    .def(nb::init<const std::string&>(), nb::arg("path"))
+    .def_prop_ro("model_count", &BinaryStructure::model_count)
+    .def_prop_ro("chain_count", &BinaryStructure::chain_count)
+    .def_prop_ro("residue_count", &BinaryStructure::residue_count)
+    .def_prop_ro("atom_count", &BinaryStructure::atom_count)
+    // index arrays have one more element than the number of items
+    .def_prop_ro("model_nums", [](const BinaryStructure& self) {
+        return column_array(self.model_nums(), self.model_count());
+    }, nb::rv_policy::reference_internal)
+    .def_prop_ro("model_chains", [](const BinaryStructure& self) {
+        return column_array(self.model_chains(), self.model_count() + 1);
+    }, nb::rv_policy::reference_internal)
+    .def_prop_ro("chain_residues", [](const BinaryStructure& self) {
+        return column_array(self.chain_residues(), self.chain_count() + 1);
+    }, nb::rv_policy::reference_internal)
+    .def_prop_ro("residue_atoms", [](const BinaryStructure& self) {
+        return column_array(self.residue_atoms(), self.residue_count() + 1);
+    }, nb::rv_policy::reference_internal)
+    .def_prop_ro("residue_seqnums", [](const BinaryStructure& self) {
+        return column_array(self.residue_seqnums(), self.residue_count());
+    }, nb::rv_policy::reference_internal)
+    .def_prop_ro("residue_icodes", [](const BinaryStructure& self) {
+        return column_array((const uint8_t*) self.residue_icodes(), self.residue_count());
+    }, nb::rv_policy::reference_internal)
+    .def_prop_ro("positions", [](const BinaryStructure& self) {
+        return nb::ndarray<nb::numpy, const double, nb::shape<-1,3>>(
+            &self.positions()->x, {self.atom_count(), 3}, nb::handle());
+    }, nb::rv_policy::reference_internal)
+    .def_prop_ro("occupancies", [](const BinaryStructure& self) {
+        return column_array(self.occupancies(), self.atom_count());
+    }, nb::rv_policy::reference_internal)
+    .def_prop_ro("b_isos", [](const BinaryStructure& self) {
+        return column_array(self.b_isos(), self.atom_count());
+    }, nb::rv_policy::reference_internal)
+    .def_prop_ro("elements", [](const BinaryStructure& self) {
+        static_assert(sizeof(Element) == 1, "Element is stored as one byte");
+        return column_array((const uint8_t*) self.elements(), self.atom_count());
+    }, nb::rv_policy::reference_internal, "Atomic numbers.")
+    .def_prop_ro("altlocs", [](const BinaryStructure& self) {
+        return column_array((const uint8_t*) self.altlocs(), self.atom_count());
+    }, nb::rv_policy::reference_internal)
+    .def("chain_name", [](const BinaryStructure& self, size_t n) {
+        check_index(n, self.chain_count());
+        return std::string(self.chain_name(n));
+    }, nb::arg("n"))
+    .def("residue_name", [](const BinaryStructure& self, size_t n) {
+        check_index(n, self.residue_count());
+        return std::string(self.residue_name(n));
+    }, nb::arg("n"))
+    .def("atom_name", [](const BinaryStructure& self, size_t n) {
+        check_index(n, self.atom_count());
+        return std::string(self.atom_name(n));
+    }, nb::arg("n"))
+    .def("structure", [](const BinaryStructure& self) {
+        return new Structure(self.structure());
+    }, "Deserializes complete Structure.")
+    ;
 
   // from smcif.hpp
   m.def("read_small_structure", [](const std::string& path) {
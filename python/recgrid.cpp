@@ -32,12 +32,14 @@ template<> void add_to_asu_data(nb::class_<AsuData<std::complex<float>>>& cl) {
          nb::arg("min_size")=std::array<int,3>{{0,0,0}}, nb::arg("sample_rate")=0.);
   cl.def("data_fits_into", &data_fits_into<AsuData>, nb::arg("size"));
   cl.def("get_f_phi_on_grid", get_f_phi_on_grid<float, AsuData>,
-         nb::arg("size"), nb::arg("half_l")=false, nb::arg("order")=AxisOrder::XYZ);
+         nb::arg("size"), nb::arg("half_l")=false, nb::arg("order")=AxisOrder::XYZ,
+         nb::arg("num_threads")=1);
   cl.def("transform_f_phi_to_map", &transform_f_phi_to_map2<float, AsuData>,
          nb::arg("min_size")=std::array<int,3>{{0,0,0}},
          nb::arg("sample_rate")=0.,
          nb::arg("exact_size")=std::array<int,3>{{0,0,0}},
-         nb::arg("order")=AxisOrder::XYZ);
+         nb::arg("order")=AxisOrder::XYZ,
+         nb::arg("num_threads")=1);
   cl.def("calculate_correlation", [](const AsuData& self, const AsuData& other) {
       return calculate_hkl_complex_correlation(self.v, other.v);
   });
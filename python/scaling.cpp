@@ -19,6 +19,7 @@ void add_scaling(nb::module_& m) {
     .def_rw("use_solvent", &Scaling::use_solvent)
     .def_rw("k_sol", &Scaling::k_sol)
     .def_rw("b_sol", &Scaling::b_sol)
+    .def_rw("num_threads", &Scaling::num_threads)
     .def_prop_rw("parameters", &Scaling::get_parameters,
                   (void (Scaling::*)(const std::vector<double>&)) &Scaling::set_parameters)
     .def("prepare_points", &Scaling::prepare_points,
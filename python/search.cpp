@@ -32,6 +32,18 @@ void add_search(nb::module_& m) {
                    " element ", self.element.name(), ">");
     });
   nb::bind_vector<std::vector<NeighborSearch::Mark*>>(m, "VectorMarkPtr");
+  using BatchResult = NeighborSearch::BatchResult;
+  nb::class_<BatchResult>(neighbor_search, "BatchResult")
+    .def_ro("offsets", &BatchResult::offsets)
+    .def_ro("marks", &BatchResult::marks)
+    .def_ro("dist_sq", &BatchResult::dist_sq)
+    .def("__len__", &BatchResult::size)
+    .def("count", &BatchResult::count, nb::arg("i"))
+    .def("__getitem__", [](const BatchResult& self, size_t i) {
+        size_t n = self.count(i);  // throws out_of_range -> IndexError
+        auto begin = self.marks.begin() + self.offsets[i];
+        return std::vector<NeighborSearch::Mark*>(begin, begin + n);
+    }, nb::arg("i"), nb::rv_policy::move, nb::keep_alive<0, 1>());
   neighbor_search
     .def_ro("radius_specified", &NeighborSearch::radius_specified)
     .def(nb::init<Model&, const UnitCell&, double>(),
@@ -46,6 +58,7 @@ void add_search(nb::module_& m) {
          nb::arg("small_structure"), nb::arg("max_radius"),
          nb::keep_alive<1, 2>())
     .def("populate", &NeighborSearch::populate, nb::arg("include_h")=true,
+         nb::arg("num_threads")=1,
          "Usually run after constructing NeighborSearch.")
     .def("add_chain", &NeighborSearch::add_chain,
          nb::arg("chain"), nb::arg("include_h")=true)
@@ -55,10 +68,19 @@ void add_search(nb::module_& m) {
     .def("add_site", &NeighborSearch::add_site,
          nb::arg("site"), nb::arg("n"),
          "Lower-level alternative to populate() for SmallStructure")
+    .def("compact", &NeighborSearch::compact,
+         "Moves marks to compact storage that is faster to search.")
+    .def("is_compact", &NeighborSearch::is_compact)
     .def("find_atoms", &NeighborSearch::find_atoms,
          nb::arg("pos"), nb::arg("alt")='\0',
          nb::kw_only(), nb::arg("min_dist")=0, nb::arg("radius")=0,
          nb::rv_policy::move, nb::keep_alive<0, 1>())
+    .def("find_atoms_batch", &NeighborSearch::find_atoms_batch,
+         nb::arg("positions"), nb::arg("alt")='\0',
+         nb::kw_only(), nb::arg("min_dist")=0, nb::arg("radius")=0,
+         nb::arg("num_threads")=1,
+         nb::rv_policy::move, nb::keep_alive<0, 1>(),
+         "find_atoms() for each position; result[i] has atoms for positions[i].")
     .def("find_neighbors", &NeighborSearch::find_neighbors,
          nb::arg("atom"), nb::arg("min_dist")=0, nb::arg("max_dist")=0,
          nb::rv_policy::move, nb::keep_alive<0, 1>())
@@ -95,7 +117,8 @@ void add_search(nb::module_& m) {
     .def("set_radius", [](ContactSearch& self, Element el, float r) {
         self.set_radius(el.elem, r);
     })
-    .def("find_contacts", &ContactSearch::find_contacts)
+    .def("find_contacts", &ContactSearch::find_contacts,
+         nb::arg("ns"), nb::arg("num_threads")=1)
     ;
 
   csignore
@@ -1,6 +1,7 @@
 // Copyright 2020 Global Phasing Ltd.
 
 #include "common.h"
+#include "array.h"
 #include <nanobind/stl/array.h>
 #include <nanobind/stl/complex.h>
 #include "gemmi/it92.hpp"
@@ -12,6 +13,14 @@
 
 namespace {
 
+std::vector<gemmi::Miller> miller_vector(const cpu_miller_array& hkl) {
+  auto h = hkl.view();
+  std::vector<gemmi::Miller> result(h.shape(0));
+  for (size_t i = 0; i < h.shape(0); ++i)
+    result[i] = {{h(i, 0), h(i, 1), h(i, 2)}};
+  return result;
+}
+
 template<typename Table>
 void add_sfcalc(nb::module_& m, const char* name, bool with_mb) {
   using SFC = gemmi::StructureFactorCalculator<Table>;
@@ -19,11 +28,29 @@ void add_sfcalc(nb::module_& m, const char* name, bool with_mb) {
   sfc
     .def(nb::init<const gemmi::UnitCell&>())
     .def_rw("addends", &SFC::addends)
-    .def("calculate_sf_from_model", &SFC::calculate_sf_from_model)
-    .def("calculate_sf_from_small_structure", &SFC::calculate_sf_from_small_structure);
+    .def("calculate_sf_from_model",
+         (std::complex<double> (SFC::*)(const gemmi::Model&, const gemmi::Miller&))
+         &SFC::calculate_sf_from_model)
+    .def("calculate_sf_from_model",
+         [](SFC& self, const gemmi::Model& model, const cpu_miller_array& hkl, int num_threads) {
+           return numpy_array_from_vector(
+               self.calculate_sf_from_model(model, miller_vector(hkl), num_threads));
+    }, nb::arg("model"), nb::arg("hkl"), nb::arg("num_threads")=1)
+    .def("calculate_sf_from_small_structure",
+         (std::complex<double> (SFC::*)(const gemmi::SmallStructure&, const gemmi::Miller&))
+         &SFC::calculate_sf_from_small_structure)
+    .def("calculate_sf_from_small_structure",
+         [](SFC& self, const gemmi::SmallStructure& small, const cpu_miller_array& hkl,
+            int num_threads) {
+           return numpy_array_from_vector(
+               self.calculate_sf_from_small_structure(small, miller_vector(hkl), num_threads));
+    }, nb::arg("small_st"), nb::arg("hkl"), nb::arg("num_threads")=1);
   if (with_mb)
     sfc
-      .def("mott_bethe_factor", &SFC::mott_bethe_factor)
+      .def("mott_bethe_factor", (double (SFC::*)() const) &SFC::mott_bethe_factor)
+      .def("mott_bethe_factor",
+           (double (SFC::*)(const gemmi::Miller&) const) &SFC::mott_bethe_factor,
+           nb::arg("hkl"))
       .def("calculate_mb_z", &SFC::calculate_mb_z,
            nb::arg("model"), nb::arg("hkl"), nb::arg("only_h")=false);
 }
@@ -38,6 +65,7 @@ void add_dencalc(nb::module_& m, const char* name) {
     .def_rw("rate", &DenCalc::rate)
     .def_rw("blur", &DenCalc::blur)
     .def_rw("cutoff", &DenCalc::cutoff)
+    .def_rw("num_threads", &DenCalc::num_threads)
     .def_rw("addends", &DenCalc::addends)
     .def("set_refmac_compatible_blur", &DenCalc::set_refmac_compatible_blur,
          nb::arg("model"), nb::arg("allow_negative")=false)
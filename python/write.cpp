@@ -96,10 +96,12 @@ void add_write(nb::module_& m, nb::class_<Structure>& structure) {
   structure
     .def("make_pdb_string", &make_pdb_string,
          nb::arg("options").sig("PdbWriteOptions()")=PdbWriteOptions())
-    .def("write_pdb", [](const Structure& st, const std::string& path, PdbWriteOptions options) {
+    .def("write_pdb", [](const Structure& st, const std::string& path,
+                         PdbWriteOptions options, int num_threads) {
         Ofstream f(path);
-        write_pdb(st, f.ref(), options);
-    })
+        write_pdb(st, f.ref(), options, num_threads);
+    }, nb::arg("path"), nb::arg("options").sig("PdbWriteOptions()")=PdbWriteOptions(),
+       nb::arg("num_threads")=1)
     // deprecated - kept for compatibility
     .def("write_pdb", [](const Structure& st, const std::string& path, const nb::kwargs& kwargs) {
         Ofstream f(path);
@@ -125,6 +127,14 @@ void add_write(nb::module_& m, nb::class_<Structure>& structure) {
          nb::arg("groups").sig("MmcifOutputGroups(True)")=MmcifOutputGroups(true))
     .def("update_mmcif_block", &update_mmcif_block, nb::arg("block"),
          nb::arg("groups").sig("MmcifOutputGroups(True)")=MmcifOutputGroups(true))
+    .def("write_mmcif", [](const Structure& st, const std::string& path,
+                           MmcifOutputGroups groups, cif::WriteOptions options,
+                           int num_threads) {
+       Ofstream f(path);
+       write_mmcif(st, f.ref(), groups, options, num_threads);
+    }, nb::arg("path"),
+       nb::arg("groups").sig("MmcifOutputGroups(True)")=MmcifOutputGroups(true),
+       nb::arg("options")=cif::WriteOptions(), nb::arg("num_threads")=1)
     .def("make_mmcif_headers", &make_mmcif_headers)
     ;
 }
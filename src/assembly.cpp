@@ -365,7 +365,7 @@ void merge_atoms_in_expanded_model(Model& model, const UnitCell& cell, double ma
       for (int n_atom = 0; n_atom != (int) res.atoms.size(); ++n_atom) {
         Atom& atom = res.atoms[n_atom];
         std::vector<std::pair<CRA, int>> equiv;
-        ns.for_each_cell(atom.pos, [&](std::vector<Mark>& marks, const Fractional& fr) {
+        ns.for_each_cell(atom.pos, [&](Span<Mark>& marks, const Fractional& fr) {
             for (Mark& m : marks) {
               // We look for the same atoms, but copied to a different chain.
               // First quick check that filters out most of non-matching pairs.
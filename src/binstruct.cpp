@@ -0,0 +1,245 @@
+// Copyright Global Phasing Ltd.
+
+#include <gemmi/binstruct.hpp>
+#include <cstring>   // for memcpy, memcmp
+#include <gemmi/fileutil.hpp>  // for file_open, read_file_into_buffer
+#if defined(__GNUC__) && __GNUC__-0 > 4
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wshadow"
+#endif
+#include "../third_party/serializer.h"
+#if defined(__GNUC__) && __GNUC__-0 > 4
+#pragma GCC diagnostic pop
+#endif
+#include <gemmi/serialize.hpp>
+
+#if !defined(_WIN32)
+# include <fcntl.h>     // for open
+# include <sys/mman.h>  // for mmap
+# include <sys/stat.h>  // for fstat
+# include <unistd.h>    // for close
+#endif
+
+namespace gemmi {
+
+namespace {
+
+const char bin_magic[8] = {'G', 'E', 'M', 'M', 'I', 'B', 'S', '\0'};
+const std::uint32_t bin_byte_order = 0x01020304;
+const size_t bin_header_size = 256;
+const int n_sections = (int) BinSec::Count;
+
+// When serialize.hpp changes, bump binary_structure_version
+// and update the number here.
+static_assert(serialize_layout_version == 1 && binary_structure_version == 1,
+              "serialized layout changed, bump binary_structure_version");
+static_assert(sizeof(Position) == 24, "unexpected padding in Position");
+static_assert(sizeof(Element) == 1, "unexpected size of Element");
+static_assert(48 + 8 * (n_sections + 1) <= bin_header_size, "header too small");
+
+struct SectionWriter {
+  std::vector<char> data[n_sections];
+
+  template<typename T>
+  void add(BinSec s, const T* ptr, size_t n) {
+    std::vector<char>& v = data[(int)s];
+    size_t pos = v.size();
+    v.resize(pos + n * sizeof(T));
+    if (n != 0)
+      std::memcpy(v.data() + pos, ptr, n * sizeof(T));
+  }
+  template<typename T>
+  void add(BinSec s, const T& value) { add(s, &value, 1); }
+
+  // names are stored as null-terminated strings with uint32 offsets
+  void add_name(BinSec idx, const std::string& name) {
+    std::vector<char>& names = data[(int)idx + 1];
+    add_name_offset(idx, names.size());
+    names.insert(names.end(), name.c_str(), name.c_str() + name.size() + 1);
+  }
+  void finish_names(BinSec idx) {
+    std::vector<char>& names = data[(int)idx + 1];
+    add_name_offset(idx, names.size());
+    names.push_back('\0');
+  }
+  void add_name_offset(BinSec idx, size_t offset) {
+    if (offset > UINT32_MAX)
+      fail("too many names for the binary format");
+    add(idx, (std::uint32_t) offset);
+  }
+};
+
+size_t align8(size_t n) { return (n + 7) & ~size_t(7); }
+
+void unmap_file(const char* data, size_t size) {
+#if !defined(_WIN32)
+  ::munmap(const_cast<char*>(data), size);
+#else
+  (void) data, (void) size;
+#endif
+}
+
+} // anonymous namespace
+
+void write_binary_structure(const Structure& st, const std::string& path) {
+  SectionWriter w;
+  std::uint64_t counts[4] = {st.models.size(), 0, 0, 0};
+  for (const Model& model : st.models) {
+    w.add(BinSec::ModelNum, (std::int32_t) model.num);
+    w.add(BinSec::ModelChains, (std::uint32_t) counts[1]);
+    for (const Chain& chain : model.chains) {
+      ++counts[1];
+      w.add(BinSec::ChainResidues, (std::uint32_t) counts[2]);
+      w.add_name(BinSec::ChainNameIdx, chain.name);
+      for (const Residue& res : chain.residues) {
+        ++counts[2];
+        w.add(BinSec::ResidueAtoms, (std::uint32_t) counts[3]);
+        w.add(BinSec::ResidueSeqNum, (std::int32_t) res.seqid.num.value);
+        w.add(BinSec::ResidueIcode, res.seqid.icode);
+        w.add_name(BinSec::ResidueNameIdx, res.name);
+        for (const Atom& atom : res.atoms) {
+          ++counts[3];
+          w.add(BinSec::AtomPos, atom.pos);
+          w.add(BinSec::AtomOcc, atom.occ);
+          w.add(BinSec::AtomBiso, atom.b_iso);
+          w.add(BinSec::AtomElement, atom.element);
+          w.add(BinSec::AtomAltloc, atom.altloc);
+          w.add_name(BinSec::AtomNameIdx, atom.name);
+        }
+      }
+    }
+  }
+  if (counts[3] > UINT32_MAX)
+    fail("too many atoms for the binary format");
+  w.add(BinSec::ModelChains, (std::uint32_t) counts[1]);
+  w.add(BinSec::ChainResidues, (std::uint32_t) counts[2]);
+  w.add(BinSec::ResidueAtoms, (std::uint32_t) counts[3]);
+  w.finish_names(BinSec::ChainNameIdx);
+  w.finish_names(BinSec::ResidueNameIdx);
+  w.finish_names(BinSec::AtomNameIdx);
+  {
+    std::vector<unsigned char> serialized;
+    zpp::serializer::memory_output_archive out(serialized);
+    out(st);
+    w.add(BinSec::StructureData, serialized.data(), serialized.size());
+  }
+
+  char header[bin_header_size] = {};
+  std::memcpy(header, bin_magic, 8);
+  std::memcpy(header + 8, &binary_structure_version, 4);
+  std::memcpy(header + 12, &bin_byte_order, 4);
+  std::memcpy(header + 16, counts, sizeof(counts));
+  std::uint64_t offsets[n_sections + 1];
+  offsets[0] = bin_header_size;
+  for (int i = 0; i < n_sections; ++i)
+    offsets[i+1] = offsets[i] + align8(w.data[i].size());
+  std::memcpy(header + 48, offsets, sizeof(offsets));
+
+  fileptr_t f = file_open(path.c_str(), "wb");
+  bool ok = std::fwrite(header, bin_header_size, 1, f.get()) == 1;
+  const char zeros[8] = {};
+  for (int i = 0; i < n_sections && ok; ++i) {
+    const std::vector<char>& v = w.data[i];
+    size_t padding = align8(v.size()) - v.size();
+    ok = (v.empty() || std::fwrite(v.data(), v.size(), 1, f.get()) == 1) &&
+         (padding == 0 || std::fwrite(zeros, padding, 1, f.get()) == 1);
+  }
+  if (!ok || std::fflush(f.get()) != 0)
+    sys_fail("Failed to write " + path);
+}
+
+BinaryStructure::BinaryStructure(const std::string& path) {
+#if !defined(_WIN32)
+  int fd = ::open(path.c_str(), O_RDONLY);
+  if (fd < 0)
+    sys_fail("Failed to open " + path);
+  struct stat sb;
+  if (::fstat(fd, &sb) == 0 && sb.st_size > 0) {
+    size_ = (size_t) sb.st_size;
+    void* ptr = ::mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (ptr != MAP_FAILED) {
+      data_ = static_cast<const char*>(ptr);
+      mapped_ = true;
+    }
+  }
+  ::close(fd);
+#endif
+  if (!mapped_) {
+    buffer_ = read_file_into_buffer(path);
+    data_ = buffer_.data();
+    size_ = buffer_.size();
+  }
+  try {
+    check_header();
+  } catch (std::runtime_error& e) {
+    if (mapped_)
+      unmap_file(data_, size_);
+    fail(path + ": " + e.what());
+  }
+}
+
+BinaryStructure::BinaryStructure(BinaryStructure&& o) noexcept
+  : data_(o.data_), size_(o.size_), mapped_(o.mapped_),
+    buffer_(std::move(o.buffer_)), counts_(o.counts_), offsets_(o.offsets_) {
+  o.data_ = nullptr;
+  o.mapped_ = false;
+}
+
+BinaryStructure::~BinaryStructure() {
+  if (mapped_)
+    unmap_file(data_, size_);
+}
+
+void BinaryStructure::check_header() const {
+  if (size_ < bin_header_size || std::memcmp(data_, bin_magic, 8) != 0)
+    fail("not a binary structure file");
+  std::uint32_t version, byte_order;
+  std::memcpy(&version, data_ + 8, 4);
+  std::memcpy(&byte_order, data_ + 12, 4);
+  if (byte_order != bin_byte_order)
+    fail("binary structure file with different byte order");
+  if (version != binary_structure_version)
+    fail("unsupported version of binary structure file: " + std::to_string(version));
+  // the header is 8-byte aligned in both mmap-ed memory and CharArray
+  const_cast<BinaryStructure*>(this)->counts_ =
+      reinterpret_cast<const std::uint64_t*>(data_ + 16);
+  const_cast<BinaryStructure*>(this)->offsets_ =
+      reinterpret_cast<const std::uint64_t*>(data_ + 48);
+  if (offsets_[0] != bin_header_size || offsets_[n_sections] != size_)
+    fail("corrupted binary structure file");
+  for (int i = 0; i < n_sections; ++i)
+    if (offsets_[i+1] < offsets_[i] || offsets_[i] % 8 != 0)
+      fail("corrupted binary structure file");
+  auto sec_size = [&](BinSec s) { return offsets_[(int)s + 1] - offsets_[(int)s]; };
+  const std::uint64_t n_models = counts_[0], n_chains = counts_[1],
+                      n_res = counts_[2], n_atoms = counts_[3];
+  if (sec_size(BinSec::ModelNum) < 4 * n_models ||
+      sec_size(BinSec::ModelChains) < 4 * (n_models + 1) ||
+      sec_size(BinSec::ChainResidues) < 4 * (n_chains + 1) ||
+      sec_size(BinSec::ChainNameIdx) < 4 * (n_chains + 1) ||
+      sec_size(BinSec::ResidueAtoms) < 4 * (n_res + 1) ||
+      sec_size(BinSec::ResidueSeqNum) < 4 * n_res ||
+      sec_size(BinSec::ResidueIcode) < n_res ||
+      sec_size(BinSec::ResidueNameIdx) < 4 * (n_res + 1) ||
+      sec_size(BinSec::AtomPos) < 24 * n_atoms ||
+      sec_size(BinSec::AtomOcc) < 4 * n_atoms ||
+      sec_size(BinSec::AtomBiso) < 4 * n_atoms ||
+      sec_size(BinSec::AtomElement) < n_atoms ||
+      sec_size(BinSec::AtomAltloc) < n_atoms ||
+      sec_size(BinSec::AtomNameIdx) < 4 * (n_atoms + 1))
+    fail("corrupted binary structure file");
+  for (BinSec s : {BinSec::ChainNames, BinSec::ResidueNames, BinSec::AtomNames})
+    if (sec_size(s) == 0 || data_[offsets_[(int)s + 1] - 1] != '\0')
+      fail("corrupted binary structure file");
+}
+
+Structure BinaryStructure::structure() const {
+  Structure st;
+  zpp::serializer::memory_view_input_archive in(
+      sec<unsigned char>(BinSec::StructureData),
+      offsets_[(int)BinSec::StructureData + 1] - offsets_[(int)BinSec::StructureData]);
+  in(st);
+  return st;
+}
+
+} // namespace gemmi
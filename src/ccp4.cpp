@@ -3,6 +3,10 @@
 #include "gemmi/ccp4.hpp"
 #include "gemmi/gz.hpp"  // for MaybeGzipped
 
+#if !defined(_WIN32)
+# include <unistd.h>  // for pread
+#endif
+
 namespace gemmi {
 
 Ccp4<float> read_ccp4_map(const std::string& path, bool setup) {
@@ -27,4 +31,104 @@ Ccp4Base read_ccp4_header(const std::string& path) {
   return ccp4;
 }
 
+Ccp4Reader::Ccp4Reader(const std::string& path)
+    : path_(path), file_(file_open(path.c_str(), "rb")) {
+  FileStream stream(file_.get());
+  read_ccp4_header_(nullptr, stream, path);
+  int mode = header_i32(4);
+  if (mode != 0 && mode != 1 && mode != 2 && mode != 6)
+    fail("Mode " + std::to_string(mode) + " is not supported "
+         "(only 0, 1, 2 and 6 are supported).");
+  data_offset_ = 4 * ccp4_header.size();
+}
+
+void Ccp4Reader::check_box(const std::array<int, 3>& start,
+                           const std::array<int, 3>& size) const {
+  std::array<int, 3> dims = file_dims();
+  for (int i = 0; i < 3; ++i)
+    if (start[i] < 0 || size[i] < 0 || start[i] + size[i] > dims[i])
+      fail("Ccp4Reader: box outside of the map in " + path_);
+}
+
+void Ccp4Reader::read_bytes(size_t offset, size_t n, void* buf) const {
+#if defined(_WIN32)
+  bool ok = _fseeki64(file_.get(), (long long) offset, SEEK_SET) == 0 &&
+            (n == 0 || std::fread(buf, n, 1, file_.get()) == 1);
+#else
+  int fd = fileno(file_.get());
+  char* ptr = static_cast<char*>(buf);
+  bool ok = true;
+  while (n != 0) {
+    ssize_t ret = ::pread(fd, ptr, n, (off_t) offset);
+    if (ret <= 0) {
+      ok = false;
+      break;
+    }
+    ptr += ret;
+    offset += ret;
+    n -= ret;
+  }
+#endif
+  if (!ok)
+    fail("Failed to read the data from the map file: " + path_);
+}
+
+std::pair<std::array<int, 3>, std::array<int, 3>>
+Ccp4Reader::box_for_extent(const Box<Fractional>& box) const {
+  // cf. get_extent()
+  auto pos = axis_positions();
+  std::array<int, 3> file_start = header_3i32(5);
+  std::array<int, 3> dims = file_dims();
+  std::array<int, 3> sampl = header_3i32(8);
+  std::array<int, 3> start, size;
+  for (int i = 0; i < 3; ++i) {
+    int p = pos[i];
+    int lo = (int) std::ceil(box.minimum.at(i) * sampl[i]) - file_start[p];
+    int hi = (int) std::floor(box.maximum.at(i) * sampl[i]) - file_start[p];
+    start[p] = std::max(lo, 0);
+    size[p] = std::min(hi, dims[p] - 1) - start[p] + 1;
+    if (size[p] <= 0)
+      fail("Ccp4Reader: the box does not overlap the map in " + path_);
+  }
+  return {start, size};
+}
+
+Ccp4Writer::Ccp4Writer(const std::string& path, const Ccp4Base& header)
+    : Ccp4Base(header), path_(path) {
+  if (ccp4_header.size() < 256)
+    fail("Ccp4Writer: the map header is not set");
+  int mode = header_i32(4);
+  if (mode != 0 && mode != 1 && mode != 2 && mode != 6)
+    fail("Only modes 0, 1, 2 and 6 are supported.");
+  std::array<int, 3> dims = header_3i32(1);
+  point_count_ = (size_t) dims[0] * dims[1] * dims[2];
+  hstats = DataStats();
+  f_ = file_open(path.c_str(), "wb");
+  // the header is written again in finish(), with updated statistics
+  write_bytes(ccp4_header.data(), 4 * ccp4_header.size());
+}
+
+void Ccp4Writer::write_bytes(const void* buf, size_t n) {
+  if (n != 0 && std::fwrite(buf, n, 1, f_.get()) != 1)
+    sys_fail("Failed to write data to the map file " + path_);
+}
+
+void Ccp4Writer::finish() {
+  if (written_ != point_count_)
+    fail("Ccp4Writer: written " + std::to_string(written_) + " of "
+         + std::to_string(point_count_) + " points to " + path_);
+  if (hstats.nan_count != written_) {
+    double n = double(written_ - hstats.nan_count);
+    hstats.dmean = sum_ / n;
+    hstats.rms = std::sqrt(sq_sum_ / n - hstats.dmean * hstats.dmean);
+  }
+  update_header_mode_and_stats(header_i32(4));
+  if (std::fseek(f_.get(), 0, SEEK_SET) != 0)
+    sys_fail("Failed to rewind " + path_);
+  write_bytes(ccp4_header.data(), 4 * ccp4_header.size());
+  if (std::fflush(f_.get()) != 0)
+    sys_fail("Failed to write " + path_);
+  f_.reset();
+}
+
 } // namespace gemmi
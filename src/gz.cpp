@@ -4,6 +4,14 @@
 #include <cassert>
 #include <cstdio>       // fseek, ftell, fread
 #include <climits>      // INT_MAX
+#include <algorithm>    // for min
+#include <condition_variable>
+#include <deque>
+#include <exception>    // for exception_ptr
+#include <mutex>
+#include <system_error> // for system_error
+#include <thread>
+#include <vector>
 #if USE_ZLIB_NG
 # define WITH_GZFILEOP 1
 # include <zlib-ng.h>
@@ -13,6 +21,7 @@
 # define GG(name) name
 #endif
 #include <gemmi/fileutil.hpp> // file_open
+#include <gemmi/parallel.hpp> // for parallel_for_chunks
 
 namespace gemmi {
 
@@ -76,6 +85,346 @@ static size_t big_gzread(gzFile file, void* buf, size_t len) {
 #endif
 }
 
+namespace {
+
+#if USE_ZLIB_NG
+using ZStream = zng_stream;
+#else
+using ZStream = z_stream;
+#endif
+
+// Parses gzip member header (RFC 1952). Returns the header length,
+// or 0 if p does not start with a complete gzip header.
+// If the header has BGZF extra subfield (BC), *block_size is set to
+// the size of the whole member, otherwise to 0.
+size_t parse_gzip_header(const unsigned char* p, size_t n, size_t* block_size) {
+  *block_size = 0;
+  if (n < 10 || p[0] != 0x1f || p[1] != 0x8b || p[2] != 8)
+    return 0;
+  int flags = p[3];
+  size_t pos = 10;
+  if (flags & 4) {  // FEXTRA
+    if (n < pos + 2)
+      return 0;
+    size_t xlen = p[pos] | (p[pos+1] << 8);
+    pos += 2;
+    if (n < pos + xlen)
+      return 0;
+    for (size_t i = pos; i + 4 <= pos + xlen; ) {
+      size_t slen = p[i+2] | (p[i+3] << 8);
+      if (p[i] == 'B' && p[i+1] == 'C' && slen == 2 && i + 6 <= pos + xlen)
+        *block_size = (p[i+4] | (p[i+5] << 8)) + 1;
+      i += 4 + slen;
+    }
+    pos += xlen;
+  }
+  for (int flag : {8, 16})  // FNAME, FCOMMENT
+    if (flags & flag) {
+      const void* zero = pos < n ? std::memchr(p + pos, '\0', n - pos) : nullptr;
+      if (!zero)
+        return 0;
+      pos = (const unsigned char*) zero - p + 1;
+    }
+  if (flags & 2)  // FHCRC
+    pos += 2;
+  return pos <= n ? pos : 0;
+}
+
+std::uint32_t read_le32(const unsigned char* p) {
+  return p[0] | (p[1] << 8) | (p[2] << 16) | ((std::uint32_t)p[3] << 24);
+}
+
+// Sequential decompression of (possibly multi-member) gzip file.
+// Like gzread(), it reads files that are not gzipped as they are
+// and ignores trailing garbage after a gzip member.
+class GzInflater {
+public:
+  explicit GzInflater(const std::string& path)
+    : path_(path), f_(file_open(path.c_str(), "rb")), in_(256 * 1024) {
+    fill_input();
+    const unsigned char* p = in_.data();
+    transparent_ = !(avail_ >= 2 && p[0] == 0x1f && p[1] == 0x8b);
+    if (!transparent_) {
+      zs_.next_in = in_.data();
+      zs_.avail_in = (unsigned) avail_;
+      if (GG(inflateInit2)(&zs_, 15 + 16) != Z_OK)
+        fail("inflateInit2 failed");
+      initialized_ = true;
+    }
+  }
+  GzInflater(const GzInflater&) = delete;
+  ~GzInflater() {
+    if (initialized_)
+      GG(inflateEnd)(&zs_);
+  }
+
+  // Returns the number of bytes written to buf, 0 at the end of data.
+  size_t read(char* buf, size_t len) {
+    if (transparent_)
+      return read_transparent(buf, len);
+    size_t total = 0;
+    while (total < len && !finished_) {
+      if (zs_.avail_in == 0) {
+        fill_input();
+        zs_.next_in = in_.data();
+        zs_.avail_in = (unsigned) avail_;
+      }
+      size_t out_len = std::min(len - total, (size_t) UINT_MAX);
+      zs_.next_out = (unsigned char*) buf + total;
+      zs_.avail_out = (unsigned) out_len;
+      int ret = GG(inflate)(&zs_, Z_NO_FLUSH);
+      total += out_len - zs_.avail_out;
+      if (ret == Z_STREAM_END) {
+        // another gzip member may follow
+        if (zs_.avail_in < 2 && !eof_) {
+          std::memmove(in_.data(), zs_.next_in, zs_.avail_in);
+          size_t n = zs_.avail_in;
+          avail_ = n + std::fread(in_.data() + n, 1, in_.size() - n, f_.get());
+          eof_ = avail_ < in_.size();
+          zs_.next_in = in_.data();
+          zs_.avail_in = (unsigned) avail_;
+        }
+        if (zs_.avail_in >= 2 && zs_.next_in[0] == 0x1f && zs_.next_in[1] == 0x8b)
+          GG(inflateReset)(&zs_);
+        else
+          finished_ = true;
+      } else if (ret == Z_BUF_ERROR && zs_.avail_in == 0 && eof_) {
+        fail("Error reading " + path_ + ": unexpected end of file");
+      } else if (ret != Z_OK && ret != Z_BUF_ERROR) {
+        fail("Error reading " + path_ + ": " + (zs_.msg ? zs_.msg : "inflate failed"));
+      }
+    }
+    return total;
+  }
+
+private:
+  std::string path_;
+  fileptr_t f_;
+  std::vector<unsigned char> in_;
+  size_t avail_ = 0;
+  ZStream zs_ = {};
+  bool eof_ = false;
+  bool transparent_ = false;
+  bool initialized_ = false;
+  bool finished_ = false;
+  size_t transparent_pos_ = 0;
+
+  void fill_input() {
+    avail_ = eof_ ? 0 : std::fread(in_.data(), 1, in_.size(), f_.get());
+    if (avail_ < in_.size()) {
+      if (std::ferror(f_.get()))
+        sys_fail("failed to read " + path_);
+      eof_ = true;
+    }
+  }
+
+  size_t read_transparent(char* buf, size_t len) {
+    size_t total = 0;
+    while (total < len) {
+      if (transparent_pos_ == avail_) {
+        if (eof_)
+          break;
+        fill_input();
+        transparent_pos_ = 0;
+      }
+      size_t n = std::min(len - total, avail_ - transparent_pos_);
+      std::memcpy(buf + total, in_.data() + transparent_pos_, n);
+      transparent_pos_ += n;
+      total += n;
+    }
+    return total;
+  }
+};
+
+struct BgzfBlock {
+  size_t in_pos;   // position of deflate data
+  size_t in_size;
+  size_t out_pos;
+  std::uint32_t crc;
+  std::uint32_t out_size;
+};
+
+// Returns empty vector if the data is not entirely in BGZF format.
+std::vector<BgzfBlock> find_bgzf_blocks(const unsigned char* data, size_t size) {
+  std::vector<BgzfBlock> blocks;
+  size_t out_pos = 0;
+  for (size_t pos = 0; pos < size; ) {
+    size_t block_size;
+    size_t header_size = parse_gzip_header(data + pos, size - pos, &block_size);
+    if (header_size == 0 || block_size < header_size + 8 || block_size > size - pos)
+      return {};
+    const unsigned char* trailer = data + pos + block_size - 8;
+    BgzfBlock block;
+    block.in_pos = pos + header_size;
+    block.in_size = block_size - header_size - 8;
+    block.out_pos = out_pos;
+    block.crc = read_le32(trailer);
+    block.out_size = read_le32(trailer + 4);
+    blocks.push_back(block);
+    out_pos += block.out_size;
+    pos += block_size;
+  }
+  return blocks;
+}
+
+// BGZF consists of independent gzip members (up to 64KiB each) that
+// have their size recorded in the header, so they can be inflated
+// in parallel directly into their final positions.
+CharArray inflate_bgzf(const std::string& path, const unsigned char* data,
+                       const std::vector<BgzfBlock>& blocks, int num_threads) {
+  const BgzfBlock& last = blocks.back();
+  CharArray mem(last.out_pos + last.out_size);
+  parallel_for_chunks(blocks.size(), num_threads, [&](size_t begin, size_t end, int) {
+    ZStream zs = {};
+    if (GG(inflateInit2)(&zs, -15) != Z_OK)
+      fail("inflateInit2 failed");
+    std::string error;
+    for (size_t i = begin; i != end && error.empty(); ++i) {
+      const BgzfBlock& b = blocks[i];
+      GG(inflateReset)(&zs);
+      zs.next_in = const_cast<unsigned char*>(data + b.in_pos);
+      zs.avail_in = (unsigned) b.in_size;
+      unsigned char* out = (unsigned char*) mem.data() + b.out_pos;
+      zs.next_out = out;
+      zs.avail_out = b.out_size;
+      int ret = GG(inflate)(&zs, Z_FINISH);
+      if (ret != Z_STREAM_END || zs.avail_out != 0)
+        error = zs.msg ? zs.msg : "corrupted BGZF block";
+      else if (GG(crc32)(GG(crc32)(0, nullptr, 0), out, b.out_size) != b.crc)
+        error = "incorrect data check";
+    }
+    GG(inflateEnd)(&zs);
+    if (!error.empty())
+      fail("Error reading " + path + ": " + error);
+  });
+  return mem;
+}
+
+// Streams data inflated by GzInflater on a background thread,
+// so that decompression overlaps with parsing.
+class BackgroundGzStream final : public AnyStream {
+public:
+  explicit BackgroundGzStream(const std::string& path)
+    : inflater_(path), thread_(&BackgroundGzStream::produce, this) {}
+  ~BackgroundGzStream() {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      stop_ = true;
+    }
+    cv_.notify_all();
+    thread_.join();
+  }
+
+  char* gets(char* line, int size) override {
+    int n = 0;
+    while (n < size - 1 && (pos_ < cur_.size() || next_chunk())) {
+      size_t count = std::min(cur_.size() - pos_, size_t(size - 1 - n));
+      const char* start = cur_.data() + pos_;
+      const char* nl = (const char*) std::memchr(start, '\n', count);
+      if (nl)
+        count = nl - start + 1;
+      std::memcpy(line + n, start, count);
+      pos_ += count;
+      n += (int) count;
+      if (nl)
+        break;
+    }
+    if (n == 0)
+      return nullptr;
+    line[n] = '\0';
+    return line;
+  }
+
+  int getc() override {
+    if (pos_ == cur_.size() && !next_chunk())
+      return EOF;
+    return (unsigned char) cur_[pos_++];
+  }
+
+  bool read(void* buf, size_t len) override {
+    char* out = (char*) buf;
+    while (len != 0) {
+      if (pos_ == cur_.size() && !next_chunk())
+        return false;
+      size_t n = std::min(len, cur_.size() - pos_);
+      std::memcpy(out, cur_.data() + pos_, n);
+      pos_ += n;
+      out += n;
+      len -= n;
+    }
+    return true;
+  }
+
+private:
+  static constexpr size_t chunk_size = 1024 * 1024;
+  static constexpr size_t max_ready = 4;
+  GzInflater inflater_;
+  std::vector<char> cur_;
+  size_t pos_ = 0;
+  std::mutex mutex_;
+  std::condition_variable cv_;
+  std::deque<std::vector<char>> ready_;
+  std::vector<char> spare_;
+  bool done_ = false;
+  bool stop_ = false;
+  std::exception_ptr error_;
+  std::thread thread_;  // the last member, started after the others
+
+  bool next_chunk() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    cv_.wait(lock, [&] { return !ready_.empty() || done_; });
+    if (ready_.empty()) {
+      if (error_)
+        std::rethrow_exception(error_);
+      return false;
+    }
+    spare_.swap(cur_);
+    cur_.swap(ready_.front());
+    ready_.pop_front();
+    pos_ = 0;
+    lock.unlock();
+    cv_.notify_all();
+    return true;
+  }
+
+  void produce() {
+    try {
+      for (;;) {
+        std::vector<char> buf;
+        {
+          std::unique_lock<std::mutex> lock(mutex_);
+          cv_.wait(lock, [&] { return ready_.size() < max_ready || stop_; });
+          if (stop_)
+            break;
+          buf.swap(spare_);
+        }
+        buf.resize(chunk_size);
+        buf.resize(inflater_.read(buf.data(), chunk_size));
+        if (buf.empty())
+          break;
+        {
+          std::lock_guard<std::mutex> lock(mutex_);
+          ready_.push_back(std::move(buf));
+        }
+        cv_.notify_all();
+      }
+    } catch (...) {
+      std::lock_guard<std::mutex> lock(mutex_);
+      error_ = std::current_exception();
+    }
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      done_ = true;
+    }
+    cv_.notify_all();
+  }
+};
+
+// compressed files smaller than this are read without additional thread
+const size_t background_inflate_min_size = 1024 * 1024;
+
+} // anonymous namespace
+
 char* GzStream::gets(char* line, int size) {
   return GG(gzgets)((gzFile)f, line, size);
 }
@@ -89,7 +438,8 @@ bool GzStream::read(void* buf, size_t len) {
 }
 
 
-MaybeGzipped::MaybeGzipped(const std::string& path) : BasicInput(path) {}
+MaybeGzipped::MaybeGzipped(const std::string& path, int num_threads)
+  : BasicInput(path), num_threads_(num_threads) {}
 
 MaybeGzipped::~MaybeGzipped() {
   if (file_)
@@ -119,38 +469,59 @@ size_t MaybeGzipped::gzread_checked(void* buf, size_t len) {
 CharArray MaybeGzipped::uncompress_into_buffer(size_t limit) {
   if (!is_compressed())
     return BasicInput::uncompress_into_buffer();
-  size_t size = (limit == 0 ? estimate_uncompressed_size(path()) : limit);
-  file_ = GG(gzopen)(path().c_str(), "rb");
-  if (!file_)
-    sys_fail("Failed to gzopen " + path());
-  if (size > 3221225471)
-    // if this exception is changed adjust prog/cif2mtz.cpp
-    fail("For now gz files above 3 GiB uncompressed are not supported.\n"
-         "To read " + path() + " first uncompress it.");
-  CharArray mem(size);
-  size_t read_bytes = gzread_checked(mem.data(), size);
-  // if the file is shorter than the size from header, adjust size
-  if (read_bytes < size) {
-    mem.set_size(read_bytes);  // should we call resize() here
-  } else if (limit == 0) { // read_bytes == size
-  // if the file is longer than the size from header, read in the rest
-    int next_char;
-    while (!GG(gzeof)((gzFile)file_) && (next_char = GG(gzgetc)((gzFile)file_)) != -1) {
-      if (mem.size() > 3221225471)
-        fail("For now gz files above 3 GiB uncompressed are not supported.\n"
-             "To read " + path() + " first uncompress it.");
-      GG(gzungetc)(next_char, (gzFile)file_);
-      size_t old_size = mem.size();
-      mem.resize(2 * old_size);
-      size_t n = gzread_checked(mem.data() + old_size, old_size);
-      mem.set_size(old_size + n);
+  if (limit == 0) {
+    fileptr_t f = file_open(path().c_str(), "rb");
+    unsigned char header[64];
+    size_t n = std::fread(header, 1, sizeof(header), f.get());
+    size_t block_size;
+    if (parse_gzip_header(header, n, &block_size) != 0 && block_size != 0) {
+      f.reset();
+      CharArray gz = read_file_into_buffer(path());
+      const unsigned char* data = (const unsigned char*) gz.data();
+      std::vector<BgzfBlock> blocks = find_bgzf_blocks(data, gz.size());
+      if (!blocks.empty())
+        return inflate_bgzf(path(), data, blocks, get_num_threads(num_threads_));
     }
   }
+  size_t size = limit;
+  if (size == 0) {
+    try {
+      size = estimate_uncompressed_size(path());
+    } catch (std::runtime_error&) {
+      size = 0;
+    }
+    // the estimate comes from 32-bit field, we just start with it
+    size = std::max(size, (size_t) 64 * 1024);
+  }
+  GzInflater inflater(path());
+  // one extra byte: if the estimate is exact, the end of data is detected
+  // without growing the buffer
+  CharArray mem(limit == 0 ? size + 1 : size);
+  size_t read_bytes = inflater.read(mem.data(), mem.size());
+  // the size from the gzip trailer is not reliable (multi-member files,
+  // files >= 4GiB), so we read until the end, growing the buffer
+  while (limit == 0 && read_bytes == mem.size()) {
+    size_t old_size = mem.size();
+    mem.resize(2 * old_size);
+    read_bytes += inflater.read(mem.data() + old_size, old_size);
+  }
+  mem.set_size(read_bytes);
   return mem;
 }
 
 std::unique_ptr<AnyStream> MaybeGzipped::create_stream() {
   if (is_compressed()) {
+    // large files are decompressed in a separate thread
+    fileptr_t f = file_open(path().c_str(), "rb");
+    if (file_size(f.get(), path()) >= background_inflate_min_size) {
+      f.reset();
+      try {
+        return std::unique_ptr<AnyStream>(new BackgroundGzStream(path()));
+      } catch (std::system_error&) {
+        // threads not available, fall back to gzFile
+      }
+    }
+    f.reset();
     file_ = GG(gzopen)(path().c_str(), "rb");
     if (!file_)
       sys_fail("Failed to gzopen " + path());
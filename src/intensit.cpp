@@ -1,8 +1,12 @@
 // Copyright Global Phasing Ltd.
 
 #include <gemmi/intensit.hpp>
+#include <climits>    // for INT_MAX, INT_MIN
+#include <cstdint>    // for uint64_t
+#include <numeric>    // for iota
 #include <gemmi/atof.hpp>  // for fast_from_chars
 #include <gemmi/refln.hpp>
+#include <gemmi/parallel.hpp>  // for parallel_for_chunks
 
 namespace gemmi {
 
@@ -89,6 +93,111 @@ bool read_staraniso_b_from_mmcif(const cif::Block& block, SMat33<double>& output
   return true;
 }
 
+int bit_width(std::uint64_t x) {
+  int n = 0;
+  for (; x != 0; x >>= 1)
+    ++n;
+  return n;
+}
+
+// Stable LSD radix sort of v on bits [lo_bit, hi_bit), 11 bits per pass.
+void radix_sort_bits(std::vector<std::uint64_t>& v, int lo_bit, int hi_bit, int n_threads) {
+  constexpr int radix_bits = 11;
+  constexpr size_t n_buckets = size_t(1) << radix_bits;
+  std::vector<std::uint64_t> tmp(v.size());
+  std::vector<size_t> counts(n_threads * n_buckets);
+  for (int shift = lo_bit; shift < hi_bit; shift += radix_bits) {
+    std::fill(counts.begin(), counts.end(), 0);
+    parallel_for_chunks(v.size(), n_threads, [&](size_t begin, size_t end, int t) {
+      size_t* c = &counts[t * n_buckets];
+      for (size_t i = begin; i < end; ++i)
+        ++c[(v[i] >> shift) & (n_buckets - 1)];
+    });
+    // offsets are assigned in (digit, chunk) order to keep the sort stable
+    size_t total = 0;
+    bool same_digit = false;
+    for (size_t d = 0; d < n_buckets; ++d) {
+      size_t start = total;
+      for (int t = 0; t < n_threads; ++t) {
+        size_t c = counts[t * n_buckets + d];
+        counts[t * n_buckets + d] = total;
+        total += c;
+      }
+      if (total - start == v.size())
+        same_digit = true;
+    }
+    if (same_digit)  // nothing to do in this pass
+      continue;
+    parallel_for_chunks(v.size(), n_threads, [&](size_t begin, size_t end, int t) {
+      size_t* c = &counts[t * n_buckets];
+      for (size_t i = begin; i < end; ++i)
+        tmp[c[(v[i] >> shift) & (n_buckets - 1)]++] = v[i];
+    });
+    v.swap(tmp);
+  }
+}
+
+// Returns indices of data stably sorted by (h, k, l, isign). Each index
+// is stored in the lower idx_bits bits, the upper bits are equal for equal
+// (h, k, l, isign) and used for grouping.
+std::vector<std::uint64_t> sort_for_merging(const std::vector<Intensities::Refl>& data,
+                                            int n_threads, int& idx_bits) {
+  const size_t n = data.size();
+  idx_bits = bit_width(n - 1);
+  std::vector<std::array<int,6>> ranges(n_threads, {{INT_MAX, INT_MIN, INT_MAX,
+                                                     INT_MIN, INT_MAX, INT_MIN}});
+  parallel_for_chunks(n, n_threads, [&](size_t begin, size_t end, int t) {
+    std::array<int,6>& r = ranges[t];
+    for (size_t i = begin; i < end; ++i)
+      for (int j = 0; j < 3; ++j) {
+        r[2*j] = std::min(r[2*j], data[i].hkl[j]);
+        r[2*j+1] = std::max(r[2*j+1], data[i].hkl[j]);
+      }
+  });
+  std::array<int,6> range = ranges[0];
+  for (const std::array<int,6>& r : ranges)
+    for (int j = 0; j < 3; ++j) {
+      range[2*j] = std::min(range[2*j], r[2*j]);
+      range[2*j+1] = std::max(range[2*j+1], r[2*j+1]);
+    }
+  int bits[3];
+  for (int j = 0; j < 3; ++j)
+    bits[j] = bit_width(std::uint64_t(std::int64_t(range[2*j+1]) - range[2*j]));
+  int key_bits = bits[0] + bits[1] + bits[2] + 2;  // 2 bits for isign+1
+
+  std::vector<std::uint64_t> v(n);
+  if (key_bits + idx_bits <= 64) {
+    int shift_k = bits[2] + 2 + idx_bits;
+    int shift_h = bits[1] + shift_k;
+    parallel_for_chunks(n, n_threads, [&](size_t begin, size_t end, int) {
+      for (size_t i = begin; i < end; ++i) {
+        const Intensities::Refl& r = data[i];
+        v[i] = std::uint64_t(std::int64_t(r.hkl[0]) - range[0]) << shift_h |
+               std::uint64_t(std::int64_t(r.hkl[1]) - range[2]) << shift_k |
+               std::uint64_t(std::int64_t(r.hkl[2]) - range[4]) << (2 + idx_bits) |
+               std::uint64_t(r.isign + 1) << idx_bits |
+               i;
+      }
+    });
+    radix_sort_bits(v, idx_bits, idx_bits + key_bits, n_threads);
+  } else {
+    // Miller indices span a range too wide for packed keys
+    if (2 * idx_bits > 64)
+      fail("too many reflections to merge");
+    std::iota(v.begin(), v.end(), 0);
+    std::stable_sort(v.begin(), v.end(), [&](std::uint64_t a, std::uint64_t b) {
+        return data[a] < data[b];
+    });
+    std::uint64_t group = 0;
+    for (size_t i = 1; i < n; ++i) {
+      if (data[v[i-1] & ((std::uint64_t(1) << idx_bits) - 1)] < data[v[i]])
+        ++group;
+      v[i] |= group << idx_bits;
+    }
+  }
+  return v;
+}
+
 } // anonymous namespace
 
 // This function is used in wasm/to_cif.cpp.
@@ -152,67 +261,177 @@ Correlation Intensities::calculate_correlation(const Intensities& other) const {
   return corr;
 }
 
-void Intensities::merge_in_place(DataType new_type) {
+std::vector<MergingStats> Intensities::merge_in_place(DataType new_type, int num_threads,
+                                                      double outlier_sigma,
+                                                      const Binner* binner) {
   if (data.empty() || new_type == type || type == DataType::Mean || new_type == DataType::Unmerged)
-    return;
+    return {};
+  if (binner)
+    binner->ensure_limits_are_set();
+  int n_threads = get_num_threads(num_threads);
   if (new_type == DataType::Mean) {
     // discard signs so that merging produces Imean
     for (Refl& refl : data)
       refl.isign = 0;
   } else if (new_type == DataType::Anomalous && type == DataType::Unmerged) {
     GroupOps gops = spacegroup->operations();
-    for (Refl& refl : data)
-      refl.isign = refl.isym % 2 != 0 || gops.is_reflection_centric(refl.hkl) ? 1 : -1;
+    parallel_for_chunks(data.size(), n_threads, [&](size_t begin, size_t end, int) {
+      for (size_t i = begin; i < end; ++i) {
+        Refl& refl = data[i];
+        refl.isign = refl.isym % 2 != 0 || gops.is_reflection_centric(refl.hkl) ? 1 : -1;
+      }
+    });
   }
-  sort();
-  std::vector<Refl>::iterator out = data.begin();
-  double sum_wI = 0.;
-  double sum_w = 0.;
-  int nobs = 0;
-  for (auto in = data.begin(); in != data.end(); ++in) {
-    if (out->hkl != in->hkl || out->isign != in->isign) {
-      out->value = sum_wI / sum_w;
-      out->sigma = 1.0 / std::sqrt(sum_w);
-      out->nobs = nobs;
-      sum_wI = sum_w = 0.;
-      nobs = 0;
+  int idx_bits;
+  std::vector<std::uint64_t> sorted = sort_for_merging(data, n_threads, idx_bits);
+  const std::uint64_t idx_mask = (std::uint64_t(1) << idx_bits) - 1;
+  auto group_start = [&](size_t pos) {
+    while (pos != 0 && pos < sorted.size() &&
+           (sorted[pos-1] >> idx_bits) == (sorted[pos] >> idx_bits))
+      ++pos;
+    return pos;
+  };
+
+  // the first pass counts merged reflections in each chunk
+  std::vector<size_t> offsets(n_threads + 1, 0);
+  parallel_for_chunks(sorted.size(), n_threads, [&](size_t begin, size_t end, int t) {
+    begin = group_start(begin);
+    end = group_start(end);
+    size_t count = 0;
+    for (size_t i = begin; i < end; ++i)
+      if (i == begin || (sorted[i-1] >> idx_bits) != (sorted[i] >> idx_bits))
+        ++count;
+    offsets[t + 1] = count;
+  });
+  for (int t = 0; t < n_threads; ++t)
+    offsets[t + 1] += offsets[t];
+
+  // the second pass merges observations and accumulates statistics
+  std::vector<Refl> merged(offsets.back());
+  size_t n_bins = binner ? binner->size() : 1;
+  std::vector<std::vector<MergingStats>> stats(n_threads,
+                                               std::vector<MergingStats>(n_bins));
+  parallel_for_chunks(sorted.size(), n_threads, [&](size_t begin, size_t end, int t) {
+    begin = group_start(begin);
+    end = group_start(end);
+    Refl* out = merged.data() + offsets[t];
+    std::vector<char> rejected;
+    int hint = 0;
+    for (size_t b = begin; b < end; ) {
+      size_t e = b + 1;
+      while (e < end && (sorted[e] >> idx_bits) == (sorted[b] >> idx_bits))
+        ++e;
+      auto obs = [&](size_t i) -> const Refl& { return data[sorted[b + i] & idx_mask]; };
+      size_t n = e - b;
+      rejected.assign(n, 0);
+      size_t n_ok = n;
+      if (outlier_sigma > 0 && n > 2) {
+        double sum_wI = 0.;
+        double sum_w = 0.;
+        for (size_t i = 0; i < n; ++i) {
+          double w = 1. / (obs(i).sigma * obs(i).sigma);
+          sum_wI += w * obs(i).value;
+          sum_w += w;
+        }
+        while (n_ok > 2) {
+          double max_dev = 0.;
+          size_t worst = 0;
+          for (size_t i = 0; i < n; ++i) {
+            if (rejected[i])
+              continue;
+            const Refl& r = obs(i);
+            double w = 1. / (r.sigma * r.sigma);
+            double others_w = sum_w - w;
+            if (others_w <= 0)
+              continue;
+            double others_mean = (sum_wI - w * r.value) / others_w;
+            double dev = std::fabs(r.value - others_mean) /
+                         std::sqrt(r.sigma * r.sigma + 1. / others_w);
+            if (dev > max_dev) {
+              max_dev = dev;
+              worst = i;
+            }
+          }
+          if (max_dev <= outlier_sigma)
+            break;
+          rejected[worst] = 1;
+          --n_ok;
+          double w = 1. / (obs(worst).sigma * obs(worst).sigma);
+          sum_wI -= w * obs(worst).value;
+          sum_w -= w;
+        }
+      }
+      // sums are re-calculated in the original order of observations
+      double sum_wI = 0.;
+      double sum_w = 0.;
+      double half_wI[2] = {0., 0.};
+      double half_w[2] = {0., 0.};
+      int k = 0;
+      for (size_t i = 0; i < n; ++i) {
+        if (rejected[i])
+          continue;
+        const Refl& r = obs(i);
+        double w = 1. / (r.sigma * r.sigma);
+        sum_wI += w * r.value;
+        sum_w += w;
+        half_wI[k] += w * r.value;
+        half_w[k] += w;
+        k ^= 1;
+      }
+      const Refl& first = obs(0);
+      *out = {first.hkl, first.isign, 0, (short) n_ok, sum_wI / sum_w, 1.0 / std::sqrt(sum_w)};
+      MergingStats& st = stats[t][binner ? binner->get_bin_hinted(first.hkl, hint) : 0];
+      st.all_refl += (int) n;
+      st.unique_refl++;
+      st.rejected += int(n - n_ok);
+      if (n_ok >= 2)
+        st.cc_half.add_point(half_wI[0] / half_w[0], half_wI[1] / half_w[1]);
       ++out;
-      out->hkl = in->hkl;
-      out->isign = in->isign;
+      b = e;
     }
-    double w = 1. / (in->sigma * in->sigma);
-    sum_wI += w * in->value;
-    sum_w += w;
-    ++nobs;
-  }
-  out->value = sum_wI / sum_w;
-  out->sigma = 1.0 / std::sqrt(sum_w);
-  out->nobs = nobs;
-  data.erase(++out, data.end());
+  });
+  std::vector<std::uint64_t>().swap(sorted);
+  data.swap(merged);
   type = new_type;
+
+  for (int t = 1; t < n_threads; ++t)
+    for (size_t i = 0; i < n_bins; ++i) {
+      MergingStats& a = stats[0][i];
+      const MergingStats& b = stats[t][i];
+      a.all_refl += b.all_refl;
+      a.unique_refl += b.unique_refl;
+      a.rejected += b.rejected;
+      if (b.cc_half.n != 0)
+        a.cc_half = combine_two_correlations(a.cc_half, b.cc_half);
+    }
+  return stats[0];
 }
 
-void Intensities::switch_to_asu_indices() {
+void Intensities::switch_to_asu_indices(int num_threads) {
   GroupOps gops = spacegroup->operations();
   if (isym_ops.empty())
     isym_ops = gops.sym_ops;
   ReciprocalAsu asu(spacegroup);
-  for (Refl& refl : data) {
-    if (asu.is_in(refl.hkl)) {
-      if (refl.isym == 0)
-        refl.isym = 1;
-    } else {
-      assert(refl.isym == 0);
-      std::tie(refl.hkl, refl.isym) = asu.to_asu(refl.hkl, isym_ops);
-      if (type == DataType::Anomalous && refl.isym % 2 == 0) {
-        if (refl.isign == 1 && gops.is_reflection_centric(refl.hkl)) {
-          // leave it as 1
-        } else {
-          refl.isign = -refl.isign;
+  parallel_for_chunks(data.size(), get_num_threads(num_threads),
+                      [&](size_t begin, size_t end, int) {
+    for (size_t i = begin; i < end; ++i) {
+      Refl& refl = data[i];
+      if (asu.is_in(refl.hkl)) {
+        if (refl.isym == 0)
+          refl.isym = 1;
+      } else {
+        assert(refl.isym == 0);
+        std::tie(refl.hkl, refl.isym) = asu.to_asu(refl.hkl, isym_ops);
+        if (type == DataType::Anomalous && refl.isym % 2 == 0) {
+          if (refl.isign == 1 && gops.is_reflection_centric(refl.hkl)) {
+            // leave it as 1
+          } else {
+            refl.isign = -refl.isign;
+          }
         }
       }
     }
-  }
+  });
 }
 
 void Intensities::read_unmerged_intensities_from_mtz(const Mtz& mtz) {
@@ -2,9 +2,11 @@
 
 #include <gemmi/mmcif.hpp>   // for string_to_int
 #include <array>
+#include <map>
 #include <unordered_map>
 #include <gemmi/mmcif_impl.hpp> // for set_cell_from_mmcif
 #include <gemmi/atox.hpp>    // for string_to_int
+#include <gemmi/cif.hpp>     // for pegtl::parse, Action, used in streaming mode
 #include <gemmi/enumstr.hpp> // for entity_type_from_string, polymer_type_from_string
 #include <gemmi/numb.hpp>    // for as_number
 #include <gemmi/polyheur.hpp>  // for restore_full_ccd_codes
@@ -26,11 +28,14 @@ void copy_string(const cif::Table::Row& row, int n, std::string& dest) {
     dest = cif::as_string(row[n]);
 }
 
-std::unordered_map<std::string, SMat33<float>> get_anisotropic_u(cif::Block& block) {
+using AnisoMap = std::unordered_map<std::string, SMat33<float>>;
+using AtomIds = std::map<std::array<size_t, 4>, std::string>;
+
+AnisoMap get_anisotropic_u(cif::Block& block) {
   cif::Table aniso_tab = block.find("_atom_site_anisotrop.",
                                     {"id", "U[1][1]", "U[2][2]", "U[3][3]",
                                      "U[1][2]", "U[1][3]", "U[2][3]"});
-  std::unordered_map<std::string, SMat33<float>> aniso_map;
+  AnisoMap aniso_map;
   for (auto ani : aniso_tab)
     aniso_map.emplace(ani[0], SMat33<float>{
                                 (float) cif::as_number(ani[1]),
@@ -523,11 +528,187 @@ struct RowAccess {
   }
 };
 
-} // anonymous namespace
+// Converts rows of _atom_site to atoms. When mmCIF is read in the streaming
+// mode (read_mmcif_streaming()), it is called for consecutive chunks
+// of the loop, so the state (current model, chain, residue) is kept here.
+struct AtomSiteReader {
+  enum { kId=0, kGroupPdb, kSymbol, kLabelAtomId, kAltId, kLabelCompId,
+         kLabelAsymId, kLabelEntityId, kLabelSeqId, kInsCode,
+         kX, kY, kZ, kOcc, kBiso, kCharge,
+         kAuthSeqId, kAuthCompId, kAuthAsymId, kAuthAtomId, kModelNum,
+         kCalcFlag, kTlsGroupId, kDeuterium };
+  Structure& st;
+  Model *model = nullptr;
+  Chain *chain = nullptr;
+  Residue *resi = nullptr;
+  std::string model_num;
+  bool started = false;
+  // If set, _atom_site.id values that are not equal to str(atom.serial)
+  // are stored here (with indices of model, chain, residue and atom),
+  // so that _atom_site_anisotrop can be matched after reading atoms.
+  AtomIds* odd_ids = nullptr;
 
-Structure make_structure_from_block(const cif::Block& block_) {
-  // find() and Table don't have const variants, but we don't change anything.
-  cif::Block& block = const_cast<cif::Block&>(block_);
+  explicit AtomSiteReader(Structure& st_) : st(st_) {}
+
+  void read(cif::Block& block, const AnisoMap& aniso_map) {
+    cif::Table atom_table = block.find("_atom_site.",
+                                       {"id",
+                                        "?group_PDB",
+                                        "type_symbol",
+                                        "?label_atom_id",
+                                        "label_alt_id",
+                                        "?label_comp_id",
+                                        "label_asym_id",
+                                        "?label_entity_id",
+                                        "?label_seq_id",
+                                        "?pdbx_PDB_ins_code",
+                                        "Cartn_x",
+                                        "Cartn_y",
+                                        "Cartn_z",
+                                        "occupancy",
+                                        "B_iso_or_equiv",
+                                        "?pdbx_formal_charge",
+                                        "?auth_seq_id",
+                                        "?auth_comp_id",
+                                        "?auth_asym_id",
+                                        "?auth_atom_id",
+                                        "?pdbx_PDB_model_num",
+                                        "?calc_flag",
+                                        "?pdbx_tls_group_id",
+                                        "?ccp4_deuterium_fraction",
+                                       });
+    if (atom_table.length() == 0)
+      return;
+    RowAccess asym_id(atom_table, kAuthAsymId, kLabelAsymId);
+    // we use only one comp (residue) and one atom name
+    RowAccess comp_id(atom_table, kAuthCompId, kLabelCompId);
+    RowAccess atom_id(atom_table, kAuthAtomId, kLabelAtomId);
+    RowAccess seq_id(atom_table, kAuthSeqId, kLabelSeqId);
+    if (!asym_id.ok())
+      fail("Neither _atom_site.label_asym_id nor auth_asym_id found");
+    if (!comp_id.ok())
+      fail("Neither _atom_site.label_comp_id nor auth_comp_id found");
+    if (!atom_id.ok())
+      fail("Neither _atom_site.label_atom_id nor auth_atom_id found");
+    if (!seq_id.ok())
+      fail("Neither _atom_site.label_seq_id nor auth_seq_id found");
+    size_t loop_width = 0;
+    if (const cif::Loop* loop = atom_table.get_loop())
+      loop_width = loop->width();
+
+    st.has_d_fraction = atom_table.has_column(kDeuterium);
+
+    if (!started) {
+      started = true;
+      if (!atom_table.has_column(kModelNum)) {
+        st.models.emplace_back(1);
+        model = &st.models[0];
+      }
+    }
+    for (auto row : atom_table) {
+      size_t gap = row.row_index * loop_width;
+      if (row.has(kModelNum) && row[kModelNum] != model_num) {
+        model_num = row[kModelNum];
+        model = &st.find_or_add_model(cif::as_int(model_num, 0));
+        chain = nullptr;
+      }
+      if (!chain || cif::as_string(asym_id.get(gap)) != chain->name) {
+        model->chains.emplace_back(cif::as_string(asym_id.get(gap)));
+        chain = &model->chains.back();
+        resi = nullptr;
+      }
+      ResidueId rid = make_resid(cif::as_string(comp_id.get(gap)),
+                                 cif::as_string(seq_id.get(gap)),
+                                 row.has(kInsCode) ? &row[kInsCode] : nullptr);
+      if (!resi || !resi->matches(rid)) {
+        resi = chain->find_or_add_residue(rid);
+        if (resi->atoms.empty()) {
+          if (row.has2(kLabelSeqId))
+            resi->label_seq = cif::as_int(row[kLabelSeqId]);
+          resi->subchain = row.str(kLabelAsymId);
+          if (row.has2(kLabelEntityId))
+            resi->entity_id = row.str(kLabelEntityId);
+          // don't check if group_PDB is consistent, it's not that important
+          if (row.has2(kGroupPdb))
+            for (int i = 0; i < 2; ++i) { // first character could be " or '
+              const char c = alpha_up(row[kGroupPdb][i]);
+              if (c == 'A' || c == 'H' || c == '\0')
+                resi->het_flag = c;
+            }
+        }
+      } else if (resi->seqid != rid.seqid) {
+        fail("Inconsistent sequence ID: " + resi->str() + " / " + rid.str());
+      }
+      Atom atom;
+      atom.name = cif::as_string(atom_id.get(gap));
+      // altloc is always a single letter (not guaranteed by the mmCIF spec)
+      atom.altloc = cif::as_char(row[kAltId], '\0');
+      atom.charge = row.has2(kCharge) ? cif::as_int(row[kCharge]) : 0;
+      atom.element = gemmi::Element(cif::as_string(row[kSymbol]));
+      // According to the PDBx/mmCIF spec _atom_site.id can be a string,
+      // but in all the files it is a serial number; its value is not essential,
+      // so we just ignore non-integer ids.
+      atom.serial = string_to_int(row[kId], false);
+      if (st.has_d_fraction)
+        atom.fraction = (float) cif::as_number(row[kDeuterium], 0.);
+      if (row.has2(kCalcFlag)) {
+        const std::string& cf = row[kCalcFlag];
+        if (cf[0] == 'c')
+          atom.calc_flag = CalcFlag::Calculated;
+        if (cf[0] == 'd')
+          atom.calc_flag = cf[1] == 'u' ? CalcFlag::Dummy
+                                        : CalcFlag::Determined;
+      }
+      if (row.has2(kTlsGroupId)) {
+        const char* str = row[kTlsGroupId].c_str();
+        const char* endptr;
+        int tls_id = no_sign_atoi(str, &endptr);
+        if (endptr != str)
+          atom.tls_group_id = (short) tls_id;
+      }
+      atom.pos.x = cif::as_number(row[kX]);
+      atom.pos.y = cif::as_number(row[kY]);
+      atom.pos.z = cif::as_number(row[kZ]);
+      atom.occ = (float) cif::as_number(row[kOcc], 1.0);
+      atom.b_iso = (float) cif::as_number(row[kBiso], 50.0);
+
+      if (!aniso_map.empty()) {
+        auto ani = aniso_map.find(row[kId]);
+        if (ani != aniso_map.end())
+          atom.aniso = ani->second;
+      }
+      resi->atoms.emplace_back(atom);
+      if (odd_ids && row[kId] != std::to_string(atom.serial))
+        odd_ids->emplace(std::array<size_t, 4>{{
+                           size_t(model - st.models.data()),
+                           size_t(chain - model->chains.data()),
+                           size_t(resi - chain->residues.data()),
+                           resi->atoms.size() - 1}}, row[kId]);
+    }
+  }
+};
+
+// Used after reading atoms with odd_ids set.
+void assign_anisotropic_u(Structure& st, const AnisoMap& aniso_map,
+                          const AtomIds& odd_ids) {
+  for (size_t i = 0; i != st.models.size(); ++i)
+    for (size_t j = 0; j != st.models[i].chains.size(); ++j) {
+      Chain& chain = st.models[i].chains[j];
+      for (size_t k = 0; k != chain.residues.size(); ++k)
+        for (size_t n = 0; n != chain.residues[k].atoms.size(); ++n) {
+          Atom& atom = chain.residues[k].atoms[n];
+          auto odd = odd_ids.find({{i, j, k, n}});
+          auto ani = aniso_map.find(odd != odd_ids.end() ? odd->second
+                                                          : std::to_string(atom.serial));
+          if (ani != aniso_map.end())
+            atom.aniso = ani->second;
+        }
+    }
+}
+
+// If streamed_atoms is set, _atom_site has been already read into it.
+Structure structure_from_block(cif::Block& block, Structure* streamed_atoms,
+                               const AtomIds* odd_ids) {
   Structure st;
   st.input_format = CoorFormat::Mmcif;
   st.name = block.name;
@@ -737,139 +918,14 @@ Structure make_structure_from_block(const cif::Block& block_) {
   auto aniso_map = get_anisotropic_u(block);
 
   // atom list
-  enum { kId=0, kGroupPdb, kSymbol, kLabelAtomId, kAltId, kLabelCompId,
-         kLabelAsymId, kLabelEntityId, kLabelSeqId, kInsCode,
-         kX, kY, kZ, kOcc, kBiso, kCharge,
-         kAuthSeqId, kAuthCompId, kAuthAsymId, kAuthAtomId, kModelNum,
-         kCalcFlag, kTlsGroupId, kDeuterium };
-  cif::Table atom_table = block.find("_atom_site.",
-                                     {"id",
-                                      "?group_PDB",
-                                      "type_symbol",
-                                      "?label_atom_id",
-                                      "label_alt_id",
-                                      "?label_comp_id",
-                                      "label_asym_id",
-                                      "?label_entity_id",
-                                      "?label_seq_id",
-                                      "?pdbx_PDB_ins_code",
-                                      "Cartn_x",
-                                      "Cartn_y",
-                                      "Cartn_z",
-                                      "occupancy",
-                                      "B_iso_or_equiv",
-                                      "?pdbx_formal_charge",
-                                      "?auth_seq_id",
-                                      "?auth_comp_id",
-                                      "?auth_asym_id",
-                                      "?auth_atom_id",
-                                      "?pdbx_PDB_model_num",
-                                      "?calc_flag",
-                                      "?pdbx_tls_group_id",
-                                      "?ccp4_deuterium_fraction",
-                                     });
-  if (atom_table.length() != 0) {
-    RowAccess asym_id(atom_table, kAuthAsymId, kLabelAsymId);
-    // we use only one comp (residue) and one atom name
-    RowAccess comp_id(atom_table, kAuthCompId, kLabelCompId);
-    RowAccess atom_id(atom_table, kAuthAtomId, kLabelAtomId);
-    RowAccess seq_id(atom_table, kAuthSeqId, kLabelSeqId);
-    if (!asym_id.ok())
-      fail("Neither _atom_site.label_asym_id nor auth_asym_id found");
-    if (!comp_id.ok())
-      fail("Neither _atom_site.label_comp_id nor auth_comp_id found");
-    if (!atom_id.ok())
-      fail("Neither _atom_site.label_atom_id nor auth_atom_id found");
-    if (!seq_id.ok())
-      fail("Neither _atom_site.label_seq_id nor auth_seq_id found");
-    size_t loop_width = 0;
-    if (const cif::Loop* loop = atom_table.get_loop())
-      loop_width = loop->width();
-
-    st.has_d_fraction = atom_table.has_column(kDeuterium);
-
-    Model *model = nullptr;
-    Chain *chain = nullptr;
-    Residue *resi = nullptr;
-    std::string model_num;
-    if (!atom_table.has_column(kModelNum)) {
-      st.models.emplace_back(1);
-      model = &st.models[0];
-    }
-    for (auto row : atom_table) {
-      size_t gap = row.row_index * loop_width;
-      if (row.has(kModelNum) && row[kModelNum] != model_num) {
-        model_num = row[kModelNum];
-        model = &st.find_or_add_model(cif::as_int(model_num, 0));
-        chain = nullptr;
-      }
-      if (!chain || cif::as_string(asym_id.get(gap)) != chain->name) {
-        model->chains.emplace_back(cif::as_string(asym_id.get(gap)));
-        chain = &model->chains.back();
-        resi = nullptr;
-      }
-      ResidueId rid = make_resid(cif::as_string(comp_id.get(gap)),
-                                 cif::as_string(seq_id.get(gap)),
-                                 row.has(kInsCode) ? &row[kInsCode] : nullptr);
-      if (!resi || !resi->matches(rid)) {
-        resi = chain->find_or_add_residue(rid);
-        if (resi->atoms.empty()) {
-          if (row.has2(kLabelSeqId))
-            resi->label_seq = cif::as_int(row[kLabelSeqId]);
-          resi->subchain = row.str(kLabelAsymId);
-          if (row.has2(kLabelEntityId))
-            resi->entity_id = row.str(kLabelEntityId);
-          // don't check if group_PDB is consistent, it's not that important
-          if (row.has2(kGroupPdb))
-            for (int i = 0; i < 2; ++i) { // first character could be " or '
-              const char c = alpha_up(row[kGroupPdb][i]);
-              if (c == 'A' || c == 'H' || c == '\0')
-                resi->het_flag = c;
-            }
-        }
-      } else if (resi->seqid != rid.seqid) {
-        fail("Inconsistent sequence ID: " + resi->str() + " / " + rid.str());
-      }
-      Atom atom;
-      atom.name = cif::as_string(atom_id.get(gap));
-      // altloc is always a single letter (not guaranteed by the mmCIF spec)
-      atom.altloc = cif::as_char(row[kAltId], '\0');
-      atom.charge = row.has2(kCharge) ? cif::as_int(row[kCharge]) : 0;
-      atom.element = gemmi::Element(cif::as_string(row[kSymbol]));
-      // According to the PDBx/mmCIF spec _atom_site.id can be a string,
-      // but in all the files it is a serial number; its value is not essential,
-      // so we just ignore non-integer ids.
-      atom.serial = string_to_int(row[kId], false);
-      if (st.has_d_fraction)
-        atom.fraction = (float) cif::as_number(row[kDeuterium], 0.);
-      if (row.has2(kCalcFlag)) {
-        const std::string& cf = row[kCalcFlag];
-        if (cf[0] == 'c')
-          atom.calc_flag = CalcFlag::Calculated;
-        if (cf[0] == 'd')
-          atom.calc_flag = cf[1] == 'u' ? CalcFlag::Dummy
-                                        : CalcFlag::Determined;
-      }
-      if (row.has2(kTlsGroupId)) {
-        const char* str = row[kTlsGroupId].c_str();
-        const char* endptr;
-        int tls_id = no_sign_atoi(str, &endptr);
-        if (endptr != str)
-          atom.tls_group_id = (short) tls_id;
-      }
-      atom.pos.x = cif::as_number(row[kX]);
-      atom.pos.y = cif::as_number(row[kY]);
-      atom.pos.z = cif::as_number(row[kZ]);
-      atom.occ = (float) cif::as_number(row[kOcc], 1.0);
-      atom.b_iso = (float) cif::as_number(row[kBiso], 50.0);
-
-      if (!aniso_map.empty()) {
-        auto ani = aniso_map.find(row[kId]);
-        if (ani != aniso_map.end())
-          atom.aniso = ani->second;
-      }
-      resi->atoms.emplace_back(atom);
-    }
+  if (streamed_atoms) {
+    // _atom_site was read in chunks during parsing
+    st.models = std::move(streamed_atoms->models);
+    st.has_d_fraction = streamed_atoms->has_d_fraction;
+    if (!aniso_map.empty())
+      assign_anisotropic_u(st, aniso_map, *odd_ids);
+  } else {
+    AtomSiteReader(st).read(block, aniso_map);
   }
 
   cif::Table polymer_types = block.find("_entity_poly.", {"entity_id", "type"});
@@ -986,6 +1042,14 @@ Structure make_structure_from_block(const cif::Block& block_) {
   return st;
 }
 
+} // anonymous namespace
+
+Structure make_structure_from_block(const cif::Block& block_) {
+  // find() and Table don't have const variants, but we don't change anything.
+  cif::Block& block = const_cast<cif::Block&>(block_);
+  return structure_from_block(block, nullptr, nullptr);
+}
+
 
 Residue make_residue_from_chemcomp_block(const cif::Block& block, ChemCompModel kind) {
   std::array<std::string, 3> xyz_tags;
@@ -1030,4 +1094,97 @@ Residue make_residue_from_chemcomp_block(const cif::Block& block, ChemCompModel
   return res;
 }
 
+namespace {
+
+// Parsing state for read_mmcif_streaming(): Document with all categories
+// except _atom_site, which is converted to atoms in chunks of 4096 rows.
+struct MmcifStream : cif::Document {
+  static const size_t chunk_rows = 4096;
+  Structure atoms;
+  AtomIds odd_ids;
+  AtomSiteReader reader{atoms};
+  cif::Loop* atom_loop = nullptr;
+  bool atoms_read = false;
+
+  MmcifStream() { reader.odd_ids = &odd_ids; }
+
+  // called when the first value of a loop is parsed
+  void check_loop(cif::Loop& loop) {
+    if (!atoms_read && blocks.size() == 1 && items_ == &blocks[0].items &&
+        istarts_with(loop.tags[0], "_atom_site.")) {
+      atom_loop = &loop;
+      loop.values.reserve(chunk_rows * loop.width());
+    }
+  }
+
+  void flush_atoms() {
+    reader.read(blocks[0], AnisoMap());  // anisotropic ADPs are added later
+    atom_loop->values.clear();
+  }
+};
+
+template<typename Rule> struct StreamAction : cif::Action<Rule> {};
+
+template<> struct StreamAction<cif::rules::loop_value> {
+  template<typename Input> static void apply(const Input& in, MmcifStream& out) {
+    cif::Loop& loop = out.items_->back().loop;
+    if (!out.atom_loop && loop.values.empty())
+      out.check_loop(loop);
+    if (&loop != out.atom_loop) {
+      cif::Action<cif::rules::loop_value>::apply(in, out);
+      return;
+    }
+    loop.values.emplace_back(in.begin(), in.end());
+    if (loop.values.size() == MmcifStream::chunk_rows * loop.width())
+      out.flush_atoms();
+  }
+};
+
+template<> struct StreamAction<cif::rules::loop> {
+  template<typename Input> static void apply(const Input& in, MmcifStream& out) {
+    // chunks have complete rows, so the check for the remainder is enough
+    cif::Action<cif::rules::loop>::apply(in, out);
+    if (&out.items_->back().loop == out.atom_loop) {
+      out.flush_atoms();
+      out.atom_loop = nullptr;
+      out.atoms_read = true;
+    }
+  }
+};
+
+template<typename Input>
+Structure read_mmcif_stream(Input&& in, bool possible_chemcomp) {
+  MmcifStream doc;
+  doc.source = in.source();
+  cif::pegtl::parse<cif::rules::file, StreamAction, cif::Errors>(in, doc);
+  cif::check_for_missing_values(doc);
+  cif::check_for_duplicates(doc);
+  if (possible_chemcomp) {
+    int n = check_chemcomp_block_number(doc);
+    if (n != -1)
+      return make_structure_from_chemcomp_block(doc.blocks[n]);
+  }
+  // the same check as in make_structure()
+  for (size_t i = 1; i < doc.blocks.size(); ++i)
+    if (doc.blocks[i].has_tag("_atom_site.id"))
+      fail("2+ blocks are ok if only the first one has coordinates;\n"
+           "_atom_site in block #" + std::to_string(i+1) + ": " + doc.source);
+  if (!doc.atoms_read)
+    return structure_from_block(doc.blocks.at(0), nullptr, nullptr);
+  return structure_from_block(doc.blocks.at(0), &doc.atoms, &doc.odd_ids);
+}
+
+} // anonymous namespace
+
+Structure read_mmcif_streaming(const char* data, size_t size, const std::string& name,
+                               bool possible_chemcomp) {
+  cif::pegtl::memory_input<> in(data, size, name);
+  return read_mmcif_stream(in, possible_chemcomp);
+}
+
+Structure read_mmcif_file_streaming(const std::string& path) {
+  GEMMI_CIF_FILE_INPUT(in, path);
+  return read_mmcif_stream(in, false);
+}
+
 } // namespace gemmi
@@ -5,6 +5,25 @@
 #include <gemmi/modify.hpp>     // for rename_atom_names
 #include <gemmi/read_cif.hpp>   // for read_cif_gz
 #include <gemmi/numb.hpp>       // for as_number
+#include <gemmi/fileutil.hpp>   // for read_file_into_buffer
+#include <gemmi/parallel.hpp>   // for parallel_for_chunks
+#if defined(__GNUC__) && __GNUC__-0 > 4
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wshadow"
+#endif
+#include "../third_party/serializer.h"
+#if defined(__GNUC__) && __GNUC__-0 > 4
+#pragma GCC diagnostic pop
+#endif
+#include <gemmi/serialize.hpp>
+#include <chrono>               // for steady_clock
+#include <cstdio>               // for rename, remove
+#include <cstring>              // for memcmp
+#include <exception>            // for exception_ptr
+#include <functional>           // for hash
+#include <thread>               // for this_thread
+#include <unordered_map>
+#include <sys/stat.h>           // for stat
 
 namespace gemmi {
 
@@ -241,6 +260,200 @@ void insert_chemmods_into(const cif::Document& doc, std::map<std::string, ChemMo
     }
 }
 
+// Content of a cif file with monomers, links and modifications.
+// Read in parallel and then added to MonLib in the original order.
+struct MonLibDoc {
+  std::vector<std::pair<std::string, ChemComp::Group>> cc_groups;
+  std::vector<ChemComp> monomers;  // before setting ChemComp::group from cc_groups
+  std::map<std::string, ChemLink> links;
+  std::map<std::string, ChemMod> mods;
+};
+
+template <typename Archive>
+void serialize(Archive& archive, MonLibDoc& o) {
+  archive(o.cc_groups, o.monomers, o.links, o.mods);
+}
+template <typename Archive>
+void serialize(Archive& archive, const MonLibDoc& o) {
+  archive(o.cc_groups, o.monomers, o.links, o.mods);
+}
+
+MonLibDoc parse_monomer_doc(const cif::Document& doc) {
+  MonLibDoc md;
+  if (const cif::Block* block = doc.find_block("comp_list"))
+    for (auto row : const_cast<cif::Block*>(block)->find("_chem_comp.", {"id", "group"}))
+      md.cc_groups.emplace_back(row.str(0), ChemComp::read_group(row.str(1)));
+  for (const cif::Block& block : doc.blocks)
+    if (block.has_tag("_chem_comp_atom.atom_id"))
+      md.monomers.push_back(make_chemcomp_from_block(block));
+  insert_chemlinks_into(doc, md.links);
+  insert_chemmods_into(doc, md.mods);
+  return md;
+}
+
+EnerLib parse_ener_lib(const cif::Document& doc) {
+  EnerLib ener_lib;
+  ener_lib.read(doc);
+  return ener_lib;
+}
+
+// Returns modification time (in ns) and size,
+// or false if the file can't be stat-ed.
+bool get_file_stamp(const std::string& path, std::int64_t& mtime, std::uint64_t& size) {
+#if defined(_WIN32)
+  struct _stat64 sb;
+  if (::_stat64(path.c_str(), &sb) != 0)
+    return false;
+  mtime = (std::int64_t) sb.st_mtime * 1000000000;
+#else
+  struct stat sb;
+  if (::stat(path.c_str(), &sb) != 0)
+    return false;
+# if defined(__APPLE__)
+  const struct timespec& ts = sb.st_mtimespec;
+# else
+  const struct timespec& ts = sb.st_mtim;
+# endif
+  mtime = (std::int64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+#endif
+  size = (std::uint64_t) sb.st_size;
+  return true;
+}
+
+// 64-bit FNV-1a, used for the cache file names and checksums
+std::uint64_t fnv1a_hash(const void* data, size_t len) {
+  const unsigned char* p = static_cast<const unsigned char*>(data);
+  std::uint64_t h = 0xcbf29ce484222325;
+  for (size_t i = 0; i != len; ++i)
+    h = (h ^ p[i]) * 0x100000001b3;
+  return h;
+}
+
+const char monlib_cache_magic[8] = {'G', 'E', 'M', 'M', 'I', 'M', 'L', 'C'};
+const std::uint32_t monlib_cache_version = 2;
+// When serialize.hpp changes, bump monlib_cache_version
+// and update the number here.
+static_assert(serialize_layout_version == 1 && monlib_cache_version == 2,
+              "serialized layout changed, bump monlib_cache_version");
+
+// Binary cache of a parsed file from the monomer library.
+// The file starts with the magic bytes and a checksum of the rest,
+// followed by path, mtime and size of the source file and the content.
+// The cache file name includes a hash of monomer_dir, so that one
+// cache_dir can be used with different monomer libraries.
+struct MonLibCache {
+  std::string source;
+  std::string cache_path;
+  std::int64_t mtime = 0;
+  std::uint64_t size = 0;
+
+  MonLibCache(const std::string& cache_dir, const std::string& monomer_dir,
+              const std::string& rel_path) : source(monomer_dir + rel_path) {
+    if (cache_dir.empty() || !get_file_stamp(source, mtime, size))
+      return;
+    cache_path = cache_dir;
+    if (cache_path.back() != '/' && cache_path.back() != '\\')
+      cache_path += '/';
+    std::uint64_t dir_hash = fnv1a_hash(monomer_dir.data(), monomer_dir.size());
+    for (int i = 60; i >= 32; i -= 4)
+      cache_path += "0123456789abcdef"[(dir_hash >> i) & 0xf];
+    cache_path += '_';
+    for (char c : rel_path)
+      cache_path += (c == '/' || c == '\\') ? '_' : c;
+    cache_path += ".gmc";
+  }
+
+  template<typename T>
+  bool read(T& obj) const {
+    if (cache_path.empty())
+      return false;
+    try {
+      CharArray buf = read_file_into_buffer(cache_path);
+      if (buf.size() < 16 || std::memcmp(buf.data(), monlib_cache_magic, 8) != 0)
+        return false;
+      // the content is deserialized only if it's not corrupted
+      std::uint64_t checksum;
+      std::memcpy(&checksum, buf.data() + 8, 8);
+      if (checksum != fnv1a_hash(buf.data() + 16, buf.size() - 16))
+        return false;
+      zpp::serializer::memory_view_input_archive in(
+          reinterpret_cast<const unsigned char*>(buf.data()) + 16, buf.size() - 16);
+      std::string cached_source;
+      std::uint32_t version;
+      std::int64_t cached_mtime;
+      std::uint64_t cached_size;
+      in(version, cached_source, cached_mtime, cached_size);
+      if (version != monlib_cache_version || cached_source != source ||
+          cached_mtime != mtime || cached_size != size)
+        return false;
+      in(obj);
+      return true;
+    } catch (std::exception&) {
+      obj = T();
+      return false;
+    }
+  }
+
+  // Errors are ignored, the cache is only an optimization.
+  template<typename T>
+  void write(const T& obj) const {
+    if (cache_path.empty())
+      return;
+    std::vector<unsigned char> data;
+    try {
+      zpp::serializer::memory_output_archive out(data);
+      out(monlib_cache_version, source, mtime, size, obj);
+    } catch (std::exception&) {
+      return;
+    }
+    // write to a temporary file first, because the cache can be shared
+    size_t uid = std::hash<std::thread::id>()(std::this_thread::get_id()) ^
+                 (size_t) std::chrono::steady_clock::now().time_since_epoch().count();
+    std::string tmp_path = cache_path + ".tmp" + std::to_string(uid);
+    std::FILE* f = std::fopen(tmp_path.c_str(), "wb");
+    if (!f)
+      return;
+    std::uint64_t checksum = fnv1a_hash(data.data(), data.size());
+    bool ok = std::fwrite(monlib_cache_magic, 8, 1, f) == 1 &&
+              std::fwrite(&checksum, 8, 1, f) == 1 &&
+              std::fwrite(data.data(), data.size(), 1, f) == 1;
+    ok = std::fclose(f) == 0 && ok;
+    if (!ok || std::rename(tmp_path.c_str(), cache_path.c_str()) != 0)
+      std::remove(tmp_path.c_str());
+  }
+};
+
+template<typename T, typename Parse>
+T read_with_cache(const std::string& cache_dir, const std::string& monomer_dir,
+                  const std::string& rel_path, Parse parse) {
+  MonLibCache cache(cache_dir, monomer_dir, rel_path);
+  T obj;
+  if (!cache.read(obj)) {
+    obj = parse(read_cif_gz(cache.source));
+    cache.write(obj);
+  }
+  return obj;
+}
+
+// adds MonLibDoc in the same way as read_monomer_doc() adds cif::Document
+void add_to_monlib(MonLib& monlib, MonLibDoc&& md) {
+  for (auto& g : md.cc_groups)
+    monlib.cc_groups.emplace(g.first, g.second);
+  for (ChemComp& cc : md.monomers) {
+    if (cc.group == ChemComp::Group::Null) {
+      auto it = monlib.cc_groups.find(cc.name);
+      if (it != monlib.cc_groups.end())
+        cc.group = it->second;
+    }
+    std::string name = cc.name;
+    monlib.monomers.emplace(name, std::move(cc));
+  }
+  for (auto& link : md.links)
+    monlib.links.emplace(link.first, std::move(link.second));
+  for (auto& mod : md.mods)
+    monlib.modifications.emplace(mod.first, std::move(mod.second));
+}
+
 } // anonymous namespace
 
 void ChemMod::apply_to(ChemComp& chemcomp, ChemComp::Group alias_group) const {
@@ -481,16 +694,7 @@ std::string MonLib::relative_monomer_path(const std::string& code) {
 }
 
 void MonLib::read_monomer_doc(const cif::Document& doc) {
-  // ChemComp
-  if (const cif::Block* block = doc.find_block("comp_list"))
-    for (auto row : const_cast<cif::Block*>(block)->find("_chem_comp.", {"id", "group"}))
-      cc_groups.emplace(row.str(0), ChemComp::read_group(row.str(1)));
-  for (const cif::Block& block : doc.blocks)
-    add_monomer_if_present(block);
-  // ChemLink
-  insert_chemlinks_into(doc, links);
-  // ChemMod
-  insert_chemmods_into(doc, modifications);
+  add_to_monlib(*this, parse_monomer_doc(doc));
 }
 
 namespace {
@@ -530,26 +734,75 @@ void MonLib::read_monomer_cif(const std::string& path_) {
 
 bool MonLib::read_monomer_lib(const std::string& monomer_dir_,
                               const std::vector<std::string>& resnames,
-                              const Logger& logger) {
+                              const Logger& logger,
+                              int num_threads,
+                              const std::string& cache_dir) {
   if (monomer_dir_.empty())
     fail("read_monomer_lib: monomer_dir not specified.");
   set_monomer_dir(monomer_dir_);
 
-  // Only recent versions of CCP4 Monomer Library have links_and_mods.cif
-  try {
-    read_monomer_cif(monomer_dir + "links_and_mods.cif");
-  } catch (std::system_error&) {
-    read_monomer_cif(monomer_dir + "list/mon_lib_list.cif");
-  }
-  ener_lib.read(read_cif_gz(monomer_dir + "ener_lib.cif"));
+  // Files are first read (in parallel) and then added in the original order.
+  // Task 0 reads links_and_mods.cif, the last task reads ener_lib.cif,
+  // so that these two larger files are likely to be read by different threads.
+  std::vector<std::string> names;
+  std::unordered_map<std::string, size_t> task_of_name;
+  for (const std::string& name : resnames)
+    if (monomers.find(name) == monomers.end() &&
+        task_of_name.emplace(name, names.size() + 1).second)
+      names.push_back(name);
+  size_t n_tasks = names.size() + 2;
+  std::vector<MonLibDoc> docs(n_tasks - 1);
+  EnerLib new_ener_lib;
+  std::vector<std::exception_ptr> errors(n_tasks);
+  auto read_doc = [&](const std::string& rel_path) {
+    return read_with_cache<MonLibDoc>(cache_dir, monomer_dir, rel_path, parse_monomer_doc);
+  };
+  parallel_for_chunks(n_tasks, get_num_threads(num_threads),
+                      [&](size_t begin, size_t end, int) {
+    for (size_t i = begin; i != end; ++i) {
+      try {
+        if (i == 0) {
+          // Only recent versions of CCP4 Monomer Library have links_and_mods.cif
+          try {
+            docs[0] = read_doc("links_and_mods.cif");
+          } catch (std::system_error&) {
+            docs[0] = read_doc("list/mon_lib_list.cif");
+          }
+        } else if (i == n_tasks - 1) {
+          new_ener_lib = read_with_cache<EnerLib>(cache_dir, monomer_dir,
+                                                  "ener_lib.cif", parse_ener_lib);
+        } else {
+          docs[i] = read_doc(relative_monomer_path(names[i-1]));
+        }
+      } catch (...) {
+        errors[i] = std::current_exception();
+      }
+    }
+  });
+
+  if (errors[0])
+    std::rethrow_exception(errors[0]);
+  add_to_monlib(*this, std::move(docs[0]));
+  if (errors[n_tasks-1])
+    std::rethrow_exception(errors[n_tasks-1]);
+  for (const auto& atom : new_ener_lib.atoms)
+    ener_lib.atoms.emplace(atom);
+  for (const auto& bond : new_ener_lib.bonds)
+    ener_lib.bonds.emplace(bond);
 
   bool ok = true;
+  std::vector<bool> added(n_tasks, false);
   for (const std::string& name : resnames) {
     if (monomers.find(name) != monomers.end())
       continue;
+    size_t i = task_of_name.at(name);
     try {
-      const cif::Document& doc = read_cif_gz(path(name));
-      read_monomer_doc(doc);
+      if (errors[i])
+        std::rethrow_exception(errors[i]);
+      if (!added[i]) {
+        add_to_monlib(*this, std::move(docs[i]));
+        added[i] = true;
+      }
     } catch (std::system_error& err) {
       if (err.code().value() == ENOENT)
         logger.mesg("Monomer not in the library: ", name, '.');
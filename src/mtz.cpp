@@ -8,10 +8,25 @@
 #include <gemmi/gz.hpp>
 #include <gemmi/sprintf.hpp>
 
+#if !defined(_WIN32)
+# include <fcntl.h>     // for open
+# include <sys/mman.h>  // for mmap
+# include <sys/stat.h>  // for fstat
+# include <unistd.h>    // for close
+#endif
+
 namespace gemmi {
 
 namespace {
 
+void unmap_file(const char* data, size_t size) {
+#if !defined(_WIN32)
+  ::munmap(const_cast<char*>(data), size);
+#else
+  (void) data, (void) size;
+#endif
+}
+
 double wrap_degrees(double phi) {
   if (phi >= 0 && phi < 360.)
     return phi;
@@ -384,6 +399,47 @@ void Mtz::read_raw_data(AnyStream& stream) {
       swap_four_bytes(&f);
 }
 
+void Mtz::read_raw_data_of_columns(AnyStream& stream,
+                                   const std::vector<std::string>& labels) {
+  if (columns.size() < 3)
+    fail("MTZ file has less than 3 columns");
+  std::vector<size_t> selected = {0, 1, 2};
+  for (const std::string& label : labels) {
+    size_t idx = get_column_with_label(label).idx;
+    if (!in_vector(idx, selected))
+      selected.push_back(idx);
+  }
+  std::sort(selected.begin(), selected.end());
+  size_t width = columns.size();
+  size_t n_sel = selected.size();
+  data.clear();
+  data.resize(n_sel * nreflections);
+  if (!stream.seek(80))
+    fail("Cannot rewind to the MTZ data.");
+  // read ~1MB at a time and copy selected values
+  size_t chunk_rows = std::max<size_t>(1, (1 << 18) / width);
+  std::vector<float> buf(chunk_rows * width);
+  float* out = data.data();
+  for (size_t row = 0; row < (size_t) nreflections; row += chunk_rows) {
+    size_t n = std::min(chunk_rows, (size_t) nreflections - row);
+    if (!stream.read(buf.data(), 4 * n * width))
+      fail("Error when reading MTZ data");
+    for (const float* r = buf.data(); r != buf.data() + n * width; r += width)
+      for (size_t col : selected)
+        *out++ = r[col];
+  }
+  if (!same_byte_order)
+    for (float& f : data)
+      swap_four_bytes(&f);
+  std::vector<Column> new_columns;
+  new_columns.reserve(n_sel);
+  for (size_t col : selected) {
+    new_columns.push_back(std::move(columns[col]));
+    new_columns.back().idx = new_columns.size() - 1;
+  }
+  columns = std::move(new_columns);
+}
+
 void Mtz::read_all_headers(AnyStream& stream) {
   read_first_bytes(stream);
   read_main_headers(stream, nullptr);
@@ -611,6 +667,82 @@ void Mtz::read_file_gz(const std::string& path, bool with_data) {
   }
 }
 
+void Mtz::read_file_columns(const std::string& path,
+                            const std::vector<std::string>& labels) {
+  try {
+    MaybeGzipped input(path);
+    source_path = path;
+    auto read = [&](AnyStream&& stream) {
+      read_all_headers(stream);
+      read_raw_data_of_columns(stream, labels);
+    };
+    if (CharArray mem = input.uncompress_into_buffer())
+      read(MemoryStream(mem.data(), mem.size()));
+    else
+      read(FileStream(path.c_str(), "rb"));
+  } catch (std::system_error&) {
+    throw;
+  } catch (std::runtime_error& e) {
+    fail(std::string(e.what()) + ": " + path);
+  }
+}
+
+MappedMtz::MappedMtz(const std::string& path) {
+#if !defined(_WIN32)
+  int fd = ::open(path.c_str(), O_RDONLY);
+  if (fd < 0)
+    sys_fail("Failed to open " + path);
+  struct stat sb;
+  if (::fstat(fd, &sb) == 0 && sb.st_size > 0) {
+    file_size_ = (size_t) sb.st_size;
+    void* ptr = ::mmap(nullptr, file_size_, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (ptr != MAP_FAILED) {
+      file_ = static_cast<const char*>(ptr);
+      mapped_ = true;
+    }
+  }
+  ::close(fd);
+#endif
+  if (!mapped_) {
+    buffer_ = read_file_into_buffer(path);
+    file_ = buffer_.data();
+    file_size_ = buffer_.size();
+  }
+  try {
+    mtz.source_path = path;
+    MemoryStream stream(file_, file_size_);
+    mtz.read_all_headers(stream);
+    if (file_size_ < 80 + 4 * size())
+      fail("Error when reading MTZ data");
+    data_ = file_ + 80;
+  } catch (std::runtime_error& e) {
+    if (mapped_)
+      unmap_file(file_, file_size_);
+    fail(std::string(e.what()) + ": " + path);
+  }
+}
+
+MappedMtz::MappedMtz(MappedMtz&& o) noexcept
+  : mtz(std::move(o.mtz)), file_(o.file_), data_(o.data_), file_size_(o.file_size_),
+    mapped_(o.mapped_), buffer_(std::move(o.buffer_)) {
+  o.file_ = o.data_ = nullptr;
+  o.mapped_ = false;
+}
+
+MappedMtz::~MappedMtz() {
+  if (mapped_)
+    unmap_file(file_, file_size_);
+}
+
+Mtz MappedMtz::read_columns(const std::vector<std::string>& labels) const {
+  Mtz out;
+  out.source_path = mtz.source_path;
+  MemoryStream stream(file_, file_size_);
+  out.read_all_headers(stream);
+  out.read_raw_data_of_columns(stream, labels);
+  return out;
+}
+
 std::vector<int> Mtz::sorted_row_indices(int use_first) const {
   if (!has_data())
     fail("No data.");
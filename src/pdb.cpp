@@ -5,6 +5,7 @@
 #include <cstdlib>            // for atoi, strtol
 #include <cstring>            // for memcpy, strstr, strchr, strcmp
 #include <algorithm>          // for min, swap
+#include <exception>          // for exception_ptr
 #include <stdexcept>          // for invalid_argument
 #include <unordered_map>
 #include "gemmi/atof.hpp"     // for fast_from_chars
@@ -12,6 +13,7 @@
 #include "gemmi/input.hpp"
 #include "gemmi/metadata.hpp" // for Metadata
 #include "gemmi/model.hpp"    // for Structure, impl::find_or_add
+#include "gemmi/parallel.hpp" // for parallel_for_chunks
 #include "gemmi/polyheur.hpp" // for assign_subchains
 #include "gemmi/util.hpp"     // for trim_str, alpha_up, istarts_with
 
@@ -817,6 +819,201 @@ void read_metadata_from_remarks(Structure& st) {
   }
 }
 
+// Reads ATOM/HETATM, ANISOU and TER records into Model.
+// In the parallel mode, each model is read by a separate ModelReader,
+// after all the lines are read.
+struct ModelReader {
+  const PdbReadOptions& options;
+  Model* model = nullptr;
+  Chain* chain = nullptr;
+  Residue* resi = nullptr;
+  std::unordered_map<ResidueId, int> resmap;
+  bool after_ter = false;
+  char ter_status = '\0';  // the same as Structure::ter_status
+  int line_num = 0;
+
+  explicit ModelReader(const PdbReadOptions& opt) : options(opt) {}
+
+  [[noreturn]] void wrong(const std::string& msg) const {
+    fail("Problem in line ", std::to_string(line_num), ": ", msg);
+  }
+
+  void set_model(Model* m) {
+    model = m;
+    chain = nullptr;
+  }
+
+  void read_atom(const char* line, size_t len) {
+    if (len < 55)
+      wrong("The line is too short to be correct:\n" + std::string(line));
+    std::string chain_name = read_string(line+20, 2);
+    ResidueId rid = read_res_id(line+22, line+17);
+
+    if (!chain || chain_name != chain->name) {
+      const Chain* prev_part = model->find_chain(chain_name);
+      after_ter = prev_part &&
+                  prev_part->residues[0].entity_type == EntityType::Polymer;
+      model->chains.emplace_back(chain_name);
+      chain = &model->chains.back();
+      resmap.clear();
+      resi = nullptr;
+    }
+    // Non-standard but widely used 4-character segment identifier.
+    // Left-justified, and may include a space in the middle.
+    // The segment may be a portion of a chain or a complete chain.
+    if (len > 72)
+      rid.segment = read_string(line+72, 4);
+    if (!resi || !resi->matches(rid)) {
+      auto it = resmap.find(rid);
+      // In normal PDB files it is fast enough to use
+      // resi = chain->find_residue(rid);
+      // but in pseudo-PDB files (such as MD files where millions
+      // of residues are in the same "chain") it is too slow.
+      if (it == resmap.end()) {
+        resmap.emplace(rid, (int) chain->residues.size());
+        chain->residues.emplace_back(rid);
+        resi = &chain->residues.back();
+
+        resi->het_flag = line[0] & ~0x20;
+        if (after_ter)
+          resi->entity_type = resi->is_water() ? EntityType::Water
+                                               : EntityType::NonPolymer;
+      } else {
+        resi = &chain->residues[it->second];
+      }
+    }
+
+    Atom atom;
+    atom.serial = read_serial(line+6);
+    atom.name = read_string(line+12, 4);
+    atom.altloc = read_altloc(line[16]);
+    atom.pos.x = read_double(line+30, 8);
+    atom.pos.y = read_double(line+38, 8);
+    atom.pos.z = read_double(line+46, 8);
+    if (len > 58)
+      atom.occ = (float) read_double(line+54, 6);
+    if (len > 64)
+      atom.b_iso = (float) read_double(line+60, 6);
+    if (len > 76 && (std::isalpha(line[76]) || std::isalpha(line[77])))
+      atom.element = Element(line + 76);
+    // Atom names HXXX are ambiguous, but Hg, He, Hf, Ho and Hs (almost)
+    // never have 4-character names, so H is assumed.
+    else if (alpha_up(line[12]) == 'H' && line[15] != ' ')
+      atom.element = El::H;
+    // Similarly Deuterium (DXXX), but here alternatives are Dy, Db and Ds.
+    // Only Dysprosium is present in the PDB - in a single entry as of 2022.
+    else if (alpha_up(line[12]) == 'D' && line[15] != ' ')
+      atom.element = El::D;
+    // Old versions of the PDB format had hydrogen names such as "1HB ".
+    // Some MD files use similar names for other elements ("1C4A" -> C).
+    else if (is_digit(line[12]))
+      atom.element = impl::find_single_letter_element(line[13]);
+    // ... or it can be "C210"
+    else if (is_digit(line[13]))
+      atom.element = impl::find_single_letter_element(line[12]);
+    else
+      atom.element = Element(line + 12);
+    atom.charge = (len > 78 ? read_charge(line[78], line[79]) : 0);
+    resi->atoms.emplace_back(atom);
+  }
+
+  void read_anisou(const char* line) {
+    if (!model || !chain || !resi || resi->atoms.empty())
+      wrong("ANISOU record not directly after ATOM/HETATM.");
+    // We assume that ANISOU refers to the last atom.
+    // Can it not be the case?
+    Atom &atom = resi->atoms.back();
+    if (atom.aniso.u11 != 0.)
+      wrong("Duplicated ANISOU record or not directly after ATOM/HETATM.");
+    atom.aniso.u11 = read_int(line+28, 7) * 1e-4f;
+    atom.aniso.u22 = read_int(line+35, 7) * 1e-4f;
+    atom.aniso.u33 = read_int(line+42, 7) * 1e-4f;
+    atom.aniso.u12 = read_int(line+49, 7) * 1e-4f;
+    atom.aniso.u13 = read_int(line+56, 7) * 1e-4f;
+    atom.aniso.u23 = read_int(line+63, 7) * 1e-4f;
+  }
+
+  // finishes polymer chains
+  void read_ter() {
+    if (!chain || ter_status == 'e')
+      return;
+    ter_status = 'y';
+    if (options.split_chain_on_ter) {
+      chain = nullptr;
+      // split_chain_on_ter is used for AMBER files that can have TER records
+      // in various places. So in such case TER doesn't imply entity_type.
+      return;
+    }
+    // If we have 2+ TER records in one chain, they are used in non-standard
+    // way and should be better ignored (in all the chains).
+    if (after_ter) {
+      ter_status = 'e';  // all entity_types will be later set to Unknown
+      return;
+    }
+    for (Residue& res : chain->residues) {
+      res.entity_type = EntityType::Polymer;
+      // Sanity check: water should not be marked as a polymer.
+      if GEMMI_UNLIKELY(res.is_water())
+        ter_status = 'e';  // all entity_types will be later set to Unknown
+    }
+    after_ter = true;
+  }
+};
+
+// ATOM/HETATM, ANISOU or TER record stored to be read later
+struct DeferredRecord {
+  char type;  // 'A', 'U' or 'T'
+  int line_num;
+  size_t offset;  // position of the line in the text buffer
+  size_t len;
+};
+
+struct DeferredModel {
+  bool has_atoms = false;
+  std::vector<DeferredRecord> records;
+};
+
+// Reads deferred records, each model in one task, and returns merged
+// ter_status. If an error is found, the one from the first line is thrown.
+char read_deferred_models(Structure& st, const std::vector<DeferredModel>& models,
+                          const std::vector<char>& text,
+                          const PdbReadOptions& options, int num_threads) {
+  std::vector<char> ter_status(models.size(), '\0');
+  std::vector<std::pair<int, std::exception_ptr>> errors(models.size());
+  parallel_for_chunks(models.size(), num_threads, [&](size_t begin, size_t end, int) {
+    for (size_t i = begin; i != end; ++i) {
+      ModelReader reader(options);
+      reader.set_model(&st.models[i]);
+      try {
+        for (const DeferredRecord& rec : models[i].records) {
+          const char* line = &text[rec.offset];
+          reader.line_num = rec.line_num;
+          if (rec.type == 'A')
+            reader.read_atom(line, rec.len);
+          else if (rec.type == 'U')
+            reader.read_anisou(line);
+          else
+            reader.read_ter();
+        }
+      } catch (...) {
+        errors[i] = {reader.line_num, std::current_exception()};
+      }
+      ter_status[i] = reader.ter_status;
+    }
+  });
+  const std::pair<int, std::exception_ptr>* first_error = nullptr;
+  for (const auto& error : errors)
+    if (error.second && (!first_error || error.first < first_error->first))
+      first_error = &error;
+  if (first_error)
+    std::rethrow_exception(first_error->second);
+  char status = '\0';
+  for (char c : ter_status)
+    if (c == 'e' || (c == 'y' && status == '\0'))
+      status = c;
+  return status;
+}
+
 } // anonymous namespace
 
 Structure read_pdb_from_stream(AnyStream& line_reader, const std::string& source,
@@ -828,14 +1025,32 @@ Structure read_pdb_from_stream(AnyStream& line_reader, const std::string& source
   st.name = path_basename(source, {".gz", ".pdb"});
   Transform matrix;
   std::vector<std::string> conn_records;
-  std::unordered_map<ResidueId, int> resmap;
   Model *model = nullptr;
-  Chain *chain = nullptr;
-  Residue *resi = nullptr;
+  ModelReader reader(options);
+  // With num_threads > 1, atom records are stored and read at the end,
+  // models in parallel. In such case, in_chain is used instead of
+  // reader.chain to check if the chain is continued.
+  int num_threads = get_num_threads(options.num_threads);
+  bool deferred = num_threads > 1;
+  std::vector<DeferredModel> deferred_models;  // the same indices as st.models
+  std::vector<char> deferred_text;
+  bool in_chain = false;
+  auto defer = [&](char type, int line_num, const char* line, size_t len) {
+    size_t idx = model - st.models.data();
+    if (deferred_models.size() <= idx)
+      deferred_models.resize(idx + 1);
+    DeferredModel& dm = deferred_models[idx];
+    if (type == 'A')
+      dm.has_atoms = true;
+    dm.records.push_back({type, line_num, deferred_text.size(), len});
+    deferred_text.insert(deferred_text.end(), line, line + len + 1);
+  };
   char line[122] = {0};
   int line_num = 0;
-  bool after_ter = false;
-  auto wrong = [&line_num](const std::string& msg) {
+  auto wrong = [&](const std::string& msg) {
+    // errors in deferred records, if any, come from earlier lines
+    if (deferred)
+      read_deferred_models(st, deferred_models, deferred_text, options, num_threads);
     fail("Problem in line ", std::to_string(line_num), ": ", msg);
   };
   while (size_t len = line_reader.copy_line(line, options.max_line_length+1)) {
@@ -843,99 +1058,35 @@ Structure read_pdb_from_stream(AnyStream& line_reader, const std::string& source
     if (is_record_type4(line, "ATOM") || is_record_type4(line, "HETATM")) {
       if (len < 55)
         wrong("The line is too short to be correct:\n" + std::string(line));
-      std::string chain_name = read_string(line+20, 2);
-      ResidueId rid = read_res_id(line+22, line+17);
-
-      if (!chain || chain_name != chain->name) {
-        if (!model) {
-          // A single model usually doesn't have the MODEL record. Also,
-          // MD trajectories may have frames separated by ENDMDL without MODEL.
-          int num = (int) st.models.size() + 1;
-          if (st.find_model(num))
-            wrong("ATOM/HETATM between models");
-          st.models.emplace_back(num);
-          model = &st.models.back();
-        }
-        const Chain* prev_part = model->find_chain(chain_name);
-        after_ter = prev_part &&
-                    prev_part->residues[0].entity_type == EntityType::Polymer;
-        model->chains.emplace_back(chain_name);
-        chain = &model->chains.back();
-        resmap.clear();
-        resi = nullptr;
+      if (!model) {
+        // A single model usually doesn't have the MODEL record. Also,
+        // MD trajectories may have frames separated by ENDMDL without MODEL.
+        int num = (int) st.models.size() + 1;
+        if (st.find_model(num))
+          wrong("ATOM/HETATM between models");
+        st.models.emplace_back(num);
+        model = &st.models.back();
+        reader.set_model(model);
       }
-      // Non-standard but widely used 4-character segment identifier.
-      // Left-justified, and may include a space in the middle.
-      // The segment may be a portion of a chain or a complete chain.
-      if (len > 72)
-        rid.segment = read_string(line+72, 4);
-      if (!resi || !resi->matches(rid)) {
-        auto it = resmap.find(rid);
-        // In normal PDB files it is fast enough to use
-        // resi = chain->find_residue(rid);
-        // but in pseudo-PDB files (such as MD files where millions
-        // of residues are in the same "chain") it is too slow.
-        if (it == resmap.end()) {
-          resmap.emplace(rid, (int) chain->residues.size());
-          chain->residues.emplace_back(rid);
-          resi = &chain->residues.back();
-
-          resi->het_flag = line[0] & ~0x20;
-          if (after_ter)
-            resi->entity_type = resi->is_water() ? EntityType::Water
-                                                 : EntityType::NonPolymer;
-        } else {
-          resi = &chain->residues[it->second];
-        }
+      if (deferred) {
+        defer('A', line_num, line, len);
+        in_chain = true;
+      } else {
+        reader.line_num = line_num;
+        reader.read_atom(line, len);
       }
 
-      Atom atom;
-      atom.serial = read_serial(line+6);
-      atom.name = read_string(line+12, 4);
-      atom.altloc = read_altloc(line[16]);
-      atom.pos.x = read_double(line+30, 8);
-      atom.pos.y = read_double(line+38, 8);
-      atom.pos.z = read_double(line+46, 8);
-      if (len > 58)
-        atom.occ = (float) read_double(line+54, 6);
-      if (len > 64)
-        atom.b_iso = (float) read_double(line+60, 6);
-      if (len > 76 && (std::isalpha(line[76]) || std::isalpha(line[77])))
-        atom.element = Element(line + 76);
-      // Atom names HXXX are ambiguous, but Hg, He, Hf, Ho and Hs (almost)
-      // never have 4-character names, so H is assumed.
-      else if (alpha_up(line[12]) == 'H' && line[15] != ' ')
-        atom.element = El::H;
-      // Similarly Deuterium (DXXX), but here alternatives are Dy, Db and Ds.
-      // Only Dysprosium is present in the PDB - in a single entry as of 2022.
-      else if (alpha_up(line[12]) == 'D' && line[15] != ' ')
-        atom.element = El::D;
-      // Old versions of the PDB format had hydrogen names such as "1HB ".
-      // Some MD files use similar names for other elements ("1C4A" -> C).
-      else if (is_digit(line[12]))
-        atom.element = impl::find_single_letter_element(line[13]);
-      // ... or it can be "C210"
-      else if (is_digit(line[13]))
-        atom.element = impl::find_single_letter_element(line[12]);
-      else
-        atom.element = Element(line + 12);
-      atom.charge = (len > 78 ? read_charge(line[78], line[79]) : 0);
-      resi->atoms.emplace_back(atom);
-
     } else if (is_record_type4(line, "ANISOU")) {
-      if (!model || !chain || !resi || resi->atoms.empty())
-        wrong("ANISOU record not directly after ATOM/HETATM.");
-      // We assume that ANISOU refers to the last atom.
-      // Can it not be the case?
-      Atom &atom = resi->atoms.back();
-      if (atom.aniso.u11 != 0.)
-        wrong("Duplicated ANISOU record or not directly after ATOM/HETATM.");
-      atom.aniso.u11 = read_int(line+28, 7) * 1e-4f;
-      atom.aniso.u22 = read_int(line+35, 7) * 1e-4f;
-      atom.aniso.u33 = read_int(line+42, 7) * 1e-4f;
-      atom.aniso.u12 = read_int(line+49, 7) * 1e-4f;
-      atom.aniso.u13 = read_int(line+56, 7) * 1e-4f;
-      atom.aniso.u23 = read_int(line+63, 7) * 1e-4f;
+      if (len < 70)
+        wrong("The line is too short to be correct:\n" + std::string(line));
+      if (deferred) {
+        if (!model)
+          wrong("ANISOU record not directly after ATOM/HETATM.");
+        defer('U', line_num, line, len);
+      } else {
+        reader.line_num = line_num;
+        reader.read_anisou(line);
+      }
 
     } else if (is_record_type4(line, "REMARK")) {
       if (line[len-1] == '\n')
@@ -1006,29 +1157,14 @@ Structure read_pdb_from_stream(AnyStream& line_reader, const std::string& source
                is_record_type4(line, "CISPEP")) {
       conn_records.emplace_back(line);
 
-    } else if (is_record_type3(line, "TER")) { // finishes polymer chains
-      if (!chain || st.ter_status == 'e')
-        continue;
-      st.ter_status = 'y';
-      if (options.split_chain_on_ter) {
-        chain = nullptr;
-        // split_chain_on_ter is used for AMBER files that can have TER records
-        // in various places. So in such case TER doesn't imply entity_type.
-        continue;
-      }
-      // If we have 2+ TER records in one chain, they are used in non-standard
-      // way and should be better ignored (in all the chains).
-      if (after_ter) {
-        st.ter_status = 'e';  // all entity_types will be later set to Unknown
-        continue;
+    } else if (is_record_type3(line, "TER")) {
+      if (!deferred) {
+        reader.read_ter();
+      } else if (in_chain) {
+        defer('T', line_num, line, len);
+        if (options.split_chain_on_ter)
+          in_chain = false;
       }
-      for (Residue& res : chain->residues) {
-        res.entity_type = EntityType::Polymer;
-        // Sanity check: water should not be marked as a polymer.
-        if GEMMI_UNLIKELY(res.is_water())
-          st.ter_status = 'e';  // all entity_types will be later set to Unknown
-      }
-      after_ter = true;
 
     } else if (is_record_type4(line, "MODRES")) {
       ModRes modres;
@@ -1162,17 +1298,21 @@ Structure read_pdb_from_stream(AnyStream& line_reader, const std::string& source
         }
       }
     } else if (is_record_type4(line, "MODEL")) {
-      if (model && chain)
+      if (model && (deferred ? in_chain : reader.chain != nullptr))
         wrong("MODEL without ENDMDL?");
       int num = read_int(line+6, 8);
       model = &st.find_or_add_model(num);
-      if (!model->chains.empty())
+      size_t idx = model - st.models.data();
+      if (deferred ? idx < deferred_models.size() && deferred_models[idx].has_atoms
+                   : !model->chains.empty())
         wrong("duplicate MODEL number: " + std::to_string(num));
-      chain = nullptr;
+      reader.set_model(model);
+      in_chain = false;
 
     } else if (is_record_type4(line, "ENDMDL")) {
       model = nullptr;
-      chain = nullptr;
+      reader.set_model(nullptr);
+      in_chain = false;
 
     } else if (is_record_type3(line, "END")) {
       break;
@@ -1184,6 +1324,10 @@ Structure read_pdb_from_stream(AnyStream& line_reader, const std::string& source
       fail("Incorrect file format (perhaps it is mmJSON not pdb?): " + source);
     }
   }
+  st.ter_status = reader.ter_status;
+  if (deferred)
+    st.ter_status = read_deferred_models(st, deferred_models, deferred_text,
+                                         options, num_threads);
   // If we read a PDB header (they can be downloaded from RSCB) we have no
   // models. User's code may not expect this. Usually, empty model will be
   // handled more gracefully than no models.
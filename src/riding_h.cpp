@@ -210,9 +210,8 @@ void place_hydrogens(const Topo& topo, const Atom& atom,
     double tau = 0.0;
     int period = 0;
     const Atom* tau_end = nullptr;
-    auto plane_range = topo.plane_index.equal_range(&atom);
-    for (auto i = plane_range.first; i != plane_range.second; ++i) {
-      const Topo::Plane& plane = *i->second;
+    for (const Topo::Plane* plane_ptr : topo.planes_with(&atom)) {
+      const Topo::Plane& plane = *plane_ptr;
       // only Topo::Plane with atoms.size() >= 4 is put into planes
       if (plane.has(h.ptr) && plane.has(heavy.ptr)) {
         for (const Atom* a : plane.atoms) {
@@ -230,9 +229,8 @@ void place_hydrogens(const Topo& topo, const Atom& atom,
       // We don't check here for which hydrogen the torsion angle is defined.
       // If an atom has 2 or 3 hydrogens, the torsion angle may not be given
       // for the first one, but only for the 2nd or 3rd (e.g. HD22 in ASN).
-      auto tor_range = topo.torsion_index.equal_range(&atom);
-      for (auto i = tor_range.first; i != tor_range.second; ++i) {
-        const Topo::Torsion& tor = *i->second;
+      for (const Topo::Torsion* tor_ptr : topo.torsions_with(&atom)) {
+        const Topo::Torsion& tor = *tor_ptr;
         if (tor.atoms[1] == &atom && tor.atoms[2] == heavy.ptr &&
             tor.atoms[0]->is_hydrogen() && !tor.atoms[3]->is_hydrogen()) {
           tau = rad(tor.restr->value);
@@ -434,9 +432,7 @@ void place_hydrogens_on_all_atoms(Topo& topo) {
           // gather bonded atoms
           known.clear();
           hs.clear();
-          auto range = topo.bond_index.equal_range(&atom);
-          for (auto i = range.first; i != range.second; ++i) {
-            const Topo::Bond* t = i->second;
+          for (const Topo::Bond* t : topo.bonds_with(&atom)) {
             Atom* other = t->atoms[t->atoms[0] == &atom ? 1 : 0];
             if (other->altloc && atom.altloc) {
               // We support links between different altlocs in Topo (e.g. link A-B),
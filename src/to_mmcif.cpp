@@ -10,6 +10,7 @@
 
 #include <gemmi/atox.hpp>       // no_sign_atoi
 #include <gemmi/sprintf.hpp>
+#include <gemmi/parallel.hpp>   // for parallel_for_chunks
 #include <gemmi/enumstr.hpp>    // for entity_type_to_string, ...
 #include <gemmi/seqtools.hpp>   // for pdbx_one_letter_code, ...
 #include <gemmi/to_pdb.hpp>     // for use_hetatm
@@ -59,8 +60,35 @@ inline std::string qchain(const std::string& s) {
 }
 
 
-void add_cif_atoms(const Structure& st, cif::Block& block,
-                   bool use_group_pdb, bool auth_all) {
+// Properties of Structure that determine columns of _atom_site
+// and the presence of _atom_site_anisotrop.
+struct AtomSiteInfo {
+  size_t atom_count = 0;
+  size_t aniso_count = 0;
+  bool has_calc_flag = false;
+  bool has_tls_group_id = false;
+
+  explicit AtomSiteInfo(const Structure& st) {
+    for (const Model& model : st.models)
+      for (const Chain& chain : model.chains)
+        for (const Residue& res : chain.residues)
+          for (const Atom& atom : res.atoms) {
+            ++atom_count;
+            if (atom.calc_flag != CalcFlag::NotSet &&
+                atom.calc_flag != CalcFlag::NoHydrogen)
+              has_calc_flag = true;
+            if (atom.tls_group_id >= 0)
+              has_tls_group_id = true;
+            if (atom.aniso.nonzero())
+              ++aniso_count;
+          }
+  }
+};
+
+// Adds _atom_site and (if needed) _atom_site_anisotrop loops without values.
+cif::Loop& init_atom_site_loops(const Structure& st, cif::Block& block,
+                                const AtomSiteInfo& info,
+                                bool use_group_pdb, bool auth_all) {
   // atom list
   cif::Loop& atom_loop = block.init_mmcif_loop("_atom_site.", {
       "id",
@@ -87,30 +115,34 @@ void add_cif_atoms(const Structure& st, cif::Block& block,
     atom_loop.tags.erase(atom_loop.tags.begin() + 15, atom_loop.tags.begin() + 17);
   if (use_group_pdb)
     atom_loop.tags.emplace(atom_loop.tags.begin(), "_atom_site.group_PDB");
-  bool has_calc_flag = false;
-  bool has_tls_group_id = false;
-  size_t atom_site_count = 0;
-  for (const Model& model : st.models)
-    for (const Chain& chain : model.chains)
-      for (const Residue& res : chain.residues)
-        for (const Atom& atom : res.atoms) {
-          ++atom_site_count;
-          if (atom.calc_flag != CalcFlag::NotSet &&
-              atom.calc_flag != CalcFlag::NoHydrogen)
-            has_calc_flag = true;
-          if (atom.tls_group_id >= 0)
-            has_tls_group_id = true;
-        }
-  if (has_calc_flag)
+  if (info.has_calc_flag)
     atom_loop.tags.emplace_back("_atom_site.calc_flag");
-  if (has_tls_group_id)
+  if (info.has_tls_group_id)
     atom_loop.tags.emplace_back("_atom_site.pdbx_tls_group_id");
   if (st.has_d_fraction)
     atom_loop.tags.emplace_back("_atom_site.ccp4_deuterium_fraction");
 
+  if (info.aniso_count == 0)
+    block.find_mmcif_category("_atom_site_anisotrop.").erase();
+  else
+    block.init_mmcif_loop("_atom_site_anisotrop.", {
+                          "id", "type_symbol", "U[1][1]", "U[2][2]",
+                          "U[3][3]", "U[1][2]", "U[1][3]", "U[2][3]"});
+  // init_mmcif_loop() could have invalidated the reference
+  return *block.find_mmcif_category("_atom_site.").get_loop();
+}
+
+void add_cif_atoms(const Structure& st, cif::Block& block,
+                   bool use_group_pdb, bool auth_all, bool with_values=true) {
+  AtomSiteInfo info(st);
+  cif::Loop& atom_loop = init_atom_site_loops(st, block, info, use_group_pdb, auth_all);
+  if (!with_values)
+    return;
+
   std::vector<std::string>& vv = atom_loop.values;
-  vv.reserve(atom_site_count * atom_loop.tags.size());
+  vv.reserve(info.atom_count * atom_loop.tags.size());
   std::vector<std::pair<int, const Atom*>> aniso;
+  aniso.reserve(info.aniso_count);
   int serial = 0;
   for (const Model& model : st.models) {
     for (const Chain& chain : model.chains) {
@@ -149,9 +181,9 @@ void add_cif_atoms(const Structure& st, cif::Block& block,
           vv.emplace_back(auth_seq_id);
           vv.emplace_back(qchain(chain.name));
           vv.emplace_back(std::to_string(model.num));
-          if (has_calc_flag)
+          if (info.has_calc_flag)
             vv.emplace_back(&".\0.\0d\0c\0dum"[2 * (int) atom.calc_flag]);
-          if (has_tls_group_id)
+          if (info.has_tls_group_id)
             vv.emplace_back(int_or_qmark(atom.tls_group_id));
           if (st.has_d_fraction)
             vv.emplace_back(to_str(atom.fraction));
@@ -161,12 +193,8 @@ void add_cif_atoms(const Structure& st, cif::Block& block,
       }
     }
   }
-  if (aniso.empty()) {
-    block.find_mmcif_category("_atom_site_anisotrop.").erase();
-  } else {
-    cif::Loop& aniso_loop = block.init_mmcif_loop("_atom_site_anisotrop.", {
-                                  "id", "type_symbol", "U[1][1]", "U[2][2]",
-                                  "U[3][3]", "U[1][2]", "U[1][3]", "U[2][3]"});
+  if (!aniso.empty()) {
+    cif::Loop& aniso_loop = *block.find_mmcif_category("_atom_site_anisotrop.").get_loop();
     std::vector<std::string>& aniso_val = aniso_loop.values;
     aniso_val.reserve(aniso_loop.tags.size() * aniso.size());
     for (const auto& a : aniso) {
@@ -452,7 +480,9 @@ void write_cispeps(const Structure& st, cif::Block& block) {
   }
 }
 
-void update_mmcif_block(const Structure& st, cif::Block& block, MmcifOutputGroups groups) {
+// if atom_values is false, _atom_site and _atom_site_anisotrop have only tags
+static void update_block(const Structure& st, cif::Block& block,
+                         MmcifOutputGroups groups, bool atom_values) {
   if (st.models.empty())
     return;
 
@@ -1201,7 +1231,7 @@ void update_mmcif_block(const Structure& st, cif::Block& block, MmcifOutputGroup
   }
 
   if (groups.atoms)
-    add_cif_atoms(st, block, groups.group_pdb, groups.auth_all);
+    add_cif_atoms(st, block, groups.group_pdb, groups.auth_all, atom_values);
 
   if (groups.tls && st.meta.has_tls()) {
     cif::Loop& loop = block.init_mmcif_loop("_pdbx_refine_tls.", {
@@ -1261,6 +1291,10 @@ void update_mmcif_block(const Structure& st, cif::Block& block, MmcifOutputGroup
   }
 }
 
+void update_mmcif_block(const Structure& st, cif::Block& block, MmcifOutputGroups groups) {
+  update_block(st, block, groups, true);
+}
+
 cif::Document make_mmcif_document(const Structure& st, MmcifOutputGroups groups) {
   cif::Document doc;
   doc.blocks.resize(1);
@@ -1288,4 +1322,233 @@ void add_minimal_mmcif_data(const Structure& st, cif::Block& block) {
   add_cif_atoms(st, block, /*use_group_pdb=*/false, /*auth_all=*/false);
 }
 
+namespace {
+
+// Formats values of loop rows in the same way as cif::write_out_loop()
+// when the columns are not aligned.
+struct LoopRowWriter {
+  std::string buf;
+  bool need_new_line = true;
+
+  void start_row() { need_new_line = true; }
+
+  void add(const char* s, size_t len) {
+    bool text_field = len > 2 && s[0] == ';' && (s[len-2] == '\n' || s[len-2] == '\r');
+    buf += need_new_line || text_field ? '\n' : ' ';
+    need_new_line = text_field;
+    if (!text_field) {
+      buf.append(s, len);
+      return;
+    }
+    // the same as cif::write_text_field()
+    const char* end = s + len;
+    for (const char* p = s; ; ) {
+      const char* crlf = std::search(p, end, "\r\n", "\r\n" + 2);
+      buf.append(p, crlf);
+      if (crlf == end)
+        break;
+      p = crlf + 1;
+    }
+  }
+  void add(const std::string& s) { add(s.c_str(), s.size()); }
+  void add(const char* s) { add(s, std::strlen(s)); }
+  void add_int(int n) {
+    char tmp[16];
+    char* end = to_chars_z(tmp, tmp + sizeof(tmp), n);
+    add(tmp, end - tmp);
+  }
+  // the same output as from to_str()
+  template<typename T> void add_number(T d) {
+    char tmp[24];
+    char* end = to_chars_g(tmp, d);
+    add(tmp, end - tmp);
+  }
+};
+
+struct ResidueRef {
+  const Model* model;
+  const Chain* chain;
+  const Residue* res;
+  int serial;  // _atom_site.id of the first atom
+};
+
+// Residues are processed in batches. In each batch, consecutive residues
+// are assigned to threads, formatted into separate buffers,
+// and the buffers are written in order.
+template<typename Func>
+void write_loop_rows(cif::BufOstream& os, const std::vector<ResidueRef>& residues,
+                     int num_threads, Func func) {
+  const size_t atoms_per_thread = 16384;
+  num_threads = get_num_threads(num_threads);
+  std::vector<LoopRowWriter> writers(num_threads);
+  for (size_t begin = 0; begin != residues.size(); ) {
+    size_t end = begin;
+    for (size_t n = 0; end != residues.size() && n < atoms_per_thread * num_threads; ++end)
+      n += residues[end].res->atoms.size();
+    for (LoopRowWriter& w : writers)
+      w.buf.clear();
+    parallel_for_chunks(end - begin, num_threads, [&](size_t b, size_t e, int n) {
+      for (size_t i = begin + b; i != begin + e; ++i)
+        func(writers[n], residues[i]);
+    });
+    for (const LoopRowWriter& w : writers)
+      os.write(w.buf.c_str(), w.buf.size());
+    begin = end;
+  }
+}
+
+void write_loop_tags(cif::BufOstream& os, const cif::Loop& loop) {
+  os.write("loop_", 5);
+  for (const std::string& tag : loop.tags) {
+    os.put('\n');
+    os << tag;
+  }
+}
+
+void write_atom_site(cif::BufOstream& os, const Structure& st, const cif::Loop& loop,
+                     const std::vector<ResidueRef>& residues, int num_threads) {
+  bool use_group_pdb = loop.tags[0] == "_atom_site.group_PDB";
+  bool auth_all = loop.has_tag("_atom_site.auth_atom_id");
+  bool has_calc_flag = loop.has_tag("_atom_site.calc_flag");
+  bool has_tls_group_id = loop.has_tag("_atom_site.pdbx_tls_group_id");
+  write_loop_tags(os, loop);
+  write_loop_rows(os, residues, num_threads, [&](LoopRowWriter& w, const ResidueRef& r) {
+    const Residue& res = *r.res;
+    const char* group_pdb = use_hetatm(res) ? "HETATM" : "ATOM";
+    std::string label_seq_id = res.label_seq.str('.');
+    std::string auth_seq_id = res.seqid.num.str();
+    std::string entity_id;
+    if (const Entity* ent = gemmi::find_entity_of_subchain(res.subchain, st.entities))
+      entity_id = cif::quote(ent->name);
+    else
+      entity_id = string_or_dot(res.entity_id);
+    std::string res_name = cif::quote(res.name);
+    std::string subchain = subchain_or_dot(res);
+    std::string icode = pdbx_icode(res);
+    std::string chain_name = qchain(r.chain->name);
+    int serial = r.serial;
+    for (const Atom& atom : res.atoms) {
+      w.start_row();
+      if (use_group_pdb)
+        w.add(group_pdb);
+      w.add_int(serial++);
+      w.add(atom.element.uname());
+      std::string atom_name = cif::quote(atom.name);
+      w.add(atom_name);
+      char altloc = atom.altloc_or('.');
+      w.add(&altloc, 1);
+      w.add(res_name);
+      w.add(subchain);
+      w.add(entity_id);
+      w.add(label_seq_id);
+      w.add(icode);
+      w.add_number(atom.pos.x);
+      w.add_number(atom.pos.y);
+      w.add_number(atom.pos.z);
+      w.add_number(atom.occ);
+      w.add_number(atom.b_iso);
+      if (atom.charge == 0)
+        w.add("?", 1);
+      else
+        w.add_int(atom.charge);
+      if (auth_all) {
+        w.add(atom_name);
+        w.add(res_name);
+      }
+      w.add(auth_seq_id);
+      w.add(chain_name);
+      w.add_int(r.model->num);
+      if (has_calc_flag)
+        w.add(&".\0.\0d\0c\0dum"[2 * (int) atom.calc_flag]);
+      if (has_tls_group_id) {
+        if (atom.tls_group_id == -1)
+          w.add("?", 1);
+        else
+          w.add_int(atom.tls_group_id);
+      }
+      if (st.has_d_fraction)
+        w.add_number(atom.fraction);
+    }
+  });
+  os.put('\n');
+}
+
+void write_atom_site_anisotrop(cif::BufOstream& os, const cif::Loop& loop,
+                               const std::vector<ResidueRef>& residues, int num_threads) {
+  write_loop_tags(os, loop);
+  write_loop_rows(os, residues, num_threads, [&](LoopRowWriter& w, const ResidueRef& r) {
+    int serial = r.serial;
+    for (const Atom& atom : r.res->atoms) {
+      if (atom.aniso.nonzero()) {
+        w.start_row();
+        w.add_int(serial);
+        w.add(atom.element.uname());
+        w.add_number(atom.aniso.u11);
+        w.add_number(atom.aniso.u22);
+        w.add_number(atom.aniso.u33);
+        w.add_number(atom.aniso.u12);
+        w.add_number(atom.aniso.u13);
+        w.add_number(atom.aniso.u23);
+      }
+      ++serial;
+    }
+  });
+  os.put('\n');
+}
+
+} // anonymous namespace
+
+void write_mmcif(const Structure& st, std::ostream& os, MmcifOutputGroups groups,
+                 cif::WriteOptions options, int num_threads) {
+  AtomSiteInfo info(st);
+  // atom values are formatted directly only if they'd be written as a loop
+  // without aligned columns; otherwise the standard writer is used
+  bool direct = groups.atoms && options.align_loops == 0 &&
+                !(options.prefer_pairs && (info.atom_count == 1 || info.aniso_count == 1));
+  cif::Block block;
+  update_block(st, block, groups, !direct);
+  if (!direct) {
+    cif::write_cif_block_to_stream(os, block, options);
+    return;
+  }
+
+  std::vector<ResidueRef> residues;
+  int serial = 1;
+  for (const Model& model : st.models)
+    for (const Chain& chain : model.chains)
+      for (const Residue& res : chain.residues) {
+        residues.push_back({&model, &chain, &res, serial});
+        serial += (int) res.atoms.size();
+      }
+
+  // the same as cif::write_cif_block_to_stream(), except for atom loops
+  cif::BufOstream bos(os);
+  bos.write("data_", 5);
+  bos << block.name;
+  bos.put('\n');
+  if (options.misuse_hash)
+    bos.write("#\n", 2);
+  const cif::Item* prev = nullptr;
+  for (const cif::Item& item : block.items) {
+    if (item.type == cif::ItemType::Erased)
+      continue;
+    if (prev && !options.compact && cif::should_be_separated_(*prev, item)) {
+      if (options.misuse_hash)
+        bos.put('#');
+      bos.put('\n');
+    }
+    if (item.type == cif::ItemType::Loop && item.loop.values.empty() && info.atom_count != 0) {
+      if (starts_with(item.loop.tags[0], "_atom_site."))
+        write_atom_site(bos, st, item.loop, residues, num_threads);
+      else if (starts_with(item.loop.tags[0], "_atom_site_anisotrop."))
+        write_atom_site_anisotrop(bos, item.loop, residues, num_threads);
+    } else {
+      cif::write_out_item(bos, item, options);
+    }
+    prev = &item;
+  }
+  if (options.misuse_hash)
+    bos.write("#\n", 2);
+}
+
 } // namespace gemmi
@@ -4,7 +4,8 @@
 
 #include <cassert>
 #include <cctype>         // for isdigit
-#include <cstring>        // for memset, memcpy
+#include <cmath>          // for fabs, floor, signbit
+#include <cstring>        // for memset, memcpy, strlen
 #include <algorithm>
 #include <array>
 #include <sstream>       // for ostringstream
@@ -13,6 +14,7 @@
 #include <gemmi/sprintf.hpp>
 #include <gemmi/resinfo.hpp>    // for find_tabulated_residue
 #include <gemmi/util.hpp>
+#include <gemmi/parallel.hpp>   // for parallel_for_chunks
 
 namespace gemmi {
 
@@ -208,8 +210,177 @@ void write_remarks(const Structure& st, std::ostream& os) {
   }
 }
 
-void write_chain_atoms(const Chain& chain, std::ostream& os,
-                       int& serial, PdbWriteOptions opt) {
+// Writes d as "%{width}.{prec}f" (without terminating null), right-justified.
+// Returns false if the number doesn't fit in the width or if it is so close
+// to a rounding tie that the output could differ from snprintf_z.
+bool write_fixed(char* buf, int width, int prec, double d) {
+  static const double p10[] = {1, 10, 100, 1000};
+  double a = std::fabs(d);
+  if (!(a < 1e7))  // also excludes NaN and infinity
+    return false;
+  double y = a * p10[prec];
+  double fl = std::floor(y);
+  double frac = y - fl;
+  if (std::fabs(frac - 0.5) <= 1e-6)
+    return false;
+  std::uint64_t r = (std::uint64_t) fl + (frac > 0.5);
+  char* p = buf + width;
+  for (int i = 0; i < prec; ++i, r /= 10)
+    *--p = char('0' + r % 10);
+  if (prec != 0)
+    *--p = '.';
+  do {
+    if (p == buf)
+      return false;
+    *--p = char('0' + r % 10);
+    r /= 10;
+  } while (r != 0);
+  if (std::signbit(d)) {
+    if (p == buf)
+      return false;
+    *--p = '-';
+  }
+  while (p != buf)
+    *--p = ' ';
+  return true;
+}
+
+// %{width}s for strings no longer than width
+void write_right(char* buf, int width, const char* str, size_t len) {
+  std::memset(buf, ' ', width - len);
+  std::memcpy(buf + (width - len), str, len);
+}
+
+// %-{width}.{width}s
+void write_left(char* buf, int width, const std::string& str) {
+  size_t len = std::min(str.size(), (size_t) width);
+  std::memcpy(buf, str.c_str(), len);
+  std::memset(buf + len, ' ', width - len);
+}
+
+// The same ATOM/HETATM record as in write_atom_line() below, but without
+// snprintf_z. Returns false for unusual values that don't fit the columns.
+bool write_atom_line_fast(char* buf, const Atom& a, const Residue& res,
+                          const Chain& chain, int serial, bool as_het) {
+  std::memcpy(buf, as_het ? "HETATM" : "ATOM  ", 6);
+  std::array<char,8> serial_str = encode_serial_in_hybrid36(serial);
+  size_t len = std::strlen(serial_str.data());
+  if (len > 5)
+    return false;
+  write_right(buf+6, 5, serial_str.data(), len);
+  buf[11] = ' ';
+  write_left(buf+12, 4, a.padded_name());
+  buf[16] = a.altloc ? (char) std::toupper(a.altloc) : ' ';
+  write_right(buf+17, 3, res.name.c_str(), std::min(res.name.size(), (size_t)3));
+  write_right(buf+20, 2, chain.name.c_str(), chain.name.size());
+  std::array<char,8> seq_id = write_seq_id(res.seqid);
+  write_right(buf+22, 5, seq_id.data(), std::strlen(seq_id.data()));
+  std::memset(buf+27, ' ', 3);
+  // see comments in write_atom_line()
+  if (!write_fixed(buf+30, 8, 3, a.pos.x > -5e-4 && a.pos.x < 0 ? 0 : a.pos.x + 1e-10) ||
+      !write_fixed(buf+38, 8, 3, a.pos.y > -5e-4 && a.pos.y < 0 ? 0 : a.pos.y + 1e-10) ||
+      !write_fixed(buf+46, 8, 3, a.pos.z > -5e-4 && a.pos.z < 0 ? 0 : a.pos.z + 1e-10) ||
+      !write_fixed(buf+54, 6, 2, a.occ + 1e-6) ||
+      !write_fixed(buf+60, 6, 2, std::min(a.b_iso + 0.5e-5, 999.99)))
+    return false;
+  std::memset(buf+66, ' ', 6);
+  write_left(buf+72, 4, res.segment);
+  const char* el = a.element.uname();
+  write_right(buf+76, 2, el, el[1] == '\0' ? 1 : 2);
+  buf[78] = a.charge ? a.charge > 0 ? '0'+a.charge : '0'-a.charge : ' ';
+  buf[79] = a.charge ? a.charge > 0 ? '+' : '-' : ' ';
+  buf[80] = '\n';
+  return true;
+}
+
+void write_atom_line(char* buf, const Atom& a, const Residue& res,
+                     const Chain& chain, int serial, bool as_het) {
+  if (write_atom_line_fast(buf, a, res, chain, serial, as_het))
+    return;
+  //  1- 6  6s  record name
+  //  7-11  5d  integer serial
+  // 12     1   -
+  // 13-16  4s  atom name (from 13 only if 4-char or 2-char symbol)
+  // 17     1c  altloc
+  // 18-20  3s  residue name
+  // 21     1   -
+  // 22     1s  chain
+  // 23-26  4d  integer residue sequence number
+  // 27     1c  insertion code
+  // 28-30  3   -
+  // 31-38  8f  x (8.3)
+  // 39-46  8f  y
+  // 47-54  8f  z
+  // 55-60  6f  occupancy (6.2)
+  // 61-66  6f  temperature factor (6.2)
+  // 67-76  6   -
+  // 73-76      segment identifier, left-justified (non-standard)
+  // 77-78  2s  element symbol, right-justified
+  // 79-80  2s  charge
+  int written_bytes = snprintf_z(buf, 82,
+        "%-6s%5s %-4.4s%c%3.3s"
+        "%2s%5s   %8.3f%8.3f%8.3f",
+        as_het ? "HETATM" : "ATOM",
+        encode_serial_in_hybrid36(serial).data(),
+        a.padded_name().c_str(),
+        a.altloc ? std::toupper(a.altloc) : ' ',
+        res.name.c_str(),
+        chain.name.c_str(),
+        write_seq_id(res.seqid).data(),
+        // We want to avoid negative zero and round the numbers up
+        // if they originally had one digit more and that digit was 5.
+        a.pos.x > -5e-4 && a.pos.x < 0 ? 0 : a.pos.x + 1e-10,
+        a.pos.y > -5e-4 && a.pos.y < 0 ? 0 : a.pos.y + 1e-10,
+        a.pos.z > -5e-4 && a.pos.z < 0 ? 0 : a.pos.z + 1e-10);
+  if GEMMI_UNLIKELY(written_bytes > 54) {
+    // The only items expected to overflow above are the coordinates,
+    // if the integer part of the number exceeds 5 characters.
+    // This happens when something goes wrong and the model is far from
+    // the origin. Such a model should be shifted; it can't be written it
+    // in a spec-conforming format: Real(8.3). Here we overwrite the last
+    // digits - trimming is better than overflowing the line.
+    snprintf_z(buf+38, 82-38, "%8.3f", a.pos.y);
+    snprintf_z(buf+46, 82-46, "%8.3f", a.pos.z);
+  }
+  snprintf_z(buf+54, 82-54,
+        "%6.2f%6.2f      %-4.4s%2s%c%c",
+        // Occupancy is stored as single prec, but we know it's <= 1,
+        // so no precision is lost even if it had 6 digits after dot.
+        a.occ + 1e-6,
+        // B is harder to get rounded right. It is stored as float,
+        // and may be given with more than single precision in mmCIF
+        // If it was originally %.5f (5TIS) we need to add 0.5 * 10^-5.
+        std::min(a.b_iso + 0.5e-5, 999.99),
+        res.segment.c_str(),
+        a.element.uname(),
+        // Charge is written as 1+ or 2-, etc, or just empty space.
+        // Sometimes PDB files have explicit 0s (5M05); we ignore them.
+        a.charge ? a.charge > 0 ? '0'+a.charge : '0'-a.charge : ' ',
+        a.charge ? a.charge > 0 ? '+' : '-' : ' ');
+  buf[80] = '\n';
+}
+
+bool needs_ter(const Chain& chain, const Residue& res, const PdbWriteOptions& opt) {
+  return opt.ter_records &&
+         (opt.ter_ignores_type ? &res == &chain.residues.back()
+                               : (res.entity_type == EntityType::Polymer &&
+                                 (&res == &chain.residues.back() ||
+                                  (&res + 1)->entity_type != EntityType::Polymer)));
+}
+
+// Number of serial numbers used by write_chain_atoms().
+int count_serials(const Chain& chain, const PdbWriteOptions& opt) {
+  int n = 0;
+  for (const Residue& res : chain.residues) {
+    n += (int) res.atoms.size();
+    if (n != 0 && opt.numbered_ter && needs_ter(chain, res, opt))
+      ++n;
+  }
+  return n;
+}
+
+void write_chain_atoms(const Chain& chain, std::string& out,
+                       int& serial, const PdbWriteOptions& opt) {
   char buf[88];
   buf[0] = '\0';
   if (chain.name.length() > 2)
@@ -218,86 +389,26 @@ void write_chain_atoms(const Chain& chain, std::ostream& os,
     bool as_het = use_hetatm(res);
     for (const Atom& a : res.atoms) {
       serial = opt.preserve_serial ? a.serial : serial + 1;
-      //  1- 6  6s  record name
-      //  7-11  5d  integer serial
-      // 12     1   -
-      // 13-16  4s  atom name (from 13 only if 4-char or 2-char symbol)
-      // 17     1c  altloc
-      // 18-20  3s  residue name
-      // 21     1   -
-      // 22     1s  chain
-      // 23-26  4d  integer residue sequence number
-      // 27     1c  insertion code
-      // 28-30  3   -
-      // 31-38  8f  x (8.3)
-      // 39-46  8f  y
-      // 47-54  8f  z
-      // 55-60  6f  occupancy (6.2)
-      // 61-66  6f  temperature factor (6.2)
-      // 67-76  6   -
-      // 73-76      segment identifier, left-justified (non-standard)
-      // 77-78  2s  element symbol, right-justified
-      // 79-80  2s  charge
-      int written_bytes = snprintf_z(buf, 82,
-            "%-6s%5s %-4.4s%c%3.3s"
-            "%2s%5s   %8.3f%8.3f%8.3f",
-            as_het ? "HETATM" : "ATOM",
-            encode_serial_in_hybrid36(serial).data(),
-            a.padded_name().c_str(),
-            a.altloc ? std::toupper(a.altloc) : ' ',
-            res.name.c_str(),
-            chain.name.c_str(),
-            write_seq_id(res.seqid).data(),
-            // We want to avoid negative zero and round the numbers up
-            // if they originally had one digit more and that digit was 5.
-            a.pos.x > -5e-4 && a.pos.x < 0 ? 0 : a.pos.x + 1e-10,
-            a.pos.y > -5e-4 && a.pos.y < 0 ? 0 : a.pos.y + 1e-10,
-            a.pos.z > -5e-4 && a.pos.z < 0 ? 0 : a.pos.z + 1e-10);
-      if GEMMI_UNLIKELY(written_bytes > 54) {
-        // The only items expected to overflow above are the coordinates,
-        // if the integer part of the number exceeds 5 characters.
-        // This happens when something goes wrong and the model is far from
-        // the origin. Such a model should be shifted; it can't be written it
-        // in a spec-conforming format: Real(8.3). Here we overwrite the last
-        // digits - trimming is better than overflowing the line.
-        snprintf_z(buf+38, 82-38, "%8.3f", a.pos.y);
-        snprintf_z(buf+46, 82-46, "%8.3f", a.pos.z);
-      }
-      snprintf_z(buf+54, 82-54,
-            "%6.2f%6.2f      %-4.4s%2s%c%c",
-            // Occupancy is stored as single prec, but we know it's <= 1,
-            // so no precision is lost even if it had 6 digits after dot.
-            a.occ + 1e-6,
-            // B is harder to get rounded right. It is stored as float,
-            // and may be given with more than single precision in mmCIF
-            // If it was originally %.5f (5TIS) we need to add 0.5 * 10^-5.
-            std::min(a.b_iso + 0.5e-5, 999.99),
-            res.segment.c_str(),
-            a.element.uname(),
-            // Charge is written as 1+ or 2-, etc, or just empty space.
-            // Sometimes PDB files have explicit 0s (5M05); we ignore them.
-            a.charge ? a.charge > 0 ? '0'+a.charge : '0'-a.charge : ' ',
-            a.charge ? a.charge > 0 ? '+' : '-' : ' ');
-      buf[80] = '\n';
-      os.write(buf, 81);
+      write_atom_line(buf, a, res, chain, serial, as_het);
+      out.append(buf, 81);
       if (a.aniso.nonzero()) {
         // re-using part of the buffer
         std::memcpy(buf, "ANISOU", 6);
         const double eps = 1e-6;
-        snprintf_z(buf+28, 43, "%7.0f%7.0f%7.0f%7.0f%7.0f%7.0f",
-                   a.aniso.u11*1e4 + eps, a.aniso.u22*1e4 + eps,
-                   a.aniso.u33*1e4 + eps, a.aniso.u12*1e4 + eps,
-                   a.aniso.u13*1e4 + eps, a.aniso.u23*1e4 + eps);
+        double u[6] = {a.aniso.u11*1e4 + eps, a.aniso.u22*1e4 + eps,
+                       a.aniso.u33*1e4 + eps, a.aniso.u12*1e4 + eps,
+                       a.aniso.u13*1e4 + eps, a.aniso.u23*1e4 + eps};
+        if (!write_fixed(buf+28, 7, 0, u[0]) || !write_fixed(buf+35, 7, 0, u[1]) ||
+            !write_fixed(buf+42, 7, 0, u[2]) || !write_fixed(buf+49, 7, 0, u[3]) ||
+            !write_fixed(buf+56, 7, 0, u[4]) || !write_fixed(buf+63, 7, 0, u[5]))
+          snprintf_z(buf+28, 43, "%7.0f%7.0f%7.0f%7.0f%7.0f%7.0f",
+                     u[0], u[1], u[2], u[3], u[4], u[5]);
         buf[28+42] = ' ';
         buf[80] = '\n';
-        os.write(buf, 81);
+        out.append(buf, 81);
       }
     }
-    if (opt.ter_records && buf[0] != '\0' &&
-        (opt.ter_ignores_type ? &res == &chain.residues.back()
-                              : (res.entity_type == EntityType::Polymer &&
-                                (&res == &chain.residues.back() ||
-                                 (&res + 1)->entity_type != EntityType::Polymer)))) {
+    if (buf[0] != '\0' && needs_ter(chain, res, opt)) {
       if (opt.numbered_ter) {
         // re-using part of the buffer in the middle, e.g.:
         // TER    4153      LYS B 286
@@ -305,18 +416,87 @@ void write_chain_atoms(const Chain& chain, std::ostream& os,
                    encode_serial_in_hybrid36(++serial).data());
         std::memset(buf+11, ' ', 6);
         std::memset(buf+28, ' ', 52);
-        buf[80] = '\n';
-        os.write(buf, 81);
       } else {
-        WRITE("%-80s", "TER");
+        snprintf_z(buf, 82, "%-80s", "TER");
       }
+      buf[80] = '\n';
+      out.append(buf, 81);
+    }
+  }
+}
+
+// Atoms from each model are numbered from 1. Before formatting, the first
+// serial number of each chain is calculated, so that chains can be
+// formatted independently.
+struct ChainItem {
+  const Model* model;
+  const Chain* chain;  // null for a model without chains
+  int serial;
+  bool model_start;
+  bool model_end;
+};
+
+void write_atom_records(const Structure& st, std::ostream& os,
+                        const PdbWriteOptions& opt, int num_threads) {
+  std::vector<ChainItem> items;
+  for (const Model& model : st.models) {
+    int serial = 0;
+    if (model.chains.empty())
+      items.push_back({&model, nullptr, 0, true, true});
+    for (const Chain& chain : model.chains) {
+      items.push_back({&model, &chain, serial, &chain == &model.chains.front(),
+                       &chain == &model.chains.back()});
+      if (!opt.preserve_serial)
+        serial += count_serials(chain, opt);
+    }
+  }
+  bool multi_model = st.models.size() > 1;
+  auto write_item = [&](std::string& out, const ChainItem& item) {
+    char buf[88];
+    if (multi_model && item.model_start) {
+      snprintf_z(buf, 82, "MODEL %8d %65s", item.model->num, "");
+      buf[80] = '\n';
+      out.append(buf, 81);
     }
+    if (item.chain) {
+      int serial = item.serial;
+      write_chain_atoms(*item.chain, out, serial, opt);
+    }
+    if (multi_model && item.model_end) {
+      snprintf_z(buf, 82, "%-80s", "ENDMDL");
+      buf[80] = '\n';
+      out.append(buf, 81);
+    }
+  };
+
+  // Chains are processed in batches. In each batch, consecutive chains
+  // are assigned to threads, formatted into separate buffers,
+  // and the buffers are written in order.
+  const size_t atoms_per_thread = 16384;
+  num_threads = get_num_threads(num_threads);
+  std::vector<std::string> buffers(num_threads);
+  for (size_t begin = 0; begin != items.size(); ) {
+    size_t end = begin;
+    for (size_t n = 0; end != items.size() && n < atoms_per_thread * num_threads; ++end)
+      if (items[end].chain)
+        for (const Residue& res : items[end].chain->residues)
+          n += res.atoms.size() + 1;
+    for (std::string& buf : buffers)
+      buf.clear();
+    parallel_for_chunks(end - begin, num_threads, [&](size_t b, size_t e, int n) {
+      for (size_t i = begin + b; i != begin + e; ++i)
+        write_item(buffers[n], items[i]);
+    });
+    for (const std::string& buf : buffers)
+      os.write(buf.data(), buf.size());
+    begin = end;
   }
 }
 
 } // anonymous namespace
 
-void write_pdb(const Structure& st, std::ostream& os, PdbWriteOptions opt) {
+void write_pdb(const Structure& st, std::ostream& os, PdbWriteOptions opt,
+               int num_threads) {
   // check if structure can be written as pdb
   for (const gemmi::Model& model : st.models)
     for (const gemmi::Chain& chain : model.chains)
@@ -671,17 +851,8 @@ void write_pdb(const Structure& st, std::ostream& os, PdbWriteOptions opt) {
   }
 
   // MODEL, ATOM, HETATM, TER, ENDMDL
-  if (opt.atom_records) {
-    for (const Model& model : st.models) {
-      int serial = 0;
-      if (st.models.size() > 1)
-        WRITE("MODEL %8d %65s", model.num, "");
-      for (const Chain& chain : model.chains)
-        write_chain_atoms(chain, os, serial, opt);
-      if (st.models.size() > 1)
-        WRITE("%-80s", "ENDMDL");
-    }
-  }
+  if (opt.atom_records)
+    write_atom_records(st, os, opt, num_threads);
 
   // CONECT
   if (opt.conect_records) {
@@ -615,26 +615,73 @@ void Topo::apply_all_restraints(const MonLib& monlib) {
     apply_restraints_from_link(link, monlib);
 }
 
+namespace {
+
+// atoms under which restraints are indexed in Topo
+template<typename F> void for_index_atoms(Topo::Bond& t, F f) {
+  f(t.atoms[0]);
+  if (t.atoms[1] != t.atoms[0])
+    f(t.atoms[1]);
+}
+template<typename F> void for_index_atoms(Topo::Angle& t, F f) {
+  f(t.atoms[1]);
+}
+template<typename F> void for_index_atoms(Topo::Torsion& t, F f) {
+  f(t.atoms[1]);
+  if (t.atoms[2] != t.atoms[1])
+    f(t.atoms[2]);
+}
+template<typename F> void for_index_atoms(Topo::Plane& t, F f) {
+  for (Atom* atom : t.atoms)
+    f(atom);
+}
+
+// counting sort; restraints of each atom are kept in the original order
+template<typename T>
+void fill_restraint_index(Topo::RestraintIndex<T>& index, std::vector<T>& restraints,
+                          std::unordered_map<const Atom*, int>& atom_index) {
+  auto get_idx = [&](const Atom* a) {
+    auto it = atom_index.find(a);
+    if (it != atom_index.end())
+      return it->second;
+    // normally not used - all atoms should be in residues from chain_infos
+    int n = (int) atom_index.size();
+    atom_index.emplace(a, n);
+    return n;
+  };
+  std::vector<int> idx;
+  for (T& t : restraints)
+    for_index_atoms(t, [&](const Atom* a) { idx.push_back(get_idx(a)); });
+  std::vector<int>& offsets = index.offsets;
+  offsets.assign(atom_index.size() + 1, 0);
+  for (int i : idx)
+    ++offsets[i+1];
+  for (size_t i = 1; i < offsets.size(); ++i)
+    offsets[i] += offsets[i-1];
+  index.items.resize(idx.size());
+  std::vector<int> pos(offsets.begin(), offsets.end() - 1);
+  auto i = idx.begin();
+  for (T& t : restraints)
+    for_index_atoms(t, [&](const Atom*) { index.items[pos[*i++]++] = &t; });
+}
+
+} // anonymous namespace
+
 void Topo::create_indices() {
-  bond_index.clear();
-  for (Bond& bond : bonds) {
-    bond_index.emplace(bond.atoms[0], &bond);
-    if (bond.atoms[1] != bond.atoms[0])
-      bond_index.emplace(bond.atoms[1], &bond);
-  }
-  angle_index.clear();
-  for (Angle& ang : angles)
-    angle_index.emplace(ang.atoms[1], &ang);
-  torsion_index.clear();
-  for (Torsion& tor : torsions) {
-    torsion_index.emplace(tor.atoms[1], &tor);
-    if (tor.atoms[1] != tor.atoms[2])
-      torsion_index.emplace(tor.atoms[2], &tor);
-  }
-  plane_index.clear();
-  for (Plane& plane : planes)
-    for (Atom* atom : plane.atoms)
-      plane_index.emplace(atom, &plane);
+  atom_index.clear();
+  size_t n = 0;
+  for (const ChainInfo& ci : chain_infos)
+    for (const ResInfo& ri : ci.res_infos)
+      n += ri.res->atoms.size();
+  atom_index.reserve(n);
+  for (const ChainInfo& ci : chain_infos)
+    for (const ResInfo& ri : ci.res_infos)
+      for (const Atom& atom : ri.res->atoms)
+        atom_index.emplace(&atom, (int) atom_index.size());
+  fill_restraint_index(bond_index, bonds, atom_index);
+  fill_restraint_index(angle_index, angles, atom_index);
+  fill_restraint_index(torsion_index, torsions, atom_index);
+  fill_restraint_index(plane_index, planes, atom_index);
 }
 
 Topo::Link* Topo::find_polymer_link(const AtomAddress& aa1, const AtomAddress& aa2) {
@@ -6,6 +6,7 @@
 #include <gemmi/util.hpp>      // for trim_str
 #include <gemmi/gz.hpp>
 #include <gemmi/math.hpp>
+#include <gemmi/parallel.hpp>  // for parallel_for_chunks
 
 namespace gemmi {
 
@@ -123,10 +124,145 @@ void parse_numbers_into_vec3(const char* start, const char* end,
     start = parse_number_into(start, end, *val, line);
 }
 
+void parse_data_line(const char* line, size_t len, int read_columns, int iset_col,
+                     XdsAscii::Refl& r) {
+  const char* p = line;
+  for (int i = 0; i < 3; ++i)
+    r.hkl[i] = simple_atoi(p, &p);
+  auto result = fast_from_chars(p, line+len, r.iobs); // 4
+  result = fast_from_chars(result.ptr, line+len, r.sigma); // 5
+  if (read_columns >= 8) {
+    result = fast_from_chars(result.ptr, line+len, r.xd); // 6
+    result = fast_from_chars(result.ptr, line+len, r.yd); // 7
+    result = fast_from_chars(result.ptr, line+len, r.zd); // 8
+    if (read_columns >= 11) {
+      result = fast_from_chars(result.ptr, line+len, r.rlp); // 9
+      result = fast_from_chars(result.ptr, line+len, r.peak); // 10
+      result = fast_from_chars(result.ptr, line+len, r.corr); // 11
+      if (read_columns >= 12) {
+        result = fast_from_chars(result.ptr, line+len, r.maxc); // 12
+      } else {
+        r.maxc = 0;  // 12
+      }
+    } else {
+      r.rlp = r.peak = r.corr = r.maxc = 0;  // 9-11
+    }
+  } else {
+    r.xd = r.yd = r.zd = 0;  // 6-8
+  }
+  if (result.ec != std::errc())
+    fail("failed to parse data line:\n", line);
+  if (iset_col >= read_columns) {
+    const char* iset_ptr = result.ptr;
+    for (int j = read_columns+1; j < iset_col; ++j)
+      iset_ptr = skip_word(skip_blank(iset_ptr));
+    r.iset = simple_atoi(iset_ptr);
+  }
+}
+
+// Reads lines from memory in the same way as AnyStream::copy_line(),
+// but the current position is accessible, which allows parsing
+// a block of data lines in parallel.
+struct MemoryLineReader {
+  const char* cur;
+  const char* end;
+
+  size_t copy_line(char* line, int size) {
+    if (cur >= end)
+      return 0;
+    size_t n = std::min(size_t(size - 1), size_t(end - cur));
+    const char* nl = (const char*) std::memchr(cur, '\n', n);
+    if (nl)
+      n = nl - cur + 1;
+    std::memcpy(line, cur, n);
+    line[n] = '\0';
+    cur += n;
+    if (!nl)  // if a line is longer than size we discard the rest of it
+      cur = next_line(cur, end);
+    return std::strlen(line);
+  }
+
+  static const char* next_line(const char* p, const char* end) {
+    const char* nl = (const char*) std::memchr(p, '\n', end - p);
+    return nl ? nl + 1 : end;
+  }
+};
+
+// Data lines are parsed one by one when reading from a stream.
+void read_data_lines(AnyStream&, const char* line, size_t len, int read_columns,
+                     int iset_col, int, std::vector<XdsAscii::Refl>& data) {
+  parse_data_line(line, len, read_columns, iset_col, data.emplace_back());
+}
+
+// When reading from memory, the first data line is parsed as above,
+// and the following data lines (up to the next line starting with '!')
+// are parsed in parallel. Lines are counted first, so that data is resized
+// only once and each chunk is parsed directly into its place.
+void read_data_lines(MemoryLineReader& reader, const char* line, size_t len,
+                     int read_columns, int iset_col, int num_threads,
+                     std::vector<XdsAscii::Refl>& data) {
+  parse_data_line(line, len, read_columns, iset_col, data.emplace_back());
+  const size_t min_chunk_size = 1024 * 1024;
+  size_t size = reader.end - reader.cur;
+  int n = std::max(1, std::min(get_num_threads(num_threads),
+                               int(size / min_chunk_size)));
+  // chunk boundaries are at the beginning of lines
+  std::vector<const char*> bounds(n + 1, reader.end);
+  bounds[0] = reader.cur;
+  for (int i = 1; i < n; ++i)
+    bounds[i] = std::max(bounds[i-1],
+                         MemoryLineReader::next_line(reader.cur + size * i / n - 1, reader.end));
+  // count data lines in each chunk and find the first line starting with '!'
+  std::vector<size_t> counts(n, 0);
+  std::vector<const char*> stops(n, nullptr);
+  parallel_for_chunks(n, n, [&](size_t i, size_t, int) {
+    for (const char* p = bounds[i]; p < bounds[i+1];
+         p = MemoryLineReader::next_line(p, bounds[i+1])) {
+      if (*p == '!' || *p == '\0') {
+        stops[i] = p;
+        break;
+      }
+      ++counts[i];
+    }
+  });
+  const char* data_end = reader.end;
+  size_t offset = data.size();
+  std::vector<size_t> offsets(n);
+  for (int i = 0; i < n; ++i) {
+    offsets[i] = offset;
+    offset += counts[i];
+    if (stops[i]) {
+      data_end = stops[i];
+      n = i + 1;
+      break;
+    }
+  }
+  data.resize(offset);
+  parallel_for_chunks(n, n, [&](size_t i, size_t, int) {
+    MemoryLineReader chunk{bounds[i], std::min(bounds[i+1], data_end)};
+    char buf[256];
+    XdsAscii::Refl* r = &data[offsets[i]];
+    while (size_t line_len = chunk.copy_line(buf, 255))
+      parse_data_line(buf, line_len, read_columns, iset_col, *r++);
+  });
+  reader.cur = data_end;
+}
+
 
 } // anonymous namespace
 
-void XdsAscii::read_stream(AnyStream& line_reader, const std::string& source) {
+void XdsAscii::read_stream(AnyStream& reader, const std::string& source) {
+  read_lines(reader, source, 1);
+}
+
+void XdsAscii::read_memory(const char* data_, size_t size, const std::string& source,
+                           int num_threads) {
+  MemoryLineReader reader{data_, data_ + size};
+  read_lines(reader, source, num_threads);
+}
+
+template<typename Reader>
+void XdsAscii::read_lines(Reader& line_reader, const std::string& source, int num_threads) {
   source_path = source;
   read_columns = 12;
   char line[256];
@@ -258,48 +394,15 @@ void XdsAscii::read_stream(AnyStream& line_reader, const std::string& source) {
         return;
       }
     } else {
-      data.emplace_back();
-      XdsAscii::Refl& r = data.back();
-      const char* p = line;
-      for (int i = 0; i < 3; ++i)
-        r.hkl[i] = simple_atoi(p, &p);
-      auto result = fast_from_chars(p, line+len, r.iobs); // 4
-      result = fast_from_chars(result.ptr, line+len, r.sigma); // 5
-      if (read_columns >= 8) {
-        result = fast_from_chars(result.ptr, line+len, r.xd); // 6
-        result = fast_from_chars(result.ptr, line+len, r.yd); // 7
-        result = fast_from_chars(result.ptr, line+len, r.zd); // 8
-        if (read_columns >= 11) {
-          result = fast_from_chars(result.ptr, line+len, r.rlp); // 9
-          result = fast_from_chars(result.ptr, line+len, r.peak); // 10
-          result = fast_from_chars(result.ptr, line+len, r.corr); // 11
-          if (read_columns >= 12) {
-            result = fast_from_chars(result.ptr, line+len, r.maxc); // 12
-          } else {
-            r.maxc = 0;  // 12
-          }
-        } else {
-          r.rlp = r.peak = r.corr = r.maxc = 0;  // 9-11
-        }
-      } else {
-        r.xd = r.yd = r.zd = 0;  // 6-8
-      }
-      if (result.ec != std::errc())
-        fail("failed to parse data line:\n", line);
-      if (iset_col >= read_columns) {
-        const char* iset_ptr = result.ptr;
-        for (int j = read_columns+1; j < iset_col; ++j)
-          iset_ptr = skip_word(skip_blank(iset_ptr));
-        r.iset = simple_atoi(iset_ptr);
-      }
+      read_data_lines(line_reader, line, len, read_columns, iset_col, num_threads, data);
     }
   }
   fail("incorrect or unfinished file: " + source_path);
 }
 
-XdsAscii read_xds_ascii(const std::string& path) {
+XdsAscii read_xds_ascii(const std::string& path, int num_threads) {
   XdsAscii xds_ascii;
-  xds_ascii.read_input(gemmi::MaybeGzipped(path));
+  xds_ascii.read_input(gemmi::MaybeGzipped(path), num_threads);
   return xds_ascii;
 }
 
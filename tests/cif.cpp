@@ -2,6 +2,7 @@
 #include "doctest.h"
 
 #include <algorithm>
+#include <gemmi/cif.hpp>       // for estimate_loop_values
 #include <gemmi/read_cif.hpp>
 
 namespace cif = gemmi::cif;
@@ -87,3 +88,71 @@ TEST_CASE("cif::Block::init_loop") {
   CHECK_EQ(block.find_values("_p.u").item(), nullptr);
   CHECK_EQ(block.find_values("_p.v").at(0), "30");
 }
+
+TEST_CASE("cif::estimate_loop_values") {
+  std::string text = "data_1 loop_ _a _b _c\n";
+  for (int i = 0; i < 500; ++i)
+    text += "x 'a b' \"O5'\"\n";
+  text += "#\n_pair 1\nloop_ _q 1 2\n";
+  size_t pos = text.find("x ");
+  size_t est = cif::estimate_loop_values(text.c_str() + pos,
+                                         text.c_str() + text.size(), 3);
+  CHECK_EQ(est, 1503);
+  cif::Document doc = cif::read_string(text);
+  const cif::Loop* loop = &doc.blocks[0].find_loop_item("_a")->loop;
+  CHECK_EQ(loop->values.size(), 1500);
+  CHECK(loop->values.capacity() >= loop->values.size());
+  CHECK_EQ(loop->values[1], "'a b'");
+  CHECK_EQ(*doc.blocks[0].find_value("_pair"), "1");
+
+  // rows split across lines make the estimate too high
+  text = "data_2 loop_ _a _b _c\n";
+  for (int i = 0; i < 500; ++i)
+    text += "x 'a b'\n\"O5'\"\n";
+  pos = text.find("x ");
+  est = cif::estimate_loop_values(text.c_str() + pos,
+                                  text.c_str() + text.size(), 3);
+  CHECK_EQ(est, 2001);
+  doc = cif::read_string(text);
+  loop = &doc.blocks[0].find_loop_item("_a")->loop;
+  CHECK_EQ(loop->values.size(), 1500);
+  CHECK(loop->values.capacity() >= loop->values.size());
+  CHECK(loop->values.capacity() < est);
+}
+
+TEST_CASE("cif::read_memory with num_threads") {
+  std::string text = "data_1\nloop_ _a _b _c\n";
+  for (int i = 0; i < 40000; ++i)
+    text += "x" + std::to_string(i) + " 'a b' \"O5'\" # comment\n";
+  text += "   #\n  _pair 1\nloop_ _q 1 2\n";
+  auto read = [&](const std::string& s, int num_threads) {
+    return cif::read_memory(s.c_str(), s.size(), "test", num_threads);
+  };
+  cif::Document doc1 = read(text, 1);
+  cif::Document doc4 = read(text, 4);
+  const cif::Loop& loop1 = doc1.blocks[0].items[0].loop;
+  const cif::Loop& loop4 = doc4.blocks[0].items[0].loop;
+  CHECK_EQ(loop4.values.size(), 120000);
+  CHECK(loop4.values == loop1.values);
+  CHECK_EQ(loop4.values[119999], "\"O5'\"");
+  CHECK_EQ(doc4.blocks[0].items[1].line_number, 40004);
+  CHECK_EQ(doc4.blocks[0].items[1].line_number, doc1.blocks[0].items[1].line_number);
+  CHECK_EQ(doc4.blocks[0].items[2].loop.values.size(), 2);
+  // a text field is left for the sequential parser
+  std::string text2 = text;
+  text2.insert(text2.find("x2000 "), ";text\nfield\n;\n'a b' c\n");
+  CHECK_EQ(read(text2, 4).blocks[0].items[0].loop.values.size(), 120003);
+  // errors are reported by the sequential parser
+  std::string text3 = text;
+  text3.insert(text3.find("x3000 "), "'unterminated\n");
+  auto error_message = [&](int num_threads) -> std::string {
+    try {
+      read(text3, num_threads);
+    } catch (std::exception& e) {
+      return e.what();
+    }
+    return "";
+  };
+  CHECK_EQ(error_message(4), error_message(1));
+  CHECK_NE(error_message(4), "");
+}
@@ -0,0 +1,156 @@
+#include "doctest.h"
+
+#include <algorithm>  // for max
+#include <cmath>
+#include <cstdlib>  // for rand
+#include <fstream>
+#include <sstream>
+#include <gemmi/asudata.hpp>  // for make_asu_data
+#include <gemmi/levmar.hpp>   // for compute_wssr, compute_lm_matrices
+#include <gemmi/mtz.hpp>
+#include <gemmi/scaling.hpp>
+#include <gemmi/xds_ascii.hpp>
+
+static bool same_float(float a, float b) {
+  return a == b || (std::isnan(a) && std::isnan(b));
+}
+
+TEST_CASE("MappedMtz") {
+  std::string path = std::string(TEST_DIR) + "5e5z.mtz";
+  gemmi::Mtz mtz = gemmi::read_mtz_file(path);
+  gemmi::MappedMtz mapped(path);
+  CHECK(!mapped.mtz.has_data());
+  REQUIRE_EQ(mapped.mtz.columns.size(), mtz.columns.size());
+  CHECK_EQ(mapped.size(), mtz.data.size());
+  for (const gemmi::Mtz::Column& col : mtz.columns) {
+    gemmi::MappedMtz::ColumnView view = mapped.column(col.label);
+    REQUIRE_EQ(view.size(), (size_t) col.size());
+    size_t n_diff = 0;
+    for (size_t i = 0; i != view.size(); ++i)
+      if (!same_float(view[i], col[i]))
+        ++n_diff;
+    CHECK_EQ(n_diff, 0);
+  }
+  CHECK_THROWS(mapped.column("FP").at(mtz.nreflections));
+
+  gemmi::MtzMappedDataProxy proxy = gemmi::data_proxy(mapped);
+  CHECK_EQ(proxy.size(), mtz.data.size());
+  size_t offset = 7 * proxy.stride();
+  CHECK_EQ(proxy.get_hkl(offset), gemmi::MtzDataProxy{mtz}.get_hkl(offset));
+
+  using VS = gemmi::ValueSigma<float>;
+  auto asu1 = gemmi::make_asu_data<VS, 2>(mtz, {"FP", "SIGFP"});
+  auto asu2 = gemmi::make_asu_data<VS, 2>(mapped, {"FP", "SIGFP"});
+  REQUIRE_EQ(asu2.size(), asu1.size());
+  CHECK(asu2.size() > 0);
+  size_t n_diff = 0;
+  for (size_t i = 0; i != asu1.size(); ++i)
+    if (asu1.v[i].hkl != asu2.v[i].hkl ||
+        asu1.v[i].value.value != asu2.v[i].value.value ||
+        asu1.v[i].value.sigma != asu2.v[i].value.sigma)
+      ++n_diff;
+  CHECK_EQ(n_diff, 0);
+  auto free1 = gemmi::make_asu_data<float>(mtz, "FREE", true);
+  auto free2 = gemmi::make_asu_data<float>(mapped, "FREE", true);
+  CHECK_EQ(free2.size(), free1.size());
+}
+
+TEST_CASE("Scaling::compute_lm_matrices") {
+  gemmi::UnitCell cell(50, 60, 70, 90, 100, 90);
+  gemmi::Scaling<float> scaling(cell, gemmi::find_spacegroup_by_name("P 1 21 1"));
+  std::srand(5);
+  auto random = [](double low, double high) {
+    return low + (high - low) * std::rand() / RAND_MAX;
+  };
+  for (int h = -10; h <= 10; ++h)
+    for (int k = 0; k <= 12; ++k)
+      for (int l = 0; l <= 14; ++l) {
+        gemmi::Miller hkl{{h, k, l}};
+        std::complex<float> fc = std::polar((float) random(1, 100), (float) random(0, 6.28));
+        std::complex<float> fm = std::polar((float) random(1, 50), (float) random(0, 6.28));
+        scaling.points.push_back({hkl, cell.calculate_stol_sq(hkl), fc, fm,
+                                  (float) random(1, 150), 1.f});
+      }
+  REQUIRE(scaling.points.size() % gemmi::Scaling<float>::block_size != 0);
+  scaling.set_b_overall({12, 15, 20, 0, 3, 0});
+  scaling.k_overall = 1.2;
+  for (bool use_solvent : {false, true}) {
+    scaling.use_solvent = use_solvent;
+    size_t na = scaling.get_parameters().size();
+    std::vector<double> alpha0(na * na), beta0(na);
+    const gemmi::Scaling<float>& cscaling = scaling;
+    double wssr0 = gemmi::compute_lm_matrices(cscaling, alpha0, beta0);
+    CHECK_EQ(gemmi::compute_wssr(cscaling), doctest::Approx(wssr0).epsilon(1e-6));
+    double wssr1 = 0;
+    for (int num_threads : {1, 3}) {
+      scaling.num_threads = num_threads;
+      scaling.arrays = {};
+      double wssr = scaling.compute_wssr();
+      CHECK_EQ(wssr, doctest::Approx(wssr0).epsilon(1e-6));
+      if (num_threads == 1)
+        wssr1 = wssr;
+      else
+        CHECK_EQ(wssr, doctest::Approx(wssr1).epsilon(1e-12));
+      std::vector<double> alpha(na * na), beta(na);
+      CHECK_EQ(scaling.compute_lm_matrices(alpha, beta), doctest::Approx(wssr).epsilon(1e-12));
+      // the generic functions use Real (float) in some calculations,
+      // so the differences are compared with the diagonal of alpha
+      double max_beta_diff = 0, max_alpha_diff = 0;
+      for (size_t j = 0; j != na; ++j) {
+        double scale_j = std::sqrt(alpha0[j * na + j]);
+        max_beta_diff = std::max(max_beta_diff,
+                                 std::fabs(beta[j] - beta0[j]) / scale_j / std::sqrt(wssr0));
+        for (size_t k = 0; k != na; ++k) {
+          double scale = scale_j * std::sqrt(alpha0[k * na + k]);
+          max_alpha_diff = std::max(max_alpha_diff,
+                                    std::fabs(alpha[j * na + k] - alpha0[j * na + k]) / scale);
+        }
+      }
+      CHECK(max_beta_diff < 1e-6);
+      CHECK(max_alpha_diff < 1e-6);
+    }
+    scaling.b_sol = 30;
+  }
+}
+
+TEST_CASE("XdsAscii::read_memory") {
+  std::ifstream file(std::string(TEST_DIR) + "INTEGRATE-tiny.HKL");
+  std::string header, lines, line;
+  while (std::getline(file, line)) {
+    header += line + "\n";
+    if (line == "!END_OF_HEADER")
+      break;
+  }
+  while (std::getline(file, line) && line[0] != '!')
+    lines += line + "\n";
+  // two blocks of data lines, each split into chunks of 1MB+,
+  // separated by a comment
+  std::string text = header;
+  while (text.size() < 2500000)
+    text += lines;
+  text += "! comment inside data\n";
+  while (text.size() < 5500000)
+    text += lines;
+  text += "!END_OF_DATA\n";
+
+  gemmi::XdsAscii xds1;
+  gemmi::MemoryStream stream(text.data(), text.size());
+  xds1.read_stream(stream, "large");
+  REQUIRE(xds1.data.size() > 40000);
+  for (int num_threads : {1, 3}) {
+    gemmi::XdsAscii xds2;
+    xds2.read_memory(text.data(), text.size(), "large", num_threads);
+    REQUIRE_EQ(xds2.data.size(), xds1.data.size());
+    CHECK_EQ(xds2.read_columns, xds1.read_columns);
+    size_t n_diff = 0;
+    for (size_t i = 0; i != xds1.data.size(); ++i) {
+      const gemmi::XdsAscii::Refl& a = xds1.data[i];
+      const gemmi::XdsAscii::Refl& b = xds2.data[i];
+      if (a.hkl != b.hkl || a.iset != b.iset || a.iobs != b.iobs ||
+          a.sigma != b.sigma || a.xd != b.xd || a.yd != b.yd || a.zd != b.zd ||
+          a.rlp != b.rlp || a.peak != b.peak || a.corr != b.corr || a.maxc != b.maxc)
+        ++n_diff;
+    }
+    CHECK_EQ(n_diff, 0);
+  }
+}
@@ -2,14 +2,21 @@
 #define DOCTEST_CONFIG_IMPLEMENT_WITH_MAIN
 #include "doctest.h"
 
+#include <algorithm>  // for min
+#include <cstdio>   // for FILE, remove
 #include <cstdlib>  // for rand
 #include <climits>  // for INT_MIN, INT_MAX
+#include <memory>  // for unique_ptr
+#include <string>
 #include <vector>
 #include <gemmi/atox.hpp>
+#include <gemmi/gz.hpp>    // for MaybeGzipped
 #include <gemmi/math.hpp>
 #include <gemmi/it92.hpp>
 #include <gemmi/util.hpp>  // for is_in_list
 #include <gemmi/asudata.hpp>  // for ComplexCorrelation
+#include <gemmi/solmask.hpp>  // for set_margin_around
+#include <gemmi/sprintf.hpp>  // for to_chars_g, to_str
 #include <linalg.h>
 
 static double draw() { return 10.0 * std::rand() / RAND_MAX - 5; }
@@ -183,3 +190,142 @@ TEST_CASE("vector_Vec3") {
   auto offset = x1 - x0;
   CHECK_EQ(offset, 3);
 }
+
+TEST_CASE("set_margin_around") {
+  // Fine grid in orthogonal cell: the stencil would have 1000+ points,
+  // so set_margin_around() uses the distance transform.
+  gemmi::Grid<signed char> grid;
+  grid.set_unit_cell(10, 12, 14, 90, 90, 90);
+  grid.set_size(40, 48, 56);
+  const double r = 1.73;
+  std::srand(1);
+  for (signed char& x : grid.data)
+    x = std::rand() % 50 == 0 ? 1 : 0;
+  // what the stencils do: mark points != 1 within r from any point == 1
+  gemmi::Grid<signed char> expected = grid;
+  int d = (int) std::ceil(r / grid.spacing[0]);
+  for (int w = 0; w < grid.nw; ++w)
+    for (int v = 0; v < grid.nv; ++v)
+      for (int u = 0; u < grid.nu; ++u) {
+        if (grid.get_value_q(u, v, w) != 1)
+          continue;
+        for (int dw = -d; dw <= d; ++dw)
+          for (int dv = -d; dv <= d; ++dv)
+            for (int du = -d; du <= d; ++du) {
+              gemmi::Fractional fdelta = grid.get_fractional(du, dv, dw);
+              double r2 = grid.unit_cell.orthogonalize_difference(fdelta).length_sq();
+              signed char& x = expected.data[grid.index_n(u + du, v + dv, w + dw)];
+              if (r2 <= r * r && x == 0)
+                x = 2;
+            }
+      }
+  for (int num_threads : {1, 3}) {
+    gemmi::Grid<signed char> mask = grid;
+    gemmi::set_margin_around(mask, r, (signed char)1, (signed char)2, num_threads);
+    CHECK(mask.data == expected.data);
+  }
+  // too many points along u for the distance transform, stencils are used
+  gemmi::Grid<signed char> long_grid;
+  long_grid.set_unit_cell(1638.4, 8, 8, 90, 90, 90);
+  long_grid.set_size(16384, 8, 8);
+  long_grid.set_value(0, 0, 0, 1);
+  gemmi::set_margin_around(long_grid, 2.5, (signed char)1, (signed char)2);
+  CHECK(long_grid.get_value(20, 0, 0) == 2);
+  CHECK(long_grid.get_value(16366, 1, 0) == 2);
+  CHECK(long_grid.get_value(26, 0, 0) == 0);
+  CHECK(long_grid.get_value(0, 2, 2) == 0);
+}
+
+TEST_CASE("to_chars_g") {
+  char buf[24];
+  auto check_double = [&](double d) {
+    CHECK_EQ(std::string(buf, gemmi::to_chars_g(buf, d)), gemmi::to_str(d));
+  };
+  auto check_float = [&](float f) {
+    CHECK_EQ(std::string(buf, gemmi::to_chars_g(buf, f)), gemmi::to_str(f));
+  };
+  for (double d : {0., -0., 1e-3, -1e-3, 0.00099999999, 0.0009999999999,
+                   1e9, -1e9, 999999999.4, 999999999.5, 999999999.6, 1e10,
+                   0.5, 1.5, 2.5, -2.5, 0.0012345678905, 1.0000000005,
+                   -1.0000000005, 12.3456789125, 123456.7895, 1e-300, 1e300,
+                   HUGE_VAL, -HUGE_VAL, (double) NAN})
+    check_double(d);
+  for (float f : {0.f, -0.f, 1e-3f, -1e-3f, 1e9f, -1e9f, 999999.5f, 1e6f,
+                  0.5f, 2.5f, -2.5f, 1.0000005f, 12.34565f, 0.00123455f,
+                  -0.00123455f, 1e-30f, 1e30f, HUGE_VALF, NAN})
+    check_float(f);
+  // values with up to 3 decimal places are common in coordinate files
+  std::srand(7);
+  for (int i = 0; i < 20000; ++i) {
+    int n = std::rand() % 2000000 - 1000000;
+    int scale = 1;
+    for (int j = std::rand() % 7; j != 0; --j)
+      scale *= 10;
+    check_double((double) n / scale);
+    check_float((float) n / scale);
+    double r = (double) std::rand() / RAND_MAX;
+    check_double(r * scale);
+    check_float(float(-r * 1e9 / scale));
+  }
+}
+
+static unsigned crc32(const std::string& s) {
+  unsigned crc = 0xFFFFFFFF;
+  for (unsigned char c : s) {
+    crc ^= c;
+    for (int k = 0; k < 8; ++k)
+      crc = (crc >> 1) ^ (0xEDB88320 & (0 - (crc & 1)));
+  }
+  return ~crc;
+}
+
+// writes gzip member with uncompressed (stored) deflate blocks
+static void write_gzip_member(std::FILE* f, const std::string& s) {
+  auto put_le = [&](unsigned value, int nbytes) {
+    for (int i = 0; i < nbytes; ++i)
+      std::fputc((value >> (8 * i)) & 0xFF, f);
+  };
+  const unsigned char header[10] = {0x1f, 0x8b, 8, 0, 0, 0, 0, 0, 0, 255};
+  std::fwrite(header, 1, sizeof(header), f);
+  size_t pos = 0;
+  do {
+    size_t len = std::min(s.size() - pos, (size_t) 65535);
+    std::fputc(pos + len == s.size() ? 1 : 0, f);  // BFINAL, BTYPE=00
+    put_le((unsigned) len, 2);
+    put_le((unsigned) ~len, 2);
+    std::fwrite(s.data() + pos, 1, len, f);
+    pos += len;
+  } while (pos < s.size());
+  put_le(crc32(s), 4);
+  put_le((unsigned) s.size(), 4);
+}
+
+TEST_CASE("MaybeGzipped multi-member") {
+  // two members, > 1 MiB compressed, so create_stream() inflates in background
+  std::string parts[2];
+  std::srand(7);
+  for (std::string& part : parts)
+    while (part.size() < 800000)
+      part += std::to_string(std::rand()) + (std::rand() % 10 ? " " : "\n");
+  const std::string text = parts[0] + parts[1];
+  const char* path = "gemmi_test_multi_member.gz";
+  {
+    std::FILE* f = std::fopen(path, "wb");
+    REQUIRE(f);
+    for (const std::string& part : parts)
+      write_gzip_member(f, part);
+    std::fclose(f);
+  }
+  gemmi::MaybeGzipped input(path);
+  gemmi::CharArray mem = input.uncompress_into_buffer();
+  CHECK(std::string(mem.data(), mem.size()) == text);
+  std::string streamed;
+  {
+    std::unique_ptr<gemmi::AnyStream> stream = input.create_stream();
+    char line[128];
+    while (stream->gets(line, sizeof(line)))
+      streamed += line;
+  }
+  CHECK(streamed == text);
+  std::remove(path);
+}
@@ -0,0 +1,252 @@
+#include "doctest.h"
+
+#include <sstream>
+#include <gemmi/calculate.hpp>  // for count_atom_sites
+#include <gemmi/mmcif.hpp>      // for read_mmcif_streaming, make_structure
+#include <gemmi/mmread_gz.hpp>  // for read_structure_gz
+#include <gemmi/monlib.hpp>     // for MonLib
+#include <gemmi/neighbor.hpp>   // for NeighborSearch
+#include <gemmi/pdb.hpp>        // for read_pdb_string
+#include <gemmi/read_cif.hpp>   // for read_string, read_cif_gz
+#include <gemmi/to_pdb.hpp>     // for write_pdb
+#include <gemmi/topo.hpp>       // for prepare_topology
+#include <gemmi/to_cif.hpp>     // for write_cif_to_stream
+#include <gemmi/to_mmcif.hpp>   // for make_mmcif_document
+
+static std::string mmcif_string(const gemmi::Structure& st) {
+  std::ostringstream os;
+  gemmi::cif::write_cif_to_stream(os, gemmi::make_mmcif_document(st));
+  return os.str();
+}
+
+// 1pfe with chains copied to get 2 models and 20000+ atoms in the first one
+static gemmi::Structure make_large_structure() {
+  gemmi::Structure st = gemmi::read_structure_gz(std::string(TEST_DIR) + "1pfe.cif.gz");
+  gemmi::Model& model = st.models.at(0);
+  const std::vector<gemmi::Chain> orig = model.chains;
+  for (int i = 1; i <= 60; ++i)
+    for (const gemmi::Chain& ch : orig) {
+      model.chains.push_back(ch);
+      model.chains.back().name = ch.name + std::to_string(i);
+    }
+  int n = 0;
+  for (gemmi::Chain& chain : model.chains)
+    for (gemmi::Residue& res : chain.residues)
+      for (gemmi::Atom& atom : res.atoms) {
+        atom.serial = ++n;
+        if (n % 7 == 0)
+          atom.aniso = {0.1f, 0.2f, 0.3f, 0.01f, 0.02f, 0.03f};
+      }
+  st.models.push_back(model);
+  st.models.back().num = 2;
+  st.models.back().chains.resize(5);
+  return st;
+}
+
+TEST_CASE("read_mmcif_streaming") {
+  gemmi::Structure st = make_large_structure();
+  REQUIRE(gemmi::count_atom_sites(st.models[0]) > 4 * 4096);
+  std::string text = mmcif_string(st);
+  gemmi::Structure st1 = gemmi::make_structure(
+      gemmi::cif::read_string(text));
+  gemmi::Structure st2 = gemmi::read_mmcif_streaming(text.c_str(), text.size(), "large");
+  CHECK_EQ(st2.models.size(), 2);
+  CHECK_EQ(gemmi::count_atom_sites(st2), gemmi::count_atom_sites(st));
+  CHECK_EQ(mmcif_string(st2), mmcif_string(st1));
+}
+
+TEST_CASE("write_mmcif") {
+  gemmi::Structure st1 = gemmi::read_structure_gz(std::string(TEST_DIR) + "1pfe.cif.gz");
+  gemmi::Structure st2 = gemmi::read_structure_gz(std::string(TEST_DIR) + "5i55.cif");
+  // 5i55 has no anisotropic ADPs, add them to a few atoms
+  int n = 0;
+  for (gemmi::Chain& chain : st2.models[0].chains)
+    for (gemmi::Residue& res : chain.residues)
+      for (gemmi::Atom& atom : res.atoms)
+        if (++n % 5 == 0)
+          atom.aniso = {0.15f, 0.25f, 0.35f, -0.01f, 0.02f, 0.0123456f};
+  gemmi::Structure st3 = make_large_structure();
+  for (const gemmi::Structure* st : {&st1, &st2, &st3}) {
+    std::string expected = mmcif_string(*st);
+    CHECK(expected.find("_atom_site_anisotrop.U[1][1]") != std::string::npos);
+    for (int num_threads : {1, 3}) {
+      std::ostringstream os;
+      gemmi::write_mmcif(*st, os, gemmi::MmcifOutputGroups(true),
+                         gemmi::cif::WriteOptions(), num_threads);
+      CHECK(os.str() == expected);
+    }
+  }
+}
+
+TEST_CASE("write_pdb") {
+  gemmi::Structure st = gemmi::read_structure_gz(std::string(TEST_DIR) + "1pfe.cif.gz");
+  gemmi::Model& model = st.models.at(0);
+  const std::vector<gemmi::Chain> orig = model.chains;
+  model.chains.clear();
+  // 1pfe has 342 atoms, with 160 copies we get > 3 * 16384 atoms
+  const char* symbols = "ABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789";
+  for (int i = 0; i < 160; ++i)
+    for (const gemmi::Chain& ch : orig) {
+      model.chains.push_back(ch);
+      int n = (int) model.chains.size();
+      model.chains.back().name = std::string(1, symbols[n / 36]) + symbols[n % 36];
+    }
+  int n = 0;
+  for (gemmi::Chain& chain : model.chains)
+    for (gemmi::Residue& res : chain.residues)
+      for (gemmi::Atom& atom : res.atoms) {
+        ++n;
+        // values that don't fit in the columns are written with snprintf
+        if (n % 1000 == 0)
+          atom.pos.x = 123456.789;
+        if (n % 1000 == 1)
+          atom.pos.z = -98765.4321;
+        if (n % 1000 == 2)
+          atom.b_iso = -1234.5f;
+        if (n % 1000 == 3)
+          atom.occ = 1000.f;
+      }
+  REQUIRE(n > 3 * 16384);
+  st.models.push_back(model);
+  st.models.back().num = 2;
+  st.models.back().chains.resize(3);
+  std::ostringstream os1;
+  gemmi::write_pdb(st, os1, gemmi::PdbWriteOptions(), 1);
+  std::string expected = os1.str();
+  CHECK(expected.find(" 123456.7") != std::string::npos);
+  CHECK(expected.find("-98765.4") != std::string::npos);
+  CHECK(expected.find("-1234.50") != std::string::npos);
+  for (int num_threads : {2, 3}) {
+    std::ostringstream os;
+    gemmi::write_pdb(st, os, gemmi::PdbWriteOptions(), num_threads);
+    CHECK(os.str() == expected);
+  }
+}
+
+TEST_CASE("read_pdb_string with ANISOU") {
+  std::string text =
+"ATOM      1  N   MET A   1      11.104  13.207   2.100  1.00 28.19           N\n"
+"ANISOU    1  N   MET A   1     3651   3395   3664   -246    215   -138       N\n"
+"ATOM      2  CA  MET A   1      12.560  13.207   2.100  1.00 27.40           C\n"
+"ANISOU    2  CA  MET A   1     3622   3332   3455   -196    178   -125       C\n";
+  for (int num_threads : {1, 3}) {
+    gemmi::PdbReadOptions options;
+    options.num_threads = num_threads;
+    gemmi::Structure st = gemmi::read_pdb_string(text, "anisou", options);
+    const gemmi::Atom& atom = st.models.at(0).chains.at(0).residues.at(0).atoms.at(1);
+    CHECK_EQ(atom.aniso.u11, doctest::Approx(0.3622));
+    CHECK_EQ(atom.aniso.u23, doctest::Approx(-0.0125));
+    // a truncated ANISOU record is an error, also when it's the last line
+    std::string truncated = text.substr(0, text.size() - 30);
+    CHECK_THROWS(gemmi::read_pdb_string(truncated, "anisou", options));
+    truncated = text.substr(0, text.size() - 30) + "\n" + text.substr(0, 81);
+    CHECK_THROWS(gemmi::read_pdb_string(truncated, "anisou", options));
+  }
+}
+
+TEST_CASE("NeighborSearch::find_atoms_batch") {
+  gemmi::Structure st = gemmi::read_structure_gz(std::string(TEST_DIR) + "4oz7.pdb");
+  gemmi::NeighborSearch ns(st.models[0], st.cell, 5);
+  ns.populate();
+  std::vector<gemmi::Position> positions;
+  for (const gemmi::Chain& chain : st.models[0].chains)
+    for (const gemmi::Residue& res : chain.residues)
+      for (const gemmi::Atom& atom : res.atoms)
+        positions.push_back(atom.pos + gemmi::Position(0.6, 0.6, 0.6));
+  for (double radius : {3.0, 0.8}) {
+    size_t zero_hits = 0;
+    for (int num_threads : {1, 3}) {
+      gemmi::NeighborSearch::BatchResult result =
+        ns.find_atoms_batch(positions, '\0', 0.1, radius, num_threads);
+      REQUIRE_EQ(result.size(), positions.size());
+      CHECK_EQ(result.offsets.back(), result.marks.size());
+      CHECK_EQ(result.dist_sq.size(), result.marks.size());
+      for (size_t i = 0; i != positions.size(); ++i) {
+        std::vector<gemmi::NeighborSearch::Mark*> marks =
+          ns.find_atoms(positions[i], '\0', 0.1, radius);
+        REQUIRE_EQ(result.count(i), marks.size());
+        CHECK(std::equal(marks.begin(), marks.end(),
+                         result.marks.begin() + result.offsets[i]));
+        if (num_threads == 1 && marks.empty())
+          ++zero_hits;
+      }
+    }
+    if (radius < 1)
+      CHECK(zero_hits > 0);
+    else
+      CHECK_EQ(zero_hits, 0);
+  }
+  CHECK_EQ(ns.find_atoms_batch({}, '\0', 0, 3, 3).size(), 0);
+}
+
+TEST_CASE("Topo::bonds_with") {
+  std::string path = std::string(TEST_DIR) + "SO3.cif";
+  gemmi::cif::Document doc = gemmi::read_cif_gz(path);
+  gemmi::Structure st = gemmi::make_structure_from_chemcomp_block(*doc.find_block("comp_SO3"));
+  REQUIRE_EQ(st.models.size(), 1);
+  // two SO3 residues in one chain
+  gemmi::Chain& chain = st.models[0].chains.at(0);
+  chain.residues.push_back(chain.residues.at(0));
+  chain.residues[1].seqid.num = 2;
+  for (gemmi::Atom& atom : chain.residues[1].atoms)
+    atom.pos += gemmi::Position(10, 0, 0);
+  gemmi::MonLib monlib;
+  monlib.read_monomer_cif(path);
+  std::unique_ptr<gemmi::Topo> topo =
+    gemmi::prepare_topology(st, monlib, 0, gemmi::HydrogenChange::NoChange, false);
+  CHECK_EQ(topo->bonds.size(), 6);
+  CHECK_EQ(topo->angles.size(), 6);
+  for (const gemmi::Residue& res : st.models[0].chains[0].residues) {
+    const gemmi::Atom* s = res.find_atom("S", '*');
+    const gemmi::Atom* o1 = res.find_atom("O1", '*');
+    const gemmi::Atom* o2 = res.find_atom("O2", '*');
+    REQUIRE(s);
+    REQUIRE(o1);
+    REQUIRE(o2);
+    CHECK_EQ(topo->bonds_with(s).size(), 3);
+    CHECK_EQ(topo->bonds_with(o1).size(), 1);
+    for (const gemmi::Topo::Bond* bond : topo->bonds_with(s))
+      CHECK((bond->atoms[0] == s || bond->atoms[1] == s));
+    CHECK_EQ(topo->angles_with(s).size(), 3);
+    CHECK_EQ(topo->angles_with(o1).size(), 0);
+    for (const gemmi::Topo::Angle* angle : topo->angles_with(s))
+      CHECK_EQ(angle->atoms[1], s);
+    const gemmi::Restraints::Bond* bond = topo->take_bond(s, o1);
+    REQUIRE(bond);
+    CHECK_EQ(bond->id2.atom, "O1");
+    CHECK_EQ(topo->take_bond(o1, s), bond);
+    CHECK_EQ(topo->take_bond(o1, o2), nullptr);
+    const gemmi::Restraints::Angle* angle = topo->take_angle(o1, s, o2);
+    REQUIRE(angle);
+    CHECK_EQ(topo->take_angle(o2, s, o1), angle);
+    CHECK_EQ(topo->take_angle(s, o1, o2), nullptr);
+  }
+  const gemmi::Atom* s1 = chain.residues[0].find_atom("S", '*');
+  const gemmi::Atom* o1 = chain.residues[1].find_atom("O1", '*');
+  CHECK_EQ(topo->take_bond(s1, o1), nullptr);
+  gemmi::Atom other;
+  CHECK_EQ(topo->bonds_with(&other).size(), 0);
+}
+
+TEST_CASE("NeighborSearch::for_each_cell") {
+  gemmi::Structure st = gemmi::read_structure_gz(std::string(TEST_DIR) + "4oz7.pdb");
+  gemmi::NeighborSearch ns(st.models[0], st.cell, 5);
+  ns.populate();
+  gemmi::Position pos = st.models[0].chains[0].residues[0].atoms[0].pos;
+  size_t n_span = 0, n_vector = 0;
+  ns.for_each_cell(pos, [&](gemmi::Span<gemmi::NeighborSearch::Mark>& marks,
+                            const gemmi::Fractional&) { n_span += marks.size(); });
+  // callback with the argument type used before compact storage was added
+  auto old_func = [&](std::vector<gemmi::NeighborSearch::Mark>& marks,
+                      const gemmi::Fractional&) { n_vector += marks.size(); };
+  ns.for_each_cell(pos, old_func);
+  CHECK(n_span > 0);
+  CHECK_EQ(n_vector, n_span);
+  ns.compact();
+  size_t n_compact = 0;
+  ns.for_each_cell(pos, [&](gemmi::Span<gemmi::NeighborSearch::Mark>& marks,
+                            const gemmi::Fractional&) { n_compact += marks.size(); });
+  CHECK_EQ(n_compact, n_span);
+  CHECK_THROWS(ns.for_each_cell(pos, old_func));
+  CHECK_THROWS(ns.get_subcell(gemmi::Fractional(0.5, 0.5, 0.5)));
+}
@@ -248,6 +248,34 @@ class TestBlock(unittest.TestCase):
         del tab[:-1]
         self.assertEqual(nums(), ['5'])
 
+    def test_reading_multimember_and_bgzf(self):
+        import struct
+        import zlib
+        from common import get_path_for_tempfile
+        text = ''.join('data_b%d\n_a %d\n' % (i, i) for i in range(9000))
+        data = text.encode()
+        def member(chunk, bgzf):
+            c = zlib.compressobj(6, zlib.DEFLATED, -15)
+            comp = c.compress(chunk) + c.flush()
+            if bgzf:
+                bsize = 18 + len(comp) + 8 - 1
+                header = struct.pack('<BBBBIBBH2sHH', 0x1f, 0x8b, 8, 4, 0, 0,
+                                     255, 6, b'BC', 2, bsize)
+            else:
+                header = struct.pack('<BBBBIBB', 0x1f, 0x8b, 8, 0, 0, 0, 255)
+            return header + comp + struct.pack('<II', zlib.crc32(chunk),
+                                                len(chunk))
+        path = get_path_for_tempfile(suffix='.cif.gz')
+        for bgzf in [False, True]:
+            with open(path, 'wb') as f:
+                for i in range(0, len(data), 30000):
+                    f.write(member(data[i:i+30000], bgzf))
+            for num_threads in [1, 3]:
+                doc = cif.read_file(path, num_threads=num_threads)
+                self.assertEqual(len(doc), 9000)
+                self.assertEqual(doc[-1].find_value('_a'), '8999')
+        os.remove(path)
+
     def test_reading_gzipped_file(self):
         path = os.path.join(os.path.dirname(__file__), '1pfe.cif.gz')
         cif_doc = cif.read(path)
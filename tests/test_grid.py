@@ -1,6 +1,7 @@
 #!/usr/bin/env python
 
 import math
+import os
 import sys
 import unittest
 import zlib
@@ -84,6 +85,14 @@ class TestFloatGrid(unittest.TestCase):
         m.set_value(1, 2, 3, 0.0)
         m.symmetrize_min()
         self.assertEqual(m.sum(), 2 * N * N * N - 2 * 12)
+        m.fill(2.0)
+        m.set_value(1, 2, 3, 0.0)
+        m.symmetrize_min(num_threads=3)
+        self.assertEqual(m.sum(), 2 * N * N * N - 2 * 12)
+        m2 = gemmi.FloatGrid(N - 1, N, N)
+        m2.spacegroup = m.spacegroup
+        with self.assertRaises(RuntimeError):
+            m2.symmetrize_min()
 
     def test_grid_size(self):
         # original cell from 4a0g, and a cell with a <-> b
@@ -130,6 +139,24 @@ class TestCcp4Map(unittest.TestCase):
         box = gemmi.FractionalBox()
         box.minimum = gemmi.Fractional(0.5/5, 1.5/6, 3.5/7)
         box.maximum = gemmi.Fractional(4.5/5, 2.5/6, 5.5/7)
+
+        # read a part of the file, and copy the file section by section
+        reader = gemmi.Ccp4Reader(tmp_path)
+        self.assertEqual(reader.file_dims(), [5, 6, 7])
+        start, size = reader.box_for_extent(box)
+        self.assertEqual((start, size), ([1, 2, 4], [4, 1, 2]))
+        sub = reader.read_subbox(start, size)
+        self.assertTrue(numpy.array_equal(sub.grid.array, data[1:5, 2:3, 4:6]))
+        copy_path = get_path_for_tempfile(suffix='.ccp4')
+        writer = gemmi.Ccp4Writer(copy_path, reader)
+        for w in range(7):
+            writer.write(reader.read_subbox([0, 0, w], [5, 6, 1]))
+        writer.finish()
+        with open(tmp_path, 'rb') as f1, open(copy_path, 'rb') as f2:
+            self.assertEqual(f1.read(), f2.read())
+        del reader
+        os.remove(copy_path)
+
         m.set_extent(box)
         cut_data = data[1:5, 2:3, 4:6]
         self.assertEqual(cut_data.shape, (4, 1, 2))
@@ -204,5 +231,43 @@ class TestCcp4Map(unittest.TestCase):
         volume = span[0] * span[1] * span[2]
         self.assertAlmostEqual(orig_point_count / m.grid.point_count, volume)
 
+    @unittest.skipIf(numpy is None, "NumPy not installed.")
+    def test_solvent_mask(self):
+        st = gemmi.read_structure(full_path('1orc.pdb'))
+        grid = gemmi.FloatGrid()
+        grid.setup_from(st, spacing=0.8)
+        masker = gemmi.SolventMasker(gemmi.AtomicRadiiSet.Refmac)
+        masker.put_mask_on_float_grid(grid, st[0])
+        expected = grid.array.copy()
+        masker.num_threads = 3
+        masker.put_mask_on_float_grid(grid, st[0])
+        assert_numpy_equal(self, grid.array, expected)
+        inc_masker = gemmi.IncrementalSolventMasker(gemmi.AtomicRadiiSet.Refmac)
+        inc_masker.masker.num_threads = 2
+        inc_masker.put_mask_on_float_grid(grid, st[0])
+        assert_numpy_equal(self, grid.array, expected)
+        for res in st[0]['A']:
+            if res.seqid.num % 5 == 0:
+                res[0].pos.y += 1.5
+        inc_masker.put_mask_on_float_grid(grid, st[0])
+        self.assertTrue(0 < inc_masker.updated_atoms < 100)
+        masker.put_mask_on_float_grid(grid, st[0])
+        expected = grid.array.copy()
+        inc_masker.put_mask_on_float_grid(grid, st[0])
+        self.assertEqual(inc_masker.updated_atoms, 0)
+        assert_numpy_equal(self, grid.array, expected)
+
+    def test_soft_edge(self):
+        grid = gemmi.FloatGrid(20, 24, 30)
+        grid.set_unit_cell(gemmi.UnitCell(10, 12, 15, 90, 90, 90))
+        grid.set_value(0, 0, 0, 1)
+        grid.add_soft_edge_to_mask(2.0)
+        self.assertAlmostEqual(grid.get_value(2, 0, 0), 0.5)
+        # periodic boundary conditions
+        self.assertAlmostEqual(grid.get_value(0, 0, 29), 0.853553, delta=1e-6)
+        self.assertAlmostEqual(grid.get_value(3, 2, 0), 0.0238026, delta=1e-6)
+        self.assertEqual(grid.get_value(17, 22, 0), grid.get_value(3, 2, 0))
+        self.assertEqual(grid.get_value(4, 0, 0), 0)
+
 if __name__ == '__main__':
     unittest.main()
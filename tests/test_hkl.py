@@ -39,11 +39,15 @@ def fft_test(self, data, f, phi, size, order=gemmi.AxisOrder.XYZ):
     compare_maps(self, map1, map2, atol=1e-6)
     map3 = data.transform_f_phi_to_map(f, phi, size, order=order)
     compare_maps(self, map1, map3, atol=6e-7)
+    map4 = data.transform_f_phi_to_map(f, phi, size, order=order, num_threads=3)
+    compare_maps(self, map3, map4, atol=0)
 
     grid2 = gemmi.transform_map_to_f_phi(map1, half_l=False)
     self.assertFalse(grid2.half_l)
     self.assertEqual(grid2.axis_order, order)
     compare_maps(self, grid2, array_full, atol=2e-4)
+    grid4 = gemmi.transform_map_to_f_phi(map1, half_l=False, num_threads=3)
+    compare_maps(self, grid2, grid4, atol=0)
     if grid2.axis_order != gemmi.AxisOrder.ZYX:
         compare_asu_data(self, grid2.prepare_asu_data(), data, f, phi)
     grid_half = data.get_f_phi_on_grid(f, phi, size, half_l=True, order=order)
@@ -86,6 +90,37 @@ class TestMtz(unittest.TestCase):
         if numpy is not None:
             assert_numpy_equal(self, mtz.array, mtz2.array)
 
+    def test_mapped_mtz(self):
+        path = full_path('5e5z.mtz')
+        mtz = gemmi.read_mtz_file(path)
+        mapped = gemmi.MappedMtz(path)
+        self.assertEqual(mapped.mtz.nreflections, mtz.nreflections)
+        self.assertEqual([c.label for c in mapped.mtz.columns],
+                         [c.label for c in mtz.columns])
+        for col in mtz.columns:
+            view = mapped.column(col.label)
+            self.assertEqual(view.idx, col.idx)
+            self.assertEqual(len(view), mtz.nreflections)
+            if numpy is not None:
+                assert_numpy_equal(self, view.array, col.array)
+        self.assertEqual(view[5], mtz.array[5, view.idx])
+        with self.assertRaises(IndexError):
+            view[len(view)]
+        if numpy is None:
+            return
+        asu1 = mtz.get_value_sigma('FP', 'SIGFP')
+        asu2 = mapped.get_value_sigma('FP', 'SIGFP')
+        self.assertEqual(len(asu2), len(asu1))
+        assert_numpy_equal(self, asu2.miller_array, asu1.miller_array)
+        assert_numpy_equal(self, asu2.value_array, asu1.value_array)
+        free = mapped.get_float('FREE')
+        assert_numpy_equal(self, free.value_array,
+                           mtz.get_float('FREE').value_array)
+        part = mapped.read_columns(['I'])
+        self.assertEqual([c.label for c in part.columns], ['H', 'K', 'L', 'I'])
+        assert_numpy_equal(self, part.column_with_label('I').array,
+                           mtz.column_with_label('I').array)
+
     def test_remove_and_add_column(self):
         path = full_path('5e5z.mtz')
         col_name = 'FREE'
@@ -106,6 +141,21 @@ class TestMtz(unittest.TestCase):
         col.array[:] = arr
         assert_numpy_equal(self, mtz_data, mtz.array)
 
+    def test_read_selected_columns(self):
+        path = full_path('5e5z.mtz')
+        mtz = gemmi.read_mtz_file(path)
+        sel = gemmi.read_mtz_file(path, columns=['FREE', 'FP'])
+        self.assertEqual([col.label for col in sel.columns],
+                         ['H', 'K', 'L', 'FREE', 'FP'])
+        self.assertEqual(sel.nreflections, mtz.nreflections)
+        for n, col in enumerate(sel.columns):
+            self.assertEqual(col.idx, n)
+            orig = mtz.column_with_label(col.label)
+            # compare as strings, because NaN != NaN
+            self.assertEqual([str(x) for x in col], [str(x) for x in orig])
+        with self.assertRaises(RuntimeError):
+            gemmi.read_mtz_file(path, columns=['NOSUCHCOL'])
+
     def asu_data_test(self, grid):
         asu = grid.prepare_asu_data()
         d = asu.make_d_array()
@@ -194,6 +244,18 @@ class TestSfMmcif(unittest.TestCase):
         for order in (gemmi.AxisOrder.XYZ, gemmi.AxisOrder.ZYX):
             fft_test(self, rblock, 'pdbx_FWT', 'pdbx_PHWT', size)
 
+        numeric = rblock.make_numeric_data(['pdbx_FWT', 'pdbx_PHWT'],
+                                           num_threads=2)
+        self.assertEqual(numeric.labels, ['index_h', 'index_k', 'index_l',
+                                          'pdbx_FWT', 'pdbx_PHWT'])
+        self.assertEqual(numeric.get_size_for_hkl(), size)
+        if numpy is not None:
+            assert_numpy_equal(self,
+                numeric.get_f_phi('pdbx_FWT', 'pdbx_PHWT').miller_array,
+                rblock.get_f_phi('pdbx_FWT', 'pdbx_PHWT').miller_array)
+            self.assertEqual(numeric.array.shape, (406, 5))
+            assert_numpy_equal(self, numeric.array[:, :3], rblock.make_miller_array())
+
     def test_scaling(self):
         doc = gemmi.cif.read(full_path('r5wkdsf.ent'))
         rblock = gemmi.as_refln_blocks(doc)[0]
@@ -247,6 +309,37 @@ class TestBinner(unittest.TestCase):
         inv_d2 = numpy.array([mtz.cell.calculate_1_d2(h) for h in hkls])
         self.assertEqual(list(binner.get_bins_from_1_d2(inv_d2)), bins)
 
+class TestIntensities(unittest.TestCase):
+    @unittest.skipIf(numpy is None, 'requires NumPy')
+    def test_merge_in_place(self):
+        cell = gemmi.UnitCell(20, 30, 40, 90, 90, 90)
+        sg = gemmi.SpaceGroup('P 1')
+        hkl = numpy.array([[1, 2, 3], [-1, -2, -3], [1, 2, 3], [1, 2, 3],
+                           [2, 0, 0]], dtype=numpy.int32)
+        values = numpy.array([10., 11., 9., 100., 5.])
+        sigmas = numpy.array([1., 1., 1., 1., 2.])
+        for num_threads in [1, 2]:
+            intensities = gemmi.Intensities()
+            intensities.set_data(cell, sg, hkl, values, sigmas)
+            stats = intensities.merge_in_place(gemmi.DataType.Mean,
+                                               num_threads=num_threads)
+            self.assertEqual(intensities.miller_array.tolist(),
+                             [[1, 2, 3], [2, 0, 0]])
+            self.assertEqual(list(intensities.value_array), [32.5, 5])
+            self.assertEqual(list(intensities.nobs_array), [4, 1])
+            self.assertEqual(stats[0].all_refl, 5)
+            self.assertEqual(stats[0].rejected, 0)
+            # with outlier rejection
+            intensities.set_data(cell, sg, hkl, values, sigmas)
+            stats = intensities.merge_in_place(gemmi.DataType.Mean,
+                                               num_threads=num_threads,
+                                               outlier_sigma=4)
+            self.assertEqual(list(intensities.value_array), [10, 5])
+            self.assertEqual(list(intensities.nobs_array), [3, 1])
+            self.assertAlmostEqual(intensities.sigma_array[0], 3**-0.5)
+            self.assertEqual(stats[0].unique_refl, 2)
+            self.assertEqual(stats[0].rejected, 1)
+
 class TestConversion(unittest.TestCase):
     def test_4aap(self):
         def check_metadata(o, d):
@@ -7,7 +7,7 @@ import pickle
 import unittest
 
 import gemmi
-from common import full_path, get_path_for_tempfile
+from common import full_path, get_path_for_tempfile, numpy
 try:
     from Bio import PDB
 except ImportError:
@@ -443,6 +443,70 @@ class TestMol(unittest.TestCase):
         st3 = gemmi.make_structure_from_block(doc[0])
         self.check_1pfe(st3)
 
+        # st was read in the streaming mode (without save_doc),
+        # with save_doc the whole Document is kept and converted
+        st4 = gemmi.read_structure(full_path('1pfe.cif.gz'),
+                                   save_doc=gemmi.cif.Document())
+        self.assertEqual(st4.make_mmcif_document().as_string(),
+                         mmcif_doc.as_string())
+
+        # write structure to binary cache and read it back
+        out_name = get_path_for_tempfile(suffix='.gbs')
+        gemmi.write_binary_structure(st, out_name)
+        st5 = gemmi.read_binary_structure(out_name)
+        os.remove(out_name)
+        self.assertEqual(st5.make_mmcif_document().as_string(),
+                         mmcif_doc.as_string())
+
+    def test_write_mmcif(self):
+        for filename in ['1pfe.cif.gz', '5i55.cif']:
+            st = gemmi.read_structure(full_path(filename))
+            for n, cra in enumerate(st[0].all()):
+                if n % 5 == 0:
+                    cra.atom.aniso = gemmi.SMat33f(0.15, 0.25, 0.35,
+                                                   -0.01, 0.02, 0.0123456)
+            expected = st.make_mmcif_document().as_string()
+            self.assertIn('_atom_site_anisotrop.U[1][1]', expected)
+            for num_threads in [1, 3]:
+                out_name = get_path_for_tempfile(suffix='.cif')
+                st.write_mmcif(out_name, num_threads=num_threads)
+                with open(out_name) as f:
+                    self.assertEqual(f.read(), expected)
+                os.remove(out_name)
+
+    @unittest.skipIf(numpy is None, 'requires NumPy')
+    def test_binary_structure_columns(self):
+        st = gemmi.read_structure(full_path('1pfe.cif.gz'))
+        out_name = get_path_for_tempfile(suffix='.gbs')
+        gemmi.write_binary_structure(st, out_name)
+        bs = gemmi.BinaryStructure(out_name)
+        atoms = [cra for cra in st[0].all()]
+        self.assertEqual(bs.model_count, len(st))
+        self.assertEqual(bs.chain_count, len(st[0]))
+        self.assertEqual(bs.atom_count, len(atoms))
+        self.assertEqual(list(bs.model_nums), [st[0].num])
+        self.assertEqual(list(bs.model_chains), [0, len(st[0])])
+        self.assertEqual(bs.chain_name(1), st[0][1].name)
+        self.assertRaises(IndexError, bs.chain_name, bs.chain_count)
+        residues = [res for ch in st[0] for res in ch]
+        self.assertEqual(bs.residue_count, len(residues))
+        self.assertEqual(list(bs.residue_seqnums),
+                         [res.seqid.num for res in residues])
+        self.assertEqual(bs.residue_name(5), residues[5].name)
+        self.assertEqual(bs.residue_atoms[-1], len(atoms))
+        positions = numpy.array([cra.atom.pos.tolist() for cra in atoms])
+        self.assertTrue(numpy.array_equal(bs.positions, positions))
+        self.assertTrue(numpy.allclose(bs.b_isos,
+                                       [cra.atom.b_iso for cra in atoms]))
+        self.assertEqual(list(bs.elements),
+                         [cra.atom.element.atomic_number for cra in atoms])
+        self.assertEqual(bs.atom_name(10), atoms[10].atom.name)
+        self.assertFalse(bs.positions.flags.writeable)
+        self.assertEqual(bs.structure().make_mmcif_document().as_string(),
+                         st.make_mmcif_document().as_string())
+        del bs
+        os.remove(out_name)
+
     def test_read_1pfe_json(self):
         st = gemmi.read_structure(full_path('1pfe.json'))
         self.check_1pfe(st)
@@ -477,6 +541,19 @@ class TestMol(unittest.TestCase):
                                                  gemmi.PolymerType.Unknown)
         self.assertEqual(result.cigar_str(), '2I64M5I')
 
+    def test_read_pdb_in_parallel(self):
+        st = gemmi.read_structure(full_path('1orc.pdb'))
+        for i in range(2, 5):
+            st.add_model(st[0])
+        st.renumber_models()
+        pdb_str = st.make_pdb_string()
+        st1 = gemmi.read_pdb_string(pdb_str)
+        st3 = gemmi.read_pdb_string(pdb_str, num_threads=3)
+        self.assertEqual(len(st3), 4)
+        self.assertEqual(st3.make_pdb_string(), st1.make_pdb_string())
+        self.assertEqual(st3.make_mmcif_document().as_string(),
+                         st1.make_mmcif_document().as_string())
+
     def write_and_read(self, st, via_cif):
         if via_cif:
             st.setup_entities()
@@ -1,6 +1,8 @@
 #!/usr/bin/env python
 
 import os
+import shutil
+import tempfile
 import unittest
 import gemmi
 
@@ -115,6 +117,42 @@ class TestMonLib(unittest.TestCase):
         self.assertEqual(monlib.path('ALA'), path + "a/ALA.cif")
         self.assertEqual(monlib.path('CON'), path + "c/CON_CON.cif")
 
+    def test_read_monomer_lib_with_cache(self):
+        with tempfile.TemporaryDirectory() as tmp_dir:
+            mon_dir = os.path.join(tmp_dir, 'mon')
+            cache_dir = os.path.join(tmp_dir, 'cache')
+            os.makedirs(os.path.join(mon_dir, 'list'))
+            os.makedirs(os.path.join(mon_dir, 's'))
+            os.makedirs(os.path.join(mon_dir, 'h'))
+            os.makedirs(cache_dir)
+            shutil.copy(full_path('list/mon_lib_list.cif'),
+                        os.path.join(mon_dir, 'list'))
+            shutil.copy(full_path('ener_lib.cif'), mon_dir)
+            shutil.copy(full_path('SO3.cif'), os.path.join(mon_dir, 's'))
+            shutil.copy(full_path('HEM.cif'), os.path.join(mon_dir, 'h'))
+            resnames = ['SO3', 'HEM', 'HOH']
+            for n in range(3):
+                if n == 2:
+                    # corrupted cache files are ignored
+                    for name in os.listdir(cache_dir):
+                        with open(os.path.join(cache_dir, name), 'r+b') as f:
+                            f.seek(-3, os.SEEK_END)
+                            f.write(b'\xff')
+                monlib = gemmi.MonLib()
+                ok = monlib.read_monomer_lib(mon_dir, resnames,
+                                             logging=None, num_threads=2,
+                                             cache_dir=cache_dir)
+                self.assertFalse(ok)  # HOH is missing
+                self.assertEqual(sorted(monlib.monomers.keys()), ['HEM', 'SO3'])
+                so3 = monlib.monomers['SO3']
+                self.assertEqual([a.id for a in so3.atoms],
+                                 ['S', 'O1', 'O2', 'O3'])
+                self.assertEqual(len(so3.rt.bonds), 3)
+                self.assertEqual(len(monlib.monomers['HEM'].atoms), 75)
+            cached = os.listdir(cache_dir)
+            self.assertEqual(len(cached), 4)
+            self.assertTrue(any(name.endswith('_s_SO3.cif.gmc') for name in cached))
+
     @unittest.skipIf(os.getenv('CLIBD_MON') is None, "$CLIBD_MON not defined.")
     def test_read_monomer_lib(self):
         st = gemmi.read_structure(full_path('4oz7.pdb'))
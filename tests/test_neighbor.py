@@ -70,6 +70,48 @@ class TestNeighborSearch(unittest.TestCase):
                                               mark.image_idx, inverse=True)
         self.assertAlmostEqual(nim.dist(), p.dist(cra.atom.pos))
 
+    def test_compact(self):
+        st = gemmi.read_structure(full_path('4oz7.pdb'))
+        ns = gemmi.NeighborSearch(st[0], st.cell, 5).populate()
+        ns2 = gemmi.NeighborSearch(st[0], st.cell, 5).populate()
+        ns2.compact()
+        self.assertTrue(ns2.is_compact())
+        for res in st[0]['A']:
+            for atom in res:
+                marks = ns.find_neighbors(atom, 0.1, 4)
+                marks2 = ns2.find_neighbors(atom, 0.1, 4)
+                self.assertEqual([str(m) for m in marks],
+                                 [str(m) for m in marks2])
+                m = ns.find_nearest_atom(atom.pos + gemmi.Position(1, 1, 1))
+                m2 = ns2.find_nearest_atom(atom.pos + gemmi.Position(1, 1, 1))
+                self.assertEqual(str(m), str(m2))
+        with self.assertRaises(RuntimeError):
+            ns2.add_atom(st[0]['A'][0][0], 0, 0, 0)
+
+    def test_find_atoms_batch(self):
+        st = gemmi.read_structure(full_path('4oz7.pdb'))
+        ns = gemmi.NeighborSearch(st[0], st.cell, 5).populate()
+        shift = gemmi.Position(0.6, 0.6, 0.6)
+        positions = [cra.atom.pos + shift for cra in st[0].all()]
+        for radius in [3, 0.8]:
+            expected = [ns.find_atoms(pos, min_dist=0.1, radius=radius)
+                        for pos in positions]
+            for num_threads in [1, 3]:
+                result = ns.find_atoms_batch(positions, min_dist=0.1,
+                                             radius=radius,
+                                             num_threads=num_threads)
+                self.assertEqual(len(result), len(positions))
+                self.assertEqual(result.offsets[-1], len(result.marks))
+                self.assertEqual(len(result.dist_sq), len(result.marks))
+                for i, marks in enumerate(expected):
+                    self.assertEqual(result.count(i), len(marks))
+                    self.assertEqual([str(m) for m in result[i]],
+                                     [str(m) for m in marks])
+                with self.assertRaises(IndexError):
+                    result[len(positions)]
+        # with the smaller radius, some positions have no atoms
+        self.assertIn(0, [len(marks) for marks in expected])
+
     def test_b208(self):
         st = gemmi.read_structure(full_path('4oz7.pdb'))
         hoh208 = gemmi.Selection('B/208').copy_model_selection(st[0])
@@ -112,6 +154,20 @@ class TestContactSearch(unittest.TestCase):
                             or r.partner1.chain is not r.partner2.chain
                             for r in results))
 
+    def test_multithreaded(self):
+        st = gemmi.read_structure(full_path('4oz7.pdb'))
+        ns = gemmi.NeighborSearch(st[0], st.cell, 5).populate()
+        ns3 = gemmi.NeighborSearch(st[0], st.cell, 5).populate(num_threads=3)
+        cs = gemmi.ContactSearch(4.0)
+        results = cs.find_contacts(ns)
+        results3 = cs.find_contacts(ns3, num_threads=3)
+        self.assertEqual(len(results), len(results3))
+        for r, r3 in zip(results, results3):
+            self.assertEqual(str(r.partner1), str(r3.partner1))
+            self.assertEqual(str(r.partner2), str(r3.partner2))
+            self.assertEqual(r.image_idx, r3.image_idx)
+            self.assertEqual(r.dist, r3.dist)
+
 
 if __name__ == '__main__':
     unittest.main()
@@ -38,6 +38,49 @@ class TestDensityCalculator(unittest.TestCase):
             # we only check here that it doesn't crash
             dencalc.put_model_density_on_grid(st[0])
 
+    @unittest.skipIf(numpy is None, "requires NumPy")
+    def test_num_threads(self):
+        st = gemmi.read_pdb(full_path('5e5z.pdb'))
+        arrays = []
+        for num_threads in [1, 3]:
+            dencalc = gemmi.DensityCalculatorX()
+            dencalc.d_min = 2.5
+            dencalc.num_threads = num_threads
+            dencalc.grid.setup_from(st)
+            dencalc.put_model_density_on_grid(st[0])
+            arrays.append(dencalc.grid.array)
+        self.assertTrue(numpy.array_equal(arrays[0], arrays[1]))
+
+class TestStructureFactorCalculator(unittest.TestCase):
+    @unittest.skipIf(numpy is None, "requires NumPy")
+    def test_many_reflections(self):
+        st = gemmi.read_pdb(full_path('5e5z.pdb'))
+        # mix of isotropic and anisotropic atoms
+        for atom in st[0].all():
+            if atom.atom.serial % 2 == 0:
+                atom.atom.aniso = gemmi.SMat33f(0.2, 0.3, 0.25, 0.01, 0.02, 0.03)
+        sfcalc = gemmi.StructureFactorCalculatorX(st.cell)
+        hkl = numpy.array([(h, k, l) for h in range(-4, 5)
+                                     for k in range(-3, 4)
+                                     for l in range(1, 4)], dtype=numpy.int32)
+        for num_threads in [1, 2]:
+            values = sfcalc.calculate_sf_from_model(st[0], hkl, num_threads)
+            self.assertEqual(len(values), len(hkl))
+            for h, value in zip(hkl, values):
+                expected = sfcalc.calculate_sf_from_model(st[0], tuple(h))
+                self.assertAlmostEqual(value, expected, delta=1e-6)
+
+    def test_mott_bethe_factor(self):
+        st = gemmi.read_pdb(full_path('5e5z.pdb'))
+        sfcalc = gemmi.StructureFactorCalculatorX(st.cell)
+        for hkl in [(1, 2, 3), (-4, 0, 7)]:
+            # calculate_sf_from_model() sets d^2 used in mott_bethe_factor()
+            sfcalc.calculate_sf_from_model(st[0], hkl)
+            self.assertAlmostEqual(sfcalc.mott_bethe_factor(hkl),
+                                   sfcalc.mott_bethe_factor(), delta=1e-9)
+        self.assertNotAlmostEqual(sfcalc.mott_bethe_factor((1, 2, 3)),
+                                  sfcalc.mott_bethe_factor((-4, 0, 7)))
+
 class TestExpandingToP1(unittest.TestCase):
     def test_1gdr(self):
         st = gemmi.read_pdb(full_path('pdb1gdr.ent'), max_line_length=72)
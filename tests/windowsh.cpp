@@ -20,6 +20,7 @@
 #include <gemmi/assembly.hpp>
 #include <gemmi/asudata.hpp>
 #include <gemmi/asumask.hpp>
+#include <gemmi/binstruct.hpp>
 #include <gemmi/atof.hpp>
 #include <gemmi/atox.hpp>
 #include <gemmi/bessel.hpp>